@@ -0,0 +1,177 @@
+#include <hive/chain/comment_archive.hpp>
+
+#include <fc/io/raw.hpp>
+
+#include <rocksdb/db.h>
+#include <rocksdb/options.h>
+#include <rocksdb/write_batch.h>
+
+namespace hive { namespace chain {
+
+  namespace detail {
+
+    class comment_archive_impl
+    {
+      public:
+        static constexpr char COMMENT_BY_ID_PREFIX = 'i';
+        static constexpr char COMMENT_BY_HASH_PREFIX = 'h';
+        static constexpr char CURSOR_KEY = 'c';
+
+        // big endian, so RocksDB keeps comments in order of their ids
+        static std::string encode_id( comment_id_type id )
+        {
+          uint32_t value = id.get_value();
+          std::string buffer( sizeof( value ), '\0' );
+          for( size_t i = 0; i < sizeof( value ); ++i )
+            buffer[ sizeof( value ) - 1 - i ] = char( ( value >> ( 8 * i ) ) & 0xFF );
+          return buffer;
+        }
+
+        static comment_id_type decode_id( const std::string& buffer )
+        {
+          FC_ASSERT( buffer.size() == sizeof( uint32_t ), "Corrupted comment archive" );
+          uint32_t value = 0;
+          for( char c : buffer )
+            value = ( value << 8 ) | uint8_t( c );
+          return comment_object::id_type( value );
+        }
+
+        static std::string id_key( comment_id_type id )
+        {
+          return std::string( 1, COMMENT_BY_ID_PREFIX ) + encode_id( id );
+        }
+
+        static std::string hash_key( const comment_object::author_and_permlink_hash_type& hash )
+        {
+          std::string key( 1, COMMENT_BY_HASH_PREFIX );
+          key.append( hash.data(), hash.data_size() );
+          return key;
+        }
+
+        void check_status( const ::rocksdb::Status& s, const char* action )const
+        {
+          FC_ASSERT( s.ok(), "Comment archive ${action} failed: ${e}", ( "action", action )( "e", s.ToString() ) );
+        }
+
+        fc::path                         dir;
+        std::unique_ptr< ::rocksdb::DB > storage;
+        comment_id_type                  cursor = comment_object::id_type( 0 );
+    };
+
+    constexpr char comment_archive_impl::CURSOR_KEY;
+
+  }
+
+comment_archive::comment_archive() : my( new detail::comment_archive_impl() ) {}
+
+comment_archive::~comment_archive()
+{
+  close();
+}
+
+void comment_archive::open( const fc::path& dir )
+{
+  close();
+
+  ::rocksdb::Options options;
+  options.create_if_missing = true;
+  /// archive is mostly written sequentially and read rarely
+  options.OptimizeLevelStyleCompaction();
+
+  ::rocksdb::DB* db = nullptr;
+  my->check_status( ::rocksdb::DB::Open( options, dir.string(), &db ), "open" );
+  my->storage.reset( db );
+  my->dir = dir;
+
+  std::string buffer;
+  auto s = my->storage->Get( ::rocksdb::ReadOptions(), ::rocksdb::Slice( &detail::comment_archive_impl::CURSOR_KEY, 1 ), &buffer );
+  if( s.IsNotFound() )
+  {
+    my->cursor = comment_object::id_type( 0 );
+  }
+  else
+  {
+    my->check_status( s, "cursor read" );
+    my->cursor = detail::comment_archive_impl::decode_id( buffer );
+  }
+
+  ilog( "Opened comment archive at ${d}, first not archived comment: ${c}", ( "d", dir )( "c", my->cursor.get_value() ) );
+}
+
+void comment_archive::close()
+{
+  if( my->storage )
+  {
+    my->storage->SyncWAL();
+    my->storage.reset();
+  }
+}
+
+bool comment_archive::is_open()const
+{
+  return my->storage != nullptr;
+}
+
+void comment_archive::wipe()
+{
+  FC_ASSERT( is_open() );
+  fc::path dir = my->dir;
+  close();
+  fc::remove_all( dir );
+  open( dir );
+}
+
+void comment_archive::store( const std::vector< const comment_object* >& comments, comment_id_type new_cursor )
+{
+  FC_ASSERT( is_open() );
+
+  ::rocksdb::WriteBatch batch;
+  for( const comment_object* comment : comments )
+  {
+    std::vector< char > packed = fc::raw::pack_to_vector( *comment );
+    batch.Put( detail::comment_archive_impl::id_key( comment->get_id() ), ::rocksdb::Slice( packed.data(), packed.size() ) );
+    batch.Put( detail::comment_archive_impl::hash_key( comment->get_author_and_permlink_hash() ), detail::comment_archive_impl::encode_id( comment->get_id() ) );
+  }
+
+  batch.Put( ::rocksdb::Slice( &detail::comment_archive_impl::CURSOR_KEY, 1 ), detail::comment_archive_impl::encode_id( new_cursor ) );
+
+  // no need for synced write - unclean shutdown requires replay from scratch anyway, which also wipes the archive
+  my->check_status( my->storage->Write( ::rocksdb::WriteOptions(), &batch ), "write" );
+  my->cursor = new_cursor;
+}
+
+fc::optional< comment_id_type > comment_archive::find_id( const comment_object::author_and_permlink_hash_type& hash )const
+{
+  if( !is_open() )
+    return fc::optional< comment_id_type >();
+
+  std::string buffer;
+  auto s = my->storage->Get( ::rocksdb::ReadOptions(), detail::comment_archive_impl::hash_key( hash ), &buffer );
+  if( s.IsNotFound() )
+    return fc::optional< comment_id_type >();
+  my->check_status( s, "read" );
+
+  return detail::comment_archive_impl::decode_id( buffer );
+}
+
+bool comment_archive::load( comment_id_type id, std::vector< char >& packed_comment )const
+{
+  if( !is_open() || !( id < my->cursor ) )
+    return false;
+
+  std::string buffer;
+  auto s = my->storage->Get( ::rocksdb::ReadOptions(), detail::comment_archive_impl::id_key( id ), &buffer );
+  if( s.IsNotFound() )
+    return false;
+  my->check_status( s, "read" );
+
+  packed_comment.assign( buffer.begin(), buffer.end() );
+  return true;
+}
+
+comment_id_type comment_archive::get_cursor()const
+{
+  return my->cursor;
+}
+
+} } // hive::chain
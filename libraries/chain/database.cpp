@@ -4,6 +4,7 @@
 
 #include <hive/protocol/hive_operations.hpp>
 #include <hive/protocol/get_config.hpp>
+#include <hive/protocol/transaction_util.hpp>
 
 #include <hive/chain/block_summary_object.hpp>
 #include <hive/chain/compound.hpp>
@@ -22,6 +23,7 @@
 #include <hive/chain/hive_evaluator.hpp>
 #include <hive/chain/hive_objects.hpp>
 #include <hive/chain/transaction_object.hpp>
+#include <hive/chain/transaction_admission_cache.hpp>
 #include <hive/chain/shared_db_merkle.hpp>
 #include <hive/chain/witness_schedule.hpp>
 
@@ -43,16 +45,24 @@
 #include <fc/io/fstream.hpp>
 
 #include <boost/scope_exit.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/thread/thread.hpp>
 
 #include <iostream>
 
+#include <atomic>
 #include <cstdint>
 #include <deque>
 #include <fstream>
 #include <functional>
+#include <future>
+#include <memory>
 
 #include <stdlib.h>
 
+/// number of archived comments each thread keeps unpacked for read-only lookups
+#define ARCHIVED_COMMENT_CACHE_SIZE 10000
+
 long next_hf_time()
 {
   // current "next hardfork" is HF25
@@ -114,16 +124,112 @@ class database_impl
 {
   public:
     database_impl( database& self );
+    ~database_impl() { stop_precheck_threads(); }
+
+    void start_precheck_threads( uint32_t thread_count );
+    void stop_precheck_threads();
+    void precheck_transactions( const signed_block& block, uint32_t skip, vector< precomputed_transaction_info >& result );
 
     database&                                       _self;
     evaluator_registry< operation >                 _evaluator_registry;
     evaluator_registry< required_automated_action > _req_action_evaluator_registry;
     evaluator_registry< optional_automated_action > _opt_action_evaluator_registry;
+
+    uint32_t                                          _precheck_thread_count = 0;
+    boost::asio::io_service                           _precheck_service;
+    std::unique_ptr< boost::asio::io_service::work >  _precheck_work;
+    boost::thread_group                               _precheck_threads;
+
+    /// results of stateless checks of transactions that were already applied (pending, broadcast, received from peers)
+    transaction_admission_cache                       _admission_cache;
 };
 
 database_impl::database_impl( database& self )
   : _self(self), _evaluator_registry(self), _req_action_evaluator_registry(self), _opt_action_evaluator_registry(self) {}
 
+void database_impl::start_precheck_threads( uint32_t thread_count )
+{
+  stop_precheck_threads();
+  if( thread_count == 0 )
+    return;
+
+  _precheck_service.restart();
+  _precheck_work.reset( new boost::asio::io_service::work( _precheck_service ) );
+  for( uint32_t i = 0; i < thread_count; ++i )
+    _precheck_threads.create_thread( boost::bind( &boost::asio::io_service::run, &_precheck_service ) );
+  _precheck_thread_count = thread_count;
+}
+
+void database_impl::stop_precheck_threads()
+{
+  if( _precheck_thread_count == 0 )
+    return;
+
+  _precheck_work.reset();
+  _precheck_threads.join_all();
+  _precheck_thread_count = 0;
+}
+
+namespace {
+
+void precheck_transaction( const signed_transaction& trx, uint32_t skip, const chain_id_type& chain_id,
+  fc::ecc::canonical_signature_type canon_type, const transaction_admission_cache& cache, precomputed_transaction_info& info )
+{
+  try
+  {
+    info.trx_id = trx.id();
+    // transaction is likely to be already known from p2p or API
+    if( cache.find( info.trx_id, trx, chain_id, canon_type, info.signature_keys ) )
+    {
+      info.valid = true;
+      return;
+    }
+    if( !( skip & database::skip_validate ) )
+      trx.validate();
+    if( !( skip & ( database::skip_transaction_signatures | database::skip_authority_check ) ) )
+      info.signature_keys = trx.get_signature_keys( chain_id, canon_type );
+    info.valid = true;
+  }
+  catch( ... )
+  {
+    // transaction stays marked as invalid; its application repeats the failing step and reports the error in order
+  }
+}
+
+} // namespace
+
+void database_impl::precheck_transactions( const signed_block& block, uint32_t skip, vector< precomputed_transaction_info >& result )
+{
+  const auto& transactions = block.transactions;
+  result.clear();
+  result.resize( transactions.size() );
+
+  // hardfork state (and therefore chain id and canonical signature type) can't change until all transactions are applied
+  const chain_id_type chain_id = _self.get_chain_id();
+  const auto canon_type = _self.has_hardfork( HIVE_HARDFORK_0_20__1944 ) ? fc::ecc::bip_0062 : fc::ecc::fc_canonical;
+
+  std::atomic< size_t > next_trx( 0 );
+  auto worker = [&]()
+  {
+    for( size_t i = next_trx++; i < transactions.size(); i = next_trx++ )
+      precheck_transaction( transactions[i], skip, chain_id, canon_type, _admission_cache, result[i] );
+  };
+
+  std::vector< std::future< void > > helpers;
+  helpers.reserve( _precheck_thread_count );
+  for( uint32_t i = 0; i < _precheck_thread_count; ++i )
+  {
+    auto task = std::make_shared< std::packaged_task< void() > >( worker );
+    helpers.emplace_back( task->get_future() );
+    _precheck_service.post( [task]() { ( *task )(); } );
+  }
+
+  // calling thread takes part in the work instead of just waiting for helpers
+  worker();
+  for( auto& helper : helpers )
+    helper.wait();
+}
+
 database::database()
   : _my( new database_impl(*this) ) {}
 
@@ -149,12 +255,34 @@ void database::open( const open_args& args )
     initialize_evaluators();
     initialize_irreversible_storage();
 
+    fc::path comment_archive_dir = args.shared_mem_dir / "comment_archive";
+    if( args.enable_comment_archive )
+    {
+      _comment_archive.reset( new comment_archive() );
+      _comment_archive->open( comment_archive_dir );
+    }
+    else
+    {
+      FC_ASSERT( !fc::exists( comment_archive_dir ), "State was built with comment archive enabled and cannot be used without it. Enable archive or replay.",
+        ( "dir", comment_archive_dir ) );
+    }
+
     if( !find< dynamic_global_property_object >() )
       with_write_lock( [&]()
       {
         init_genesis( args.initial_supply, args.hbd_initial_supply );
+        if( _comment_archive )
+          _comment_archive->wipe();
       });
 
+    if( _comment_archive )
+    {
+      // archived comments that were brought back to state before last shutdown are the only ones below archive cursor
+      const auto& comment_idx = get_index< comment_index, by_id >();
+      for( auto itr = comment_idx.begin(); itr != comment_idx.end() && itr->get_id() < _comment_archive->get_cursor(); ++itr )
+        _restored_comments.insert( itr->get_id() );
+    }
+
     _benchmark_dumper.set_enabled( args.benchmark_is_enabled );
 
     with_write_lock( [&]()
@@ -420,6 +548,7 @@ void database::wipe( const fc::path& data_dir, const fc::path& shared_mem_dir, b
   if( get_is_open() )
     close();
   chainbase::database::wipe( shared_mem_dir );
+  fc::remove_all( shared_mem_dir / "comment_archive" );
   if( include_blocks )
   {
     fc::remove_all( data_dir / "block_log" );
@@ -449,6 +578,13 @@ void database::close(bool rewind)
 
     chainbase::database::close();
 
+    if( _comment_archive )
+    {
+      _comment_archive->close();
+      _comment_archive.reset();
+      _restored_comments.clear();
+    }
+
     _block_log.close();
 
     _fork_db.reset();
@@ -541,15 +677,10 @@ optional<signed_block> database::fetch_block_by_number( uint32_t block_num )cons
     return _block_log.read_block_by_num( block_num ); 
 } FC_LOG_AND_RETHROW() }
 
-// this version doesn't assume the caller has a read lock.  It will get its own lock for the
-// portion of the function that requires it.
+// this version doesn't assume the caller has a read lock (it doesn't need one, fork database can be read concurrently)
 optional<signed_block> database::fetch_block_by_number_unlocked( uint32_t block_num )
 { try {
-  shared_ptr< fork_item > fitem;
-  with_read_lock( [&]()
-  {
-    fitem = _fork_db.fetch_block_on_main_branch_by_number( block_num );
-  });
+  shared_ptr< fork_item > fitem = _fork_db.fetch_validated_block_on_main_branch_by_number( block_num );
 
   if( fitem )
     return fitem->data;
@@ -566,11 +697,7 @@ std::vector<signed_block> database::fetch_block_range_unlocked( const uint32_t s
   FC_ASSERT(count <= 1000, "You can only ask for 1000 blocks at a time");
   idump((starting_block_num)(count));
 
-  vector<fork_item> fork_items;
-  with_read_lock( [&]()
-  {
-    fork_items = _fork_db.fetch_block_range_on_main_branch_by_number( starting_block_num, count );
-  });
+  vector<fork_item> fork_items = _fork_db.fetch_validated_block_range_on_main_branch_by_number( starting_block_num, count );
   idump((fork_items.size()));
   if (!fork_items.empty())
     idump((fork_items.front().num));
@@ -623,6 +750,78 @@ std::vector< block_id_type > database::get_block_ids_on_fork( block_id_type head
   return result;
 } FC_CAPTURE_AND_RETHROW() }
 
+bool database::is_known_block_unlocked( const block_id_type& id )const
+{ try {
+  return fetch_block_by_id_unlocked( id ).valid();
+} FC_CAPTURE_AND_RETHROW() }
+
+optional<signed_block> database::fetch_block_by_id_unlocked( const block_id_type& id )const
+{ try {
+  auto b = _fork_db.fetch_validated_block( id );
+  if( b )
+    return b->data;
+
+  optional<signed_block> tmp = _block_log.read_block_by_num( protocol::block_header::num_from_id( id ) );
+  if( tmp && tmp->id() == id )
+    return tmp;
+  return optional<signed_block>();
+} FC_CAPTURE_AND_RETHROW() }
+
+uint32_t database::head_block_num_unlocked()const
+{
+  shared_ptr< fork_item > fork_head = _fork_db.validated_head();
+  if( fork_head )
+    return fork_head->num;
+  return last_irreversible_block_num_unlocked();
+}
+
+block_id_type database::head_block_id_unlocked()const
+{
+  shared_ptr< fork_item > fork_head = _fork_db.validated_head();
+  if( fork_head )
+    return fork_head->id;
+  auto log_head = _block_log.head();
+  return log_head ? log_head->id() : block_id_type();
+}
+
+uint32_t database::last_irreversible_block_num_unlocked()const
+{
+  auto log_head = _block_log.head();
+  return log_head ? log_head->block_num() : 0;
+}
+
+block_id_type database::find_block_id_for_num_unlocked( uint32_t block_num )const
+{ try {
+  if( block_num == 0 )
+    return block_id_type();
+
+  // reversible blocks are in fork database, check it first since it is the cheapest
+  shared_ptr< fork_item > fitem = _fork_db.fetch_validated_block_on_main_branch_by_number( block_num );
+  if( fitem )
+    return fitem->id;
+
+  optional<signed_block> b = _block_log.read_block_by_num( block_num );
+  if( b )
+    return b->id();
+
+  return block_id_type();
+} FC_CAPTURE_AND_RETHROW( (block_num) ) }
+
+std::vector< block_id_type > database::get_block_ids_on_fork_unlocked( block_id_type head_of_fork )const
+{ try {
+  // both lookups have to see the same version of fork database, otherwise fork head might be gone already
+  const fork_database::snapshot fork_db = _fork_db.get_snapshot();
+  shared_ptr< fork_item > fork_head = fork_db.validated_head();
+  FC_ASSERT( fork_head, "Fork database is empty" );
+  pair<fork_database::branch_type, fork_database::branch_type> branches = fork_db.fetch_branch_from(fork_head->id, head_of_fork);
+  FC_ASSERT( branches.first.back()->previous_id() == branches.second.back()->previous_id() );
+  std::vector< block_id_type > result;
+  for( const item_ptr& fork_block : branches.second )
+    result.emplace_back(fork_block->id);
+  result.emplace_back(branches.first.back()->previous_id());
+  return result;
+} FC_CAPTURE_AND_RETHROW( (head_of_fork) ) }
+
 chain_id_type database::get_chain_id() const
 {
   return hive_chain_id;
@@ -756,18 +955,44 @@ const account_object* database::find_account( const account_name_type& name )con
 
 const comment_object& database::get_comment( comment_id_type comment_id )const try
 {
-  return get< comment_object, by_id >( comment_id );
+  const comment_object* comment = find< comment_object, by_id >( comment_id );
+  if( comment == nullptr && _comment_archive )
+    comment = find_archived_comment( comment_id );
+  return comment != nullptr ? *comment : get< comment_object, by_id >( comment_id ); // the latter throws
+}
+FC_CAPTURE_AND_RETHROW( (comment_id) )
+
+const comment_object& database::get_comment( comment_id_type comment_id ) try
+{
+  const comment_object* comment = find< comment_object, by_id >( comment_id );
+  if( comment == nullptr && _comment_archive )
+    comment = restore_archived_comment( comment_id );
+  return comment != nullptr ? *comment : get< comment_object, by_id >( comment_id ); // the latter throws
 }
 FC_CAPTURE_AND_RETHROW( (comment_id) )
 
 const comment_object& database::get_comment( const account_id_type& author, const shared_string& permlink )const
 { try {
-  return get< comment_object, by_permlink >( comment_object::compute_author_and_permlink_hash( author, to_string( permlink ) ) );
+  auto hash = comment_object::compute_author_and_permlink_hash( author, to_string( permlink ) );
+  const comment_object* comment = find_comment_by_hash( hash );
+  return comment != nullptr ? *comment : get< comment_object, by_permlink >( hash ); // the latter throws
+} FC_CAPTURE_AND_RETHROW( (author)(permlink) ) }
+
+const comment_object& database::get_comment( const account_id_type& author, const shared_string& permlink )
+{ try {
+  auto hash = comment_object::compute_author_and_permlink_hash( author, to_string( permlink ) );
+  const comment_object* comment = find_comment_by_hash( hash );
+  return comment != nullptr ? *comment : get< comment_object, by_permlink >( hash ); // the latter throws
 } FC_CAPTURE_AND_RETHROW( (author)(permlink) ) }
 
 const comment_object* database::find_comment( const account_id_type& author, const shared_string& permlink )const
 {
-  return find< comment_object, by_permlink >( comment_object::compute_author_and_permlink_hash( author, to_string( permlink ) ) );
+  return find_comment_by_hash( comment_object::compute_author_and_permlink_hash( author, to_string( permlink ) ) );
+}
+
+const comment_object* database::find_comment( const account_id_type& author, const shared_string& permlink )
+{
+  return find_comment_by_hash( comment_object::compute_author_and_permlink_hash( author, to_string( permlink ) ) );
 }
 
 const comment_object& database::get_comment( const account_name_type& author, const shared_string& permlink )const
@@ -775,6 +1000,11 @@ const comment_object& database::get_comment( const account_name_type& author, co
   return get_comment( get_account(author).get_id(), permlink );
 } FC_CAPTURE_AND_RETHROW( (author)(permlink) ) }
 
+const comment_object& database::get_comment( const account_name_type& author, const shared_string& permlink )
+{ try {
+  return get_comment( get_account(author).get_id(), permlink );
+} FC_CAPTURE_AND_RETHROW( (author)(permlink) ) }
+
 const comment_object* database::find_comment( const account_name_type& author, const shared_string& permlink )const
 {
   const account_object* acc = find_account(author);
@@ -782,16 +1012,37 @@ const comment_object* database::find_comment( const account_name_type& author, c
   return find_comment( acc->get_id(), permlink );
 }
 
+const comment_object* database::find_comment( const account_name_type& author, const shared_string& permlink )
+{
+  const account_object* acc = find_account(author);
+  if(acc == nullptr) return nullptr;
+  return find_comment( acc->get_id(), permlink );
+}
+
 #ifndef ENABLE_STD_ALLOCATOR
 
 const comment_object& database::get_comment( const account_id_type& author, const string& permlink )const
 { try {
-  return get< comment_object, by_permlink >( comment_object::compute_author_and_permlink_hash( author, permlink ) );
+  auto hash = comment_object::compute_author_and_permlink_hash( author, permlink );
+  const comment_object* comment = find_comment_by_hash( hash );
+  return comment != nullptr ? *comment : get< comment_object, by_permlink >( hash ); // the latter throws
+} FC_CAPTURE_AND_RETHROW( (author)(permlink) ) }
+
+const comment_object& database::get_comment( const account_id_type& author, const string& permlink )
+{ try {
+  auto hash = comment_object::compute_author_and_permlink_hash( author, permlink );
+  const comment_object* comment = find_comment_by_hash( hash );
+  return comment != nullptr ? *comment : get< comment_object, by_permlink >( hash ); // the latter throws
 } FC_CAPTURE_AND_RETHROW( (author)(permlink) ) }
 
 const comment_object* database::find_comment( const account_id_type& author, const string& permlink )const
 {
-  return find< comment_object, by_permlink >( comment_object::compute_author_and_permlink_hash( author, permlink ) );
+  return find_comment_by_hash( comment_object::compute_author_and_permlink_hash( author, permlink ) );
+}
+
+const comment_object* database::find_comment( const account_id_type& author, const string& permlink )
+{
+  return find_comment_by_hash( comment_object::compute_author_and_permlink_hash( author, permlink ) );
 }
 
 const comment_object& database::get_comment( const account_name_type& author, const string& permlink )const
@@ -799,6 +1050,11 @@ const comment_object& database::get_comment( const account_name_type& author, co
   return get_comment( get_account(author).get_id(), permlink );
 } FC_CAPTURE_AND_RETHROW( (author)(permlink) ) }
 
+const comment_object& database::get_comment( const account_name_type& author, const string& permlink )
+{ try {
+  return get_comment( get_account(author).get_id(), permlink );
+} FC_CAPTURE_AND_RETHROW( (author)(permlink) ) }
+
 const comment_object* database::find_comment( const account_name_type& author, const string& permlink )const
 {
   const account_object* acc = find_account(author);
@@ -806,6 +1062,13 @@ const comment_object* database::find_comment( const account_name_type& author, c
   return find_comment( acc->get_id(), permlink );
 }
 
+const comment_object* database::find_comment( const account_name_type& author, const string& permlink )
+{
+  const account_object* acc = find_account(author);
+  if(acc == nullptr) return nullptr;
+  return find_comment( acc->get_id(), permlink );
+}
+
 #endif
 
 const escrow_object& database::get_escrow( const account_name_type& name, uint32_t escrow_id )const
@@ -874,7 +1137,7 @@ const comment_object& database::get_comment_for_payout_time( const comment_objec
   if( has_hardfork( HIVE_HARDFORK_0_17__769 ) || comment.is_root() )
     return comment;
   else
-    return get< comment_object >( comment.get_root_id() );
+    return get_comment( comment.get_root_id() );
 }
 
 const time_point_sec database::calculate_discussion_payout_time( const comment_object& comment )const
@@ -939,6 +1202,148 @@ const comment_object& database::get_comment( const comment_cashout_object& comme
   return *found;
 }
 
+const comment_object* database::find_comment_by_hash( const comment_object::author_and_permlink_hash_type& hash )
+{
+  const comment_object* comment = find< comment_object, by_permlink >( hash );
+  if( comment == nullptr && _comment_archive )
+  {
+    auto archived_id = _comment_archive->find_id( hash );
+    if( archived_id.valid() )
+      comment = restore_archived_comment( *archived_id );
+  }
+  return comment;
+}
+
+const comment_object* database::find_comment_by_hash( const comment_object::author_and_permlink_hash_type& hash )const
+{
+  const comment_object* comment = find< comment_object, by_permlink >( hash );
+  if( comment == nullptr && _comment_archive )
+  {
+    auto archived_id = _comment_archive->find_id( hash );
+    if( archived_id.valid() )
+      comment = find_archived_comment( *archived_id );
+  }
+  return comment;
+}
+
+thread_local int32_t database::_comment_restore_allowed = 0;
+
+namespace {
+  /// archived comments unpacked by read-only lookups of current thread, dropped in order of loading
+  struct archived_comment_cache
+  {
+    const comment_archive*                                              archive = nullptr;
+    std::map< comment_id_type, std::unique_ptr< comment_object > >      comments;
+    std::deque< comment_id_type >                                       load_order;
+  };
+
+  thread_local archived_comment_cache _archived_comments;
+}
+
+const comment_object* database::find_archived_comment( comment_id_type comment_id )const
+{
+  if( _archived_comments.archive != _comment_archive.get() )
+  {
+    // objects loaded from other database instance (or archive opened again) are not valid here
+    _archived_comments.comments.clear();
+    _archived_comments.load_order.clear();
+    _archived_comments.archive = _comment_archive.get();
+  }
+
+  auto found = _archived_comments.comments.find( comment_id );
+  if( found != _archived_comments.comments.end() )
+    return found->second.get();
+
+  std::vector< char > packed_comment;
+  if( !_comment_archive->load( comment_id, packed_comment ) )
+    return nullptr;
+
+  if( _archived_comments.load_order.size() >= ARCHIVED_COMMENT_CACHE_SIZE )
+  {
+    _archived_comments.comments.erase( _archived_comments.load_order.front() );
+    _archived_comments.load_order.pop_front();
+  }
+
+  // comment_object is immutable, so the copy holds the same data as the object would have in state
+  auto comment = get_index< comment_index >().load_from_external_storage( comment_id, [&]( comment_object& c )
+  {
+    fc::raw::unpack_from_vector( packed_comment, c );
+  } );
+  const comment_object* result = comment.get();
+  _archived_comments.comments.emplace( comment_id, std::move( comment ) );
+  _archived_comments.load_order.push_back( comment_id );
+  return result;
+}
+
+const comment_object* database::restore_archived_comment( comment_id_type comment_id )
+{
+  // only thread applying transaction holds write lock - readers (API calls) cannot modify state, so they
+  // get read-only copy of archived comment, even when they reach non-const lookups
+  if( _comment_restore_allowed == 0 )
+    return find_archived_comment( comment_id );
+
+  std::vector< char > packed_comment;
+  if( !_comment_archive->load( comment_id, packed_comment ) )
+    return nullptr;
+
+  // comment_object is immutable, so bringing it back does not change the logical state
+  auto& comment_idx = get_mutable_index< comment_index >();
+  const comment_object& comment = comment_idx.restore_from_external_storage( comment_id, [&]( comment_object& c )
+  {
+    fc::raw::unpack_from_vector( packed_comment, c );
+  } );
+  _restored_comments.insert( comment_id );
+  return &comment;
+}
+
+void database::archive_cold_comments()
+{
+  // before HF19 paid out comments were still subject to payout processing (see remove_old_comments)
+  if( !has_hardfork( HIVE_HARDFORK_0_19 ) )
+    return;
+
+  auto& comment_idx = get_mutable_index< comment_index >();
+  const auto& cashout_idx = get_index< comment_cashout_index >();
+  const auto& by_id_idx = comment_idx.indices().get< by_id >();
+
+  // restored comments are already in the archive, they just need to be dropped again (unless reversible blocks refer to them)
+  for( auto restored_itr = _restored_comments.begin(); restored_itr != _restored_comments.end(); )
+  {
+    auto comment_itr = by_id_idx.find( *restored_itr );
+    if( comment_itr != by_id_idx.end() )
+    {
+      if( comment_idx.is_in_undo_state( *restored_itr ) )
+      {
+        ++restored_itr;
+        continue;
+      }
+      comment_idx.move_to_external_storage< by_id >( comment_itr, std::next( comment_itr ), []( const comment_object& ) {} );
+    }
+    restored_itr = _restored_comments.erase( restored_itr );
+  }
+
+  // comments are paid out in order of their creation, so the first one that still has cashout object (or whose
+  // cashout object was removed in reversible block) ends the range of comments that can be archived
+  const size_t max_batch_size = 10000;
+  std::vector< const comment_object* > cold_comments;
+  for( auto itr = by_id_idx.lower_bound( _comment_archive->get_cursor() ); itr != by_id_idx.end() && cold_comments.size() < max_batch_size; ++itr )
+  {
+    comment_id_type id = itr->get_id();
+    if( find_comment_cashout( id ) != nullptr || comment_idx.is_in_undo_state( id ) ||
+      cashout_idx.is_in_undo_state( comment_cashout_object::id_type( id.get_value() ) ) )
+      break;
+    cold_comments.push_back( &*itr );
+  }
+
+  if( cold_comments.empty() )
+    return;
+
+  comment_id_type new_cursor = comment_object::id_type( cold_comments.back()->get_id().get_value() + 1 );
+  _comment_archive->store( cold_comments, new_cursor );
+  comment_idx.move_to_external_storage< by_id >( by_id_idx.find( cold_comments.front()->get_id() ), by_id_idx.lower_bound( new_cursor ),
+    []( const comment_object& ) {} );
+}
+
 void database::remove_old_comments()
 {
   const auto& idx = get_index< comment_cashout_index >().indices().get< by_cashout_time >();
@@ -1101,6 +1506,7 @@ bool database::_push_block(const signed_block& new_block)
               auto session = start_undo_session();
               apply_block( (*ritr)->data, skip );
               session.push();
+              (*ritr)->set_validated();
             }
             catch ( const fc::exception& e ) { except = e; }
             if( except )
@@ -1140,6 +1546,13 @@ bool database::_push_block(const signed_block& new_block)
     auto session = start_undo_session();
     apply_block(new_block, skip);
     session.push();
+    // only now block becomes visible to lock-free readers of fork database
+    if( !(skip&skip_fork_db) )
+    {
+      shared_ptr<fork_item> new_item = _fork_db.fetch_block( new_block.id() );
+      if( new_item )
+        new_item->set_validated();
+    }
   }
   catch( const fc::exception& e )
   {
@@ -1192,7 +1605,14 @@ void database::_push_transaction( const signed_transaction& trx )
   // If this is the first transaction pushed after applying a block, start a new undo session.
   // This allows us to quickly rewind to the clean state of the head block, in case a new block arrives.
   if( !_pending_tx_session.valid() )
+  {
+    // pending transactions that are already on the list (if any) are not part of new pending state
+    _pending_tx_applied = _pending_tx.empty();
     _pending_tx_session = start_undo_session();
+  }
+
+  auto entry = pending_transaction_pool::make_entry( trx, trx.id() );
+  _pending_tx_pool.check_account_limit( entry );
 
   // Create a temporary undo session as a child of _pending_tx_session.
   // The temporary session will be discarded by the destructor if
@@ -1201,11 +1621,102 @@ void database::_push_transaction( const signed_transaction& trx )
 
   auto temp_session = start_undo_session();
   _apply_transaction( trx );
-  _pending_tx.push_back( trx );
+  // priority can depend on effects of the transaction (f.e. RC left after paying for it)
+  entry.priority = _pending_tx_pool.evaluate_priority( trx );
+  auto dropped = _pending_tx_pool.find_room( entry, head_block_time() );
 
   notify_changed_objects();
-  // The transaction applied successfully. Merge its changes into the pending block session.
-  temp_session.squash();
+  // The transaction applied successfully. Keep its changes as separate level on top of the pending block session,
+  // so when it has to be dropped only transactions that follow it need to be applied again.
+  _pending_tx_levels.emplace_back( _pending_tx.size(), std::move( temp_session ) );
+
+  _pending_tx.push_back( trx );
+  _pending_tx_pool.add( entry );
+  if( !dropped.empty() )
+  {
+    drop_pending_transactions( dropped );
+    HIVE_ASSERT( _pending_tx_pool.find( entry.id ) != nullptr, transaction_pool_full_exception,
+      "Transaction can't be applied without pending transactions dropped to make room for it" );
+  }
+}
+
+void database::postpone_pending_transaction( const signed_transaction& trx )
+{
+  auto entry = pending_transaction_pool::make_entry( trx, trx.id() );
+  try
+  {
+    // not applied, so its priority is not known - it gets the lowest and cannot push out other transactions
+    _pending_tx_pool.check_account_limit( entry );
+    auto dropped = _pending_tx_pool.find_room( entry, head_block_time() );
+    drop_pending_transactions( dropped );
+  }
+  catch( const transaction_pool_full_exception& )
+  {
+    return;
+  }
+
+  _pending_tx.push_back( trx );
+  _pending_tx_pool.add( entry );
+  _pending_tx_applied = false;
+}
+
+void database::undo_pending_tx_levels( size_t first_tx_index )
+{
+  while( !_pending_tx_levels.empty() && _pending_tx_levels.back().tx_index >= first_tx_index )
+    _pending_tx_levels.pop_back(); // session undoes its changes when destroyed
+}
+
+void database::drop_pending_transactions( const std::vector< transaction_id_type >& ids )
+{
+  if( ids.empty() )
+    return;
+
+  // searching from the end costs as much as reapplying the transactions that follow the first dropped one anyway
+  flat_set< transaction_id_type > dropped( ids.begin(), ids.end() );
+  size_t first_dropped = _pending_tx.size();
+  size_t found = 0;
+  while( found < dropped.size() && first_dropped > 0 )
+  {
+    --first_dropped;
+    found += dropped.count( _pending_tx[ first_dropped ].id() );
+  }
+
+  // Effects of dropped transactions have to be undone (their ids would make rebroadcast look like duplicate, and
+  // later transactions could rely on their effects), so pending state is rewound to the first dropped one and the
+  // remaining ones that followed it are applied again. They fit the limits, so nothing is dropped while they are
+  // applied again.
+  undo_pending_tx_levels( first_dropped );
+  std::vector< signed_transaction > remaining;
+  remaining.reserve( _pending_tx.size() - first_dropped );
+  for( auto itr = _pending_tx.begin() + first_dropped; itr != _pending_tx.end(); ++itr )
+  {
+    auto id = itr->id();
+    _pending_tx_pool.remove( id );
+    if( dropped.count( id ) == 0 )
+      remaining.push_back( std::move( *itr ) );
+  }
+  _pending_tx.erase( _pending_tx.begin() + first_dropped, _pending_tx.end() );
+
+  auto start = fc::time_point::now();
+  for( const auto& tx : remaining )
+  {
+    // without pending state (transactions are only being restored) there is nothing to apply them to
+    if( !_pending_tx_session.valid() || fc::time_point::now() - start > HIVE_PENDING_TRANSACTION_EXECUTION_LIMIT )
+    {
+      postpone_pending_transaction( tx );
+      continue;
+    }
+
+    try
+    {
+      if( tx.expiration >= head_block_time() )
+        _push_transaction( tx );
+    }
+    catch( const fc::exception& e )
+    {
+      dlog( "Pending transaction became invalid after dropping other pending transactions: ${e}", ("e", e.to_detail_string()) );
+    }
+  }
 }
 
 /**
@@ -1216,7 +1727,9 @@ void database::pop_block()
 {
   try
   {
+    undo_pending_tx_levels();
     _pending_tx_session.reset();
+    _pending_tx_applied = _pending_tx.empty();
     auto head_id = head_block_id();
 
     /// save the head block so we can recover its transactions
@@ -1238,7 +1751,10 @@ void database::clear_pending()
   {
     assert( (_pending_tx.size() == 0) || _pending_tx_session.valid() );
     _pending_tx.clear();
+    _pending_tx_pool.clear();
+    undo_pending_tx_levels();
     _pending_tx_session.reset();
+    _pending_tx_applied = true;
   }
   FC_CAPTURE_AND_RETHROW()
 }
@@ -3191,10 +3707,11 @@ void database::process_funds()
 
 void database::process_savings_withdraws()
 {
+  auto now = head_block_time();
   const auto& idx = get_index< savings_withdraw_index >().indices().get< by_complete_from_rid >();
   auto itr = idx.begin();
   while( itr != idx.end() ) {
-    if( itr->complete > head_block_time() )
+    if( itr->complete > now )
       break;
     adjust_balance( get_account( itr->to ), itr->amount );
 
@@ -3525,10 +4042,11 @@ void database::account_recovery_processing()
 
 void database::expire_escrow_ratification()
 {
+  auto now = head_block_time();
   const auto& escrow_idx = get_index< escrow_index >().indices().get< by_ratification_deadline >();
   auto escrow_itr = escrow_idx.lower_bound( false );
 
-  while( escrow_itr != escrow_idx.end() && !escrow_itr->is_approved() && escrow_itr->ratification_deadline <= head_block_time() )
+  while( escrow_itr != escrow_idx.end() && !escrow_itr->is_approved() && escrow_itr->ratification_deadline <= now )
   {
     const auto& old_escrow = *escrow_itr;
     ++escrow_itr;
@@ -3548,10 +4066,11 @@ void database::expire_escrow_ratification()
 
 void database::process_decline_voting_rights()
 {
+  auto now = head_block_time();
   const auto& request_idx = get_index< decline_voting_rights_request_index >().indices().get< by_effective_date >();
   auto itr = request_idx.begin();
 
-  while( itr != request_idx.end() && itr->effective_date <= head_block_time() )
+  while( itr != request_idx.end() && itr->effective_date <= now )
   {
     const auto& account = get< account_object, by_name >( itr->account );
 
@@ -3960,6 +4479,21 @@ void database::set_flush_interval( uint32_t flush_blocks )
   _next_flush_block = 0;
 }
 
+void database::set_trx_precheck_threads( uint32_t thread_count )
+{
+  _my->start_precheck_threads( thread_count );
+}
+
+void database::set_trx_admission_cache_size( uint32_t size )
+{
+  _my->_admission_cache.set_capacity( size );
+}
+
+void database::set_pending_transaction_limits( uint32_t max_transactions_per_account, uint64_t max_size )
+{
+  _pending_tx_pool.set_limits( max_transactions_per_account, max_size );
+}
+
 //////////////////// private methods ////////////////////
 
 void database::apply_block( const signed_block& next_block, uint32_t skip )
@@ -4063,6 +4597,7 @@ void database::_apply_block( const signed_block& next_block )
   BOOST_SCOPE_EXIT( this_ )
   {
     this_->_currently_processing_block_id.reset();
+    this_->_current_precomputed_trx = nullptr;
   } BOOST_SCOPE_EXIT_END
   _currently_processing_block_id = note.block_id;
 
@@ -4164,6 +4699,10 @@ void database::_apply_block( const signed_block& next_block )
     );
   }
 
+  vector< precomputed_transaction_info > precomputed;
+  if( _my->_precheck_thread_count > 0 && next_block.transactions.size() > 1 )
+    _my->precheck_transactions( next_block, skip, precomputed );
+
   for( const auto& trx : next_block.transactions )
   {
     /* We do not need to push the undo state for each transaction
@@ -4172,9 +4711,12 @@ void database::_apply_block( const signed_block& next_block )
       * for transactions when validating broadcast transactions or
       * when building a block.
       */
+    if( !precomputed.empty() )
+      _current_precomputed_trx = &precomputed[ _current_trx_in_block ];
     apply_transaction( trx, skip );
     ++_current_trx_in_block;
   }
+  _current_precomputed_trx = nullptr;
 
   _current_trx_in_block = -1;
   _current_op_in_trx = 0;
@@ -4407,18 +4949,29 @@ void database::apply_transaction(const signed_transaction& trx, uint32_t skip)
 
 void database::_apply_transaction(const signed_transaction& trx)
 { try {
-  transaction_notification note(trx);
+  const precomputed_transaction_info* precomputed = _current_precomputed_trx;
+  if( precomputed != nullptr && !precomputed->valid )
+    precomputed = nullptr;
+
+  transaction_notification note = precomputed ? transaction_notification( trx, precomputed->trx_id ) : transaction_notification( trx );
   _current_trx_id = note.transaction_id;
   const transaction_id_type& trx_id = note.transaction_id;
   _current_virtual_op = 0;
+  // evaluators (and plugins reacting to operations) can refer to archived comments
+  chainbase::int_incrementer comment_restore_allowed( _comment_restore_allowed );
 
   uint32_t skip = get_node_properties().skip_flags;
 
-  if( !(skip&skip_validate) )   /* issue #505 explains why this skip_flag is disabled */
+  const chain_id_type& chain_id = get_chain_id();
+  const auto canon_type = has_hardfork( HIVE_HARDFORK_0_20__1944 ) ? fc::ecc::bip_0062 : fc::ecc::fc_canonical;
+  // stateless checks of transaction that was seen before (from other peer, API or as pending) were already done
+  flat_set< public_key_type > cached_signature_keys;
+  const bool cached = !precomputed && _my->_admission_cache.find( trx_id, trx, chain_id, canon_type, cached_signature_keys );
+
+  if( !(skip&skip_validate) && !precomputed && !cached )   /* issue #505 explains why this skip_flag is disabled */
     trx.validate();
 
   auto& trx_idx = get_index<transaction_index>();
-  const chain_id_type& chain_id = get_chain_id();
   // idump((trx_id)(skip&skip_transaction_dupe_check));
   FC_ASSERT( (skip & skip_transaction_dupe_check) ||
           trx_idx.indices().get<by_trx_id>().find(trx_id) == trx_idx.indices().get<by_trx_id>().end(),
@@ -4430,12 +4983,25 @@ void database::_apply_transaction(const signed_transaction& trx)
     auto get_owner   = [&]( const string& name ) { return authority( get< account_authority_object, by_account >( name ).owner );  };
     auto get_posting = [&]( const string& name ) { return authority( get< account_authority_object, by_account >( name ).posting );  };
 
+    const uint32_t max_membership = has_hardfork( HIVE_HARDFORK_0_20 ) || is_producing() ? HIVE_MAX_AUTHORITY_MEMBERSHIP : 0;
+    const uint32_t max_account_auths = has_hardfork( HIVE_HARDFORK_0_20 ) || is_producing() ? HIVE_MAX_SIG_CHECK_ACCOUNTS : 0;
+
     try
     {
-      trx.verify_authority( chain_id, get_active, get_owner, get_posting, HIVE_MAX_SIG_CHECK_DEPTH,
-        has_hardfork( HIVE_HARDFORK_0_20 ) || is_producing() ? HIVE_MAX_AUTHORITY_MEMBERSHIP : 0,
-        has_hardfork( HIVE_HARDFORK_0_20 ) || is_producing() ? HIVE_MAX_SIG_CHECK_ACCOUNTS : 0,
-        has_hardfork( HIVE_HARDFORK_0_20__1944 ) ? fc::ecc::bip_0062 : fc::ecc::fc_canonical );
+      if( precomputed || cached )
+      {
+        hive::protocol::verify_authority( trx.operations, precomputed ? precomputed->signature_keys : cached_signature_keys,
+          get_active, get_owner, get_posting, HIVE_MAX_SIG_CHECK_DEPTH, max_membership, max_account_auths );
+      }
+      else
+      {
+        flat_set< public_key_type > signature_keys = trx.get_signature_keys( chain_id, canon_type );
+        // only remember complete stateless verdict (validation is skipped e.g. during replay)
+        if( !(skip&skip_validate) )
+          _my->_admission_cache.store( trx_id, trx, chain_id, canon_type, signature_keys );
+        hive::protocol::verify_authority( trx.operations, signature_keys, get_active, get_owner, get_posting,
+          HIVE_MAX_SIG_CHECK_DEPTH, max_membership, max_account_auths );
+      }
     }
     catch( protocol::tx_missing_active_auth& e )
     {
@@ -4596,17 +5162,19 @@ void database::process_optional_actions( const optional_automated_actions& actio
     apply_optional_action( *actions_itr );
   }
 
-  // This expiration is based on the timestamp of the last irreversible block. For historical
-  // blocks, generation of optional actions should be disabled and the expiration can be skipped.
-  // For reindexing of the first 2 million blocks, this unnecessary read consumes almost 30%
-  // of runtime.
-  FC_TODO( "Optimize expiration for reindex." );
-
   // Clear out "expired" optional_actions. If the block when an optional action was generated
   // has become irreversible then a super majority of witnesses have chosen to not include it
   // and it is safe to delete.
   const auto& pending_action_idx = get_index< pending_optional_action_index, by_execution >();
   auto pending_itr = pending_action_idx.begin();
+
+  // This expiration is based on the timestamp of the last irreversible block, which has to be read
+  // from block log. Since that timestamp is never later than head block time, the read can be skipped
+  // when there is nothing that could expire (always the case for historical blocks, where reading
+  // it used to consume almost 30% of reindex time for the first 2 million blocks).
+  if( pending_itr == pending_action_idx.end() || pending_itr->execution_time > head_block_time() )
+    return;
+
   auto lib = fetch_block_by_number( get_last_irreversible_block_num() );
 
   // This is always valid when running on mainnet because there are irreversible blocks
@@ -5079,6 +5647,9 @@ void database::migrate_irreversible_state(uint32_t old_last_irreversible)
     // This deletes undo state
     commit( get_last_irreversible_block_num() );
 
+    if( _comment_archive )
+      archive_cold_comments();
+
     if(old_last_irreversible < get_last_irreversible_block_num() )
     {
       //ilog("Updating last irreversible block to: ${b}. Old last irreversible was: ${ob}.",
@@ -5310,7 +5881,8 @@ void database::clear_expired_transactions()
   //Transactions must have expired by at least two forking windows in order to be removed.
   auto& transaction_idx = get_index< transaction_index >();
   const auto& dedupe_index = transaction_idx.indices().get< by_expiration >();
-  while( ( !dedupe_index.empty() ) && ( head_block_time() > dedupe_index.begin()->expiration ) )
+  auto now = head_block_time();
+  while( ( !dedupe_index.empty() ) && ( now > dedupe_index.begin()->expiration ) )
     remove( *dedupe_index.begin() );
 }
 
@@ -6695,9 +7267,21 @@ void database::retally_witness_vote_counts( bool force )
 
 optional< chainbase::database::session >& database::pending_transaction_session()
 {
+  // caller takes over pending state as a whole, so levels of single transactions are merged into it
+  while( !_pending_tx_levels.empty() )
+  {
+    _pending_tx_levels.back().session.squash();
+    _pending_tx_levels.pop_back();
+  }
   return _pending_tx_session;
 }
 
+void database::undo_pending_transactions()
+{
+  undo_pending_tx_levels();
+  _pending_tx_session.reset();
+}
+
 void database::remove_expired_governance_votes()
 {
   if (!has_hardfork(HIVE_HARDFORK_1_25))
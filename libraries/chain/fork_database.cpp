@@ -2,31 +2,51 @@
 
 #include <hive/chain/database_exceptions.hpp>
 #include <boost/range/algorithm/reverse.hpp>
+#include <boost/make_shared.hpp>
 
 namespace hive { namespace chain {
 
 fork_database::fork_database()
 {
+  auto s = boost::make_shared< state_type >();
+  s->unlinked_index = std::make_shared< fork_multi_index_type >();
+  _state.store( s );
 }
+
+boost::shared_ptr< fork_database::state_type > fork_database::copy_state()const
+{
+  return boost::make_shared< state_type >( *_state.load() );
+}
+
 void fork_database::reset()
 {
-  _head.reset();
-  _index.clear();
+  auto s = copy_state();
+  s->head.reset();
+  s->layers.clear();
+  s->min_num = 0;
+  _state.store( s );
 }
 
 void fork_database::pop_block()
 {
-  FC_ASSERT( _head, "cannot pop an empty fork database" );
-  auto prev = _head->prev.lock();
+  auto s = copy_state();
+  FC_ASSERT( s->head, "cannot pop an empty fork database" );
+  auto prev = s->head->prev.lock();
   FC_ASSERT( prev, "popping head block would leave fork DB empty" );
-  _head = prev;
+  s->head = prev;
+  _state.store( s );
 }
 
 void     fork_database::start_block(signed_block b)
 {
   auto item = std::make_shared<fork_item>(std::move(b));
-  _index.insert(item);
-  _head = item;
+  item->set_validated(); // starting block comes from state, so it was applied already
+  auto layer = std::make_shared< fork_multi_index_type >();
+  layer->insert(item);
+  auto s = copy_state();
+  s->layers.emplace_back( std::move( layer ) );
+  s->head = item;
+  _state.store( s );
 }
 
 /**
@@ -36,41 +56,52 @@ void     fork_database::start_block(signed_block b)
 shared_ptr<fork_item>  fork_database::push_block(const signed_block& b)
 {
   auto item = std::make_shared<fork_item>(b);
+  auto s = copy_state();
+  auto layer = std::make_shared< fork_multi_index_type >();
   try {
-    _push_block(item);
+    _push_block(*s, *layer, item);
   }
   catch ( const unlinkable_block_exception& e )
   {
     wlog( "Pushing block to fork database that failed to link: ${id}, ${num}", ("id",b.id())("num",b.block_num()) );
-    wlog( "Head: ${num}, ${id}", ("num",_head->data.block_num())("id",_head->data.id()) );
-    _unlinked_index.insert( item );
+    wlog( "Head: ${num}, ${id}", ("num",s->head->data.block_num())("id",s->head->data.id()) );
+    auto unlinked = std::make_shared< fork_multi_index_type >( *s->unlinked_index );
+    unlinked->insert( item );
+    s->unlinked_index = std::move( unlinked );
+    _state.store( s );
     throw;
   }
-  return _head;
+  s->layers.emplace_back( std::move( layer ) );
+  if( s->layers.size() >= MAX_LAYERS )
+    _merge_layers( *s );
+  _state.store( s );
+  return s->head;
 }
 
-void  fork_database::_push_block(const item_ptr& item)
+void  fork_database::_push_block(state_type& s, fork_multi_index_type& layer, const item_ptr& item)
 {
-  if( _head ) // make sure the block is within the range that we are caching
+  if( s.head ) // make sure the block is within the range that we are caching
   {
-    FC_ASSERT( item->num > std::max<int64_t>( 0, int64_t(_head->num) - (_max_size) ),
+    FC_ASSERT( item->num > std::max<int64_t>( 0, int64_t(s.head->num) - (_max_size) ),
             "attempting to push a block that is too old",
-            ("item->num",item->num)("head",_head->num)("max_size",_max_size));
+            ("item->num",item->num)("head",s.head->num)("max_size",_max_size));
   }
 
-  if( _head && item->previous_id() != block_id_type() )
+  if( s.head && item->previous_id() != block_id_type() )
   {
-    auto& index = _index.get<block_id>();
+    auto& index = layer.get<block_id>();
     auto itr = index.find(item->previous_id());
-    HIVE_ASSERT(itr != index.end(), unlinkable_block_exception, "block does not link to known chain");
-    FC_ASSERT(!(*itr)->invalid);
-    item->prev = *itr;
+    item_ptr prev = itr != index.end() ? *itr : _find( s, item->previous_id() );
+    HIVE_ASSERT(prev, unlinkable_block_exception, "block does not link to known chain");
+    FC_ASSERT(!prev->invalid);
+    item->prev = prev;
   }
 
-  _index.insert(item);
-  if( !_head || item->num > _head->num ) _head = item;
+  if( !_find( s, item->id ) ) // same block might be in older layer already
+    layer.insert(item);
+  if( !s.head || item->num > s.head->num ) s.head = item;
 
-  _push_next( item ); //check for any unlinked blocks that can now be linked to our fork
+  _push_next( s, layer, item ); //check for any unlinked blocks that can now be linked to our fork
 }
 
 /**
@@ -79,18 +110,24 @@ void  fork_database::_push_block(const item_ptr& item)
   *  set of calls performing a depth-first insertion of pending blocks as
   *  _push_next(..) calls _push_block(...) which will in turn call _push_next
   */
-void fork_database::_push_next( const item_ptr& new_item )
+void fork_database::_push_next( state_type& s, fork_multi_index_type& layer, const item_ptr& new_item )
 {
-    auto& prev_idx = _unlinked_index.get<by_previous>();
+    if( s.unlinked_index->get<by_previous>().count( new_item->id ) == 0 )
+      return; // common case, published unlinked index stays shared
+
+    auto unlinked = std::make_shared< fork_multi_index_type >( *s.unlinked_index );
+    s.unlinked_index = unlinked;
+    auto& prev_idx = unlinked->get<by_previous>();
 
     auto itr = prev_idx.find( new_item->id );
     while( itr != prev_idx.end() )
     {
-      auto tmp = *itr;
+      // unlinked item was already published, readers might hold it, so link a copy instead
+      auto tmp = std::make_shared<fork_item>( **itr );
       prev_idx.erase( itr );
       try
       {
-        _push_block( tmp );
+        _push_block( s, layer, tmp );
       }
       catch(const fc::assert_exception& e)
       {
@@ -102,75 +139,96 @@ void fork_database::_push_next( const item_ptr& new_item )
     }
 }
 
-void fork_database::set_max_size( uint32_t s )
+void fork_database::_merge_layers( state_type& s, const block_id_type& removed_id )
 {
-  _max_size = s;
-  if( !_head ) return;
-
-  { /// index
-    auto& by_num_idx = _index.get<block_num>();
-    auto itr = by_num_idx.begin();
-    while( itr != by_num_idx.end() )
+  auto merged = std::make_shared< fork_multi_index_type >();
+  for( const layer_ptr& layer : s.layers )
+  {
+    // within layer (and from older to newer layers) items of the same number keep their insertion order
+    for( const item_ptr& item : layer->get<block_num>() )
     {
-      if( (*itr)->num < std::max(int64_t(0),int64_t(_head->num) - _max_size) )
-        by_num_idx.erase(itr);
-      else
-        break;
-      itr = by_num_idx.begin();
+      if( item->num >= s.min_num && item->id != removed_id )
+        merged->insert( item );
     }
   }
-  { /// unlinked_index
-    auto& by_num_idx = _unlinked_index.get<block_num>();
-    auto itr = by_num_idx.begin();
-    while( itr != by_num_idx.end() )
-    {
-      if( (*itr)->num < std::max(int64_t(0),int64_t(_head->num) - _max_size) )
-        by_num_idx.erase(itr);
-      else
-        break;
-      itr = by_num_idx.begin();
-    }
+  s.layers.clear();
+  s.layers.emplace_back( std::move( merged ) );
+}
+
+item_ptr fork_database::_find( const state_type& s, const block_id_type& id )
+{
+  for( auto layer_itr = s.layers.rbegin(); layer_itr != s.layers.rend(); ++layer_itr )
+  {
+    auto& index = ( *layer_itr )->get<block_id>();
+    auto itr = index.find( id );
+    if( itr != index.end() )
+      return ( *itr )->num >= s.min_num ? *itr : item_ptr();
   }
+  return item_ptr();
 }
 
-bool fork_database::is_known_block(const block_id_type& id)const
+void fork_database::set_max_size( uint32_t s )
 {
-  auto& index = _index.get<block_id>();
-  auto itr = index.find(id);
-  if( itr != index.end() )
-    return true;
-  auto& unlinked_index = _unlinked_index.get<block_id>();
-  auto unlinked_itr = unlinked_index.find(id);
-  return unlinked_itr != unlinked_index.end();
+  _max_size = s;
+  auto current = _state.load();
+  if( !current->head ) return;
+
+  const uint32_t min_num = std::max(int64_t(0),int64_t(current->head->num) - _max_size);
+  auto unlinked_too_old = [min_num]( const fork_multi_index_type& index )
+  {
+    return !index.empty() && index.get<block_num>().begin()->get()->num < min_num;
+  };
+  const bool prune_unlinked = unlinked_too_old( *current->unlinked_index );
+  if( min_num <= current->min_num && !prune_unlinked )
+    return; // nothing to remove, no need for new version
+
+  auto state = copy_state();
+  // linked blocks are just hidden, they are dropped when layers are merged
+  state->min_num = std::max( state->min_num, min_num );
+  if( prune_unlinked )
+  {
+    auto unlinked = std::make_shared< fork_multi_index_type >( *state->unlinked_index );
+    auto& by_num_idx = unlinked->get<block_num>();
+    by_num_idx.erase( by_num_idx.begin(), by_num_idx.lower_bound( min_num ) );
+    state->unlinked_index = std::move( unlinked );
+  }
+  _state.store( state );
 }
 
-item_ptr fork_database::fetch_block(const block_id_type& id)const
+bool fork_database::snapshot::is_known_block(const block_id_type& id)const
 {
-  auto& index = _index.get<block_id>();
-  auto itr = index.find(id);
-  if( itr != index.end() )
-    return *itr;
-  auto& unlinked_index = _unlinked_index.get<block_id>();
+  return fetch_block( id ) != item_ptr();
+}
+
+item_ptr fork_database::snapshot::fetch_block(const block_id_type& id)const
+{
+  item_ptr item = _find( *_state, id );
+  if( item )
+    return item;
+  auto& unlinked_index = _state->unlinked_index->get<block_id>();
   auto unlinked_itr = unlinked_index.find(id);
   if( unlinked_itr != unlinked_index.end() )
     return *unlinked_itr;
   return item_ptr();
 }
 
-vector<item_ptr> fork_database::fetch_block_by_number(uint32_t num)const
+vector<item_ptr> fork_database::snapshot::fetch_block_by_number(uint32_t num)const
+{
+  return _fetch_block_by_number( *_state, num );
+}
+
+vector<item_ptr> fork_database::_fetch_block_by_number( const state_type& s, uint32_t num )
 {
   try
   {
   vector<item_ptr> result;
-  auto const& block_num_idx = _index.get<block_num>();
-  auto itr = block_num_idx.lower_bound(num);
-  while( itr != block_num_idx.end() && itr->get()->num == num )
+  if( num < s.min_num )
+    return result;
+  for( const layer_ptr& layer : s.layers )
   {
-    if( (*itr)->num == num )
-      result.push_back( *itr );
-    else
-      break;
-    ++itr;
+    auto const& block_num_idx = layer->get<block_num>();
+    auto range = block_num_idx.equal_range(num);
+    result.insert( result.end(), range.first, range.second );
   }
   return result;
   }
@@ -178,18 +236,16 @@ vector<item_ptr> fork_database::fetch_block_by_number(uint32_t num)const
 }
 
 pair<fork_database::branch_type,fork_database::branch_type>
-  fork_database::fetch_branch_from(block_id_type first, block_id_type second)const
+  fork_database::snapshot::fetch_branch_from(block_id_type first, block_id_type second)const
 { try {
   // This function gets a branch (i.e. vector<fork_item>) leading
   // back to the most recent common ancestor.
   pair<branch_type,branch_type> result;
-  auto first_branch_itr = _index.get<block_id>().find(first);
-  FC_ASSERT(first_branch_itr != _index.get<block_id>().end());
-  auto first_branch = *first_branch_itr;
+  auto first_branch = _find( *_state, first );
+  FC_ASSERT(first_branch);
 
-  auto second_branch_itr = _index.get<block_id>().find(second);
-  FC_ASSERT(second_branch_itr != _index.get<block_id>().end());
-  auto second_branch = *second_branch_itr;
+  auto second_branch = _find( *_state, second );
+  FC_ASSERT(second_branch);
 
 
   while( first_branch->data.block_num() > second_branch->data.block_num() )
@@ -221,9 +277,15 @@ pair<fork_database::branch_type,fork_database::branch_type>
   return result;
 } FC_CAPTURE_AND_RETHROW( (first)(second) ) }
 
-shared_ptr<fork_item> fork_database::walk_main_branch_to_num( uint32_t block_num )const
+shared_ptr<fork_item> fork_database::snapshot::walk_main_branch_to_num( uint32_t block_num )const
+{
+  return _walk_to_num( _state->head, block_num );
+}
+
+shared_ptr<fork_item> fork_database::_walk_to_num( shared_ptr<fork_item> next, uint32_t block_num )
 {
-  shared_ptr<fork_item> next = head();
+  if( !next )
+    return shared_ptr<fork_item>();
   if( block_num > next->num )
     return shared_ptr<fork_item>();
 
@@ -232,32 +294,50 @@ shared_ptr<fork_item> fork_database::walk_main_branch_to_num( uint32_t block_num
   return next;
 }
 
-shared_ptr<fork_item> fork_database::fetch_block_on_main_branch_by_number( uint32_t block_num )const
+shared_ptr<fork_item> fork_database::snapshot::fetch_block_on_main_branch_by_number( uint32_t block_num )const
 {
-  vector<item_ptr> blocks = fetch_block_by_number(block_num);
+  vector<item_ptr> blocks = _fetch_block_by_number(*_state, block_num);
   if( blocks.size() == 1 )
     return blocks[0];
   if( blocks.size() == 0 )
     return shared_ptr<fork_item>();
-  return walk_main_branch_to_num(block_num);
+  return _walk_to_num(_state->head, block_num);
 }
 
-vector<fork_item> fork_database::fetch_block_range_on_main_branch_by_number( const uint32_t first_block_num, const uint32_t count )const
+shared_ptr<fork_item> fork_database::_fetch_block_on_branch_by_number( const state_type& s, const shared_ptr<fork_item>& head, uint32_t block_num )
+{
+  if( !head || head->num < block_num )
+    return shared_ptr<fork_item>();
+  // branch has a block at every height from the oldest one up to its head, so single block at given height is on it
+  vector<item_ptr> blocks = _fetch_block_by_number(s, block_num);
+  if( blocks.size() == 1 )
+    return blocks[0];
+  if( blocks.size() == 0 )
+    return shared_ptr<fork_item>();
+  return _walk_to_num(head, block_num);
+}
+
+vector<fork_item> fork_database::snapshot::fetch_block_range_on_main_branch_by_number( const uint32_t first_block_num, const uint32_t count )const
+{
+  return _fetch_block_range_on_branch_by_number( *_state, _state->head, first_block_num, count );
+}
+
+vector<fork_item> fork_database::_fetch_block_range_on_branch_by_number( const state_type& s, const shared_ptr<fork_item>& head,
+  const uint32_t first_block_num, const uint32_t count )
 {
   vector<fork_item> results;
-  if (!_head ||
-      _head->num < first_block_num)
+  if (!head ||
+      head->num < first_block_num)
     return results;
 
   // the caller is asking for blocks from first_block_num ... last_desired_block_num
   const uint32_t last_desired_block_num = first_block_num + count - 1;
 
   // but if the head block isn't to last_desired_block_num yet, the latest we can have is the head block
-  const uint32_t last_block_num = std::min(last_desired_block_num, _head->num);
+  const uint32_t last_block_num = std::min(last_desired_block_num, head->num);
 
   // look up that last block and see if we have it
-  const auto& block_num_idx = _index.get<block_num>();
-  const auto fork_items_for_last_block_num = boost::make_iterator_range(block_num_idx.equal_range(last_block_num));
+  const vector<item_ptr> fork_items_for_last_block_num = _fetch_block_by_number(s, last_block_num);
   // if we don't have it (it has already been moved to the block log), return an empty list
   if (fork_items_for_last_block_num.empty())
     return results;
@@ -265,12 +345,13 @@ vector<fork_item> fork_database::fetch_block_range_on_main_branch_by_number( con
   // otherwise, walk backwards from that block, collecting blocks along the way.  Stop when
   // we either reach the first block the caller asked for, or we run out of blocks in the fork database
   shared_ptr<fork_item> item;
-  if (std::next(fork_items_for_last_block_num.begin()) == fork_items_for_last_block_num.end()) // if exactly one block numbered last_block_num
+  if (fork_items_for_last_block_num.size() == 1) // if exactly one block numbered last_block_num
     item = fork_items_for_last_block_num.front();
   else
-    item = walk_main_branch_to_num(last_block_num);
+    item = _walk_to_num(head, last_block_num);
 
-  for (; item && item->num >= first_block_num; item = item->prev.lock())
+  // blocks hidden out of reversible window are in the block log already
+  for (; item && item->num >= first_block_num && item->num >= s.min_num; item = item->prev.lock())
     results.push_back(*item);
 
   // we collected the blocks in descending order, reverse that order
@@ -279,14 +360,51 @@ vector<fork_item> fork_database::fetch_block_range_on_main_branch_by_number( con
   return results;
 }
 
+shared_ptr<fork_item> fork_database::snapshot::validated_head()const
+{
+  return _validated_head( *_state );
+}
+
+shared_ptr<fork_item> fork_database::_validated_head( const state_type& s )
+{
+  // at most the blocks of the fork being switched to are not validated yet
+  shared_ptr<fork_item> item = s.head;
+  while( item && !item->is_validated() )
+    item = item->prev.lock();
+  return item;
+}
+
+shared_ptr<fork_item> fork_database::snapshot::fetch_validated_block( const block_id_type& id )const
+{
+  item_ptr item = _find( *_state, id );
+  if( item && item->is_validated() )
+    return item;
+  return item_ptr();
+}
+
+shared_ptr<fork_item> fork_database::snapshot::fetch_validated_block_on_main_branch_by_number( uint32_t block_num )const
+{
+  return _fetch_block_on_branch_by_number( *_state, _validated_head( *_state ), block_num );
+}
+
+vector<fork_item> fork_database::snapshot::fetch_validated_block_range_on_main_branch_by_number( const uint32_t first_block_num, const uint32_t count )const
+{
+  return _fetch_block_range_on_branch_by_number( *_state, _validated_head( *_state ), first_block_num, count );
+}
+
 void fork_database::set_head(shared_ptr<fork_item> h)
 {
-  _head = std::move( h );
+  auto s = copy_state();
+  s->head = std::move( h );
+  _state.store( s );
 }
 
 void fork_database::remove(block_id_type id)
 {
-  _index.get<block_id>().erase(id);
+  auto s = copy_state();
+  // removal is rare (only blocks that failed to apply), so layers are just merged without it
+  _merge_layers( *s, id );
+  _state.store( s );
 }
 
 } } // hive::chain
@@ -765,8 +765,7 @@ void comment_evaluator::do_apply( const comment_operation& o )
 
   const auto& auth = _db.get_account( o.author ); /// prove it exists
 
-  const auto& by_permlink_idx = _db.get_index< comment_index >().indices().get< by_permlink >();
-  auto itr = by_permlink_idx.find( comment_object::compute_author_and_permlink_hash( auth.get_id(), o.permlink ) );
+  const comment_object* existing_comment = _db.find_comment( auth.get_id(), o.permlink );
   auto _now = _db.head_block_time();
 
   const comment_object* parent = nullptr;
@@ -781,7 +780,7 @@ void comment_evaluator::do_apply( const comment_operation& o )
 
   FC_ASSERT( fc::is_utf8( o.json_metadata ), "JSON Metadata must be UTF-8" );
 
-  if ( itr == by_permlink_idx.end() )
+  if ( existing_comment == nullptr )
   {
     if( o.parent_author != HIVE_ROOT_POST_PARENT )
     {
@@ -875,7 +874,7 @@ void comment_evaluator::do_apply( const comment_operation& o )
   }
   else // start edit case
   {
-    const auto& comment = *itr;
+    const auto& comment = *existing_comment;
     const comment_cashout_object* comment_cashout = _db.find_comment_cashout( comment );
 
     if( _db.is_producing() || _db.has_hardfork( HIVE_HARDFORK_0_21__3313 ) )
@@ -1526,7 +1525,7 @@ void pre_hf20_vote_evaluator( const vote_operation& o, database& _db )
 
     /// if the current net_rshares is less than 0, the post is getting 0 rewards so it is not factored into total rshares^2
     fc::uint128_t old_rshares = std::max(comment_cashout->net_rshares.value, int64_t(0));
-    const auto& root = _db.get( comment.get_root_id() );
+    const auto& root = _db.get_comment( comment.get_root_id() );
     const comment_cashout_object* root_cashout = _db.find_comment_cashout( root );
     auto old_root_abs_rshares = root_cashout ? root_cashout->children_abs_rshares.value : 0;
 
@@ -1725,7 +1724,7 @@ void pre_hf20_vote_evaluator( const vote_operation& o, database& _db )
 
     /// if the current net_rshares is less than 0, the post is getting 0 rewards so it is not factored into total rshares^2
     fc::uint128_t old_rshares = std::max(comment_cashout->net_rshares.value, int64_t(0));
-    const auto& root = _db.get( comment.get_root_id() );
+    const auto& root = _db.get_comment( comment.get_root_id() );
     const comment_cashout_object* root_cashout = _db.find_comment_cashout( root );
     auto old_root_abs_rshares = root_cashout ? root_cashout->children_abs_rshares.value : 0;
 
@@ -1967,7 +1966,7 @@ void hf20_vote_evaluator( const vote_operation& o, database& _db )
 
     /// if the current net_rshares is less than 0, the post is getting 0 rewards so it is not factored into total rshares^2
     fc::uint128_t old_rshares = std::max(comment_cashout->net_rshares.value, int64_t(0));
-    const auto& root = _db.get( comment.get_root_id() );
+    const auto& root = _db.get_comment( comment.get_root_id() );
     const comment_cashout_object* root_cashout = _db.find_comment_cashout( root );
 
     auto old_vote_rshares = comment_cashout->vote_rshares;
@@ -2143,7 +2142,7 @@ void hf20_vote_evaluator( const vote_operation& o, database& _db )
 
     /// if the current net_rshares is less than 0, the post is getting 0 rewards so it is not factored into total rshares^2
     fc::uint128_t old_rshares = std::max( comment_cashout->net_rshares.value, int64_t( 0 ) );
-    const auto& root = _db.get( comment.get_root_id() );
+    const auto& root = _db.get_comment( comment.get_root_id() );
     const comment_cashout_object* root_cashout = _db.find_comment_cashout( root );
 
     _db.modify( *comment_cashout, [&]( comment_cashout_object& c )
@@ -0,0 +1,53 @@
+#pragma once
+#include <fc/filesystem.hpp>
+#include <fc/optional.hpp>
+
+#include <hive/chain/comment_object.hpp>
+
+namespace hive { namespace chain {
+
+  namespace detail { class comment_archive_impl; }
+
+  /* Cold storage for comment objects that are no longer needed for any payout processing.
+    *
+    * Comments are immutable once their cashout object is gone, but they can still be referenced
+    * (edits, replies to old posts, root lookups during voting), so they cannot just be removed from
+    * state. Instead, once such comment becomes irreversible, it is serialized into RocksDB database
+    * and dropped from shared memory. Lookups that miss in comment_index fall back to the archive - during
+    * transaction evaluation they bring the object back into the index, otherwise they return read-only copy
+    * (see database::find_comment).
+    *
+    * Archive holds two keyspaces:
+    *   comment id -> packed comment_object
+    *   author_and_permlink hash -> comment id
+    * and a cursor - id of the first comment that was not yet archived. Comments are archived in order
+    * of their ids, so all archived comments have ids below the cursor.
+    *
+    * Archived objects are never removed from the archive; the archive only grows together with the state.
+    */
+  class comment_archive
+  {
+    public:
+      comment_archive();
+      ~comment_archive();
+
+      void open( const fc::path& dir );
+      void close();
+      bool is_open()const;
+
+      /// Removes all archived data (used when state is recreated from scratch)
+      void wipe();
+
+      /// Stores given comments and moves the cursor to new_cursor in single atomic write
+      void store( const std::vector< const comment_object* >& comments, comment_id_type new_cursor );
+
+      fc::optional< comment_id_type > find_id( const comment_object::author_and_permlink_hash_type& hash )const;
+      bool load( comment_id_type id, std::vector< char >& packed_comment )const;
+
+      comment_id_type get_cursor()const;
+
+    private:
+      std::unique_ptr< detail::comment_archive_impl > my;
+  };
+
+} }
@@ -3,11 +3,13 @@
   */
 #pragma once
 #include <hive/chain/block_log.hpp>
+#include <hive/chain/comment_archive.hpp>
 #include <hive/chain/fork_database.hpp>
 #include <hive/chain/global_property_object.hpp>
 #include <hive/chain/hardfork_property_object.hpp>
 #include <hive/chain/node_property_object.hpp>
 #include <hive/chain/notifications.hpp>
+#include <hive/chain/pending_transaction_pool.hpp>
 
 #include <hive/chain/util/advanced_benchmark_dumper.hpp>
 #include <hive/chain/util/signal.hpp>
@@ -70,6 +72,15 @@ namespace chain {
 
   struct generate_optional_actions_notification {};
 
+  /// Stateless transaction data computed on helper threads before block transactions are applied
+  struct precomputed_transaction_info
+  {
+    transaction_id_type              trx_id;
+    flat_set< public_key_type >      signature_keys;
+    /// false when any of precomputation steps failed - such transaction is then fully verified during application
+    bool                             valid = false;
+  };
+
   typedef std::function<void(uint32_t, const chainbase::database::abstract_index_cntr_t&)> TBenchmarkMidReport;
   typedef std::pair<uint32_t, TBenchmarkMidReport> TBenchmark;
 
@@ -88,6 +99,8 @@ namespace chain {
     fc::variant database_cfg;
     bool replay_in_memory = false;
     std::vector< std::string > replay_memory_indices{};
+    /// moves irreversible, already paid out comments from shared memory to RocksDB based archive
+    bool enable_comment_archive = false;
 
     // The following fields are only used on reindexing
     uint32_t stop_replay_at = 0;
@@ -202,9 +215,26 @@ namespace chain {
       optional<signed_block>     fetch_block_by_number( uint32_t num )const;
       optional<signed_block>     fetch_block_by_number_unlocked( uint32_t block_num );
       std::vector<signed_block>  fetch_block_range_unlocked( const uint32_t starting_block_num, const uint32_t count );
+      /// irreversible blocks, reading them does not need any lock
+      const block_log&           get_block_log()const { return _block_log; }
       const signed_transaction   get_recent_transaction( const transaction_id_type& trx_id )const;
       std::vector<block_id_type> get_block_ids_on_fork(block_id_type head_of_fork) const;
 
+      /**
+        *  Following methods only look into fork database and block log, so they don't need read lock and can
+        *  be called from any thread concurrently with block application. They only see blocks that were already
+        *  applied: head block is the last applied block on main branch of fork database (during fork switch it
+        *  can differ from head of state) and last irreversible block is the last block written to block log.
+        *  Blocks pushed to fork database but not yet applied (that can still turn out invalid) are not visible.
+        */
+      bool                       is_known_block_unlocked( const block_id_type& id )const;
+      optional<signed_block>     fetch_block_by_id_unlocked( const block_id_type& id )const;
+      uint32_t                   head_block_num_unlocked()const;
+      block_id_type              head_block_id_unlocked()const;
+      uint32_t                   last_irreversible_block_num_unlocked()const;
+      block_id_type              find_block_id_for_num_unlocked( uint32_t block_num )const;
+      std::vector<block_id_type> get_block_ids_on_fork_unlocked( block_id_type head_of_fork )const;
+
       /// Warning: to correctly process old blocks initially old chain-id should be set.
       chain_id_type hive_chain_id = STEEM_CHAIN_ID;
       /// Returns current chain-id being in use depending on applied HF
@@ -245,20 +275,35 @@ namespace chain {
       const account_object&  get_account(  const account_name_type& name )const;
       const account_object*  find_account( const account_name_type& name )const;
 
+      /**
+        * Comment lookups. With comment archive enabled, lookups that miss in state fall back to the archive.
+        * Non-const versions called during transaction evaluation (by the thread holding write lock) bring
+        * archived comment back to state, all other lookups return read-only copy of it that is not part of
+        * state (see find_archived_comment).
+        */
       const comment_object&  get_comment( comment_id_type comment_id )const;
+      const comment_object&  get_comment( comment_id_type comment_id );
 
       const comment_object&  get_comment(  const account_id_type& author, const shared_string& permlink )const;
+      const comment_object&  get_comment(  const account_id_type& author, const shared_string& permlink );
       const comment_object*  find_comment( const account_id_type& author, const shared_string& permlink )const;
+      const comment_object*  find_comment( const account_id_type& author, const shared_string& permlink );
 
       const comment_object&  get_comment(  const account_name_type& author, const shared_string& permlink )const;
+      const comment_object&  get_comment(  const account_name_type& author, const shared_string& permlink );
       const comment_object*  find_comment( const account_name_type& author, const shared_string& permlink )const;
+      const comment_object*  find_comment( const account_name_type& author, const shared_string& permlink );
 
 #ifndef ENABLE_STD_ALLOCATOR
       const comment_object&  get_comment(  const account_id_type& author, const string& permlink )const;
+      const comment_object&  get_comment(  const account_id_type& author, const string& permlink );
       const comment_object*  find_comment( const account_id_type& author, const string& permlink )const;
+      const comment_object*  find_comment( const account_id_type& author, const string& permlink );
 
       const comment_object&  get_comment(  const account_name_type& author, const string& permlink )const;
+      const comment_object&  get_comment(  const account_name_type& author, const string& permlink );
       const comment_object*  find_comment( const account_name_type& author, const string& permlink )const;
+      const comment_object*  find_comment( const account_name_type& author, const string& permlink );
 #endif
 
       const escrow_object&   get_escrow(  const account_name_type& name, uint32_t escrow_id )const;
@@ -290,6 +335,24 @@ namespace chain {
       const comment_cashout_object* find_comment_cashout( comment_id_type comment_id ) const;
       const comment_object& get_comment( const comment_cashout_object& comment_cashout ) const;
       void remove_old_comments();
+      /// true when paid out comments are moved out of state (see comment_archive)
+      bool has_comment_archive()const { return _comment_archive != nullptr; }
+
+    private:
+
+      const comment_object* find_comment_by_hash( const comment_object::author_and_permlink_hash_type& hash );
+      const comment_object* find_comment_by_hash( const comment_object::author_and_permlink_hash_type& hash )const;
+      /// brings archived comment back to comment_index; only allowed when write access to state is guaranteed
+      const comment_object* restore_archived_comment( comment_id_type comment_id );
+      /**
+        * Unpacks archived comment into per thread cache, leaving state untouched. Returned object stays valid
+        * until the same thread loads ARCHIVED_COMMENT_CACHE_SIZE other archived comments.
+        */
+      const comment_object* find_archived_comment( comment_id_type comment_id )const;
+      /// moves paid out irreversible comments to _comment_archive
+      void archive_cold_comments();
+
+    public:
 
       asset get_effective_vesting_shares( const account_object& account, asset_symbol_type vested_symbol )const;
 
@@ -581,6 +644,20 @@ namespace chain {
       std::deque< signed_transaction >       _popped_tx;
       vector< signed_transaction >           _pending_tx;
 
+      /**
+        * True when pending state (see pending_transaction_session()) reflects all _pending_tx applied in order
+        * on top of head block, that is, none of them was postponed without being applied. In such case block
+        * producer can pick transactions for new block without applying them again.
+        */
+      bool are_pending_transactions_applied()const { return _pending_tx_applied; }
+      void set_pending_transactions_applied( bool applied ) { _pending_tx_applied = applied; }
+
+      /// Limits and priorities of _pending_tx
+      pending_transaction_pool& get_pending_transaction_pool() { return _pending_tx_pool; }
+      const pending_transaction_pool& get_pending_transaction_pool()const { return _pending_tx_pool; }
+      /// Adds transaction at the end of _pending_tx without applying it (as long as it fits pending transaction limits)
+      void postpone_pending_transaction( const signed_transaction& trx );
+
       bool apply_order( const limit_order_object& new_order_object );
       bool fill_order( const limit_order_object& order, const asset& pays, const asset& receives );
       void cancel_order( const limit_order_object& obj );
@@ -610,13 +687,33 @@ namespace chain {
       const std::string& get_json_schema() const;
 
       void set_flush_interval( uint32_t flush_blocks );
+      /**
+        * Experimental: sets number of helper threads that precompute stateless data of block transactions
+        * (ids, validation, signature key recovery) before they are applied in order. 0 (default) disables it.
+        * State changes are still applied serially, so the resulting state is the same as without helpers.
+        */
+      void set_trx_precheck_threads( uint32_t thread_count );
+      /**
+        * Sets maximum number of transactions which results of stateless checks (validation and public keys
+        * recovered from signatures) are remembered, so they are not repeated when the same transaction is
+        * applied again (received from more peers, reapplied as pending, included in block). 0 disables the cache.
+        */
+      void set_trx_admission_cache_size( uint32_t size );
+      /**
+        * Limits pending transactions: number of them per paying account and their total size in bytes (0 means
+        * no limit). See pending_transaction_pool.
+        */
+      void set_pending_transaction_limits( uint32_t max_transactions_per_account, uint64_t max_size );
       void check_free_memory( bool force_print, uint32_t current_block_num );
 
       void apply_transaction( const signed_transaction& trx, uint32_t skip = skip_nothing );
       void apply_required_action( const required_automated_action& a );
       void apply_optional_action( const optional_automated_action& a );
 
+      /// @return session of pending state, with changes of all pending transactions merged into it
       optional< chainbase::database::session >& pending_transaction_session();
+      /// Undoes pending state (pending transactions stay on the list, but are no longer applied)
+      void undo_pending_transactions();
 
 #ifdef IS_TEST_NET
       bool liquidity_rewards_enabled = true;
@@ -648,7 +745,25 @@ namespace chain {
       void notify_changed_objects();
 
     private:
+      /// Changes made by single pending transaction, kept as separate undo level on top of _pending_tx_session
+      struct pending_tx_level
+      {
+        pending_tx_level( size_t i, chainbase::database::session&& s ) : tx_index( i ), session( std::move( s ) ) {}
+
+        size_t                         tx_index; ///< position of the transaction in _pending_tx
+        chainbase::database::session   session;
+      };
+
       optional< chainbase::database::session > _pending_tx_session;
+      /// levels of applied pending transactions, in order they were applied
+      std::vector< pending_tx_level >          _pending_tx_levels;
+      bool                                     _pending_tx_applied = true;
+      pending_transaction_pool                 _pending_tx_pool;
+
+      /// undoes levels of pending transactions (most recent first) down to the one at given position in _pending_tx
+      void undo_pending_tx_levels( size_t first_tx_index = 0 );
+      /// removes given transactions from _pending_tx and the pool, then reapplies the ones that followed the first removed one
+      void drop_pending_transactions( const std::vector< transaction_id_type >& ids );
 
       void apply_block( const signed_block& next_block, uint32_t skip = skip_nothing );
       void _apply_block( const signed_block& next_block );
@@ -779,6 +894,15 @@ namespace chain {
       uint16_t                      _current_virtual_op   = 0;
 
       optional< block_id_type >     _currently_processing_block_id;
+      /// precomputed data of transaction being applied as part of block (or nullptr when not available)
+      const precomputed_transaction_info* _current_precomputed_trx = nullptr;
+
+      /// cold storage for paid out comments (nullptr when disabled)
+      std::unique_ptr< comment_archive > _comment_archive;
+      /// ids of archived comments that were brought back to comment_index and need to be dropped again
+      std::set< comment_id_type >   _restored_comments;
+      /// nonzero on thread that evaluates transaction (holding write lock), when lookups can restore archived comments
+      static thread_local int32_t   _comment_restore_allowed;
 
       flat_map<uint32_t,block_id_type>  _checkpoints;
 
@@ -65,7 +65,7 @@ struct pending_transactions_restorer
       if( apply_trxs )
       {
         try {
-          if( !_db.is_known_transaction( tx.id() ) ) {
+          if( tx.expiration >= _db.head_block_time() && !_db.is_known_transaction( tx.id() ) ) {
             // since push_transaction() takes a signed_transaction,
             // the operation_results field will be ignored.
             _db._push_transaction( tx );
@@ -75,7 +75,7 @@ struct pending_transactions_restorer
       }
       else
       {
-        _db._pending_tx.push_back( tx );
+        _db.postpone_pending_transaction( tx );
         postponed_txs++;
       }
     }
@@ -88,7 +88,8 @@ struct pending_transactions_restorer
       {
         try
         {
-          if( !_db.is_known_transaction( tx.id() ) ) {
+          // expired transaction would fail anyway, don't waste time applying it
+          if( tx.expiration >= _db.head_block_time() && !_db.is_known_transaction( tx.id() ) ) {
             // since push_transaction() takes a signed_transaction,
             // the operation_results field will be ignored.
             _db._push_transaction( tx );
@@ -115,7 +116,7 @@ struct pending_transactions_restorer
       }
       else
       {
-        _db._pending_tx.push_back( tx );
+        _db.postpone_pending_transaction( tx );
         postponed_txs++;
       }
     }
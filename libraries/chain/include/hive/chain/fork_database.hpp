@@ -7,6 +7,10 @@
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/mem_fun.hpp>
 
+#include <boost/smart_ptr/atomic_shared_ptr.hpp>
+
+#include <atomic>
+
 namespace hive { namespace chain {
 
   using hive::protocol::signed_block;
@@ -19,9 +23,27 @@ namespace hive { namespace chain {
     public:
       fork_item( signed_block d )
       :num(d.block_num()),id(d.id()),data( std::move(d) ){}
+      fork_item( const fork_item& other )
+      :prev(other.prev),num(other.num),invalid(other.invalid),id(other.id),data(other.data),
+        _validated(other.is_validated()){}
+      fork_item& operator=( const fork_item& other )
+      {
+        prev = other.prev;
+        num = other.num;
+        invalid = other.invalid;
+        id = other.id;
+        data = other.data;
+        _validated.store( other.is_validated() );
+        return *this;
+      }
 
       block_id_type previous_id()const { return data.previous; }
 
+      /// true once the block was successfully applied to state (it stays true when the block is popped)
+      bool is_validated()const { return _validated.load( std::memory_order_acquire ); }
+      void set_validated() { _validated.store( true, std::memory_order_release ); }
+
+      /// set before item is published in fork database, never changed afterwards (linking unlinked item makes its copy)
       weak_ptr< fork_item > prev;
       uint32_t              num;    // initialized in ctor
       /**
@@ -31,6 +53,9 @@ namespace hive { namespace chain {
       bool                  invalid = false;
       block_id_type         id;
       signed_block          data;
+
+    private:
+      std::atomic< bool >   _validated{ false };
   };
   typedef shared_ptr<fork_item> item_ptr;
 
@@ -44,6 +69,24 @@ namespace hive { namespace chain {
     *
     *  Every time a block is pushed into the fork DB the
     *  block with the highest block_num will be returned.
+    *
+    *  Modifications are only allowed from the thread that applies blocks
+    *  (the one holding write lock on the database), however all const methods
+    *  can be called from any thread without any locking. Each modification
+    *  publishes new version of the content atomically, so readers always see
+    *  consistent state - the one that was current when they started - and old
+    *  versions are released together with their last reader. Reader that needs
+    *  to make several lookups should take a snapshot once and make them all on it,
+    *  otherwise consecutive lookups can see different versions.
+    *
+    *  Versions share their items: blocks are kept in immutable layers, pushing
+    *  a block only adds a layer with items it linked, and changing the head only
+    *  makes new version of the small layer list. Blocks that fall out of the
+    *  reversible window are hidden by lower bound of block numbers. Layers are merged
+    *  (and hidden blocks dropped) once there are MAX_LAYERS of them or a block is removed.
+    *
+    *  Blocks are pushed before they are applied, so readers that must not see blocks that can still be
+    *  rejected use the validated_* methods, which only look at the main branch up to the last applied block.
     */
   class fork_database
   {
@@ -51,6 +94,70 @@ namespace hive { namespace chain {
       typedef vector<item_ptr> branch_type;
       /// The maximum number of blocks that may be skipped in an out-of-order push
       const static int MAX_BLOCK_REORDERING = 1024;
+      /// Number of layers that triggers merging them into one
+      const static size_t MAX_LAYERS = 16;
+
+      struct block_id;
+      struct block_num;
+      struct by_previous;
+      typedef boost::multi_index_container<
+        item_ptr,
+        boost::multi_index::indexed_by<
+          boost::multi_index::hashed_unique<boost::multi_index::tag<block_id>, boost::multi_index::member<fork_item, block_id_type, &fork_item::id>, std::hash<fc::ripemd160>>,
+          boost::multi_index::hashed_non_unique<boost::multi_index::tag<by_previous>, boost::multi_index::const_mem_fun<fork_item, block_id_type, &fork_item::previous_id>, std::hash<fc::ripemd160>>,
+          boost::multi_index::ordered_non_unique<boost::multi_index::tag<block_num>, boost::multi_index::member<fork_item,uint32_t,&fork_item::num>>
+        >
+      > fork_multi_index_type;
+
+    private:
+      typedef std::shared_ptr< const fork_multi_index_type > layer_ptr;
+
+      /// Single version of fork database content, never modified after publication
+      struct state_type
+      {
+        /// linked blocks, oldest layer first
+        vector< layer_ptr >      layers;
+        /// blocks that don't link to known chain yet
+        layer_ptr                unlinked_index;
+        shared_ptr<fork_item>    head;
+        /// linked blocks below that number are out of reversible window and no longer visible
+        uint32_t                 min_num = 0;
+      };
+      typedef boost::shared_ptr< const state_type > state_ptr;
+
+    public:
+      /// Consistent, read-only view of fork database content
+      class snapshot
+      {
+        public:
+          shared_ptr<fork_item>            head()const { return _state->head; }
+          bool                             is_known_block(const block_id_type& id)const;
+          shared_ptr<fork_item>            fetch_block(const block_id_type& id)const;
+          vector<item_ptr>                 fetch_block_by_number(uint32_t n)const;
+
+          /**
+            *  Given two head blocks, return two branches of the fork graph that
+            *  end with a common ancestor (same prior block)
+            */
+          pair< branch_type, branch_type >  fetch_branch_from(block_id_type first,
+                                              block_id_type second)const;
+          shared_ptr<fork_item>            walk_main_branch_to_num( uint32_t block_num )const;
+          shared_ptr<fork_item>            fetch_block_on_main_branch_by_number( uint32_t block_num )const;
+          vector<fork_item>                fetch_block_range_on_main_branch_by_number( const uint32_t first_block_num, const uint32_t count )const;
+
+          /// Head of main branch with unvalidated blocks at its top skipped
+          shared_ptr<fork_item>            validated_head()const;
+          /// Block with given id if it was already validated
+          shared_ptr<fork_item>            fetch_validated_block( const block_id_type& id )const;
+          shared_ptr<fork_item>            fetch_validated_block_on_main_branch_by_number( uint32_t block_num )const;
+          vector<fork_item>                fetch_validated_block_range_on_main_branch_by_number( const uint32_t first_block_num, const uint32_t count )const;
+
+        private:
+          friend class fork_database;
+          explicit snapshot( state_ptr s ) : _state( std::move( s ) ) {}
+
+          state_ptr _state;
+      };
 
       fork_database();
       void reset();
@@ -58,15 +165,19 @@ namespace hive { namespace chain {
       void                             start_block(signed_block b);
       void                             remove(block_id_type b);
       void                             set_head(shared_ptr<fork_item> h);
-      bool                             is_known_block(const block_id_type& id)const;
-      shared_ptr<fork_item>            fetch_block(const block_id_type& id)const;
-      vector<item_ptr>                 fetch_block_by_number(uint32_t n)const;
+
+      /// Current version of the content, for readers that make several lookups
+      snapshot                         get_snapshot()const { return snapshot( _state.load() ); }
+
+      bool                             is_known_block(const block_id_type& id)const { return get_snapshot().is_known_block( id ); }
+      shared_ptr<fork_item>            fetch_block(const block_id_type& id)const { return get_snapshot().fetch_block( id ); }
+      vector<item_ptr>                 fetch_block_by_number(uint32_t n)const { return get_snapshot().fetch_block_by_number( n ); }
 
       /**
         *  @return the new head block ( the longest fork )
         */
       shared_ptr<fork_item>            push_block(const signed_block& b);
-      shared_ptr<fork_item>            head()const { return _head; }
+      shared_ptr<fork_item>            head()const { return _state.load()->head; }
       void                             pop_block();
 
       /**
@@ -74,35 +185,46 @@ namespace hive { namespace chain {
         *  end with a common ancestor (same prior block)
         */
       pair< branch_type, branch_type >  fetch_branch_from(block_id_type first,
-                                          block_id_type second)const;
-      shared_ptr<fork_item>            walk_main_branch_to_num( uint32_t block_num )const;
-      shared_ptr<fork_item>            fetch_block_on_main_branch_by_number( uint32_t block_num )const;
-      vector<fork_item>                fetch_block_range_on_main_branch_by_number( const uint32_t first_block_num, const uint32_t count )const;
-
-      struct block_id;
-      struct block_num;
-      struct by_previous;
-      typedef boost::multi_index_container<
-        item_ptr,
-        boost::multi_index::indexed_by<
-          boost::multi_index::hashed_unique<boost::multi_index::tag<block_id>, boost::multi_index::member<fork_item, block_id_type, &fork_item::id>, std::hash<fc::ripemd160>>,
-          boost::multi_index::hashed_non_unique<boost::multi_index::tag<by_previous>, boost::multi_index::const_mem_fun<fork_item, block_id_type, &fork_item::previous_id>, std::hash<fc::ripemd160>>,
-          boost::multi_index::ordered_non_unique<boost::multi_index::tag<block_num>, boost::multi_index::member<fork_item,uint32_t,&fork_item::num>>
-        >
-      > fork_multi_index_type;
+                                          block_id_type second)const { return get_snapshot().fetch_branch_from( first, second ); }
+      shared_ptr<fork_item>            walk_main_branch_to_num( uint32_t block_num )const
+                                          { return get_snapshot().walk_main_branch_to_num( block_num ); }
+      shared_ptr<fork_item>            fetch_block_on_main_branch_by_number( uint32_t block_num )const
+                                          { return get_snapshot().fetch_block_on_main_branch_by_number( block_num ); }
+      vector<fork_item>                fetch_block_range_on_main_branch_by_number( const uint32_t first_block_num, const uint32_t count )const
+                                          { return get_snapshot().fetch_block_range_on_main_branch_by_number( first_block_num, count ); }
+
+      /// Head of main branch with unvalidated blocks at its top skipped
+      shared_ptr<fork_item>            validated_head()const { return get_snapshot().validated_head(); }
+      /// Block with given id if it was already validated
+      shared_ptr<fork_item>            fetch_validated_block( const block_id_type& id )const { return get_snapshot().fetch_validated_block( id ); }
+      shared_ptr<fork_item>            fetch_validated_block_on_main_branch_by_number( uint32_t block_num )const
+                                          { return get_snapshot().fetch_validated_block_on_main_branch_by_number( block_num ); }
+      vector<fork_item>                fetch_validated_block_range_on_main_branch_by_number( const uint32_t first_block_num, const uint32_t count )const
+                                          { return get_snapshot().fetch_validated_block_range_on_main_branch_by_number( first_block_num, count ); }
 
       void set_max_size( uint32_t s );
 
     private:
-      /** @return a pointer to the newly pushed item */
-      void _push_block(const item_ptr& b );
-      void _push_next(const item_ptr& newly_inserted);
+      /// @return copy of current version (sharing all layers) to be modified and published with _state.store()
+      boost::shared_ptr< state_type > copy_state()const;
+
+      /// links item using blocks of state and new layer, adding it (and unlinked blocks that now link) to the layer
+      void _push_block( state_type& s, fork_multi_index_type& layer, const item_ptr& b );
+      void _push_next( state_type& s, fork_multi_index_type& layer, const item_ptr& newly_inserted );
+      /// merges all layers into one, dropping blocks out of reversible window and the one with given id (if any)
+      static void _merge_layers( state_type& s, const block_id_type& removed_id = block_id_type() );
+
+      static item_ptr _find( const state_type& s, const block_id_type& id );
+      static vector<item_ptr> _fetch_block_by_number( const state_type& s, uint32_t n );
+      static shared_ptr<fork_item> _walk_to_num( shared_ptr<fork_item> head, uint32_t block_num );
+      static shared_ptr<fork_item> _validated_head( const state_type& s );
+      static shared_ptr<fork_item> _fetch_block_on_branch_by_number( const state_type& s, const shared_ptr<fork_item>& head, uint32_t block_num );
+      static vector<fork_item> _fetch_block_range_on_branch_by_number( const state_type& s, const shared_ptr<fork_item>& head,
+        const uint32_t first_block_num, const uint32_t count );
 
       uint32_t                 _max_size = 1024;
 
-      fork_multi_index_type    _unlinked_index;
-      fork_multi_index_type    _index;
-      shared_ptr<fork_item>    _head;
+      boost::atomic_shared_ptr< const state_type > _state;
   };
 
 } } // hive::chain
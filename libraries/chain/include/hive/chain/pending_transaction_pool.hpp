@@ -0,0 +1,89 @@
+#pragma once
+#include <hive/protocol/transaction.hpp>
+
+#include <fc/time.hpp>
+
+#include <functional>
+#include <memory>
+
+namespace hive { namespace chain {
+
+  using hive::protocol::signed_transaction;
+  using hive::protocol::transaction_id_type;
+  using hive::protocol::account_name_type;
+
+  namespace detail { class pending_transaction_pool_impl; }
+
+  /* Keeps limits and priorities of pending transactions (database::_pending_tx holds transactions themselves, in order
+    * in which they were applied to pending state).
+    *
+    * Each pending transaction is accounted to the account that pays for it (first account whose active, owner or posting
+    * authority it requires - the same account RC plugin charges). Number of pending transactions per account and total
+    * size of all pending transactions can be limited. When there is no room for new transaction, already expired ones are
+    * dropped first, then ones with lowest priority, as long as their priority is lower than that of new transaction.
+    * Otherwise new transaction is rejected. Priority comes from evaluator set by a plugin (RC plugin uses RC left to the
+    * paying account) - without it all transactions are equal and the pool only enforces limits.
+    *
+    * All operations except clear() are O(log n) in number of pending transactions.
+    */
+  class pending_transaction_pool
+  {
+    public:
+      /// Called after transaction was applied to pending state, higher value means more valuable transaction
+      typedef std::function< int64_t( const signed_transaction& ) > priority_evaluator;
+
+      struct entry
+      {
+        transaction_id_type  id;
+        account_name_type    account;
+        uint32_t             size = 0;
+        int64_t              priority = 0;
+        fc::time_point_sec   expiration;
+      };
+
+      pending_transaction_pool();
+      ~pending_transaction_pool();
+
+      /// 0 means no limit
+      void set_limits( uint32_t max_transactions_per_account, uint64_t max_size );
+      uint32_t get_max_transactions_per_account()const { return _max_transactions_per_account; }
+      uint64_t get_max_size()const { return _max_size; }
+
+      void set_priority_evaluator( priority_evaluator evaluator ) { _priority_evaluator = std::move( evaluator ); }
+      /// @return priority of given transaction (0 when there is no evaluator)
+      int64_t evaluate_priority( const signed_transaction& trx )const;
+
+      /// Fills entry for given transaction, except for priority
+      static entry make_entry( const signed_transaction& trx, const transaction_id_type& id );
+
+      /// @throw transaction_pool_full_exception when account of given entry already reached its limit
+      void check_account_limit( const entry& e )const;
+
+      /**
+        * Finds transactions that need to be dropped to make room for given entry (transactions expired as of now first,
+        * then ones with lowest priority). Nothing is removed, caller is responsible for removing returned transactions.
+        * @throw transaction_pool_full_exception when there is no room even after dropping all transactions of lower priority
+        */
+      std::vector< transaction_id_type > find_room( const entry& e, fc::time_point_sec now )const;
+
+      /// Adds new entry (replaces existing one with the same id)
+      void add( const entry& e );
+      bool remove( const transaction_id_type& id );
+      /// @return entry of given transaction or nullptr
+      const entry* find( const transaction_id_type& id )const;
+      void clear();
+
+      size_t get_transaction_count()const;
+      /// @return sum of packed sizes of all pending transactions
+      uint64_t get_total_size()const { return _total_size; }
+      uint32_t get_account_transaction_count( const account_name_type& account )const;
+
+    private:
+      std::unique_ptr< detail::pending_transaction_pool_impl > my;
+      priority_evaluator  _priority_evaluator;
+      uint32_t            _max_transactions_per_account = 0;
+      uint64_t            _max_size = 0;
+      uint64_t            _total_size = 0;
+  };
+
+} }
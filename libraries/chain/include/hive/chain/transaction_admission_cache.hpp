@@ -0,0 +1,61 @@
+#pragma once
+#include <hive/protocol/transaction.hpp>
+
+#include <fc/crypto/elliptic.hpp>
+
+#include <array>
+#include <memory>
+
+namespace hive { namespace chain {
+
+  using hive::protocol::signed_transaction;
+  using hive::protocol::transaction_id_type;
+  using hive::protocol::chain_id_type;
+  using hive::protocol::public_key_type;
+
+  namespace detail { class admission_cache_shard; }
+
+  /* Remembers results of stateless checks of transactions, so the same transaction does not need to be
+    * checked again when it arrives from another peer, is broadcast again through API or is reapplied
+    * as pending transaction after each block.
+    *
+    * Entry says that transaction passed validate() and holds public keys recovered from its signatures.
+    * Keys depend on signatures (not covered by transaction id), chain id and canonical signature type, so
+    * all of them have to match for the entry to be used. Authority check itself is not cached - it depends
+    * on state of accounts and is cheap when keys are known - so entries never need to be invalidated.
+    *
+    * Cache is split into shards with separate locks, so it can be used from helper threads (see
+    * database::set_trx_precheck_threads) while main thread applies transactions. Each shard evicts
+    * its least recently used entries when it is full.
+    */
+  class transaction_admission_cache
+  {
+    public:
+      /// capacity is the maximum number of entries in all shards together, 0 disables the cache
+      explicit transaction_admission_cache( size_t capacity = 0 );
+      ~transaction_admission_cache();
+
+      /// not thread safe, meant to be called during startup
+      void set_capacity( size_t capacity );
+      bool is_enabled()const { return _capacity > 0; }
+
+      /// @return true and fills signature_keys when given transaction was already successfully checked
+      bool find( const transaction_id_type& id, const signed_transaction& trx, const chain_id_type& chain_id,
+        fc::ecc::canonical_signature_type canon_type, flat_set< public_key_type >& signature_keys )const;
+
+      /// Records that given transaction passed validate() and its signatures resolve to given keys
+      void store( const transaction_id_type& id, const signed_transaction& trx, const chain_id_type& chain_id,
+        fc::ecc::canonical_signature_type canon_type, const flat_set< public_key_type >& signature_keys );
+
+      void clear();
+
+    private:
+      static const size_t SHARD_COUNT = 16;
+
+      detail::admission_cache_shard& get_shard( const transaction_id_type& id )const;
+
+      size_t _capacity = 0;
+      std::array< std::unique_ptr< detail::admission_cache_shard >, SHARD_COUNT > _shards;
+  };
+
+} }
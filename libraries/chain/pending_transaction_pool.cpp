@@ -0,0 +1,194 @@
+#include <hive/chain/pending_transaction_pool.hpp>
+#include <hive/chain/database_exceptions.hpp>
+
+#include <hive/protocol/operations.hpp>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/composite_key.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+
+#include <map>
+
+namespace hive { namespace chain {
+
+  namespace detail {
+
+    struct pool_entry : public pending_transaction_pool::entry
+    {
+      pool_entry( const pending_transaction_pool::entry& e, uint64_t s ) : pending_transaction_pool::entry( e ), sequence( s ) {}
+
+      uint64_t sequence = 0; // order of arrival
+    };
+
+    struct by_id;
+    struct by_priority;
+    struct by_expiration;
+
+    typedef boost::multi_index_container<
+      pool_entry,
+      boost::multi_index::indexed_by<
+        boost::multi_index::hashed_unique< boost::multi_index::tag< by_id >,
+          boost::multi_index::member< pending_transaction_pool::entry, transaction_id_type, &pending_transaction_pool::entry::id >, std::hash< fc::ripemd160 > >,
+        // least valuable first, among equally valuable the most recent one goes first
+        boost::multi_index::ordered_unique< boost::multi_index::tag< by_priority >,
+          boost::multi_index::composite_key< pool_entry,
+            boost::multi_index::member< pending_transaction_pool::entry, int64_t, &pending_transaction_pool::entry::priority >,
+            boost::multi_index::member< pool_entry, uint64_t, &pool_entry::sequence >
+          >,
+          boost::multi_index::composite_key_compare< std::less< int64_t >, std::greater< uint64_t > >
+        >,
+        boost::multi_index::ordered_non_unique< boost::multi_index::tag< by_expiration >,
+          boost::multi_index::member< pending_transaction_pool::entry, fc::time_point_sec, &pending_transaction_pool::entry::expiration > >
+      >
+    > pool_entry_index;
+
+    class pending_transaction_pool_impl
+    {
+      public:
+        pool_entry_index                          entries;
+        std::map< account_name_type, uint32_t >   account_counts;
+        uint64_t                                  next_sequence = 0;
+    };
+
+  }
+
+pending_transaction_pool::pending_transaction_pool() : my( new detail::pending_transaction_pool_impl() ) {}
+
+pending_transaction_pool::~pending_transaction_pool() {}
+
+void pending_transaction_pool::set_limits( uint32_t max_transactions_per_account, uint64_t max_size )
+{
+  _max_transactions_per_account = max_transactions_per_account;
+  _max_size = max_size;
+}
+
+int64_t pending_transaction_pool::evaluate_priority( const signed_transaction& trx )const
+{
+  return _priority_evaluator ? _priority_evaluator( trx ) : 0;
+}
+
+pending_transaction_pool::entry pending_transaction_pool::make_entry( const signed_transaction& trx, const transaction_id_type& id )
+{
+  entry e;
+  e.id = id;
+  e.size = fc::raw::pack_size( trx );
+  e.expiration = trx.expiration;
+
+  flat_set< account_name_type > req_active;
+  flat_set< account_name_type > req_owner;
+  flat_set< account_name_type > req_posting;
+  vector< hive::protocol::authority > other;
+  for( const auto& op : trx.operations )
+  {
+    hive::protocol::operation_get_required_authorities( op, req_active, req_owner, req_posting, other );
+    if( !req_active.empty() )
+      e.account = *req_active.begin();
+    else if( !req_owner.empty() )
+      e.account = *req_owner.begin();
+    else if( !req_posting.empty() )
+      e.account = *req_posting.begin();
+    else
+      continue;
+    break;
+  }
+
+  return e;
+}
+
+void pending_transaction_pool::check_account_limit( const entry& e )const
+{
+  if( _max_transactions_per_account == 0 )
+    return;
+
+  HIVE_ASSERT( get_account_transaction_count( e.account ) < _max_transactions_per_account, transaction_pool_full_exception,
+    "Account ${a} already has ${n} pending transactions, wait for them to be included in blocks",
+    ("a", e.account)("n", _max_transactions_per_account) );
+}
+
+std::vector< transaction_id_type > pending_transaction_pool::find_room( const entry& e, fc::time_point_sec now )const
+{
+  std::vector< transaction_id_type > to_remove;
+  if( _max_size == 0 || _total_size + e.size <= _max_size )
+    return to_remove;
+
+  HIVE_ASSERT( e.size <= _max_size, transaction_pool_full_exception,
+    "Transaction of size ${s} exceeds limit of all pending transactions ${m}", ("s", e.size)("m", _max_size) );
+
+  uint64_t needed = _total_size + e.size - _max_size;
+  uint64_t freed = 0;
+
+  const auto& by_expiration_idx = my->entries.get< detail::by_expiration >();
+  for( auto itr = by_expiration_idx.begin(); itr != by_expiration_idx.end() && itr->expiration < now && freed < needed; ++itr )
+  {
+    to_remove.push_back( itr->id );
+    freed += itr->size;
+  }
+
+  const auto& by_priority_idx = my->entries.get< detail::by_priority >();
+  for( auto itr = by_priority_idx.begin(); itr != by_priority_idx.end() && freed < needed; ++itr )
+  {
+    if( itr->expiration < now )
+      continue; // already taken above
+
+    HIVE_ASSERT( itr->priority < e.priority, transaction_pool_full_exception,
+      "Pending transactions reached size limit of ${m} bytes and transaction does not have higher priority than any of them",
+      ("m", _max_size) );
+
+    to_remove.push_back( itr->id );
+    freed += itr->size;
+  }
+
+  return to_remove;
+}
+
+void pending_transaction_pool::add( const entry& e )
+{
+  remove( e.id );
+  my->entries.emplace( e, my->next_sequence++ );
+  ++my->account_counts[ e.account ];
+  _total_size += e.size;
+}
+
+bool pending_transaction_pool::remove( const transaction_id_type& id )
+{
+  auto& by_id_idx = my->entries.get< detail::by_id >();
+  auto itr = by_id_idx.find( id );
+  if( itr == by_id_idx.end() )
+    return false;
+
+  auto count_itr = my->account_counts.find( itr->account );
+  if( --count_itr->second == 0 )
+    my->account_counts.erase( count_itr );
+  _total_size -= itr->size;
+  by_id_idx.erase( itr );
+  return true;
+}
+
+const pending_transaction_pool::entry* pending_transaction_pool::find( const transaction_id_type& id )const
+{
+  const auto& by_id_idx = my->entries.get< detail::by_id >();
+  auto itr = by_id_idx.find( id );
+  return itr == by_id_idx.end() ? nullptr : &*itr;
+}
+
+void pending_transaction_pool::clear()
+{
+  my->entries.clear();
+  my->account_counts.clear();
+  _total_size = 0;
+}
+
+size_t pending_transaction_pool::get_transaction_count()const
+{
+  return my->entries.size();
+}
+
+uint32_t pending_transaction_pool::get_account_transaction_count( const account_name_type& account )const
+{
+  auto itr = my->account_counts.find( account );
+  return itr == my->account_counts.end() ? 0 : itr->second;
+}
+
+} } // hive::chain
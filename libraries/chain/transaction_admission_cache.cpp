@@ -0,0 +1,126 @@
+#include <hive/chain/transaction_admission_cache.hpp>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/sequenced_index.hpp>
+
+#include <mutex>
+
+namespace hive { namespace chain {
+
+  namespace detail {
+
+    struct admission_cache_entry
+    {
+      transaction_id_type                   id;
+      chain_id_type                         chain_id;
+      fc::ecc::canonical_signature_type     canon_type;
+      vector< hive::protocol::signature_type > signatures;
+      flat_set< public_key_type >           signature_keys;
+    };
+
+    struct by_id;
+
+    typedef boost::multi_index_container<
+      admission_cache_entry,
+      boost::multi_index::indexed_by<
+        boost::multi_index::sequenced<>, // most recently used first
+        boost::multi_index::hashed_unique< boost::multi_index::tag< by_id >,
+          boost::multi_index::member< admission_cache_entry, transaction_id_type, &admission_cache_entry::id >, std::hash< fc::ripemd160 > >
+      >
+    > admission_cache_index;
+
+    class admission_cache_shard
+    {
+      public:
+        std::mutex            mutex;
+        admission_cache_index entries;
+        size_t                capacity = 0;
+    };
+
+  }
+
+transaction_admission_cache::transaction_admission_cache( size_t capacity )
+{
+  for( auto& shard : _shards )
+    shard.reset( new detail::admission_cache_shard() );
+  set_capacity( capacity );
+}
+
+transaction_admission_cache::~transaction_admission_cache() {}
+
+void transaction_admission_cache::set_capacity( size_t capacity )
+{
+  _capacity = capacity;
+  size_t shard_capacity = ( capacity + SHARD_COUNT - 1 ) / SHARD_COUNT;
+  for( auto& shard : _shards )
+  {
+    std::lock_guard< std::mutex > guard( shard->mutex );
+    shard->capacity = shard_capacity;
+    while( shard->entries.size() > shard_capacity )
+      shard->entries.pop_back();
+  }
+}
+
+detail::admission_cache_shard& transaction_admission_cache::get_shard( const transaction_id_type& id )const
+{
+  // transaction id is a hash, so any part of it distributes evenly
+  return *_shards[ id._hash[0] % SHARD_COUNT ];
+}
+
+bool transaction_admission_cache::find( const transaction_id_type& id, const signed_transaction& trx, const chain_id_type& chain_id,
+  fc::ecc::canonical_signature_type canon_type, flat_set< public_key_type >& signature_keys )const
+{
+  if( !is_enabled() )
+    return false;
+
+  auto& shard = get_shard( id );
+  std::lock_guard< std::mutex > guard( shard.mutex );
+  auto& by_id_idx = shard.entries.get< detail::by_id >();
+  auto itr = by_id_idx.find( id );
+  if( itr == by_id_idx.end() )
+    return false;
+  // the same transaction could have been signed differently (transaction id does not cover signatures)
+  if( itr->chain_id != chain_id || itr->canon_type != canon_type || itr->signatures != trx.signatures )
+    return false;
+
+  signature_keys = itr->signature_keys;
+  shard.entries.relocate( shard.entries.begin(), shard.entries.project< 0 >( itr ) );
+  return true;
+}
+
+void transaction_admission_cache::store( const transaction_id_type& id, const signed_transaction& trx, const chain_id_type& chain_id,
+  fc::ecc::canonical_signature_type canon_type, const flat_set< public_key_type >& signature_keys )
+{
+  if( !is_enabled() )
+    return;
+
+  detail::admission_cache_entry entry { id, chain_id, canon_type, trx.signatures, signature_keys };
+
+  auto& shard = get_shard( id );
+  std::lock_guard< std::mutex > guard( shard.mutex );
+  auto& by_id_idx = shard.entries.get< detail::by_id >();
+  auto itr = by_id_idx.find( id );
+  if( itr != by_id_idx.end() )
+  {
+    by_id_idx.replace( itr, std::move( entry ) );
+    shard.entries.relocate( shard.entries.begin(), shard.entries.project< 0 >( itr ) );
+    return;
+  }
+
+  shard.entries.push_front( std::move( entry ) );
+  while( shard.entries.size() > shard.capacity )
+    shard.entries.pop_back();
+}
+
+void transaction_admission_cache::clear()
+{
+  for( auto& shard : _shards )
+  {
+    std::lock_guard< std::mutex > guard( shard->mutex );
+    shard->entries.clear();
+  }
+}
+
+} } // hive::chain
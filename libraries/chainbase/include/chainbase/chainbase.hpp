@@ -378,6 +378,51 @@ namespace chainbase {
         }
       }
 
+      /**
+        * Brings back object previously moved to external storage, keeping its original ID.
+        * Reinsertion is recorded in current undo state (if any), so undoing it just drops the
+        * object from the index again - external storage is expected to still hold its copy.
+        */
+      const value_type& restore_from_external_storage( id_type objectId, std::function<void(value_type&)>&& unpack )
+      {
+        if( !( objectId < _next_id ) )
+          CHAINBASE_THROW_EXCEPTION( std::logic_error( "cannot restore object with id that was never allocated" ) );
+
+        value_type tmp( _indices.get_allocator(), objectId.get_value(), std::move( unpack ) );
+        auto insert_result = _indices.emplace( std::move( tmp ) );
+
+        if( !insert_result.second )
+          CHAINBASE_THROW_EXCEPTION( std::logic_error( "could not restore object, most likely it is already present in the index" ) );
+
+        on_create( *insert_result.first );
+        return *insert_result.first;
+      }
+
+      /**
+        * Builds standalone copy of object kept in external storage, without adding it to the index, so it can
+        * be used by readers that are not allowed to modify state. Only suitable for objects that don't hold
+        * members allocated in shared memory.
+        */
+      std::unique_ptr< value_type > load_from_external_storage( id_type objectId, std::function<void(value_type&)>&& unpack )const
+      {
+        return std::unique_ptr< value_type >( new value_type( _indices.get_allocator(), objectId.get_value(), std::move( unpack ) ) );
+      }
+
+      /**
+        * Tells if any of the undo states holds information about object with given ID. Objects that are
+        * not referenced by undo states can be safely moved to external storage even when there are
+        * reversible changes pending.
+        */
+      bool is_in_undo_state( id_type objectId )const
+      {
+        for( const auto& state : _stack )
+        {
+          if( state.new_ids.count( objectId ) || state.old_values.count( objectId ) || state.removed_values.count( objectId ) )
+            return true;
+        }
+        return false;
+      }
+
       template<typename CompatibleKey>
       const value_type* find( CompatibleKey&& key )const {
         auto itr = _indices.find( std::forward<CompatibleKey>( key ) );
@@ -24,6 +24,14 @@ class sha256
     static sha256 hash( const string& );
     static sha256 hash( const sha256& );
 
+    /**
+     * Computes hashes of count independent messages, results[i] = hash( data[i], sizes[i] ).
+     * When CPU has AVX2 but no SHA extensions (which OpenSSL uses on its own), messages are
+     * processed in groups of 8 by multi-buffer implementation. Otherwise it is the same as
+     * calling hash() in a loop.
+     */
+    static void hash_many( const char* const* data, const uint32_t* sizes, sha256* results, size_t count );
+
     template<typename T>
     static sha256 hash( const T& t )
     {
@@ -106,6 +114,13 @@ class sha256
 
   uint64_t hash64(const char* buf, size_t len);
 
+  namespace detail {
+    /// tells if sha256_multi_buffer can be used on current CPU (AVX2)
+    bool sha256_multi_buffer_supported();
+    /// multi-buffer implementation behind sha256::hash_many (exposed for tests and benchmarks)
+    void sha256_multi_buffer( const char* const* data, const uint32_t* sizes, sha256* results, size_t count );
+  }
+
 } // fc
 namespace std
 {
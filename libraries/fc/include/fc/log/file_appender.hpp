@@ -9,6 +9,9 @@ namespace fc {
 
 class file_appender : public appender {
     public:
+         /// what logging thread does when its queue of asynchronous appender is full
+         struct overflow_policy { enum type { drop, block }; };
+
          struct config {
             config( const fc::path& p = "log.txt" );
 
@@ -19,11 +22,19 @@ class file_appender : public appender {
             microseconds                       rotation_interval;
             microseconds                       rotation_limit;
             appender::time_format              time_format = appender::time_format::iso_8601_seconds;
+            /// when set, messages are queued by logging threads and formatted/written by background thread
+            bool                               async = false;
+            /// capacity of message queue of each logging thread (async only)
+            uint32_t                           queue_size = 8192;
+            overflow_policy::type              overflow = overflow_policy::drop;
          };
          file_appender( const variant& args );
          ~file_appender();
          virtual void log( const log_message& m )override;
 
+         /// number of message queues of logging threads (async only), queue of exited thread is released once written
+         size_t thread_queue_count()const;
+
       private:
          class impl;
          fc::shared_ptr<impl> my;
@@ -31,5 +42,7 @@ class file_appender : public appender {
 } // namespace fc
 
 #include <fc/reflect/reflect.hpp>
+FC_REFLECT_ENUM( fc::file_appender::overflow_policy::type, (drop)(block) )
 FC_REFLECT( fc::file_appender::config,
-            (format)(filename)(flush)(rotate)(rotation_interval)(rotation_limit)(time_format) )
+            (format)(filename)(flush)(rotate)(rotation_interval)(rotation_limit)(time_format)
+            (async)(queue_size)(overflow) )
@@ -6,7 +6,9 @@
 #include <fc/time.hpp>
 #include <fc/variant_object.hpp>
 #include <fc/shared_ptr.hpp>
+#include <atomic>
 #include <memory>
+#include <vector>
 
 #include <boost/preprocessor/seq/for_each.hpp>
 #include <boost/preprocessor/stringize.hpp>
@@ -92,6 +94,70 @@ namespace fc
    void to_variant( const log_context& l, variant& v );
    void from_variant( const variant& l, log_context& c );
 
+   /**
+    *  @brief format string of log message split into literal text and "${key}" references.
+    *
+    *  Produces the same text as fc::format_string, but the format is scanned only once, so log
+    *  statements can reuse it for every message they generate (see FC_LOG_FORMAT).
+    */
+   class log_format
+   {
+      public:
+         explicit log_format( std::string format );
+
+         const std::string& get_format()const { return _format; }
+         std::string        format( const variant_object& args )const;
+
+      private:
+         struct segment
+         {
+            std::string text;   ///< literal text or name of the key
+            bool        is_key;
+         };
+
+         std::string            _format;
+         std::vector<segment>   _segments;
+   };
+
+   typedef std::shared_ptr<const log_format> log_format_ptr;
+
+   namespace detail
+   {
+      /**
+       *  Parsed format of single log statement.  Only string literals are cached, since their address
+       *  and content is the same on every call, other formats are parsed for every message.
+       */
+      class log_format_cache
+      {
+         public:
+            template<size_t N>
+            log_format_ptr get( const char (&format)[N] )
+            {
+               log_format_ptr cached = std::atomic_load( &_cached );
+               if( cached && _key.load( std::memory_order_acquire ) == format )
+                  return cached;
+
+               log_format_ptr parsed = std::make_shared<const log_format>( format );
+               if( !cached )
+               {
+                  std::atomic_store( &_cached, parsed );
+                  _key.store( format, std::memory_order_release );
+               }
+               return parsed;
+            }
+
+            /// mutable buffer can hold different text on every call
+            template<size_t N>
+            log_format_ptr get( char (&format)[N] ) { return std::make_shared<const log_format>( format ); }
+
+            log_format_ptr get( std::string format ) { return std::make_shared<const log_format>( std::move( format ) ); }
+
+         private:
+            log_format_ptr             _cached;
+            std::atomic<const char*>   _key{ nullptr };
+      };
+   }
+
    /**
     *  @brief aggregates a message along with the context and associated meta-information.
     *  @ingroup AthenaSerializable
@@ -118,6 +184,10 @@ namespace fc
           *  @param ctx - generally provided using the FC_LOG_CONTEXT(LEVEL) macro 
           */
          log_message( log_context ctx, std::string format, variant_object args = variant_object() );
+         /**
+          *  @param format - preparsed format, generally provided using the FC_LOG_FORMAT(FORMAT) macro
+          */
+         log_message( log_context ctx, log_format_ptr format, variant_object args = variant_object() );
          ~log_message();
 
          log_message( const variant& v );
@@ -155,7 +225,15 @@ FC_REFLECT_TYPENAME( fc::log_message );
  */
 #define FC_LOG_CONTEXT(LOG_LEVEL) \
    fc::log_context( fc::log_level::LOG_LEVEL, __FILE__, __LINE__, __func__ )
-   
+
+/**
+ * @def FC_LOG_FORMAT(FORMAT)
+ * @brief Parses FORMAT into fc::log_format, reusing result of previous parse done at the same place
+ *        when FORMAT is a string literal.
+ */
+#define FC_LOG_FORMAT(FORMAT) \
+   []() -> fc::detail::log_format_cache& { static fc::detail::log_format_cache cache; return cache; }().get( FORMAT )
+
 /**
  * @def FC_LOG_MESSAGE(LOG_LEVEL,FORMAT,...)
  *
@@ -170,9 +248,9 @@ FC_REFLECT_TYPENAME( fc::log_message );
 #define FC_LOG_MESSAGE_GENERATE_PARAMETER_NAMES_IF_NEEDED(r, data, PARAMETER_AND_MAYBE_NAME) BOOST_PP_IF(BOOST_PP_EQUAL(BOOST_PP_VARIADIC_SIZE PARAMETER_AND_MAYBE_NAME,1),FC_LOG_MESSAGE_GENERATE_PARAMETER_NAME,FC_LOG_MESSAGE_DONT_GENERATE_PARAMETER_NAME)PARAMETER_AND_MAYBE_NAME
 
 #define FC_LOG_MESSAGE_STRING_ONLY(LOG_LEVEL, FORMAT) \
-   fc::log_message(FC_LOG_CONTEXT(LOG_LEVEL), FORMAT, fc::variant_object())
+   fc::log_message(FC_LOG_CONTEXT(LOG_LEVEL), FC_LOG_FORMAT(FORMAT), fc::variant_object())
 #define FC_LOG_MESSAGE_WITH_SUBSTITUTIONS(LOG_LEVEL, FORMAT, ...) \
-   fc::log_message(FC_LOG_CONTEXT(LOG_LEVEL), FORMAT, fc::mutable_variant_object() BOOST_PP_SEQ_FOR_EACH(FC_LOG_MESSAGE_GENERATE_PARAMETER_NAMES_IF_NEEDED, _, BOOST_PP_VARIADIC_SEQ_TO_SEQ(__VA_ARGS__)))
+   fc::log_message(FC_LOG_CONTEXT(LOG_LEVEL), FC_LOG_FORMAT(FORMAT), fc::mutable_variant_object() BOOST_PP_SEQ_FOR_EACH(FC_LOG_MESSAGE_GENERATE_PARAMETER_NAMES_IF_NEEDED, _, BOOST_PP_VARIADIC_SEQ_TO_SEQ(__VA_ARGS__)))
 
 
 #define FC_LOG_MESSAGE(LOG_LEVEL, ...) \
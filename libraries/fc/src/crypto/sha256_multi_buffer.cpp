@@ -0,0 +1,271 @@
+#include <fc/crypto/sha256.hpp>
+#include <fc/exception/exception.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#if defined( __x86_64__ ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+#define FC_SHA256_MULTI_BUFFER
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace fc {
+
+#ifdef FC_SHA256_MULTI_BUFFER
+
+namespace {
+
+const uint32_t round_constants[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+const uint32_t initial_state[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+const size_t LANES = 8;
+
+/// Message as seen by one lane: full blocks are read directly from input, the rest (with padding) from tail.
+struct lane_message
+{
+  const uint8_t* data = nullptr;
+  size_t         full_blocks = 0;
+  size_t         total_blocks = 0;
+  uint8_t        tail[128];
+
+  void init( const char* d, uint32_t size )
+  {
+    data = reinterpret_cast< const uint8_t* >( d );
+    full_blocks = size / 64;
+    size_t rest = size % 64;
+    total_blocks = full_blocks + ( rest + 9 <= 64 ? 1 : 2 );
+
+    memset( tail, 0, sizeof( tail ) );
+    if( rest != 0 )
+      memcpy( tail, data + 64 * full_blocks, rest );
+    tail[ rest ] = 0x80;
+    uint64_t bit_size = uint64_t( size ) * 8;
+    size_t tail_end = 64 * ( total_blocks - full_blocks );
+    for( size_t i = 0; i < 8; ++i )
+      tail[ tail_end - 1 - i ] = uint8_t( bit_size >> ( 8 * i ) );
+  }
+
+  const uint8_t* block( size_t b )const
+  {
+    if( b < full_blocks )
+      return data + 64 * b;
+    if( b < total_blocks )
+      return tail + 64 * ( b - full_blocks );
+    return tail; // lane is already finished (or unused), what it computes is ignored
+  }
+};
+
+inline uint32_t load_be32( const uint8_t* p )
+{
+  return ( uint32_t( p[0] ) << 24 ) | ( uint32_t( p[1] ) << 16 ) | ( uint32_t( p[2] ) << 8 ) | uint32_t( p[3] );
+}
+
+#define MB_ADD( x, y ) _mm256_add_epi32( (x), (y) )
+#define MB_XOR( x, y ) _mm256_xor_si256( (x), (y) )
+#define MB_ROTR( x, n ) _mm256_or_si256( _mm256_srli_epi32( (x), (n) ), _mm256_slli_epi32( (x), 32 - (n) ) )
+
+/// processes block b of all lanes
+__attribute__(( target( "avx2" ) ))
+void compress_x8( __m256i* state, const lane_message* lanes, size_t b )
+{
+  const uint8_t* p[ LANES ];
+  for( size_t l = 0; l < LANES; ++l )
+    p[l] = lanes[l].block( b );
+
+  __m256i w[16];
+  for( int t = 0; t < 16; ++t )
+  {
+    w[t] = _mm256_setr_epi32( load_be32( p[0] + 4 * t ), load_be32( p[1] + 4 * t ), load_be32( p[2] + 4 * t ), load_be32( p[3] + 4 * t ),
+                              load_be32( p[4] + 4 * t ), load_be32( p[5] + 4 * t ), load_be32( p[6] + 4 * t ), load_be32( p[7] + 4 * t ) );
+  }
+
+  __m256i a = state[0], b_ = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+
+  for( int t = 0; t < 64; ++t )
+  {
+    __m256i wt;
+    if( t < 16 )
+    {
+      wt = w[t];
+    }
+    else
+    {
+      __m256i w15 = w[ ( t - 15 ) & 15 ];
+      __m256i w2 = w[ ( t - 2 ) & 15 ];
+      __m256i s0 = MB_XOR( MB_XOR( MB_ROTR( w15, 7 ), MB_ROTR( w15, 18 ) ), _mm256_srli_epi32( w15, 3 ) );
+      __m256i s1 = MB_XOR( MB_XOR( MB_ROTR( w2, 17 ), MB_ROTR( w2, 19 ) ), _mm256_srli_epi32( w2, 10 ) );
+      wt = w[ t & 15 ] = MB_ADD( MB_ADD( w[ t & 15 ], s0 ), MB_ADD( w[ ( t - 7 ) & 15 ], s1 ) );
+    }
+
+    __m256i sum1 = MB_XOR( MB_XOR( MB_ROTR( e, 6 ), MB_ROTR( e, 11 ) ), MB_ROTR( e, 25 ) );
+    __m256i ch = MB_XOR( _mm256_and_si256( e, f ), _mm256_andnot_si256( e, g ) );
+    __m256i t1 = MB_ADD( MB_ADD( MB_ADD( h, sum1 ), MB_ADD( ch, _mm256_set1_epi32( round_constants[t] ) ) ), wt );
+    __m256i sum0 = MB_XOR( MB_XOR( MB_ROTR( a, 2 ), MB_ROTR( a, 13 ) ), MB_ROTR( a, 22 ) );
+    __m256i maj = _mm256_or_si256( _mm256_and_si256( a, b_ ), _mm256_and_si256( c, _mm256_or_si256( a, b_ ) ) );
+    __m256i t2 = MB_ADD( sum0, maj );
+
+    h = g;
+    g = f;
+    f = e;
+    e = MB_ADD( d, t1 );
+    d = c;
+    c = b_;
+    b_ = a;
+    a = MB_ADD( t1, t2 );
+  }
+
+  state[0] = MB_ADD( state[0], a );
+  state[1] = MB_ADD( state[1], b_ );
+  state[2] = MB_ADD( state[2], c );
+  state[3] = MB_ADD( state[3], d );
+  state[4] = MB_ADD( state[4], e );
+  state[5] = MB_ADD( state[5], f );
+  state[6] = MB_ADD( state[6], g );
+  state[7] = MB_ADD( state[7], h );
+}
+
+#undef MB_ADD
+#undef MB_XOR
+#undef MB_ROTR
+
+/// hashes up to 8 messages; lanes with null result are unused
+__attribute__(( target( "avx2" ) ))
+void hash_x8( const lane_message* lanes, sha256* const* results )
+{
+  __m256i state[8];
+  for( int i = 0; i < 8; ++i )
+    state[i] = _mm256_set1_epi32( initial_state[i] );
+
+  size_t max_blocks = 0;
+  for( size_t l = 0; l < LANES; ++l )
+  {
+    if( results[l] != nullptr )
+      max_blocks = std::max( max_blocks, lanes[l].total_blocks );
+  }
+
+  for( size_t b = 0; b < max_blocks; ++b )
+  {
+    compress_x8( state, lanes, b );
+
+    bool any_finished = false;
+    for( size_t l = 0; l < LANES; ++l )
+      any_finished |= results[l] != nullptr && lanes[l].total_blocks == b + 1;
+    if( !any_finished )
+      continue;
+
+    alignas( 32 ) uint32_t words[8][ LANES ];
+    for( int i = 0; i < 8; ++i )
+      _mm256_store_si256( reinterpret_cast< __m256i* >( words[i] ), state[i] );
+
+    for( size_t l = 0; l < LANES; ++l )
+    {
+      if( results[l] == nullptr || lanes[l].total_blocks != b + 1 )
+        continue;
+      uint8_t* out = reinterpret_cast< uint8_t* >( results[l]->data() );
+      for( int i = 0; i < 8; ++i )
+      {
+        out[ 4 * i ]     = uint8_t( words[i][l] >> 24 );
+        out[ 4 * i + 1 ] = uint8_t( words[i][l] >> 16 );
+        out[ 4 * i + 2 ] = uint8_t( words[i][l] >> 8 );
+        out[ 4 * i + 3 ] = uint8_t( words[i][l] );
+      }
+    }
+  }
+}
+
+bool sha_extensions_supported()
+{
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  return __get_cpuid_count( 7, 0, &eax, &ebx, &ecx, &edx ) && ( ebx & ( 1u << 29 ) );
+}
+
+} // namespace
+
+namespace detail {
+
+  bool sha256_multi_buffer_supported()
+  {
+    static const bool supported = __builtin_cpu_supports( "avx2" );
+    return supported;
+  }
+
+  void sha256_multi_buffer( const char* const* data, const uint32_t* sizes, sha256* results, size_t count )
+  {
+    FC_ASSERT( sha256_multi_buffer_supported() );
+
+    // lanes work in lockstep, so messages of similar length are put together to waste as little work as possible
+    std::vector< size_t > order( count );
+    std::iota( order.begin(), order.end(), 0 );
+    std::stable_sort( order.begin(), order.end(), [&]( size_t l, size_t r ) { return sizes[l] / 64 < sizes[r] / 64; } );
+
+    for( size_t first = 0; first < count; first += LANES )
+    {
+      lane_message lanes[ LANES ] {};
+      sha256* lane_results[ LANES ] = {};
+      for( size_t l = 0; l < LANES && first + l < count; ++l )
+      {
+        size_t i = order[ first + l ];
+        lanes[l].init( data[i], sizes[i] );
+        lane_results[l] = &results[i];
+      }
+      hash_x8( lanes, lane_results );
+    }
+  }
+
+} // detail
+
+void sha256::hash_many( const char* const* data, const uint32_t* sizes, sha256* results, size_t count )
+{
+  // OpenSSL uses SHA extensions when available and they beat multi-buffer AVX2 code
+  static const bool use_multi_buffer = detail::sha256_multi_buffer_supported() && !sha_extensions_supported();
+
+  if( use_multi_buffer && count > 1 )
+  {
+    detail::sha256_multi_buffer( data, sizes, results, count );
+    return;
+  }
+
+  for( size_t i = 0; i < count; ++i )
+    results[i] = hash( data[i], sizes[i] );
+}
+
+#else // FC_SHA256_MULTI_BUFFER
+
+namespace detail {
+
+  bool sha256_multi_buffer_supported()
+  {
+    return false;
+  }
+
+  void sha256_multi_buffer( const char* const* data, const uint32_t* sizes, sha256* results, size_t count )
+  {
+    FC_THROW_EXCEPTION( assert_exception, "Multi-buffer SHA256 is not available on this platform" );
+  }
+
+} // detail
+
+void sha256::hash_many( const char* const* data, const uint32_t* sizes, sha256* results, size_t count )
+{
+  for( size_t i = 0; i < count; ++i )
+    results[i] = hash( data[i], sizes[i] );
+}
+
+#endif // FC_SHA256_MULTI_BUFFER
+
+} // fc
@@ -182,7 +182,7 @@ namespace fc
       for( auto itr = my->_elog.begin(); itr != my->_elog.end(); ++itr )
       {
          if( itr->get_format().size() )
-            ss << fc::format_string( itr->get_format(), itr->get_data() );
+            ss << itr->get_message();
       }
       return ss.str();
    }
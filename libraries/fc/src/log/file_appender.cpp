@@ -6,13 +6,75 @@
 #include <fc/thread/thread.hpp>
 #include <fc/variant.hpp>
 #include <boost/thread/mutex.hpp>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <iomanip>
+#include <memory>
+#include <mutex>
 #include <queue>
 #include <sstream>
 #include <iostream>
+#include <thread>
+#include <unordered_map>
 
 namespace fc {
 
+   namespace detail
+   {
+      /**
+       *  Bounded queue of messages logged by single thread, drained by writer thread of asynchronous
+       *  file_appender.  Since there is exactly one producer and one consumer it needs no locking.
+       */
+      class log_message_ring
+      {
+         public:
+            explicit log_message_ring( uint32_t capacity ) : _slots( capacity + 1 ) {}
+
+            /// called by owning thread only, false when queue is full
+            bool push( const log_message& m )
+            {
+               size_t tail = _tail.load( std::memory_order_relaxed );
+               size_t next = advance( tail );
+               if( next == _head.load( std::memory_order_acquire ) )
+                  return false;
+               _slots[ tail ] = m;
+               _tail.store( next, std::memory_order_release );
+               return true;
+            }
+
+            /// called by writer thread only, false when queue is empty
+            bool pop( std::vector<log_message>& out )
+            {
+               size_t head = _head.load( std::memory_order_relaxed );
+               if( head == _tail.load( std::memory_order_acquire ) )
+                  return false;
+               out.push_back( *_slots[ head ] );
+               _slots[ head ].reset(); // don't keep message data alive until slot is reused
+               _head.store( advance( head ), std::memory_order_release );
+               return true;
+            }
+
+            /// called by owning thread when it exits, nothing is pushed afterwards
+            void retire() { _retired.store( true, std::memory_order_release ); }
+
+            /// called by writer thread, true when owning thread exited and all its messages were taken
+            bool drained()const
+            {
+               return _retired.load( std::memory_order_acquire ) &&
+                  _head.load( std::memory_order_relaxed ) == _tail.load( std::memory_order_acquire );
+            }
+
+         private:
+            size_t advance( size_t i )const { return i + 1 == _slots.size() ? 0 : i + 1; }
+
+            std::vector< fc::optional<log_message> > _slots;
+            std::atomic<size_t>                      _head{ 0 };
+            std::atomic<size_t>                      _tail{ 0 };
+            std::atomic<bool>                        _retired{ false };
+      };
+   }
+
    class file_appender::impl : public fc::retainable
    {
       public:
@@ -21,6 +83,30 @@ namespace fc {
          boost::mutex               slock;
 
       private:
+         typedef std::shared_ptr<detail::log_message_ring> ring_ptr;
+
+         /// rings of single thread, one per asynchronous appender; retired when the thread exits
+         struct thread_rings
+         {
+            std::unordered_map<uint64_t, ring_ptr> rings;
+
+            ~thread_rings()
+            {
+               for( auto& r : rings )
+                  r.second->retire();
+            }
+         };
+
+         /// distinguishes appenders in per thread ring lookup (address could be reused by new appender)
+         const uint64_t                         _id;
+         std::mutex                             _rings_mutex;
+         std::vector<ring_ptr>                  _rings;
+         std::atomic<uint64_t>                  _dropped{ 0 };
+         std::atomic<bool>                      _stopping{ false };
+         std::mutex                             _wakeup_mutex;
+         std::condition_variable                _wakeup;
+         std::thread                            _writer;
+
          future<void>               _rotation_task;
          time_point_sec             _current_file_start_time;
 
@@ -32,7 +118,7 @@ namespace fc {
          }
 
       public:
-         impl( const config& c) : cfg( c )
+         impl( const config& c) : cfg( c ), _id( next_id() )
          {
              if( cfg.rotate )
              {
@@ -48,6 +134,7 @@ namespace fc {
 
          ~impl()
          {
+            stop_writer();
             try
             {
               _rotation_task.cancel_and_wait("file_appender is destructing");
@@ -129,6 +216,172 @@ namespace fc {
                                         _current_file_start_time + cfg.rotation_interval.to_seconds(),
                                         "rotate_files(3)" );
          }
+
+         // MS THREAD METHOD  MESSAGE \t\t\t File:Line
+         string format_line( const log_message& m )const
+         {
+            std::stringstream line;
+            line << appender::format_time_as_string(m.get_context().get_timestamp(), cfg.time_format);
+            line << " " << std::setw( 21 ) << (m.get_context().get_task_name()).c_str() << " ";
+
+            string method_name = m.get_context().get_method();
+            // strip all leading scopes...
+            if( method_name.size() )
+            {
+               uint32_t p = 0;
+               for( uint32_t i = 0;i < method_name.size(); ++i )
+               {
+                   if( method_name[i] == ':' ) p = i;
+               }
+
+               if( method_name[p] == ':' )
+                 ++p;
+               line << std::setw( 20 ) << m.get_context().get_method().substr(p,20).c_str() <<" ";
+            }
+
+            line << "] ";
+            fc::string message = m.get_message();
+            line << message.c_str();
+            line << "\t\t\t" << m.get_context().get_file() << ":" << m.get_context().get_line_number() << "\n";
+            return line.str();
+         }
+
+         void write( const string& lines )
+         {
+            fc::scoped_lock<boost::mutex> lock( slock );
+            out << lines;
+            if( cfg.flush )
+              out.flush();
+         }
+
+         void start_writer()
+         {
+            FC_ASSERT( cfg.queue_size > 0 );
+            _writer = std::thread( [this]() { writer_loop(); } );
+         }
+
+         /// async path: only touches queue of the calling thread (unless it has to wait for writer)
+         void enqueue( const log_message& m )
+         {
+            detail::log_message_ring& ring = get_thread_ring();
+            if( ring.push( m ) )
+               return;
+
+            if( cfg.overflow == overflow_policy::drop )
+            {
+               _dropped.fetch_add( 1, std::memory_order_relaxed );
+               return;
+            }
+
+            do
+            {
+               _wakeup.notify_one();
+               std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+            }
+            while( !ring.push( m ) );
+         }
+
+         size_t thread_queue_count()
+         {
+            std::lock_guard<std::mutex> lock( _rings_mutex );
+            return _rings.size();
+         }
+
+      private:
+         static uint64_t next_id()
+         {
+            static std::atomic<uint64_t> id{ 0 };
+            return ++id;
+         }
+
+         detail::log_message_ring& get_thread_ring()
+         {
+            static thread_local thread_rings this_thread_rings;
+            ring_ptr& ring = this_thread_rings.rings[ _id ];
+            if( !ring )
+            {
+               ring = std::make_shared<detail::log_message_ring>( cfg.queue_size );
+               std::lock_guard<std::mutex> lock( _rings_mutex );
+               _rings.push_back( ring );
+            }
+            return *ring;
+         }
+
+         void writer_loop()
+         {
+            std::vector<ring_ptr> rings;
+            std::vector<log_message> batch;
+            while( true )
+            {
+               bool stopping = _stopping.load();
+               {
+                  std::lock_guard<std::mutex> lock( _rings_mutex );
+                  rings = _rings;
+               }
+               bool retired = false;
+               for( const ring_ptr& ring : rings )
+               {
+                  while( batch.size() < cfg.queue_size && ring->pop( batch ) );
+                  retired |= ring->drained();
+               }
+               if( retired )
+               {
+                  // rings of exited threads won't get new messages
+                  std::lock_guard<std::mutex> lock( _rings_mutex );
+                  _rings.erase( std::remove_if( _rings.begin(), _rings.end(),
+                     []( const ring_ptr& ring ) { return ring->drained(); } ), _rings.end() );
+               }
+               rings.clear();
+
+               uint64_t dropped = _dropped.exchange( 0 );
+               if( batch.empty() && dropped == 0 )
+               {
+                  if( stopping )
+                     break;
+                  std::unique_lock<std::mutex> lock( _wakeup_mutex );
+                  _wakeup.wait_for( lock, std::chrono::milliseconds( 10 ) );
+                  continue;
+               }
+
+               // messages of different threads were taken queue by queue
+               std::stable_sort( batch.begin(), batch.end(), []( const log_message& a, const log_message& b )
+               {
+                  return a.get_context().get_timestamp() < b.get_context().get_timestamp();
+               } );
+
+               string lines;
+               for( const log_message& m : batch )
+               {
+                  try
+                  {
+                     lines += format_line( m );
+                  }
+                  catch( ... )
+                  {
+                  }
+               }
+               if( dropped != 0 )
+                  lines += "file_appender: " + fc::to_string( dropped ) + " log messages dropped because logging queue was full\n";
+               batch.clear();
+
+               try
+               {
+                  write( lines );
+               }
+               catch( ... )
+               {
+               }
+            }
+         }
+
+         void stop_writer()
+         {
+            if( !_writer.joinable() )
+               return;
+            _stopping.store( true );
+            _wakeup.notify_one();
+            _writer.join();
+         }
    };
 
    file_appender::config::config(const fc::path& p) :
@@ -153,46 +406,24 @@ namespace fc {
       {
          std::cerr << "error opening log file: " << my->cfg.filename.preferred_string() << "\n";
       }
+
+      if( my->cfg.async )
+         my->start_writer();
    }
 
    file_appender::~file_appender(){}
 
-   // MS THREAD METHOD  MESSAGE \t\t\t File:Line
-   void file_appender::log( const log_message& m )
+   size_t file_appender::thread_queue_count()const
    {
-      std::stringstream line;
-      line << appender::format_time_as_string(m.get_context().get_timestamp(), my->cfg.time_format);
-      line << " " << std::setw( 21 ) << (m.get_context().get_task_name()).c_str() << " ";
-
-      string method_name = m.get_context().get_method();
-      // strip all leading scopes...
-      if( method_name.size() )
-      {
-         uint32_t p = 0;
-         for( uint32_t i = 0;i < method_name.size(); ++i )
-         {
-             if( method_name[i] == ':' ) p = i;
-         }
-
-         if( method_name[p] == ':' )
-           ++p;
-         line << std::setw( 20 ) << m.get_context().get_method().substr(p,20).c_str() <<" ";
-      }
-
-      line << "] ";
-      fc::string message = fc::format_string( m.get_format(), m.get_data() );
-      line << message.c_str();
-
-      //fc::variant lmsg(m);
-
-      // fc::string fmt_str = fc::format_string( my->cfg.format, mutable_variant_object(m.get_context())( "message", message)  );
+      return my->thread_queue_count();
+   }
 
-      {
-        fc::scoped_lock<boost::mutex> lock( my->slock );
-        my->out << line.str() << "\t\t\t" << m.get_context().get_file() << ":" << m.get_context().get_line_number() << "\n";
-        if( my->cfg.flush )
-          my->out.flush();
-      }
+   void file_appender::log( const log_message& m )
+   {
+      if( my->cfg.async )
+         my->enqueue( m );
+      else
+         my->write( my->format_line( m ) );
    }
 
 } // fc
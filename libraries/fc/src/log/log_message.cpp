@@ -34,6 +34,7 @@ namespace fc
 
             log_context     context;
             string          format;
+            log_format_ptr  parsed_format; ///< when set, format is empty
             variant_object  args;
       };
    }
@@ -48,7 +49,11 @@ namespace fc
    :my( std::make_shared<detail::log_context_impl>() )
    {
       my->level       = ll;
-      my->file        = fc::path(file).filename().generic_string(); // TODO truncate filename
+      const char* name = file;
+      for( const char* c = file; *c; ++c )
+         if( *c == '/' || *c == '\\' )
+            name = c + 1;
+      my->file        = name;
       my->line        = line;
       my->method      = method;
       my->timestamp   = time_point::now();
@@ -186,6 +191,13 @@ namespace fc
       my->args    = std::move(args);
    }
 
+   log_message::log_message( log_context ctx, log_format_ptr format, variant_object args )
+   :my( std::make_shared<detail::log_message_impl>(std::move(ctx)) )
+   {
+      my->parsed_format = std::move(format);
+      my->args          = std::move(args);
+   }
+
    log_message::log_message( const variant& v )
    :my( std::make_shared<detail::log_message_impl>( log_context( v.get_object()["context"] ) ) )
    {
@@ -196,19 +208,85 @@ namespace fc
    variant log_message::to_variant()const
    {
       return mutable_variant_object( "context", my->context )
-                          ( "format",  my->format )
+                          ( "format",  get_format() )
                           ( "data",    my->args   );
    }
 
    log_context          log_message::get_context()const { return my->context; }
-   string              log_message::get_format()const  { return my->format;  }
+   string              log_message::get_format()const  { return my->parsed_format ? my->parsed_format->get_format() : my->format; }
    variant_object log_message::get_data()const    { return my->args;    }
 
    string        log_message::get_message()const
    {
+      if( my->parsed_format )
+         return my->parsed_format->format( my->args );
       return format_string( my->format, my->args );
    }
 
+   log_format::log_format( std::string format )
+   :_format( std::move(format) )
+   {
+      // same scan as in fc::format_string, but collecting segments instead of substituting
+      const string& f = _format;
+      string literal;
+      size_t prev = 0;
+      auto next = f.find( '$' );
+      while( prev != size_t(string::npos) && prev < size_t(f.size()) )
+      {
+         literal.append( f, prev, size_t(next-prev) );
+
+         if( next == size_t(string::npos) )
+            break;
+
+         prev = next + 1;
+
+         if( prev < f.size() && f[prev] == '{' )
+         {
+            next = f.find( '}', prev );
+            if( next != size_t(string::npos) )
+            {
+               if( literal.size() )
+                  _segments.push_back( segment{ std::move(literal), false } );
+               literal.clear();
+               _segments.push_back( segment{ f.substr( prev+1, (next-prev-1) ), true } );
+               prev = next + 1;
+               next = f.find( '$', prev );
+            }
+         }
+         else
+         {
+            if( prev < f.size() )
+               literal += f[prev];
+            ++prev;
+            next = f.find( '$', prev );
+         }
+      }
+      if( literal.size() )
+         _segments.push_back( segment{ std::move(literal), false } );
+   }
+
+   string log_format::format( const variant_object& args )const
+   {
+      string result;
+      for( const segment& s : _segments )
+      {
+         if( !s.is_key )
+         {
+            result += s.text;
+            continue;
+         }
+
+         auto val = args.find( s.text );
+         if( val == args.end() )
+            result += "${" + s.text + "}";
+         else if( val->value().is_object() || val->value().is_array() )
+            result += json::to_string( val->value() );
+         else
+            result += val->value().as_string();
+      }
+      return result;
+   }
+
 
 } // fc
 
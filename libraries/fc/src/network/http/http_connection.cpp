@@ -10,6 +10,8 @@
 #include <fc/network/url.hpp>
 #include <boost/algorithm/string.hpp>
 
+#include <algorithm>
+
 
 class fc::http::connection::impl 
 {
@@ -101,7 +103,8 @@ http::reply connection::request( const fc::string& method,
       fc::stringstream req;
       req << method <<" "<<parsed_url.path()->generic_string()<<" HTTP/1.1\r\n";
       req << "Host: "<<*parsed_url.host()<<"\r\n";
-      req << "Content-Type: application/json\r\n";
+      if( std::none_of( he.begin(), he.end(), []( const header& h ) { return boost::iequals( h.key, "Content-Type" ); } ) )
+        req << "Content-Type: application/json\r\n";
       for( auto i = he.begin(); i != he.end(); ++i )
       {
           req << i->key <<": " << i->val<<"\r\n";
@@ -0,0 +1,104 @@
+#include <fc/crypto/aes.hpp>
+#include <fc/crypto/sha256.hpp>
+#include <fc/time.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+// Compares throughput of AES-256-CBC as used by graphene::net::stcp_socket: the old path copies each
+// frame through a 4 KB buffer (zero filled before every chunk), the new one encrypts whole frame in place.
+// Both must produce the same ciphertext, since the wire format did not change.
+
+static const size_t old_chunk_size = 4096;
+
+static void init( fc::aes_encoder& enc, fc::aes_decoder& dec )
+{
+   fc::sha256 key = fc::sha256::hash( std::string( "aes_bench" ) );
+   fc::uint128 iv( 0x0123456789abcdefULL, 0xfedcba9876543210ULL );
+   enc.init( key, iv );
+   dec.init( key, iv );
+}
+
+static void encrypt_chunked( fc::aes_encoder& enc, std::vector< char >& frame, std::vector< char >& out )
+{
+   std::vector< char > write_buffer( old_chunk_size );
+   for( size_t offset = 0; offset < frame.size(); offset += old_chunk_size )
+   {
+      size_t len = std::min( old_chunk_size, frame.size() - offset );
+      memset( write_buffer.data(), 0, len );
+      enc.encode( frame.data() + offset, len, write_buffer.data() );
+      memcpy( out.data() + offset, write_buffer.data(), len );
+   }
+}
+
+static void encrypt_in_place( fc::aes_encoder& enc, std::vector< char >& frame, std::vector< char >& out )
+{
+   enc.encode( frame.data(), frame.size(), frame.data() );
+   out.swap( frame );
+}
+
+static void run( const char* name, size_t frame_size, uint32_t count,
+   const std::function< void( fc::aes_encoder&, std::vector< char >&, std::vector< char >& ) >& encrypt,
+   std::vector< char >& last_ciphertext )
+{
+   fc::aes_encoder enc;
+   fc::aes_decoder dec;
+   init( enc, dec );
+
+   std::vector< char > frame;
+   std::vector< char > out;
+   std::vector< char > plain( frame_size );
+   fc::microseconds elapsed;
+   for( uint32_t i = 0; i < count; ++i )
+   {
+      frame.resize( frame_size );
+      for( size_t j = 0; j < frame_size; ++j )
+         frame[j] = char( i * 31 + j );
+      out.resize( frame_size );
+
+      auto start = fc::time_point::now();
+      encrypt( enc, frame, out );
+      elapsed += fc::time_point::now() - start;
+
+      dec.decode( out.data(), frame_size, plain.data() );
+      for( size_t j = 0; j < frame_size; ++j )
+      {
+         if( plain[j] != char( i * 31 + j ) )
+         {
+            std::cerr << name << ": decrypted frame " << i << " differs from original" << std::endl;
+            exit( 1 );
+         }
+      }
+   }
+   last_ciphertext = out;
+
+   double seconds = double( elapsed.count() ) / 1000000.0;
+   std::cout << name << " " << frame_size << "B x " << count << ": " << elapsed.count() << " us, "
+             << ( seconds > 0 ? double( frame_size ) * count / seconds / ( 1024 * 1024 ) : 0.0 ) << " MB/s" << std::endl;
+}
+
+int main( int argc, char** argv )
+{
+   uint32_t megabytes = argc > 1 ? std::atoi( argv[1] ) : 512;
+
+   for( size_t frame_size : { 256, 4096, 65536, 1048576 } )
+   {
+      uint32_t count = std::max< uint32_t >( 1, uint64_t( megabytes ) * 1024 * 1024 / frame_size );
+      std::vector< char > chunked_ciphertext;
+      std::vector< char > in_place_ciphertext;
+      run( "chunked ", frame_size, count, &encrypt_chunked, chunked_ciphertext );
+      run( "in place", frame_size, count, &encrypt_in_place, in_place_ciphertext );
+      if( chunked_ciphertext != in_place_ciphertext )
+      {
+         std::cerr << "ciphertext of in place encryption differs from chunked one" << std::endl;
+         return 1;
+      }
+   }
+
+   return 0;
+}
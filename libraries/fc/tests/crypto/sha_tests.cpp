@@ -157,6 +157,42 @@ BOOST_AUTO_TEST_CASE(sha256_test)
     BOOST_CHECK_EQUAL( "d61967f63c7dd183914a4ae452c9f6ad5d462ce3d277798075b107615c1a8a30", (std::string) fc::sha256::hash(fourth) );
 }
 
+BOOST_AUTO_TEST_CASE(sha256_hash_many_test)
+{
+    // all lengths around block and padding boundaries, in mixed order so lanes run for different number of blocks
+    std::vector<std::string> messages;
+    for( uint32_t size = 0; size < 300; ++size )
+        messages.push_back( std::string( TEST4, 0, std::min<size_t>( size, TEST4.size() ) ) + std::string( size > TEST4.size() ? size - TEST4.size() : 0, char( size ) ) );
+    std::swap( messages[3], messages[250] );
+    std::swap( messages[64], messages[130] );
+
+    std::vector<const char*> data;
+    std::vector<uint32_t> sizes;
+    for( const auto& m : messages )
+    {
+        data.push_back( m.data() );
+        sizes.push_back( m.size() );
+    }
+
+    std::vector<fc::sha256> results( messages.size() );
+    fc::sha256::hash_many( data.data(), sizes.data(), results.data(), messages.size() );
+    for( size_t i = 0; i < messages.size(); ++i )
+        BOOST_CHECK( results[i] == fc::sha256::hash( messages[i] ) );
+
+    if( fc::detail::sha256_multi_buffer_supported() )
+    {
+        // count not divisible by number of lanes
+        std::vector<fc::sha256> mb_results( messages.size() - 3 );
+        fc::detail::sha256_multi_buffer( data.data(), sizes.data(), mb_results.data(), mb_results.size() );
+        for( size_t i = 0; i < mb_results.size(); ++i )
+            BOOST_CHECK( mb_results[i] == fc::sha256::hash( messages[i] ) );
+
+        fc::sha256 single;
+        fc::detail::sha256_multi_buffer( data.data() + 3, sizes.data() + 3, &single, 1 );
+        BOOST_CHECK( single == fc::sha256::hash( messages[3] ) );
+    }
+}
+
 BOOST_AUTO_TEST_CASE(sha512_test)
 {
     init_5();
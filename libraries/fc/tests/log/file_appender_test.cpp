@@ -0,0 +1,59 @@
+#include <boost/test/unit_test.hpp>
+
+#include <fc/filesystem.hpp>
+#include <fc/log/file_appender.hpp>
+#include <fc/reflect/variant.hpp>
+#include <fc/variant.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+
+BOOST_AUTO_TEST_SUITE(file_appender_tests)
+
+BOOST_AUTO_TEST_CASE( async_thread_queue_release )
+{
+  fc::temp_directory log_dir;
+  fc::file_appender::config cfg( log_dir.path() / "test.log" );
+  cfg.async = true;
+  cfg.queue_size = 16;
+  cfg.overflow = fc::file_appender::overflow_policy::block;
+
+  const uint32_t thread_count = 8;
+  const uint32_t message_count = 100;
+  {
+    fc::variant args( cfg );
+    fc::file_appender appender( args );
+
+    appender.log( FC_LOG_MESSAGE( info, "main thread message" ) );
+    BOOST_REQUIRE_EQUAL( appender.thread_queue_count(), 1u );
+
+    for( uint32_t i = 0; i < thread_count; ++i )
+    {
+      std::thread( [&appender, i, message_count]()
+      {
+        for( uint32_t j = 0; j < message_count; ++j )
+          appender.log( FC_LOG_MESSAGE( info, "thread ${t} message ${m}", ("t", i)("m", j) ) );
+      } ).join();
+    }
+
+    BOOST_TEST_MESSAGE( "--- Queues of exited threads are released once written" );
+    for( uint32_t i = 0; i < 500 && appender.thread_queue_count() > 1; ++i )
+      std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    BOOST_REQUIRE_EQUAL( appender.thread_queue_count(), 1u );
+
+    BOOST_TEST_MESSAGE( "--- Queue of running thread is kept" );
+    appender.log( FC_LOG_MESSAGE( info, "main thread message" ) );
+    BOOST_REQUIRE_EQUAL( appender.thread_queue_count(), 1u );
+  }
+
+  std::ifstream log_file( ( log_dir.path() / "test.log" ).string() );
+  std::string line;
+  uint32_t line_count = 0;
+  while( std::getline( log_file, line ) )
+    ++line_count;
+  BOOST_REQUIRE_EQUAL( line_count, thread_count * message_count + 2 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
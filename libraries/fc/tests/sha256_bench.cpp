@@ -0,0 +1,65 @@
+#include <fc/crypto/sha256.hpp>
+#include <fc/time.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+// Compares throughput of hashing many independent messages one by one and with sha256::hash_many.
+// Message sizes correspond to merkle tree nodes (64 bytes) and typical transactions.
+
+static void run( const char* name, uint32_t message_size, uint32_t count,
+   const std::function< void( const char* const*, const uint32_t*, fc::sha256*, size_t ) >& hasher )
+{
+   std::vector< std::vector< char > > messages( count, std::vector< char >( message_size ) );
+   std::vector< const char* > data;
+   std::vector< uint32_t > sizes;
+   for( uint32_t i = 0; i < count; ++i )
+   {
+      for( uint32_t j = 0; j < message_size; ++j )
+         messages[i][j] = char( i * 31 + j );
+      data.push_back( messages[i].data() );
+      sizes.push_back( message_size );
+   }
+
+   std::vector< fc::sha256 > results( count );
+   auto start = fc::time_point::now();
+   hasher( data.data(), sizes.data(), results.data(), count );
+   auto elapsed = fc::time_point::now() - start;
+
+   for( uint32_t i = 0; i < count; i += 997 )
+   {
+      if( results[i] != fc::sha256::hash( data[i], sizes[i] ) )
+      {
+         std::cerr << name << ": wrong hash of message " << i << std::endl;
+         exit( 1 );
+      }
+   }
+
+   double seconds = double( elapsed.count() ) / 1000000.0;
+   std::cout << name << " " << message_size << "B x " << count << ": " << elapsed.count() << " us, "
+             << ( seconds > 0 ? double( message_size ) * count / seconds / ( 1024 * 1024 ) : 0.0 ) << " MB/s" << std::endl;
+}
+
+int main( int argc, char** argv )
+{
+   uint32_t count = argc > 1 ? std::atoi( argv[1] ) : 1000000;
+
+   auto one_by_one = []( const char* const* data, const uint32_t* sizes, fc::sha256* results, size_t count )
+   {
+      for( size_t i = 0; i < count; ++i )
+         results[i] = fc::sha256::hash( data[i], sizes[i] );
+   };
+
+   for( uint32_t message_size : { 64, 250, 1000 } )
+   {
+      run( "hash        ", message_size, count, one_by_one );
+      run( "hash_many   ", message_size, count, &fc::sha256::hash_many );
+      if( fc::detail::sha256_multi_buffer_supported() )
+         run( "multi_buffer", message_size, count, &fc::detail::sha256_multi_buffer );
+   }
+
+   return 0;
+}
@@ -0,0 +1,78 @@
+#include <graphene/net/compact_block.hpp>
+
+#include <fc/exception/exception.hpp>
+
+#include <numeric>
+
+namespace graphene { namespace net {
+
+  partial_compact_block::partial_compact_block(const compact_block_message& compact_block, const transaction_lookup& find_transaction) :
+    block_message_hash(compact_block.block_message_hash),
+    block_id(compact_block.block_id)
+  {
+    static_cast<signed_block_header&>(block) = compact_block.header;
+    block.transactions.resize(compact_block.short_transaction_ids.size());
+    for (uint32_t i = 0; i < compact_block.short_transaction_ids.size(); ++i)
+    {
+      std::shared_ptr<const message> transaction_message = find_transaction(compact_block.short_transaction_ids[i]);
+      if (transaction_message)
+        block.transactions[i] = transaction_message->as<trx_message>().trx;
+      else
+        missing_transaction_indexes.push_back(i);
+    }
+  }
+
+  void partial_compact_block::add_missing_transactions(const compact_block_transactions_message& transactions)
+  {
+    FC_ASSERT(transactions.transactions.size() == missing_transaction_indexes.size(),
+              "Peer sent ${n} transactions of compact block, ${m} were requested",
+              ("n", transactions.transactions.size())("m", missing_transaction_indexes.size()));
+    for (size_t i = 0; i < missing_transaction_indexes.size(); ++i)
+      block.transactions[missing_transaction_indexes[i]] = transactions.transactions[i];
+    missing_transaction_indexes.clear();
+  }
+
+  fetch_compact_block_transactions_message partial_compact_block::get_fetch_message()const
+  {
+    return fetch_compact_block_transactions_message(block_message_hash, block_id, missing_transaction_indexes);
+  }
+
+  partial_compact_block::completion_status partial_compact_block::complete(block_message& reconstructed_block,
+                                                                          fc::optional<message>& block_message_to_process)
+  {
+    if (!missing_transaction_indexes.empty())
+      return missing_transactions;
+
+    reconstructed_block = block_message(block);
+    message rebuilt_message(reconstructed_block);
+    if (rebuilt_message.id() == block_message_hash)
+    {
+      block_message_to_process = std::move(rebuilt_message);
+      return completed;
+    }
+    if (all_transactions_requested)
+      return mismatch;
+
+    // some short id matched a different transaction than the one in the block
+    all_transactions_requested = true;
+    missing_transaction_indexes.resize(block.transactions.size());
+    std::iota(missing_transaction_indexes.begin(), missing_transaction_indexes.end(), 0);
+    return short_id_collision;
+  }
+
+  compact_block_transactions_message get_compact_block_transactions(const block_message& full_block,
+                                                                    const std::vector<uint32_t>& transaction_indexes)
+  {
+    compact_block_transactions_message reply;
+    reply.block_id = full_block.block_id;
+    reply.transactions.reserve(transaction_indexes.size());
+    for (uint32_t transaction_index : transaction_indexes)
+    {
+      FC_ASSERT(transaction_index < full_block.block.transactions.size(), "Requested transaction ${i} of block ${id} that only has ${n} transactions",
+                ("i", transaction_index)("id", full_block.block_id)("n", full_block.block.transactions.size()));
+      reply.transactions.push_back(full_block.block.transactions[transaction_index]);
+    }
+    return reply;
+  }
+
+} } // graphene::net
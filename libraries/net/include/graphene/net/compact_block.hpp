@@ -0,0 +1,59 @@
+#pragma once
+#include <graphene/net/core_messages.hpp>
+#include <graphene/net/message.hpp>
+
+#include <fc/optional.hpp>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace graphene { namespace net {
+
+  /**
+   *  Block rebuilt from compact_block_message.  Transactions are taken from the ones the node already has,
+   *  the rest has to be requested from the peer that sent the compact block.  Rebuilt block is verified against
+   *  hash of the block message the peer offered - when some short id matched a different transaction,
+   *  all transactions are requested once more.
+   */
+  struct partial_compact_block
+  {
+    /// @return trx_message with transaction id starting with given short id, or null when it is not known
+    typedef std::function<std::shared_ptr<const message>(uint64_t short_transaction_id)> transaction_lookup;
+
+    enum completion_status
+    {
+      missing_transactions, ///< missing_transaction_indexes have to be requested
+      short_id_collision,   ///< block did not match, all transactions have to be requested
+      mismatch,             ///< block did not match even with all transactions sent by the peer
+      completed
+    };
+
+    partial_compact_block() {}
+    partial_compact_block(const compact_block_message& compact_block, const transaction_lookup& find_transaction);
+
+    /// Puts transactions sent by the peer (in order they were requested) in place of missing ones
+    void add_missing_transactions(const compact_block_transactions_message& transactions);
+
+    /// @return request for transactions that are missing
+    fetch_compact_block_transactions_message get_fetch_message()const;
+
+    /**
+     *  Checks rebuilt block when no transactions are missing.
+     *  @param reconstructed_block  block message, valid when completed
+     *  @param block_message_to_process  reconstructed_block as message, set when completed
+     */
+    completion_status complete(block_message& reconstructed_block, fc::optional<message>& block_message_to_process);
+
+    item_hash_t           block_message_hash;
+    block_id_type         block_id;
+    signed_block          block;
+    std::vector<uint32_t> missing_transaction_indexes;
+    bool                  all_transactions_requested = false;
+  };
+
+  /// @return transactions of full block at positions requested by fetch_compact_block_transactions_message
+  compact_block_transactions_message get_compact_block_transactions(const block_message& full_block,
+                                                                    const std::vector<uint32_t>& transaction_indexes);
+
+} } // graphene::net
@@ -68,6 +68,19 @@
  */
 #define GRAPHENE_NET_MESSAGE_CACHE_DURATION_IN_BLOCKS        20
 
+/**
+ * Number of threads that hash and unpack big incoming messages (blocks), so the
+ * p2p thread can handle messages from other peers meanwhile.  With 0 all messages
+ * are decoded on the p2p thread.
+ */
+#define GRAPHENE_NET_DEFAULT_MESSAGE_DECODING_THREADS        2
+
+/**
+ * Smaller messages are always decoded on the p2p thread, for them passing the
+ * work to other thread costs more than it saves.
+ */
+#define GRAPHENE_NET_MIN_MESSAGE_SIZE_TO_DECODE_IN_THREAD    4096
+
 /**
  * We prevent a peer from offering us a list of blocks which, if we fetched them
  * all, would result in a blockchain that extended into the future.
@@ -79,6 +92,17 @@
 
 #define GRAPHENE_NET_MAX_INVENTORY_SIZE_IN_MINUTES           2
 
+/**
+ * When node_configuration::inventory_bloom_filters is set, items advertised to peers are remembered in rolling bloom
+ * filters made of this many buckets instead of exact sets.  Each bucket covers
+ * GRAPHENE_NET_MAX_INVENTORY_SIZE_IN_MINUTES / (buckets - 1) and is sized for GRAPHENE_NET_MAX_TRX_PER_SECOND.
+ */
+#define GRAPHENE_NET_INVENTORY_BLOOM_FILTER_BUCKETS          3
+/** chance that item not advertised to given peer is considered advertised (and so not advertised at all) */
+#define GRAPHENE_NET_INVENTORY_BLOOM_FILTER_FALSE_POSITIVE_RATE 0.0001
+/** the same for node wide filter, where false positive means we won't fetch item advertised to us */
+#define GRAPHENE_NET_NODE_INVENTORY_BLOOM_FILTER_FALSE_POSITIVE_RATE 0.000001
+
 #define GRAPHENE_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING      200
 
 /**
@@ -44,6 +44,7 @@ namespace graphene { namespace net {
   using hive::protocol::block_id_type;
   using hive::protocol::transaction_id_type;
   using hive::protocol::signed_block;
+  using hive::protocol::signed_block_header;
 
   typedef fc::ecc::public_key_data node_id_t;
   typedef fc::ripemd160 item_hash_t;
@@ -86,6 +87,9 @@ namespace graphene { namespace net {
     check_firewall_reply_message_type            = 5015,
     get_current_connections_request_message_type = 5016,
     get_current_connections_reply_message_type   = 5017,
+    compact_block_message_type                   = 5018,
+    fetch_compact_block_transactions_message_type = 5019,
+    compact_block_transactions_message_type      = 5020,
     core_message_type_last                       = 5099
   };
 
@@ -397,6 +401,65 @@ namespace graphene { namespace net {
     std::vector<current_connection_data> current_connections;
   };
 
+  /**
+   * Sent instead of block_message in reply to fetch_items_message to peers that announced
+   * "compact_blocks" in their hello.  Transactions are replaced with short ids (first 8 bytes of
+   * transaction id), the receiver fills them from transactions it already has and asks for the
+   * rest with fetch_compact_block_transactions_message.
+   */
+  struct compact_block_message
+  {
+    static const core_message_type_enum type;
+
+    item_hash_t           block_message_hash; /// hash of full block_message, that is, of the item that was requested
+    block_id_type         block_id;
+    signed_block_header   header;
+    std::vector<uint64_t> short_transaction_ids;
+
+    compact_block_message() {}
+    compact_block_message(const block_message& full_block, const item_hash_t& block_message_hash) :
+      block_message_hash(block_message_hash),
+      block_id(full_block.block_id),
+      header(full_block.block)
+    {
+      short_transaction_ids.reserve(full_block.block.transactions.size());
+      for (const signed_transaction& trx : full_block.block.transactions)
+        short_transaction_ids.push_back(get_short_transaction_id(trx.id()));
+    }
+
+    static uint64_t get_short_transaction_id(const fc::ripemd160& transaction_id)
+    {
+      uint64_t short_id;
+      memcpy(&short_id, transaction_id.data(), sizeof(short_id));
+      return short_id;
+    }
+  };
+
+  struct fetch_compact_block_transactions_message
+  {
+    static const core_message_type_enum type;
+
+    item_hash_t           block_message_hash;
+    block_id_type         block_id;
+    std::vector<uint32_t> transaction_indexes;
+
+    fetch_compact_block_transactions_message() {}
+    fetch_compact_block_transactions_message(const item_hash_t& block_message_hash, const block_id_type& block_id,
+                                             std::vector<uint32_t> transaction_indexes) :
+      block_message_hash(block_message_hash),
+      block_id(block_id),
+      transaction_indexes(std::move(transaction_indexes))
+    {}
+  };
+
+  struct compact_block_transactions_message
+  {
+    static const core_message_type_enum type;
+
+    block_id_type                   block_id;
+    std::vector<signed_transaction> transactions; /// in order of requested transaction_indexes
+  };
+
 
 } } // graphene::net
 
@@ -421,6 +484,9 @@ FC_REFLECT_ENUM( graphene::net::core_message_type_enum,
                  (check_firewall_reply_message_type)
                  (get_current_connections_request_message_type)
                  (get_current_connections_reply_message_type)
+                 (compact_block_message_type)
+                 (fetch_compact_block_transactions_message_type)
+                 (compact_block_transactions_message_type)
                  (core_message_type_last) )
 
 FC_REFLECT( graphene::net::trx_message, (trx) )
@@ -504,6 +570,15 @@ FC_REFLECT(graphene::net::get_current_connections_reply_message, (upload_rate_on
                                                             (upload_rate_one_hour)
                                                             (download_rate_one_hour)
                                                             (current_connections))
+FC_REFLECT( graphene::net::compact_block_message, (block_message_hash)
+                                              (block_id)
+                                              (header)
+                                              (short_transaction_ids) )
+FC_REFLECT( graphene::net::fetch_compact_block_transactions_message, (block_message_hash)
+                                                                 (block_id)
+                                                                 (transaction_indexes) )
+FC_REFLECT( graphene::net::compact_block_transactions_message, (block_id)
+                                                           (transactions) )
 
 #include <unordered_map>
 #include <fc/crypto/city.hpp>
@@ -106,6 +106,28 @@ namespace graphene { namespace net {
               ("msg_type", msg_type)
               );
      }
+
+     /**
+      *  Same as as(), but also rejects data left after T.  Use it for messages relayed
+      *  in the form they were received, so peers get exactly what was decoded.
+      */
+     template<typename T>
+     T as_exact()const
+     {
+         try {
+          FC_ASSERT( msg_type == T::type );
+          T tmp;
+          fc::datastream<const char*> ds( data.data(), data.size() );
+          fc::raw::unpack( ds, tmp );
+          FC_ASSERT( ds.remaining() == 0, "${n} bytes of unexpected data after message", ("n", ds.remaining()) );
+          return tmp;
+         } FC_RETHROW_EXCEPTIONS( warn,
+              "error unpacking network message as a '${type}'  ${x} !=? ${msg_type}",
+              ("type", fc::get_typename<T>::name() )
+              ("x", T::type)
+              ("msg_type", msg_type)
+              );
+     }
   };
 
 
@@ -0,0 +1,82 @@
+#pragma once
+#include <graphene/net/config.hpp>
+#include <graphene/net/core_messages.hpp>
+#include <graphene/net/message.hpp>
+#include <graphene/net/node.hpp>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/tag.hpp>
+
+#include <memory>
+
+namespace graphene { namespace net {
+
+  namespace detail
+  {
+    namespace bmi = boost::multi_index;
+    /** Messages (blocks and transactions) relayed during last few blocks, so they can be sent to peers that ask for them */
+    class blockchain_tied_message_cache
+    {
+    private:
+      static const uint32_t cache_duration_in_blocks = GRAPHENE_NET_MESSAGE_CACHE_DURATION_IN_BLOCKS;
+
+      struct message_hash_index{};
+      struct message_contents_hash_index{};
+      struct block_clock_index{};
+      struct message_info
+      {
+        message_hash_type message_hash;
+        std::shared_ptr<const message> message_body; // shared with send queues of peers we relay it to
+        uint32_t          block_clock_when_received;
+
+        // for network performance stats
+        message_propagation_data propagation_data;
+        fc::uint160_t     message_contents_hash; // hash of whatever the message contains (if it's a transaction, this is the transaction id, if it's a block, it's the block_id)
+
+        message_info( const message_hash_type& message_hash,
+                      std::shared_ptr<const message> message_body,
+                      uint32_t                 block_clock_when_received,
+                      const message_propagation_data& propagation_data,
+                      fc::uint160_t            message_contents_hash ) :
+          message_hash( message_hash ),
+          message_body( std::move( message_body ) ),
+          block_clock_when_received( block_clock_when_received ),
+          propagation_data( propagation_data ),
+          message_contents_hash( message_contents_hash )
+        {}
+      };
+      typedef boost::multi_index_container
+        < message_info,
+            bmi::indexed_by< bmi::ordered_unique< bmi::tag<message_hash_index>,
+                                                  bmi::member<message_info, message_hash_type, &message_info::message_hash> >,
+                             bmi::ordered_non_unique< bmi::tag<message_contents_hash_index>,
+                                                      bmi::member<message_info, fc::uint160_t, &message_info::message_contents_hash> >,
+                             bmi::ordered_non_unique< bmi::tag<block_clock_index>,
+                                                      bmi::member<message_info, uint32_t, &message_info::block_clock_when_received> > >
+        > message_cache_container;
+
+      message_cache_container _message_cache;
+
+      uint32_t block_clock;
+
+    public:
+      blockchain_tied_message_cache() :
+        block_clock( 0 )
+      {}
+      void block_accepted();
+      void cache_message( std::shared_ptr<const message> message_to_cache, const message_hash_type& hash_of_message_to_cache,
+                        const message_propagation_data& propagation_data, const fc::uint160_t& message_content_hash );
+      std::shared_ptr<const message> get_message( const message_hash_type& hash_of_message_to_lookup );
+      std::shared_ptr<const message> get_message_by_contents_hash( const fc::uint160_t& hash_of_message_contents_to_lookup );
+      /** @return cached trx_message with transaction id starting with given short id, or null when there is no such
+        * transaction or there is more than one */
+      std::shared_ptr<const message> get_transaction_by_short_id( uint64_t short_transaction_id ) const;
+      message_propagation_data get_message_propagation_data( const fc::uint160_t& hash_of_message_contents_to_lookup ) const;
+      size_t size() const { return _message_cache.size(); }
+    };
+
+  } // namespace detail
+
+} } // graphene::net
@@ -0,0 +1,60 @@
+#pragma once
+#include <graphene/net/core_messages.hpp>
+#include <graphene/net/message.hpp>
+
+#include <fc/optional.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace graphene { namespace net {
+
+  namespace detail
+  {
+    /** Computes hashes of received messages and unpacks blocks, big messages are decoded on dedicated threads
+     *  (see node_configuration::message_decoding_threads) so p2p thread can handle other peers meanwhile.
+     *  Must be used from a single (p2p) thread.
+     */
+    class message_decoder
+    {
+    public:
+      /** replaces decoding threads with new ones, old threads are kept until messages queued on them are decoded */
+      void set_thread_count(uint32_t thread_count);
+      uint32_t get_thread_count() const { return _threads.size(); }
+
+      /** computes hash of received message and unpacks it when it is a block, waits for result when it is
+       *  decoded on other thread
+       */
+      void decode(const message& received_message, message_hash_type& message_hash,
+                  fc::optional<graphene::net::block_message>& decoded_block);
+
+      uint32_t get_messages_waiting() const { return _messages_waiting; }
+      uint32_t get_max_messages_waiting() const { return _max_messages_waiting; }
+      uint64_t get_messages_decoded_in_threads() const { return _messages_decoded_in_threads; }
+
+    private:
+      struct decoding_thread
+      {
+        explicit decoding_thread(const std::string& name);
+
+        std::shared_ptr<fc::thread> thread;
+        /// decreased by decoding tasks themselves, so they never hold the thread they run on
+        std::shared_ptr<std::atomic<uint32_t>> queued_messages;
+      };
+
+      /// destroys retired threads that have no more messages to decode
+      void release_retired_threads();
+
+      std::vector<decoding_thread> _threads;
+      std::vector<decoding_thread> _retired_threads;
+      uint32_t _next_thread = 0;
+      uint32_t _messages_waiting = 0; /// messages passed to decoding threads and not yet returned
+      uint32_t _max_messages_waiting = 0;
+      uint64_t _messages_decoded_in_threads = 0;
+    };
+
+  } // end namespace detail
+
+} } // end namespace graphene::net
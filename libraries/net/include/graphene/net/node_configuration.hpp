@@ -38,6 +38,12 @@ struct node_configuration
    uint32_t maximum_number_of_sync_blocks_to_prefetch = GRAPHENE_NET_MAX_NUMBER_OF_BLOCKS_TO_PREFETCH;
    uint32_t maximum_blocks_per_peer_during_syncing = GRAPHENE_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING;
    int64_t active_ignored_request_timeout_microseconds = 6000000;
+   /** number of threads that decode big incoming messages, 0 means they are decoded on p2p thread */
+   uint32_t message_decoding_threads = GRAPHENE_NET_DEFAULT_MESSAGE_DECODING_THREADS;
+   /** remember items advertised to peers in fixed size bloom filters instead of exact sets, see rolling_bloom_filter */
+   bool inventory_bloom_filters = false;
+   /** announce support of compact_block_message to peers and send it to the ones that support it too */
+   bool compact_blocks = true;
 };
 
 } }
@@ -56,4 +62,7 @@ FC_REFLECT(graphene::net::node_configuration,
    (maximum_number_of_sync_blocks_to_prefetch)
    (maximum_blocks_per_peer_during_syncing)
    (active_ignored_request_timeout_microseconds)
+   (message_decoding_threads)
+   (inventory_bloom_filters)
+   (compact_blocks)
 )
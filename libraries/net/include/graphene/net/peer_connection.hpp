@@ -24,10 +24,12 @@
 #pragma once
 
 #include <graphene/net/node.hpp>
+#include <graphene/net/compact_block.hpp>
 #include <graphene/net/peer_database.hpp>
 #include <graphene/net/message_oriented_connection.hpp>
 #include <graphene/net/stcp_socket.hpp>
 #include <graphene/net/config.hpp>
+#include <graphene/net/rolling_bloom_filter.hpp>
 
 #include <boost/tuple/tuple.hpp>
 
@@ -68,7 +70,7 @@ namespace graphene { namespace net
       virtual void on_message(peer_connection* originating_peer,
                               const message& received_message) = 0;
       virtual void on_connection_closed(peer_connection* originating_peer) = 0;
-      virtual message get_message_for_item(const item_id& item) = 0;
+      virtual std::shared_ptr<const message> get_message_for_item(const item_id& item) = 0;
     };
 
     class peer_connection;
@@ -123,7 +125,8 @@ namespace graphene { namespace net
           enqueue_time(enqueue_time)
         {}
 
-        virtual message get_message(peer_connection_delegate* node) = 0;
+        /** the returned message stays valid as long as this queued_message exists */
+        virtual const message& get_message(peer_connection_delegate* node) = 0;
         /** returns roughly the number of bytes of memory the message is consuming while
          * it is sitting on the queue
          */
@@ -145,7 +148,23 @@ namespace graphene { namespace net
           message_send_time_field_offset(message_send_time_field_offset)
         {}
 
-        message get_message(peer_connection_delegate* node) override;
+        const message& get_message(peer_connection_delegate* node) override;
+        size_t get_size_in_queue() override;
+      };
+
+      /* when you queue up a 'shared_queued_message', the message is not copied, the queue
+       * only keeps a reference to it.  The same message (f.e. a block we relay) can be
+       * queued for any number of peers at the cost of a single copy.
+       */
+      struct shared_queued_message : queued_message
+      {
+        std::shared_ptr<const message> message_to_send;
+
+        shared_queued_message(std::shared_ptr<const message> message_to_send) :
+          message_to_send(std::move(message_to_send))
+        {}
+
+        const message& get_message(peer_connection_delegate* node) override;
         size_t get_size_in_queue() override;
       };
 
@@ -156,12 +175,13 @@ namespace graphene { namespace net
       struct virtual_queued_message : queued_message
       {
         item_id item_to_send;
+        std::shared_ptr<const message> message_to_send; // filled when it reaches the top of the queue
 
         virtual_queued_message(item_id item_to_send) :
           item_to_send(std::move(item_to_send))
         {}
 
-        message get_message(peer_connection_delegate* node) override;
+        const message& get_message(peer_connection_delegate* node) override;
         size_t get_size_in_queue() override;
       };
 
@@ -208,6 +228,7 @@ namespace graphene { namespace net
       fc::optional<std::string> platform;
       fc::optional<uint32_t> bitness;
       fc::optional<hive::protocol::chain_id_type> chain_id;
+      bool             supports_compact_blocks = false; /// peer announced it understands compact_block_message
 
       // for inbound connections, these fields record what the peer sent us in
       // its hello message.  For outbound, they record what we sent the peer
@@ -257,8 +278,13 @@ namespace graphene { namespace net
                                                                                                                  boost::multi_index::member<timestamped_item_id, fc::time_point_sec, &timestamped_item_id::timestamp> > > > timestamped_items_set_type;
       timestamped_items_set_type inventory_peer_advertised_to_us;
       timestamped_items_set_type inventory_advertised_to_peer;
+      /// used instead of inventory_advertised_to_peer when node_configuration::inventory_bloom_filters is set
+      fc::optional<rolling_bloom_filter> inventory_advertised_to_peer_filter;
 
       item_to_time_map_type items_requested_from_peer;  /// items we've requested from this peer during normal operation.  fetch from another peer if this peer disconnects
+
+      /** block this peer sent us as compact_block_message, while we wait for the transactions we were missing */
+      fc::optional<partial_compact_block> compact_block_being_completed;
       /// @}
 
       // if they're flooding us with transactions, we set this to avoid fetching for a few seconds to let the
@@ -292,6 +318,7 @@ namespace graphene { namespace net
 
       void send_queueable_message(std::unique_ptr<queued_message>&& message_to_send);
       void send_message(const message& message_to_send, size_t message_send_time_field_offset = (size_t)-1);
+      void send_message(std::shared_ptr<const message> message_to_send);
       void send_item(const item_id& item_to_send);
       void close_connection();
       void destroy_connection(const char* caller);
@@ -313,6 +340,8 @@ namespace graphene { namespace net
       bool is_transaction_fetching_inhibited() const;
       fc::sha512 get_shared_secret() const;
       void clear_old_inventory();
+      bool was_inventory_advertised_to_peer(const item_id& item) const;
+      void add_inventory_advertised_to_peer(const item_id& item, fc::time_point now);
       bool is_inventory_advertised_to_us_list_full_for_transactions() const;
       bool is_inventory_advertised_to_us_list_full() const;
       bool performing_firewall_check() const;
@@ -0,0 +1,78 @@
+#pragma once
+#include <graphene/net/core_messages.hpp>
+
+#include <fc/bloom_filter.hpp>
+#include <fc/time.hpp>
+
+#include <vector>
+
+namespace graphene { namespace net {
+
+  /**
+   *  Remembers item ids for a limited time in fixed amount of memory.  Items are inserted into
+   *  the newest of several bloom filters (buckets), each covering bucket_duration.  When the newest
+   *  bucket gets too old, the oldest one is cleared and becomes the newest, so an item is remembered
+   *  for at least (bucket_count - 1) * bucket_duration.  contains() can give false positives (with
+   *  probability given in constructor for each of the buckets), never false negatives.
+   */
+  class rolling_bloom_filter
+  {
+    public:
+      rolling_bloom_filter( uint64_t items_per_bucket, double false_positive_probability,
+                            fc::microseconds bucket_duration, uint32_t bucket_count )
+        : _bucket_duration( bucket_duration ), _current_bucket_start( fc::time_point::now() )
+      {
+        fc::bloom_parameters parameters;
+        parameters.projected_element_count = items_per_bucket;
+        parameters.false_positive_probability = false_positive_probability;
+        parameters.compute_optimal_parameters();
+        _buckets.resize( bucket_count, fc::bloom_filter( parameters ) );
+      }
+
+      void insert( const item_id& item, fc::time_point now )
+      {
+        expire( now );
+        _buckets[ _current_bucket ].insert( key( item ), sizeof( item_id ) );
+      }
+
+      bool contains( const item_id& item )const
+      {
+        for( const fc::bloom_filter& bucket : _buckets )
+          if( bucket.contains( key( item ), sizeof( item_id ) ) )
+            return true;
+        return false;
+      }
+
+      /// forgets items from the oldest bucket when the newest one covers its whole duration
+      void expire( fc::time_point now )
+      {
+        if( now - _current_bucket_start < _bucket_duration )
+          return;
+        _current_bucket = ( _current_bucket + 1 ) % _buckets.size();
+        _buckets[ _current_bucket ].clear();
+        _current_bucket_start = now;
+      }
+
+      /// memory taken by bit tables of all buckets
+      size_t size_in_bytes()const
+      {
+        size_t size = 0;
+        for( const fc::bloom_filter& bucket : _buckets )
+          size += bucket.size() / 8;
+        return size;
+      }
+
+    private:
+      static const unsigned char* key( const item_id& item )
+      {
+        static_assert( sizeof( item_id ) == sizeof( uint32_t ) + sizeof( item_hash_t ), "item_id must not contain padding" );
+        return reinterpret_cast< const unsigned char* >( &item );
+      }
+
+      std::vector< fc::bloom_filter > _buckets;
+      uint32_t                        _current_bucket = 0;
+      fc::microseconds                _bucket_duration;
+      fc::time_point                  _current_bucket_start;
+  };
+
+} } // graphene::net
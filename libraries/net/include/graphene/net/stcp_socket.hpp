@@ -49,6 +49,12 @@ class stcp_socket : public virtual fc::iostream
 
     virtual size_t   writesome( const char* buffer, size_t len );
     virtual size_t   writesome( const std::shared_ptr<const char>& buf, size_t len, size_t offset );
+    /**
+     *  Encrypts len bytes of buf in place and sends them.  Unlike write(), data is not copied through the
+     *  internal buffer in small chunks, the whole frame is encrypted with a single call (len must be a
+     *  multiple of 16).  The ciphertext is the same as if the data was sent with write().
+     */
+    void             write_in_place( const std::shared_ptr<char>& buf, size_t len );
 
     virtual void     flush();
     virtual void     close();
@@ -0,0 +1,87 @@
+#include <graphene/net/message_cache.hpp>
+
+#include <fc/exception/exception.hpp>
+
+#include <cstring>
+
+namespace graphene { namespace net {
+
+  namespace detail
+  {
+    void blockchain_tied_message_cache::block_accepted()
+    {
+      ++block_clock;
+      if( block_clock > cache_duration_in_blocks )
+        _message_cache.get<block_clock_index>().erase(_message_cache.get<block_clock_index>().begin(),
+                                                      _message_cache.get<block_clock_index>().lower_bound(block_clock - cache_duration_in_blocks ) );
+    }
+
+    void blockchain_tied_message_cache::cache_message( std::shared_ptr<const message> message_to_cache,
+                                                     const message_hash_type& hash_of_message_to_cache,
+                                                     const message_propagation_data& propagation_data,
+                                                     const fc::uint160_t& message_content_hash )
+    {
+      _message_cache.insert( message_info(hash_of_message_to_cache,
+                                         std::move(message_to_cache),
+                                         block_clock,
+                                         propagation_data,
+                                         message_content_hash ) );
+    }
+
+    std::shared_ptr<const message> blockchain_tied_message_cache::get_message( const message_hash_type& hash_of_message_to_lookup )
+    {
+      message_cache_container::index<message_hash_index>::type::const_iterator iter =
+         _message_cache.get<message_hash_index>().find(hash_of_message_to_lookup );
+      if( iter != _message_cache.get<message_hash_index>().end() )
+        return iter->message_body;
+      FC_THROW_EXCEPTION(  fc::key_not_found_exception, "Requested message not in cache" );
+    }
+
+    std::shared_ptr<const message> blockchain_tied_message_cache::get_message_by_contents_hash( const fc::uint160_t& hash_of_message_contents_to_lookup )
+    {
+      if( hash_of_message_contents_to_lookup != fc::uint160_t() )
+      {
+        message_cache_container::index<message_contents_hash_index>::type::const_iterator iter =
+           _message_cache.get<message_contents_hash_index>().find(hash_of_message_contents_to_lookup );
+        if( iter != _message_cache.get<message_contents_hash_index>().end() )
+          return iter->message_body;
+      }
+      FC_THROW_EXCEPTION(  fc::key_not_found_exception, "Requested message not in cache" );
+    }
+
+    std::shared_ptr<const message> blockchain_tied_message_cache::get_transaction_by_short_id( uint64_t short_transaction_id ) const
+    {
+      // short id is a prefix of transaction id, and ids are ordered by their bytes, so all candidates are next to each other
+      fc::uint160_t lowest_matching_hash;
+      memcpy( lowest_matching_hash.data(), &short_transaction_id, sizeof( short_transaction_id ) );
+
+      std::shared_ptr<const message> result;
+      const auto& contents_index = _message_cache.get<message_contents_hash_index>();
+      for( auto iter = contents_index.lower_bound( lowest_matching_hash );
+           iter != contents_index.end() && compact_block_message::get_short_transaction_id( iter->message_contents_hash ) == short_transaction_id;
+           ++iter )
+      {
+        if( iter->message_body->msg_type != trx_message_type )
+          continue;
+        if( result )
+          return std::shared_ptr<const message>(); // ambiguous, let the peer send it
+        result = iter->message_body;
+      }
+      return result;
+    }
+
+    message_propagation_data blockchain_tied_message_cache::get_message_propagation_data( const fc::uint160_t& hash_of_message_contents_to_lookup ) const
+    {
+      if( hash_of_message_contents_to_lookup != fc::uint160_t() )
+      {
+        message_cache_container::index<message_contents_hash_index>::type::const_iterator iter =
+           _message_cache.get<message_contents_hash_index>().find(hash_of_message_contents_to_lookup );
+        if( iter != _message_cache.get<message_contents_hash_index>().end() )
+          return iter->propagation_data;
+      }
+      FC_THROW_EXCEPTION(  fc::key_not_found_exception, "Requested message not in cache" );
+    }
+
+  } // namespace detail
+
+} } // graphene::net
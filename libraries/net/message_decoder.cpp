@@ -0,0 +1,99 @@
+#include <graphene/net/message_decoder.hpp>
+#include <graphene/net/config.hpp>
+
+#include <algorithm>
+#include <string>
+
+namespace graphene { namespace net {
+
+  namespace detail
+  {
+    message_decoder::decoding_thread::decoding_thread(const std::string& name) :
+      thread(std::make_shared<fc::thread>(name)),
+      queued_messages(std::make_shared<std::atomic<uint32_t>>(0))
+    {}
+
+    void message_decoder::set_thread_count(uint32_t thread_count)
+    {
+      if (thread_count != _threads.size())
+      {
+        for (decoding_thread& retired_thread : _threads)
+          _retired_threads.push_back(std::move(retired_thread));
+        _threads.clear();
+        for (uint32_t i = 0; i < thread_count; ++i)
+          _threads.emplace_back("p2p_decode_" + std::to_string(i));
+        _next_thread = 0;
+      }
+      release_retired_threads();
+    }
+
+    void message_decoder::release_retired_threads()
+    {
+      _retired_threads.erase(std::remove_if(_retired_threads.begin(), _retired_threads.end(),
+        [](const decoding_thread& retired_thread) { return *retired_thread.queued_messages == 0; }),
+        _retired_threads.end());
+    }
+
+    void message_decoder::decode(const message& received_message, message_hash_type& message_hash,
+                                 fc::optional<graphene::net::block_message>& decoded_block)
+    {
+      bool is_block = received_message.msg_type == core_message_type_enum::block_message_type;
+      if (_threads.empty() || received_message.size < GRAPHENE_NET_MIN_MESSAGE_SIZE_TO_DECODE_IN_THREAD)
+      {
+        message_hash = received_message.id();
+        if (is_block)
+          decoded_block = received_message.as_exact<graphene::net::block_message>();
+        return;
+      }
+
+      // the decoding task works on its own copy, so it doesn't depend on calling task in case it is canceled
+      struct decoding_state
+      {
+        decoding_state(const message& received_message) : received_message(received_message) {}
+
+        message                                    received_message;
+        message_hash_type                          message_hash;
+        fc::optional<graphene::net::block_message> decoded_block;
+      };
+      auto state = std::make_shared<decoding_state>(received_message);
+
+      // keep the thread alive while we wait, even if it is retired in the meantime
+      decoding_thread selected_thread = _threads[_next_thread++ % _threads.size()];
+      std::shared_ptr<std::atomic<uint32_t>> queued_messages = selected_thread.queued_messages;
+      ++*queued_messages;
+      ++_messages_waiting;
+      _max_messages_waiting = std::max(_max_messages_waiting, _messages_waiting);
+      try
+      {
+        selected_thread.thread->async([state, is_block, queued_messages]() {
+          try
+          {
+            state->message_hash = state->received_message.id();
+            if (is_block)
+              state->decoded_block = state->received_message.as_exact<graphene::net::block_message>();
+          }
+          catch (...)
+          {
+            --*queued_messages;
+            throw;
+          }
+          --*queued_messages;
+        }, "decode p2p message").wait();
+      }
+      catch (...)
+      {
+        --_messages_waiting;
+        release_retired_threads();
+        throw;
+      }
+      --_messages_waiting;
+      ++_messages_decoded_in_threads;
+      release_retired_threads();
+
+      message_hash = state->message_hash;
+      decoded_block = std::move(state->decoded_block);
+    }
+
+  } // end namespace detail
+
+} } // end namespace graphene::net
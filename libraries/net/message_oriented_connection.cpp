@@ -260,7 +260,7 @@ namespace graphene { namespace net {
            elog("Trying to send a message larger than MAX_MESSAGE_SIZE. This probably won't work...");
         //pad the message we send to a multiple of 16 bytes
         size_t size_with_padding = 16 * ((size_of_message_and_header + 15) / 16);
-        std::unique_ptr<char[]> padded_message(new char[size_with_padding]);
+        std::shared_ptr<char> padded_message(new char[size_with_padding], [](char* p){ delete[] p; });
 
         memcpy(padded_message.get(), (char*)&message_to_send, sizeof(message_header));
         memcpy(padded_message.get() + sizeof(message_header), message_to_send.data.data(), message_to_send.size );
@@ -268,7 +268,8 @@ namespace graphene { namespace net {
         size_t toClean = size_with_padding - size_of_message_and_header;
         memset(paddingSpace, 0, toClean);
 
-        _sock.write(padded_message.get(), size_with_padding);
+        // padded_message is our own copy, so it can be encrypted in place
+        _sock.write_in_place(padded_message, size_with_padding);
         _sock.flush();
         _bytes_sent += size_with_padding;
         _last_message_sent_time = fc::time_point::now();
@@ -30,6 +30,7 @@
 #include <forward_list>
 #include <iostream>
 #include <algorithm>
+#include <numeric>
 #include <tuple>
 #include <boost/tuple/tuple.hpp>
 #include <boost/circular_buffer.hpp>
@@ -74,6 +75,9 @@
 
 #include <graphene/net/node_configuration.hpp>
 #include <graphene/net/node.hpp>
+#include <graphene/net/compact_block.hpp>
+#include <graphene/net/message_cache.hpp>
+#include <graphene/net/message_decoder.hpp>
 #include <graphene/net/peer_database.hpp>
 #include <graphene/net/peer_connection.hpp>
 #include <graphene/net/stcp_socket.hpp>
@@ -125,102 +129,17 @@ namespace graphene { namespace net {
 
   namespace detail
   {
-    namespace bmi = boost::multi_index;
-    class blockchain_tied_message_cache
+    /** block_id is the last field of block_message, so it can be read directly from packed message
+      * without unpacking (and copying) the whole block.  Received block messages are decoded with as_exact(),
+      * so there can't be any data after it.
+      */
+    block_id_type get_block_id_of_message( const message& block_message_to_read )
     {
-    private:
-      static const uint32_t cache_duration_in_blocks = GRAPHENE_NET_MESSAGE_CACHE_DURATION_IN_BLOCKS;
-
-      struct message_hash_index{};
-      struct message_contents_hash_index{};
-      struct block_clock_index{};
-      struct message_info
-      {
-        message_hash_type message_hash;
-        message           message_body;
-        uint32_t          block_clock_when_received;
-
-        // for network performance stats
-        message_propagation_data propagation_data;
-        fc::uint160_t     message_contents_hash; // hash of whatever the message contains (if it's a transaction, this is the transaction id, if it's a block, it's the block_id)
-
-        message_info( const message_hash_type& message_hash,
-                      const message&           message_body,
-                      uint32_t                 block_clock_when_received,
-                      const message_propagation_data& propagation_data,
-                      fc::uint160_t            message_contents_hash ) :
-          message_hash( message_hash ),
-          message_body( message_body ),
-          block_clock_when_received( block_clock_when_received ),
-          propagation_data( propagation_data ),
-          message_contents_hash( message_contents_hash )
-        {}
-      };
-      typedef boost::multi_index_container
-        < message_info,
-            bmi::indexed_by< bmi::ordered_unique< bmi::tag<message_hash_index>,
-                                                  bmi::member<message_info, message_hash_type, &message_info::message_hash> >,
-                             bmi::ordered_non_unique< bmi::tag<message_contents_hash_index>,
-                                                      bmi::member<message_info, fc::uint160_t, &message_info::message_contents_hash> >,
-                             bmi::ordered_non_unique< bmi::tag<block_clock_index>,
-                                                      bmi::member<message_info, uint32_t, &message_info::block_clock_when_received> > >
-        > message_cache_container;
-
-      message_cache_container _message_cache;
-
-      uint32_t block_clock;
-
-    public:
-      blockchain_tied_message_cache() :
-        block_clock( 0 )
-      {}
-      void block_accepted();
-      void cache_message( const message& message_to_cache, const message_hash_type& hash_of_message_to_cache,
-                        const message_propagation_data& propagation_data, const fc::uint160_t& message_content_hash );
-      message get_message( const message_hash_type& hash_of_message_to_lookup );
-      message_propagation_data get_message_propagation_data( const fc::uint160_t& hash_of_message_contents_to_lookup ) const;
-      size_t size() const { return _message_cache.size(); }
-    };
-
-    void blockchain_tied_message_cache::block_accepted()
-    {
-      ++block_clock;
-      if( block_clock > cache_duration_in_blocks )
-        _message_cache.get<block_clock_index>().erase(_message_cache.get<block_clock_index>().begin(),
-                                                      _message_cache.get<block_clock_index>().lower_bound(block_clock - cache_duration_in_blocks ) );
-    }
-
-    void blockchain_tied_message_cache::cache_message( const message& message_to_cache,
-                                                     const message_hash_type& hash_of_message_to_cache,
-                                                     const message_propagation_data& propagation_data,
-                                                     const fc::uint160_t& message_content_hash )
-    {
-      _message_cache.insert( message_info(hash_of_message_to_cache,
-                                         message_to_cache,
-                                         block_clock,
-                                         propagation_data,
-                                         message_content_hash ) );
-    }
-
-    message blockchain_tied_message_cache::get_message( const message_hash_type& hash_of_message_to_lookup )
-    {
-      message_cache_container::index<message_hash_index>::type::const_iterator iter =
-         _message_cache.get<message_hash_index>().find(hash_of_message_to_lookup );
-      if( iter != _message_cache.get<message_hash_index>().end() )
-        return iter->message_body;
-      FC_THROW_EXCEPTION(  fc::key_not_found_exception, "Requested message not in cache" );
-    }
-
-    message_propagation_data blockchain_tied_message_cache::get_message_propagation_data( const fc::uint160_t& hash_of_message_contents_to_lookup ) const
-    {
-      if( hash_of_message_contents_to_lookup != fc::uint160_t() )
-      {
-        message_cache_container::index<message_contents_hash_index>::type::const_iterator iter =
-           _message_cache.get<message_contents_hash_index>().find(hash_of_message_contents_to_lookup );
-        if( iter != _message_cache.get<message_contents_hash_index>().end() )
-          return iter->propagation_data;
-      }
-      FC_THROW_EXCEPTION(  fc::key_not_found_exception, "Requested message not in cache" );
+      FC_ASSERT( block_message_to_read.msg_type == block_message_type );
+      FC_ASSERT( block_message_to_read.data.size() >= sizeof( block_id_type ) );
+      block_id_type block_id;
+      memcpy( block_id.data(), block_message_to_read.data.data() + block_message_to_read.data.size() - sizeof( block_id_type ), sizeof( block_id_type ) );
+      return block_id;
     }
 
     // when requesting items from peers, we want to prioritize any blocks before
@@ -492,6 +411,8 @@ namespace graphene { namespace net {
       std::vector<uint32_t> _hard_fork_block_numbers; /// list of all block numbers where there are hard forks
 
       blockchain_tied_message_cache _message_cache; /// cache message we have received and might be required to provide to other peers via inventory requests
+      /// compact form of the block we relayed most recently (all peers ask for the same block at about the same time)
+      std::pair<item_hash_t, std::shared_ptr<const message>> _last_compact_block;
 
       fc::rate_limiting_group _rate_limiter;
 
@@ -540,6 +461,12 @@ namespace graphene { namespace net {
       std::atomic_int        _activeCalls;
       fc::promise<void>::ptr _shutdownNotifier;
 
+      /// threads hashing and unpacking big incoming messages (see node_configuration::message_decoding_threads)
+      message_decoder _message_decoder;
+
+      /// items advertised to any peer, set when node_configuration::inventory_bloom_filters is enabled
+      fc::optional<rolling_bloom_filter> _inventory_advertised_to_peers;
+
       node_impl(const std::string& user_agent);
       virtual ~node_impl();
 
@@ -639,14 +566,30 @@ namespace graphene { namespace net {
       void on_get_current_connections_reply_message(peer_connection* originating_peer,
                                                     const get_current_connections_reply_message& get_current_connections_reply_message_received);
 
+      std::shared_ptr<const message> get_compact_block_message(const message& full_block_message, const item_hash_t& block_message_hash);
+      void on_compact_block_message(peer_connection* originating_peer,
+                                    const compact_block_message& compact_block_message_received);
+      void on_fetch_compact_block_transactions_message(peer_connection* originating_peer,
+                                                       const fetch_compact_block_transactions_message& fetch_compact_block_transactions_message_received);
+      void on_compact_block_transactions_message(peer_connection* originating_peer,
+                                                 const compact_block_transactions_message& compact_block_transactions_message_received);
+      void complete_compact_block(peer_connection* originating_peer, partial_compact_block&& partial_block);
+
       void on_connection_closed(peer_connection* originating_peer) override;
 
       void send_sync_block_to_node_delegate(const graphene::net::block_message& block_message_to_send);
       void process_backlog_of_sync_blocks();
       void trigger_process_backlog_of_sync_blocks();
       void process_block_during_sync(peer_connection* originating_peer, const graphene::net::block_message& block_message, const message_hash_type& message_hash);
-      void process_block_during_normal_operation(peer_connection* originating_peer, const graphene::net::block_message& block_message, const message_hash_type& message_hash);
-      void process_block_message(peer_connection* originating_peer, const message& message_to_process, const message_hash_type& message_hash);
+      void process_block_during_normal_operation(peer_connection* originating_peer, const graphene::net::block_message& block_message,
+                                                 const message& message_to_process, const message_hash_type& message_hash);
+      void process_block_message(peer_connection* originating_peer, const message& message_to_process,
+                                 const graphene::net::block_message& block_message_to_process, const message_hash_type& message_hash);
+      /** computes hash of received message and unpacks it when it is a block, big messages are decoded
+        * by message decoding threads (the calling task waits, so the p2p thread can process other messages) */
+      void decode_message(const message& received_message, message_hash_type& message_hash, fc::optional<graphene::net::block_message>& decoded_block);
+      void set_message_decoding_threads(uint32_t thread_count);
+      void set_inventory_bloom_filters(bool enabled);
 
       void process_ordinary_message(peer_connection* originating_peer, const message& message_to_process, const message_hash_type& message_hash);
 
@@ -695,6 +638,8 @@ namespace graphene { namespace net {
       std::vector<peer_status> get_connected_peers() const;
       uint32_t                 get_connection_count() const;
 
+      void broadcast(std::shared_ptr<const message> item_to_broadcast, const message_hash_type& hash_of_item_to_broadcast,
+                     const fc::uint160_t& hash_of_message_contents, const message_propagation_data& propagation_data);
       void broadcast(const message& item_to_broadcast, const message_propagation_data& propagation_data);
       void broadcast(const message& item_to_broadcast);
       void sync_from(const item_id& current_head_block, const std::vector<uint32_t>& hard_fork_block_numbers);
@@ -711,7 +656,7 @@ namespace graphene { namespace net {
       void                       clear_peer_database();
       void                       set_total_bandwidth_limit( uint32_t upload_bytes_per_second, uint32_t download_bytes_per_second );
       fc::variant_object         get_call_statistics() const;
-      message                    get_message_for_item(const item_id& item) override;
+      std::shared_ptr<const message> get_message_for_item(const item_id& item) override;
 
       fc::variant_object         network_get_info() const;
       fc::variant_object         network_get_usage_stats() const;
@@ -836,6 +781,7 @@ namespace graphene { namespace net {
       fc::rand_bytes(&_node_id.data[0], (int)_node_id.size());
 
       _shutdownNotifier.reset(new fc::promise<void>("Node shutdown notifier"));
+      set_message_decoding_threads(_node_configuration.message_decoding_threads);
     }
 
     node_impl::~node_impl()
@@ -1259,6 +1205,13 @@ namespace graphene { namespace net {
         _retrigger_fetch_item_loop_promise->set_value();
     }
 
+    static rolling_bloom_filter make_inventory_bloom_filter(double false_positive_probability)
+    {
+      const uint32_t bucket_seconds = GRAPHENE_NET_MAX_INVENTORY_SIZE_IN_MINUTES * 60 / (GRAPHENE_NET_INVENTORY_BLOOM_FILTER_BUCKETS - 1);
+      return rolling_bloom_filter(GRAPHENE_NET_MAX_TRX_PER_SECOND * bucket_seconds, false_positive_probability,
+                                  fc::seconds(bucket_seconds), GRAPHENE_NET_INVENTORY_BLOOM_FILTER_BUCKETS);
+    }
+
     void node_impl::advertise_inventory_loop()
     {
       while (!_advertise_inventory_loop_done.canceled())
@@ -1272,6 +1225,7 @@ namespace graphene { namespace net {
         // first, then send them all in a batch (to avoid any fiber interruption points while
         // we're computing the messages)
         std::list<std::pair<peer_connection_ptr, item_ids_inventory_message> > inventory_messages_to_send;
+        const fc::time_point now = fc::time_point::now();
 
         for (const peer_connection_ptr& peer : _active_connections)
         {
@@ -1279,6 +1233,14 @@ namespace graphene { namespace net {
           //wdump((peer->peer_needs_sync_items_from_us));
           if( !peer->peer_needs_sync_items_from_us )
           {
+            if (_inventory_advertised_to_peers && !peer->inventory_advertised_to_peer_filter)
+            {
+              peer->inventory_advertised_to_peer_filter = make_inventory_bloom_filter(GRAPHENE_NET_INVENTORY_BLOOM_FILTER_FALSE_POSITIVE_RATE);
+              peer->inventory_advertised_to_peer.clear();
+            }
+            else if (!_inventory_advertised_to_peers && peer->inventory_advertised_to_peer_filter)
+              peer->inventory_advertised_to_peer_filter.reset();
+
             std::map<uint32_t, std::vector<item_hash_t> > items_to_advertise_by_type;
             // don't send the peer anything we've already advertised to it
             // or anything it has advertised to us
@@ -1292,11 +1254,13 @@ namespace graphene { namespace net {
               //if (peer->inventory_peer_advertised_to_us.find(item_to_advertise) != peer->inventory_peer_advertised_to_us.end() )
               //   wdump((*peer->inventory_peer_advertised_to_us.find(item_to_advertise)));
 
-              if (peer->inventory_advertised_to_peer.find(item_to_advertise) == peer->inventory_advertised_to_peer.end() &&
+              if (!peer->was_inventory_advertised_to_peer(item_to_advertise) &&
                   peer->inventory_peer_advertised_to_us.find(item_to_advertise) == peer->inventory_peer_advertised_to_us.end())
               {
                 items_to_advertise_by_type[item_to_advertise.item_type].push_back(item_to_advertise.item_hash);
-                peer->inventory_advertised_to_peer.insert(peer_connection::timestamped_item_id(item_to_advertise, fc::time_point::now()));
+                peer->add_inventory_advertised_to_peer(item_to_advertise, now);
+                if (_inventory_advertised_to_peers)
+                  _inventory_advertised_to_peers->insert(item_to_advertise, now);
                 ++total_items_to_send_to_this_peer;
                 if (item_to_advertise.item_type == trx_message_type)
                   testnetlog("advertising transaction ${id} to peer ${endpoint}", ("id", item_to_advertise.item_hash)("endpoint", peer->get_remote_endpoint()));
@@ -1782,13 +1746,38 @@ namespace graphene { namespace net {
       }
     }
 
+    void node_impl::set_message_decoding_threads(uint32_t thread_count)
+    {
+      _message_decoder.set_thread_count(thread_count);
+    }
+
+    void node_impl::set_inventory_bloom_filters(bool enabled)
+    {
+      VERIFY_CORRECT_THREAD();
+      // peers get their filters (or lose them) in advertise_inventory_loop, switching forgets what was advertised
+      // so far, which at worst makes us advertise some items again
+      if (enabled && !_inventory_advertised_to_peers)
+        _inventory_advertised_to_peers = make_inventory_bloom_filter(GRAPHENE_NET_NODE_INVENTORY_BLOOM_FILTER_FALSE_POSITIVE_RATE);
+      else if (!enabled)
+        _inventory_advertised_to_peers.reset();
+    }
+
+    void node_impl::decode_message(const message& received_message, message_hash_type& message_hash,
+                                   fc::optional<graphene::net::block_message>& decoded_block)
+    {
+      VERIFY_CORRECT_THREAD();
+      _message_decoder.decode(received_message, message_hash, decoded_block);
+    }
+
     void node_impl::on_message( peer_connection* originating_peer, const message& received_message )
     {
       VERIFY_CORRECT_THREAD();
 
       activity_tracer aTracer(__FUNCTION__, *this);
 
-      message_hash_type message_hash = received_message.id();
+      message_hash_type message_hash;
+      fc::optional<graphene::net::block_message> decoded_block;
+      decode_message(received_message, message_hash, decoded_block);
       send_message_timing_to_statsd( originating_peer, received_message, message_hash );
       dlog("handling message ${type} ${hash} size ${size} from peer ${endpoint}",
            ("type", graphene::net::core_message_type_enum(received_message.msg_type))("hash", message_hash)
@@ -1830,7 +1819,7 @@ namespace graphene { namespace net {
         on_closing_connection_message(originating_peer, received_message.as<closing_connection_message>());
         break;
       case core_message_type_enum::block_message_type:
-        process_block_message(originating_peer, received_message, message_hash);
+        process_block_message(originating_peer, received_message, *decoded_block, message_hash);
         break;
       case core_message_type_enum::current_time_request_message_type:
         on_current_time_request_message(originating_peer, received_message.as<current_time_request_message>());
@@ -1850,6 +1839,15 @@ namespace graphene { namespace net {
       case core_message_type_enum::get_current_connections_reply_message_type:
         on_get_current_connections_reply_message(originating_peer, received_message.as<get_current_connections_reply_message>());
         break;
+      case core_message_type_enum::compact_block_message_type:
+        on_compact_block_message(originating_peer, received_message.as<compact_block_message>());
+        break;
+      case core_message_type_enum::fetch_compact_block_transactions_message_type:
+        on_fetch_compact_block_transactions_message(originating_peer, received_message.as<fetch_compact_block_transactions_message>());
+        break;
+      case core_message_type_enum::compact_block_transactions_message_type:
+        on_compact_block_transactions_message(originating_peer, received_message.as<compact_block_transactions_message>());
+        break;
 
       default:
         // ignore any message in between core_message_type_first and _last that we don't handle above
@@ -1894,6 +1892,8 @@ namespace graphene { namespace net {
         user_data["last_known_fork_block_number"] = _hard_fork_block_numbers.back();
 
       user_data["chain_id"] = _delegate->get_new_chain_id();
+      if (_node_configuration.compact_blocks)
+        user_data["compact_blocks"] = true;
 
       return user_data;
     }
@@ -1919,6 +1919,8 @@ namespace graphene { namespace net {
         originating_peer->last_known_fork_block_number = user_data["last_known_fork_block_number"].as<uint32_t>();
       if (user_data.contains("chain_id"))
         originating_peer->chain_id = user_data["chain_id"].as<hive::protocol::chain_id_type>();
+      if (user_data.contains("compact_blocks"))
+        originating_peer->supports_compact_blocks = user_data["compact_blocks"].as_bool();
     }
 
     void node_impl::on_hello_message( peer_connection* originating_peer, const hello_message& hello_message_received )
@@ -2776,7 +2778,7 @@ namespace graphene { namespace net {
       }
     }
 
-    message node_impl::get_message_for_item(const item_id& item)
+    std::shared_ptr<const message> node_impl::get_message_for_item(const item_id& item)
     {
       activity_tracer aTracer(__FUNCTION__, *this);
 
@@ -2786,13 +2788,23 @@ namespace graphene { namespace net {
       }
       catch (fc::key_not_found_exception&)
       {}
+      if (item.item_type == block_message_type)
+      {
+        // blocks are queued by block_id, recently relayed ones can be sent as we received them
+        try
+        {
+          return _message_cache.get_message_by_contents_hash(item.item_hash);
+        }
+        catch (fc::key_not_found_exception&)
+        {}
+      }
       try
       {
-        return _delegate->get_item(item);
+        return std::make_shared<const message>(_delegate->get_item(item));
       }
       catch (fc::key_not_found_exception&)
       {}
-      return item_not_available_message(item);
+      return std::make_shared<const message>(item_not_available_message(item));
     }
 
     void node_impl::on_fetch_items_message(peer_connection* originating_peer, const fetch_items_message& fetch_items_message_received)
@@ -2803,20 +2815,25 @@ namespace graphene { namespace net {
            ("type", fetch_items_message_received.item_type)
            ("endpoint", originating_peer->get_remote_endpoint()));
 
-      fc::optional<message> last_block_message_sent;
+      fc::optional<block_id_type> last_block_id_sent;
 
-      std::list<message> reply_messages;
+      std::list<std::shared_ptr<const message>> reply_messages;
       for (const item_hash_t& item_hash : fetch_items_message_received.items_to_fetch)
       {
         try
         {
-          message requested_message = _message_cache.get_message(item_hash);
+          std::shared_ptr<const message> requested_message = _message_cache.get_message(item_hash);
           dlog("received item request for item ${id} from peer ${endpoint}, returning the item from my message cache",
                ("endpoint", originating_peer->get_remote_endpoint())
-               ("id", requested_message.id()));
+               ("id", item_hash));
+          if (requested_message->msg_type == block_message_type)
+          {
+            last_block_id_sent = get_block_id_of_message(*requested_message);
+            // a block we relay is new, so the peer most likely got its transactions already
+            if (originating_peer->supports_compact_blocks && _node_configuration.compact_blocks)
+              requested_message = get_compact_block_message(*requested_message, item_hash);
+          }
           reply_messages.push_back(requested_message);
-          if (fetch_items_message_received.item_type == block_message_type)
-            last_block_message_sent = requested_message;
           continue;
         }
         catch (fc::key_not_found_exception&)
@@ -2827,36 +2844,35 @@ namespace graphene { namespace net {
         item_id item_to_fetch(fetch_items_message_received.item_type, item_hash);
         try
         {
-          message requested_message = _delegate->get_item(item_to_fetch);
+          std::shared_ptr<const message> requested_message = std::make_shared<const message>(_delegate->get_item(item_to_fetch));
           dlog("received item request from peer ${endpoint}, returning the item from delegate with id ${id} size ${size}",
-               ("id", requested_message.id())
-               ("size", requested_message.size)
+               ("id", item_hash)
+               ("size", requested_message->size)
                ("endpoint", originating_peer->get_remote_endpoint()));
           reply_messages.push_back(requested_message);
-          if (fetch_items_message_received.item_type == block_message_type)
-            last_block_message_sent = requested_message;
+          if (requested_message->msg_type == block_message_type)
+            last_block_id_sent = get_block_id_of_message(*requested_message);
           continue;
         }
         catch (fc::key_not_found_exception&)
         {
-          reply_messages.push_back(item_not_available_message(item_to_fetch));
+          reply_messages.push_back(std::make_shared<const message>(item_not_available_message(item_to_fetch)));
           dlog("received item request from peer ${endpoint} but we don't have it",
                ("endpoint", originating_peer->get_remote_endpoint()));
         }
       }
 
       // if we sent them a block, update our record of the last block they've seen accordingly
-      if (last_block_message_sent)
+      if (last_block_id_sent)
       {
-        graphene::net::block_message block = last_block_message_sent->as<graphene::net::block_message>();
-        originating_peer->last_block_delegate_has_seen = block.block_id;
-        originating_peer->last_block_time_delegate_has_seen = _delegate->get_block_time(block.block_id);
+        originating_peer->last_block_delegate_has_seen = *last_block_id_sent;
+        originating_peer->last_block_time_delegate_has_seen = _delegate->get_block_time(*last_block_id_sent);
       }
 
-      for (const message& reply : reply_messages)
+      for (const std::shared_ptr<const message>& reply : reply_messages)
       {
-        if (reply.msg_type == block_message_type)
-          originating_peer->send_item(item_id(block_message_type, reply.as<graphene::net::block_message>().block_id));
+        if (reply->msg_type == block_message_type)
+          originating_peer->send_item(item_id(block_message_type, get_block_id_of_message(*reply)));
         else
           originating_peer->send_message(reply);
       }
@@ -2869,6 +2885,9 @@ namespace graphene { namespace net {
       auto regular_item_iter = originating_peer->items_requested_from_peer.find(requested_item);
       if (regular_item_iter != originating_peer->items_requested_from_peer.end())
       {
+        if (originating_peer->compact_block_being_completed &&
+            originating_peer->compact_block_being_completed->block_message_hash == requested_item.item_hash)
+          originating_peer->compact_block_being_completed.reset();
         originating_peer->items_requested_from_peer.erase( regular_item_iter );
         originating_peer->inventory_peer_advertised_to_us.erase( requested_item );
         if (is_item_in_any_peers_inventory(requested_item))
@@ -2918,11 +2937,13 @@ namespace graphene { namespace net {
           // we've processed this item but haven't advertised it to our peers yet, don't fetch it again
           continue;
 
-        bool we_advertised_this_item_to_a_peer = false;
+        bool we_advertised_this_item_to_a_peer = _inventory_advertised_to_peers && _inventory_advertised_to_peers->contains(advertised_item_id);
         bool we_requested_this_item_from_a_peer = false;
         for (const peer_connection_ptr& peer : _active_connections)
         {
-          if (peer->inventory_advertised_to_peer.find(advertised_item_id) != peer->inventory_advertised_to_peer.end())
+          if (we_advertised_this_item_to_a_peer)
+            break;
+          if (!_inventory_advertised_to_peers && peer->was_inventory_advertised_to_peer(advertised_item_id))
           {
             we_advertised_this_item_to_a_peer = true;
             break;
@@ -3448,6 +3469,7 @@ namespace graphene { namespace net {
 
     void node_impl::process_block_during_normal_operation( peer_connection* originating_peer,
                                                            const graphene::net::block_message& block_message_to_process,
+                                                           const message& message_to_process,
                                                            const message_hash_type& message_hash )
     {
       fc::time_point message_receive_time = fc::time_point::now();
@@ -3535,7 +3557,8 @@ namespace graphene { namespace net {
           peer->clear_old_inventory();
         }
         message_propagation_data propagation_data{message_receive_time, message_validated_time, originating_peer->node_id};
-        broadcast( block_message_to_process, propagation_data );
+        // relay the block exactly as we received it, there is no need to pack and hash it again
+        broadcast( std::make_shared<const message>( message_to_process ), message_hash, block_message_to_process.block_id, propagation_data );
         _message_cache.block_accepted();
 
         if (is_hard_fork_block(block_number))
@@ -3608,6 +3631,7 @@ namespace graphene { namespace net {
     }
     void node_impl::process_block_message(peer_connection* originating_peer,
                                           const message& message_to_process,
+                                          const graphene::net::block_message& block_message_to_process,
                                           const message_hash_type& message_hash)
     {
       VERIFY_CORRECT_THREAD();
@@ -3616,12 +3640,11 @@ namespace graphene { namespace net {
       // (it's possible that we request an item during normal operation and then get kicked into sync
       // mode before we receive and process the item.  In that case, we should process the item as a normal
       // item to avoid confusing the sync code)
-      graphene::net::block_message block_message_to_process(message_to_process.as<graphene::net::block_message>());
       auto item_iter = originating_peer->items_requested_from_peer.find(item_id(graphene::net::block_message_type, message_hash));
       if (item_iter != originating_peer->items_requested_from_peer.end())
       {
         originating_peer->items_requested_from_peer.erase(item_iter);
-        process_block_during_normal_operation(originating_peer, block_message_to_process, message_hash);
+        process_block_during_normal_operation(originating_peer, block_message_to_process, message_to_process, message_hash);
         if (originating_peer->idle())
           trigger_fetch_items_loop();
         return;
@@ -3945,6 +3968,108 @@ namespace graphene { namespace net {
       VERIFY_CORRECT_THREAD();
     }
 
+    std::shared_ptr<const message> node_impl::get_compact_block_message(const message& full_block_message, const item_hash_t& block_message_hash)
+    {
+      VERIFY_CORRECT_THREAD();
+      if (_last_compact_block.first != block_message_hash || !_last_compact_block.second)
+      {
+        compact_block_message compact_block(full_block_message.as<block_message>(), block_message_hash);
+        _last_compact_block = std::make_pair(block_message_hash, std::make_shared<const message>(compact_block));
+      }
+      return _last_compact_block.second;
+    }
+
+    void node_impl::on_compact_block_message(peer_connection* originating_peer,
+                                             const compact_block_message& compact_block_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      item_id block_item(block_message_type, compact_block_message_received.block_message_hash);
+      if (originating_peer->items_requested_from_peer.find(block_item) == originating_peer->items_requested_from_peer.end())
+      {
+        wlog("received a compact block ${id} I didn't ask for from peer ${endpoint}, ignoring it",
+             ("id", compact_block_message_received.block_id)("endpoint", originating_peer->get_remote_endpoint()));
+        return;
+      }
+
+      partial_compact_block partial_block(compact_block_message_received, [this](uint64_t short_transaction_id)
+        {
+          return _message_cache.get_transaction_by_short_id(short_transaction_id);
+        });
+      dlog("received compact block ${id} from peer ${endpoint}, missing ${missing} of ${count} transactions",
+           ("id", partial_block.block_id)("endpoint", originating_peer->get_remote_endpoint())
+           ("missing", partial_block.missing_transaction_indexes.size())("count", partial_block.block.transactions.size()));
+      complete_compact_block(originating_peer, std::move(partial_block));
+    }
+
+    void node_impl::on_fetch_compact_block_transactions_message(peer_connection* originating_peer,
+                                                                const fetch_compact_block_transactions_message& fetch_compact_block_transactions_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      std::shared_ptr<const message> full_block_message;
+      try
+      {
+        full_block_message = _message_cache.get_message(fetch_compact_block_transactions_message_received.block_message_hash);
+      }
+      catch (fc::key_not_found_exception&)
+      {
+        // the block already dropped out of our cache, the peer has to fetch it from someone else
+        originating_peer->send_message(item_not_available_message(item_id(block_message_type, fetch_compact_block_transactions_message_received.block_message_hash)));
+        return;
+      }
+
+      originating_peer->send_message(message(get_compact_block_transactions(full_block_message->as<block_message>(),
+                                                                            fetch_compact_block_transactions_message_received.transaction_indexes)));
+    }
+
+    void node_impl::on_compact_block_transactions_message(peer_connection* originating_peer,
+                                                          const compact_block_transactions_message& compact_block_transactions_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      if (!originating_peer->compact_block_being_completed ||
+          originating_peer->compact_block_being_completed->block_id != compact_block_transactions_message_received.block_id)
+      {
+        wlog("received transactions of compact block ${id} I'm not waiting for from peer ${endpoint}, ignoring them",
+             ("id", compact_block_transactions_message_received.block_id)("endpoint", originating_peer->get_remote_endpoint()));
+        return;
+      }
+
+      partial_compact_block partial_block = std::move(*originating_peer->compact_block_being_completed);
+      originating_peer->compact_block_being_completed.reset();
+      partial_block.add_missing_transactions(compact_block_transactions_message_received);
+      complete_compact_block(originating_peer, std::move(partial_block));
+    }
+
+    void node_impl::complete_compact_block(peer_connection* originating_peer, partial_compact_block&& partial_block)
+    {
+      VERIFY_CORRECT_THREAD();
+      graphene::net::block_message reconstructed_block;
+      fc::optional<message> block_message_to_process;
+      switch (partial_block.complete(reconstructed_block, block_message_to_process))
+      {
+        case partial_compact_block::short_id_collision:
+          dlog("compact block ${id} from peer ${endpoint} was reconstructed incorrectly, requesting all its transactions",
+               ("id", partial_block.block_id)("endpoint", originating_peer->get_remote_endpoint()));
+          // fall through
+        case partial_compact_block::missing_transactions:
+          // only one compact block per peer is completed at a time, if the peer sends another one meanwhile,
+          // the previous one times out and is fetched again like any other item
+          originating_peer->send_message(message(partial_block.get_fetch_message()));
+          originating_peer->compact_block_being_completed = std::move(partial_block);
+          return;
+        case partial_compact_block::mismatch:
+        {
+          fc::exception detailed_error(FC_LOG_MESSAGE(error, "Transactions you sent me do not form block ${id} you offered",
+                                                      ("id", partial_block.block_id)));
+          disconnect_from_peer(originating_peer, "You sent me a compact block that doesn't match the block you offered", true, detailed_error);
+          return;
+        }
+        case partial_compact_block::completed:
+          break;
+      }
+
+      process_block_message(originating_peer, *block_message_to_process, reconstructed_block, partial_block.block_message_hash);
+    }
+
 
     // this handles any message we get that doesn't require any special processing.
     // currently, this is any message other than block messages and p2p-specific
@@ -3976,12 +4101,14 @@ namespace graphene { namespace net {
 
         // Next: have the delegate process the message
         fc::time_point message_validated_time;
+        fc::uint160_t hash_of_message_contents;
         try
         {
           if (message_to_process.msg_type == trx_message_type)
           {
-            trx_message transaction_message_to_process = message_to_process.as<trx_message>();
-            dlog("passing message containing transaction ${trx} to client", ("trx", transaction_message_to_process.trx.id()));
+            trx_message transaction_message_to_process = message_to_process.as_exact<trx_message>();
+            hash_of_message_contents = transaction_message_to_process.trx.id();
+            dlog("passing message containing transaction ${trx} to client", ("trx", hash_of_message_contents));
             _delegate->handle_transaction(transaction_message_to_process);
           }
           else
@@ -4002,7 +4129,7 @@ namespace graphene { namespace net {
 
         // finally, if the delegate validated the message, broadcast it to our other peers
         message_propagation_data propagation_data{message_receive_time, message_validated_time, originating_peer->node_id};
-        broadcast( message_to_process, propagation_data );
+        broadcast( std::make_shared<const message>( message_to_process ), message_hash, hash_of_message_contents, propagation_data );
       }
     }
 
@@ -4590,6 +4717,8 @@ namespace graphene { namespace net {
       }
 
       _node_public_key = _node_configuration.private_key.get_public_key().serialize();
+      set_message_decoding_threads( _node_configuration.message_decoding_threads );
+      set_inventory_bloom_filters( _node_configuration.inventory_bloom_filters );
 
       fc::path potential_peer_database_file_name(_node_configuration_directory / POTENTIAL_PEER_DATABASE_FILENAME);
       try
@@ -4883,6 +5012,8 @@ namespace graphene { namespace net {
         ilog( "    peer.ids_of_items_to_get size: ${size}", ("size", peer->ids_of_items_to_get.size() ) );
         ilog( "    peer.inventory_peer_advertised_to_us size: ${size}", ("size", peer->inventory_peer_advertised_to_us.size() ) );
         ilog( "    peer.inventory_advertised_to_peer size: ${size}", ("size", peer->inventory_advertised_to_peer.size() ) );
+        if( peer->inventory_advertised_to_peer_filter )
+          ilog( "    peer.inventory_advertised_to_peer_filter bytes: ${size}", ("size", peer->inventory_advertised_to_peer_filter->size_in_bytes() ) );
         ilog( "    peer.items_requested_from_peer size: ${size}", ("size", peer->items_requested_from_peer.size() ) );
         ilog( "    peer.sync_items_requested_from_peer size: ${size}", ("size", peer->sync_items_requested_from_peer.size() ) );
       }
@@ -5048,15 +5179,26 @@ namespace graphene { namespace net {
       return (uint32_t)_active_connections.size();
     }
 
+    void node_impl::broadcast( std::shared_ptr<const message> item_to_broadcast, const message_hash_type& hash_of_item_to_broadcast,
+                               const fc::uint160_t& hash_of_message_contents, const message_propagation_data& propagation_data )
+    {
+      VERIFY_CORRECT_THREAD();
+      uint32_t item_type = item_to_broadcast->msg_type;
+      if( item_type == graphene::net::block_message_type )
+        _most_recent_blocks_accepted.push_back( hash_of_message_contents );
+
+      _message_cache.cache_message( std::move( item_to_broadcast ), hash_of_item_to_broadcast, propagation_data, hash_of_message_contents );
+      _new_inventory.insert( item_id( item_type, hash_of_item_to_broadcast ) );
+      trigger_advertise_inventory_loop();
+    }
+
     void node_impl::broadcast( const message& item_to_broadcast, const message_propagation_data& propagation_data )
     {
       VERIFY_CORRECT_THREAD();
       fc::uint160_t hash_of_message_contents;
       if( item_to_broadcast.msg_type == graphene::net::block_message_type )
       {
-        graphene::net::block_message block_message_to_broadcast = item_to_broadcast.as<graphene::net::block_message>();
-        hash_of_message_contents = block_message_to_broadcast.block_id; // for debugging
-        _most_recent_blocks_accepted.push_back( block_message_to_broadcast.block_id );
+        hash_of_message_contents = get_block_id_of_message( item_to_broadcast ); // for debugging
       }
       else if( item_to_broadcast.msg_type == graphene::net::trx_message_type )
       {
@@ -5064,11 +5206,7 @@ namespace graphene { namespace net {
         hash_of_message_contents = transaction_message_to_broadcast.trx.id(); // for debugging
         dlog( "broadcasting trx: ${trx}", ("trx", transaction_message_to_broadcast) );
       }
-      message_hash_type hash_of_item_to_broadcast = item_to_broadcast.id();
-
-      _message_cache.cache_message( item_to_broadcast, hash_of_item_to_broadcast, propagation_data, hash_of_message_contents );
-      _new_inventory.insert( item_id(item_to_broadcast.msg_type, hash_of_item_to_broadcast ) );
-      trigger_advertise_inventory_loop();
+      broadcast( std::make_shared<const message>( item_to_broadcast ), item_to_broadcast.id(), hash_of_message_contents, propagation_data );
     }
 
     void node_impl::broadcast( const message& item_to_broadcast )
@@ -5110,6 +5248,8 @@ namespace graphene { namespace net {
       ilog( "set_advanced_node_parameters ${params}", ("params", params) );
 
       fc::from_variant( params, _node_configuration );
+      set_message_decoding_threads( _node_configuration.message_decoding_threads );
+      set_inventory_bloom_filters( _node_configuration.inventory_bloom_filters );
 
       if( _node_configuration.private_key == fc::ecc::private_key() )
       {
@@ -5199,6 +5339,14 @@ namespace graphene { namespace net {
       info["node_public_key"] = _node_public_key;
       info["node_id"] = _node_id;
       info["firewalled"] = _is_firewalled;
+      // depth of queues between stages of message processing
+      info["message_decoding_threads"] = _message_decoder.get_thread_count();
+      info["messages_waiting_for_decoding"] = _message_decoder.get_messages_waiting();
+      info["max_messages_waiting_for_decoding"] = _message_decoder.get_max_messages_waiting();
+      info["messages_decoded_in_threads"] = _message_decoder.get_messages_decoded_in_threads();
+      info["messages_being_processed"] = _message_ids_currently_being_processed.size();
+      info["items_to_fetch"] = _items_to_fetch.size();
+      info["received_sync_items"] = _received_sync_items.size() + _new_received_sync_items.size();
       return info;
     }
     fc::variant_object node_impl::network_get_usage_stats() const
@@ -43,7 +43,7 @@
 
 namespace graphene { namespace net
   {
-    message peer_connection::real_queued_message::get_message(peer_connection_delegate*)
+    const message& peer_connection::real_queued_message::get_message(peer_connection_delegate*)
     {
       if (message_send_time_field_offset != (size_t)-1)
       {
@@ -60,9 +60,20 @@ namespace graphene { namespace net
     {
       return message_to_send.data.size();
     }
-    message peer_connection::virtual_queued_message::get_message(peer_connection_delegate* node)
+    const message& peer_connection::shared_queued_message::get_message(peer_connection_delegate*)
     {
-      return node->get_message_for_item(item_to_send);
+      return *message_to_send;
+    }
+    size_t peer_connection::shared_queued_message::get_size_in_queue()
+    {
+      // memory is shared with other queues, but the whole message still has to be sent to this peer
+      return message_to_send->data.size();
+    }
+    const message& peer_connection::virtual_queued_message::get_message(peer_connection_delegate* node)
+    {
+      if (!message_to_send)
+        message_to_send = node->get_message_for_item(item_to_send);
+      return *message_to_send;
     }
 
     size_t peer_connection::virtual_queued_message::get_size_in_queue()
@@ -294,7 +305,7 @@ namespace graphene { namespace net
       while (!_queued_messages.empty())
       {
         _queued_messages.front()->transmission_start_time = fc::time_point::now();
-        message message_to_send = _queued_messages.front()->get_message(_node);
+        const message& message_to_send = _queued_messages.front()->get_message(_node);
         try
         {
           //dlog("peer_connection::send_queued_messages_task() calling message_oriented_connection::send_message() "
@@ -378,6 +389,13 @@ namespace graphene { namespace net
       send_queueable_message(std::move(message_to_enqueue));
     }
 
+    void peer_connection::send_message(std::shared_ptr<const message> message_to_send)
+    {
+      VERIFY_CORRECT_THREAD();
+      std::unique_ptr<queued_message> message_to_enqueue(new shared_queued_message(std::move(message_to_send)));
+      send_queueable_message(std::move(message_to_enqueue));
+    }
+
     void peer_connection::send_item(const item_id& item_to_send)
     {
       VERIFY_CORRECT_THREAD();
@@ -484,6 +502,8 @@ namespace graphene { namespace net
       auto begin_iter = inventory_advertised_to_peer.get<timestamp_index>().begin();
       unsigned number_of_elements_advertised_to_peer_to_discard = std::distance(begin_iter, oldest_inventory_to_keep_iter);
       inventory_advertised_to_peer.get<timestamp_index>().erase(begin_iter, oldest_inventory_to_keep_iter);
+      if (inventory_advertised_to_peer_filter)
+        inventory_advertised_to_peer_filter->expire(fc::time_point::now());
 
       // also expire items from inventory_peer_advertised_to_us
       oldest_inventory_to_keep_iter = inventory_peer_advertised_to_us.get<timestamp_index>().lower_bound(oldest_inventory_to_keep);
@@ -496,6 +516,23 @@ namespace graphene { namespace net
            ("to_us", number_of_elements_peer_advertised_to_discard)("remain_to_us", inventory_peer_advertised_to_us.size()));
     }
 
+    bool peer_connection::was_inventory_advertised_to_peer(const item_id& item) const
+    {
+      VERIFY_CORRECT_THREAD();
+      if (inventory_advertised_to_peer_filter)
+        return inventory_advertised_to_peer_filter->contains(item);
+      return inventory_advertised_to_peer.find(item) != inventory_advertised_to_peer.end();
+    }
+
+    void peer_connection::add_inventory_advertised_to_peer(const item_id& item, fc::time_point now)
+    {
+      VERIFY_CORRECT_THREAD();
+      if (inventory_advertised_to_peer_filter)
+        inventory_advertised_to_peer_filter->insert(item, now);
+      else
+        inventory_advertised_to_peer.insert(timestamped_item_id(item, now));
+    }
+
     // we have a higher limit for blocks than transactions so we will still fetch blocks even when transactions are throttled
     bool peer_connection::is_inventory_advertised_to_us_list_full_for_transactions() const
     {
@@ -36,6 +36,10 @@
 
 namespace graphene { namespace net {
 
+// large enough for most messages to be received and decrypted at once (AES with hardware support is
+// fast enough that per call and per socket operation overhead dominates with small buffers)
+static const size_t stcp_buffer_length = 64 * 1024;
+
 stcp_socket::stcp_socket()
 //:_buf_len(0)
 #ifndef NDEBUG
@@ -100,11 +104,10 @@ size_t stcp_socket::readsome( char* buffer, size_t len )
     } buffer_in_use_checker(_read_buffer_in_use);
 #endif
 
-    const size_t read_buffer_length = 4096;
     if (!_read_buffer)
-      _read_buffer.reset(new char[read_buffer_length], [](char* p){ delete[] p; });
+      _read_buffer.reset(new char[stcp_buffer_length], [](char* p){ delete[] p; });
 
-    len = std::min<size_t>(read_buffer_length, len);
+    len = std::min<size_t>(stcp_buffer_length, len);
 
     size_t s = _sock.readsome( _read_buffer, len, 0 );
     if( s % 16 ) 
@@ -141,17 +144,9 @@ size_t stcp_socket::writesome( const char* buffer, size_t len )
     } buffer_in_use_checker(_write_buffer_in_use);
 #endif
 
-    const std::size_t write_buffer_length = 4096;
     if (!_write_buffer)
-      _write_buffer.reset(new char[write_buffer_length], [](char* p){ delete[] p; });
-    len = std::min<size_t>(write_buffer_length, len);
-    memset(_write_buffer.get(), 0, len); // just in case aes.encode screws up
-    /**
-     * every sizeof(crypt_buf) bytes the aes channel
-     * has an error and doesn't decrypt properly...  disable
-     * for now because we are going to upgrade to something
-     * better.
-     */
+      _write_buffer.reset(new char[stcp_buffer_length], [](char* p){ delete[] p; });
+    len = std::min<size_t>(stcp_buffer_length, len);
     uint32_t ciphertext_len = _send_aes.encode( buffer, len, _write_buffer.get() );
     assert(ciphertext_len == len);
     _sock.write( _write_buffer, ciphertext_len );
@@ -163,6 +158,15 @@ size_t stcp_socket::writesome( const std::shared_ptr<const char>& buf, size_t le
   return writesome(buf.get() + offset, len);
 }
 
+void stcp_socket::write_in_place( const std::shared_ptr<char>& buf, size_t len )
+{ try {
+    assert( (len % 16) == 0 );
+
+    uint32_t ciphertext_len = _send_aes.encode( buf.get(), len, buf.get() );
+    assert(ciphertext_len == len);
+    _sock.write( buf, ciphertext_len );
+} FC_RETHROW_EXCEPTIONS( warn, "", ("len",len) ) }
+
 void stcp_socket::flush()
 {
   _sock.flush();
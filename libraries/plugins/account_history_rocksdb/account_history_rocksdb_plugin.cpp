@@ -15,9 +15,11 @@
 #include <hive/plugins/chain/state_snapshot_provider.hpp>
 
 #include <hive/utilities/benchmark_dumper.hpp>
+#include <hive/utilities/metrics.hpp>
 #include <hive/utilities/plugin_utilities.hpp>
 
 #include <hive/plugins/condenser_api/condenser_api.hpp>
+#include <hive/plugins/statsd/utility.hpp>
 
 #include <appbase/application.hpp>
 
@@ -31,8 +33,12 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/container/flat_set.hpp>
 
+#include <algorithm>
 #include <condition_variable>
+#include <deque>
+#include <exception>
 #include <mutex>
+#include <thread>
 
 #include <limits>
 #include <string>
@@ -53,6 +59,7 @@ namespace bpo = boost::program_options;
 #define AH_INFO_BY_NAME 4
 #define AH_OPERATION_BY_ID 5
 #define BY_TRANSACTION_ID 6
+#define VIRTUAL_OP_BY_BLOCK 7
 
 #define WRITE_BUFFER_FLUSH_LIMIT     10
 #define ACCOUNT_HISTORY_LENGTH_LIMIT 30
@@ -64,8 +71,21 @@ namespace bpo = boost::program_options;
   */
 #define MAX_OPERATION_ID             std::numeric_limits<int64_t>::max()
 
+/** Minor version 1: AH_OPERATION_BY_ID values hold operation type next to the operation id.
+  *  Stores of version 0 are still accepted, since their (shorter) entries are handled while reading.
+  *  Minor version 2: VIRTUAL_OP_BY_BLOCK column, backfilled from OPERATION_BY_ID when older store is opened.
+  */
 #define STORE_MAJOR_VERSION          1
-#define STORE_MINOR_VERSION          0
+#define STORE_MINOR_VERSION          2
+
+/// Number of entries written in single batch while backfilling VIRTUAL_OP_BY_BLOCK column.
+#define STORE_UPGRADE_BATCH_SIZE     100000
+
+/// Max number of irreversible blocks waiting for background writer, before block processing has to wait for it.
+#define MAX_STAGED_BLOCKS            1200
+
+/// Max number of AH entries checked against operation type filter during single get_account_history call.
+#define ACCOUNT_HISTORY_FILTER_SCAN_LIMIT 100000
 
 namespace hive { namespace plugins { namespace account_history_rocksdb {
 
@@ -139,6 +159,22 @@ void load(T& obj, const serialize_buffer_t& source)
   load(obj, source.data(), source.size());
   }
 
+/// Id given to operations of reversible blocks, since they have no persistent id yet.
+uint64_t get_reversible_op_id(uint32_t trx_in_block, uint32_t op_in_trx)
+  {
+  uint64_t opId = op_in_trx;
+  opId |= static_cast<uint64_t>(trx_in_block) << 32;
+  return opId;
+  }
+
+/// Retrieves `operation::which()` from serialized operation without unpacking it whole.
+uint32_t get_operation_type(const serialize_buffer_t& serializedOp)
+  {
+  fc::unsigned_int opType;
+  load(opType, serializedOp);
+  return opType.value;
+  }
+
 /** Helper class to simplify construction of Slice objects holding primitive type values.
   *
   */
@@ -283,6 +319,8 @@ typedef PrimitiveTypeSlice< block_op_id_pair > op_by_block_num_slice_t;
 typedef PrimitiveTypeSlice< uint32_t > by_block_slice_t;
 typedef PrimitiveTypeSlice< account_name_type::Storage > ah_info_by_name_slice_t;
 typedef PrimitiveTypeSlice< ah_op_id_pair > ah_op_by_id_slice_t;
+/// Value of VIRTUAL_OP_BY_BLOCK entry - the type of virtual operation
+typedef PrimitiveTypeSlice< uint32_t > op_type_slice_t;
 
 
 class TransactionIdComparator final : public AComparator
@@ -303,6 +341,42 @@ class TransactionIdComparator final : public AComparator
 typedef std::pair<uint32_t, uint32_t> block_no_tx_in_block_pair;
 typedef PrimitiveTypeSlice<block_no_tx_in_block_pair> block_no_tx_in_block_slice_t;
 
+/** Value of AH_OPERATION_BY_ID entry: operation id followed by operation type, what allows to filter
+  *  account history by operation type without loading operations. Entries written by older versions
+  *  hold operation id only.
+  */
+class ah_op_value_slice_t final : public Slice
+  {
+  public:
+    ah_op_value_slice_t(int64_t opId, uint32_t opType)
+    {
+    memcpy(_value, &opId, sizeof(opId));
+    memcpy(_value + sizeof(opId), &opType, sizeof(opType));
+    data_ = _value;
+    size_ = sizeof(_value);
+    }
+
+    static int64_t unpackOpId(const Slice& s)
+    {
+    assert(s.size() == sizeof(int64_t) || s.size() == sizeof(int64_t) + sizeof(uint32_t));
+    int64_t opId = 0;
+    memcpy(&opId, s.data(), sizeof(opId));
+    return opId;
+    }
+
+    /// Returns false for entries which do not hold operation type.
+    static bool unpackOpType(const Slice& s, uint32_t* opType)
+    {
+    if(s.size() != sizeof(int64_t) + sizeof(uint32_t))
+      return false;
+    memcpy(opType, s.data() + sizeof(int64_t), sizeof(uint32_t));
+    return true;
+    }
+
+  private:
+    char _value[sizeof(int64_t) + sizeof(uint32_t)];
+  };
+
 const Comparator* by_id_Comparator()
 {
   static by_id_ComparatorImpl c;
@@ -410,6 +484,39 @@ private:
   std::map<account_name_type, account_history_info> _ahInfoCache;
 };
 
+/// Holds RocksDB snapshot, so all reads done by single API call see the same storage state.
+class StorageSnapshot
+{
+public:
+  StorageSnapshot() = default;
+  StorageSnapshot(const StorageSnapshot&) = delete;
+  StorageSnapshot& operator=(const StorageSnapshot&) = delete;
+
+  ~StorageSnapshot()
+  {
+    if(_snapshot != nullptr)
+      _storage->ReleaseSnapshot(_snapshot);
+  }
+
+  void take(DB* storage)
+  {
+    FC_ASSERT(_snapshot == nullptr, "Snapshot already taken");
+    _storage = storage;
+    _snapshot = storage->GetSnapshot();
+  }
+
+  ReadOptions readOptions() const
+  {
+    ReadOptions rOptions;
+    rOptions.snapshot = _snapshot;
+    return rOptions;
+  }
+
+private:
+  DB*                         _storage = nullptr;
+  const ::rocksdb::Snapshot*  _snapshot = nullptr;
+};
+
 struct supplement_operations_visitor
 {
   supplement_operations_visitor( chain::database& db ) : _db( db ) {}
@@ -591,15 +698,25 @@ public:
     options.max_open_files = OPEN_FILE_LIMIT;
 
     DBOptions dbOptions(options);
+    /// Columns introduced by newer store versions are created empty, then filled by upgradeStore.
+    dbOptions.create_missing_column_families = true;
 
     auto status = DB::Open(dbOptions, strPath, columnDefs, &_columnHandles, &storageDb);
 
     if(status.ok())
     {
       ilog("RocksDB opened successfully storage at location: `${p}'.", ("p", strPath));
-      verifyStoreVersion(storageDb);
+      auto minorVersion = verifyStoreVersion(storageDb);
       loadSeqIdentifiers(storageDb);
-      _storage.reset(storageDb);
+      {
+        std::lock_guard<std::mutex> lk(_metricsMtx);
+        _storage.reset(storageDb);
+      }
+      hive::utilities::metrics::registry::instance().add_collector("account_history_rocksdb",
+        [this](hive::utilities::metrics::text_writer& writer) { collectMetrics(writer); });
+
+      if(minorVersion < STORE_MINOR_VERSION)
+        upgradeStore(minorVersion);
 
       // I do not like using exceptions for control paths, but column definitions are set multiple times
       // opening the db, so that is not a good place to write the initial lib.
@@ -630,24 +747,140 @@ public:
 
   void find_account_history_data(const account_name_type& name, uint64_t start, uint32_t limit, bool include_reversible,
     std::function<bool(unsigned int, const rocksdb_operation_object&)> processor) const;
-  bool find_operation_object(size_t opId, rocksdb_operation_object* op) const;
+  /// Filters AH entries by operation type held in them, then loads accepted operations in batches (MultiGet).
+  void find_account_history_data(const account_name_type& name, uint64_t start, uint32_t limit, bool include_reversible,
+    const operation_type_filter& filter, std::function<bool(unsigned int, const rocksdb_operation_object&)> processor) const;
+  bool find_operation_object(size_t opId, rocksdb_operation_object* op, const ReadOptions& rOptions = ReadOptions()) const;
   /// Allows to look for all operations present in given block and call `processor` for them.
   void find_operations_by_block(size_t blockNum, bool include_reversible,
     std::function<void(const rocksdb_operation_object&)> processor) const;
   /// Allows to enumerate all operations registered in given block range.
   std::pair< uint32_t/*nr last block*/, uint64_t/*operation-id to resume from*/ > enumVirtualOperationsFromBlockRange(
     uint32_t blockRangeBegin, uint32_t blockRangeEnd, bool include_reversible,
-    fc::optional<uint64_t> operationBegin, fc::optional<uint32_t> limit,
+    fc::optional<uint64_t> operationBegin, fc::optional<uint32_t> limit, fc::optional<operation_type_filter> typeFilter,
     std::function<bool(const rocksdb_operation_object&, uint64_t, bool)> processor) const;
 
   bool find_transaction_info(const protocol::transaction_id_type& trxId, bool include_reversible, uint32_t* blockNo,
     uint32_t* txInBlock) const;
 
+  /** Starts thread writing operations of irreversible blocks, so block processing does not wait for RocksDB
+    *  (i.e. stalled by compaction). Until written, API calls read such operations from staging area.
+    */
+  void startBackgroundWriter()
+  {
+    if(_backgroundWrite == false || _storage == nullptr || _writer.joinable())
+      return;
+
+    ilog("Starting account history background writer...");
+
+    /// Writer flushes whole group of blocks taken from staging area at once.
+    _collectedOpsWriteLimit = std::numeric_limits<unsigned int>::max();
+    _stopWriter = false;
+    _writer = std::thread([this]() { writerLoop(); });
+  }
+
+  /// Waits until all staged blocks are written, then stops the writer.
+  void stopBackgroundWriter()
+  {
+    if(_writer.joinable() == false)
+      return;
+
+    {
+      std::lock_guard<std::mutex> lk(_stagingMtx);
+      _stopWriter = true;
+      _writerPaused = false;
+    }
+    _stagingCv.notify_all();
+    _writer.join();
+    _collectedOpsWriteLimit = 1;
+
+    ilog("Account history background writer stopped.");
+  }
+
+  /// Waits until all staged blocks are written.
+  void drainStagedBlocks()
+  {
+    std::unique_lock<std::mutex> lk(_stagingMtx);
+    _stagingCv.wait(lk, [this]() { return _stagedBlocks.empty() || _writerError; });
+  }
+
+#ifdef IS_TEST_NET
+  void pauseBackgroundWriter(bool pause)
+  {
+    {
+      std::lock_guard<std::mutex> lk(_stagingMtx);
+      _writerPaused = pause;
+    }
+    _stagingCv.notify_all();
+  }
+
+  size_t getStagedBlockCount() const
+  {
+    std::lock_guard<std::mutex> lk(_stagingMtx);
+    return _stagedBlocks.size();
+  }
+
+  void setFilterScanLimit(uint32_t limit)
+  {
+    _filterScanLimit = limit;
+  }
+
+  /// Converts storage to format of older minor version, then reopens it, what upgrades it back.
+  void rewriteStoreAsVersion(uint32_t minorVersion)
+  {
+    FC_ASSERT(minorVersion < STORE_MINOR_VERSION);
+
+    stopBackgroundWriter();
+    flushStorage();
+
+    WriteBatch batch;
+    {
+      /// Minor version 2 introduced VIRTUAL_OP_BY_BLOCK column.
+      std::unique_ptr<::rocksdb::Iterator> it(_storage->NewIterator(ReadOptions(), _columnHandles[VIRTUAL_OP_BY_BLOCK]));
+      for(it->SeekToFirst(); it->Valid(); it->Next())
+      {
+        auto s = batch.Delete(_columnHandles[VIRTUAL_OP_BY_BLOCK], it->key());
+        checkStatus(s);
+      }
+      checkStatus(it->status());
+    }
+
+    if(minorVersion < 1)
+    {
+      /// Minor version 1 introduced operation type in AH_OPERATION_BY_ID values.
+      std::unique_ptr<::rocksdb::Iterator> it(_storage->NewIterator(ReadOptions(), _columnHandles[AH_OPERATION_BY_ID]));
+      for(it->SeekToFirst(); it->Valid(); it->Next())
+      {
+        id_slice_t opIdSlice(ah_op_value_slice_t::unpackOpId(it->value()));
+        auto s = batch.Put(_columnHandles[AH_OPERATION_BY_ID], it->key(), opIdSlice);
+        checkStatus(s);
+      }
+      checkStatus(it->status());
+    }
+
+    PrimitiveTypeSlice<uint32_t> minorVSlice(minorVersion);
+    auto s = batch.Put(Slice("STORE_MINOR_VERSION"), minorVSlice);
+    checkStatus(s);
+    s = _storage->Write(::rocksdb::WriteOptions(), &batch);
+    checkStatus(s);
+
+    shutdownDb();
+    openDb();
+    startBackgroundWriter();
+  }
+#endif
+
   void shutdownDb()
   {
+    stopBackgroundWriter();
+
+    hive::utilities::metrics::registry::instance().remove_collector("account_history_rocksdb");
+
     if(_storage)
     {
       flushStorage();
+      /// Scrape that took the collector before its removal may still be running.
+      std::lock_guard<std::mutex> lk(_metricsMtx);
       cleanupColumnHandles();
       _storage->Close();
       _storage.reset();
@@ -660,6 +893,8 @@ private:
 
   uint32_t get_lib(const uint32_t* fallbackIrreversibleBlock = nullptr) const;
   void update_lib( uint32_t );
+  /// Puts lib into write buffer, without exposing it as _cached_irreversible_block yet.
+  void store_lib( uint32_t );
 
   typedef std::vector<ColumnFamilyDescriptor> ColumnDefinitions;
   ColumnDefinitions prepareColumnDefinitions(bool addDefaultColumn);
@@ -723,8 +958,15 @@ private:
     s = _writeBuffer.Put(_columnHandles[OPERATION_BY_BLOCK], blockLocSlice, idSlice);
     checkStatus(s);
 
+    uint32_t opType = get_operation_type(obj.serialized_op);
+
+    if( obj.virtual_op > 0 )
+    {
+      s = _writeBuffer.Put(_columnHandles[VIRTUAL_OP_BY_BLOCK], blockLocSlice, op_type_slice_t(opType));
+      checkStatus(s);
+    }
     for(const auto& name : impacted)
-      buildAccountHistoryRecord( name, obj );
+      buildAccountHistoryRecord( name, obj, opType );
 
     if(++_collectedOps >= _collectedOpsWriteLimit)
       flushWriteBuffer();
@@ -732,7 +974,7 @@ private:
     ++_totalOps;
   }
 
-  void buildAccountHistoryRecord( const account_name_type& name, const rocksdb_operation_object& obj );
+  void buildAccountHistoryRecord( const account_name_type& name, const rocksdb_operation_object& obj, uint32_t opType );
   void storeTransactionInfo(const chain::transaction_id_type& trx_id, uint32_t blockNo, uint32_t trx_in_block);
 
   void prunePotentiallyTooOldItems(account_history_info* ahInfo, const account_name_type& name,
@@ -749,7 +991,8 @@ private:
     checkStatus(s);
   }
 
-  void verifyStoreVersion(DB* storageDb)
+  /// Returns minor version of opened store.
+  uint32_t verifyStoreVersion(DB* storageDb)
   {
     ReadOptions rOptions;
 
@@ -764,9 +1007,27 @@ private:
     checkStatus(s);
     const auto minor = PrimitiveTypeSlice<uint32_t>::unpackSlice(buffer);
 
-    FC_ASSERT(minor == STORE_MINOR_VERSION, "Store minor version mismatch");
+    FC_ASSERT(minor <= STORE_MINOR_VERSION, "Store minor version mismatch");
+
+    return minor;
   }
 
+  /// Brings store of older minor version to the current one, without need of replay.
+  void upgradeStore(uint32_t minorVersion)
+  {
+    ilog("Upgrading account history store version from ${o} to ${n}", ("o", minorVersion)("n", STORE_MINOR_VERSION));
+
+    if(minorVersion < 2)
+      backfillVirtualOps();
+
+    /// Older binaries would not understand entries written from now on.
+    PrimitiveTypeSlice<uint32_t> minorVSlice(STORE_MINOR_VERSION);
+    auto s = _storage->Put(::rocksdb::WriteOptions(), Slice("STORE_MINOR_VERSION"), minorVSlice);
+    checkStatus(s);
+  }
+
+  void backfillVirtualOps();
+
   void storeSequenceIds()
   {
     Slice opSeqIdName("OPERATION_SEQ_ID");
@@ -835,6 +1096,19 @@ private:
 
   void on_irreversible_block( uint32_t block_num );
 
+  /// Operations of irreversible block(s) waiting in staging area for background writer.
+  struct staged_block
+  {
+    uint32_t lib = 0;
+    std::vector<std::pair<rocksdb_operation_object, std::vector<account_name_type>>> ops;
+  };
+
+  void stageBlock(staged_block&& block);
+  void writerLoop();
+  void reportWriterStats(size_t writtenBlocks, size_t stagedBlocks, const fc::microseconds& writeTime) const;
+  /// Writes storage statistics for /metrics, using only thread safe RocksDB properties.
+  void collectMetrics(hive::utilities::metrics::text_writer& writer) const;
+
   void on_post_apply_block(const block_notification& bn);
   void on_pre_apply_block(const  block_notification& bn);
 
@@ -864,6 +1138,25 @@ private:
   std::vector<rocksdb_operation_object> collectReversibleOps(uint32_t* blockRangeBegin, uint32_t* blockRangeEnd,
     uint32_t* collectedIrreversibleBlock) const;
 
+  /** Takes storage snapshot consistent with staging area and passes to `collector` operations of staged blocks,
+    *  which are not visible in that snapshot yet (oldest first).
+    */
+  void collectStagedOps(StorageSnapshot* snapshot,
+    std::function<void(const rocksdb_operation_object&, const std::vector<account_name_type>&)> collector) const;
+
+  /** Collects staged operations impacting given account (oldest first), then loads its account history info from
+    *  consistent storage snapshot. Returns false when account has no stored history.
+    */
+  bool loadAccountHistoryState(const account_name_type& name, StorageSnapshot* snapshot, account_history_info* ahInfo,
+    std::vector<rocksdb_operation_object>* stagedOps) const;
+
+  /** Passes staged operations to processor (newest first), numbered the same way as writer will store them.
+    *  Returns true when limit has been reached.
+    */
+  bool processStagedHistory(const std::vector<rocksdb_operation_object>& stagedOps, uint32_t firstSequence,
+    uint64_t start, uint32_t limit, const operation_type_filter* filter, unsigned int* count,
+    const std::function<bool(unsigned int, const rocksdb_operation_object&)>& processor) const;
+
 /// Class attributes:
 private:
   typedef flat_map< account_name_type, account_name_type > account_name_range_index;
@@ -939,6 +1232,27 @@ private:
 
   bool                             _prune = false;
 
+  /// Max number of AH entries checked against operation type filter in single call (changed only by tests).
+  uint32_t                         _filterScanLimit = ACCOUNT_HISTORY_FILTER_SCAN_LIMIT;
+
+  /// Set by `account-history-rocksdb-background-write` option.
+  bool                             _backgroundWrite = true;
+  std::thread                      _writer;
+  /// Protects members below, also makes change of _cached_irreversible_block atomic with staged blocks removal.
+  mutable std::mutex               _stagingMtx;
+  std::condition_variable          _stagingCv;
+  /// Irreversible blocks not written yet (oldest first). Elements are not moved while writer processes them.
+  std::deque<staged_block>         _stagedBlocks;
+  bool                             _stopWriter = false;
+  /// Set only by tests, to keep blocks in staging area.
+  bool                             _writerPaused = false;
+  std::exception_ptr               _writerError;
+
+  /// Keeps storage open while metrics are collected from webserver thread.
+  mutable std::mutex               _metricsMtx;
+  hive::utilities::metrics::histogram& _writeTimeMetric = hive::utilities::metrics::registry::instance().get_histogram(
+    "hived_account_history_write_seconds", "Time of writing batch of irreversible blocks to account history storage");
+
   struct saved_balances
   {
     asset hive_balance = asset(0, HIVE_SYMBOL);
@@ -999,6 +1313,9 @@ void account_history_rocksdb_plugin::impl::collectOptions(const boost::program_o
   if(_blacklisted_op_list.empty() == false)
     ilog( "Account History: blacklisting ops ${o}", ("o", _blacklisted_op_list) );
 
+  if(options.count("account-history-rocksdb-background-write"))
+    _backgroundWrite = options.at("account-history-rocksdb-background-write").as<bool>();
+
   if (options.count("account-history-rocksdb-dump-balance-history"))
   {
     _balance_csv_filename = options.at("account-history-rocksdb-dump-balance-history").as<std::string>();
@@ -1153,10 +1470,26 @@ account_history_rocksdb_plugin::impl::collectReversibleOps(uint32_t* blockRangeB
       ("rb", *blockRangeBegin)("re", *blockRangeEnd));
   }
 
-  *collectedIrreversibleBlock = _cached_irreversible_block;
+  std::vector<rocksdb_operation_object> retVal;
+
+  {
+    std::lock_guard<std::mutex> lk(_stagingMtx);
+
+    *collectedIrreversibleBlock = _cached_irreversible_block;
+
+    if(*blockRangeEnd < _cached_irreversible_block)
+      return retVal;
 
-  if(*blockRangeEnd < _cached_irreversible_block)
-    return std::vector<rocksdb_operation_object>();
+    /// Operations of irreversible blocks not written yet by background writer
+    for(const auto& block : _stagedBlocks)
+    {
+      for(const auto& op : block.ops)
+      {
+        if(op.first.block >= *blockRangeBegin && op.first.block < *blockRangeEnd)
+          retVal.emplace_back(op.first);
+      }
+    }
+  }
 
   if(_currently_processed_block >= *blockRangeBegin && _currently_processed_block <= *blockRangeEnd)
   {
@@ -1178,19 +1511,15 @@ account_history_rocksdb_plugin::impl::collectReversibleOps(uint32_t* blockRangeB
       ("rb", *blockRangeBegin)("re", *blockRangeEnd));
   }
 
-  std::vector<rocksdb_operation_object> retVal;
   const auto& volatileIdx = _mainDb.get_index< volatile_operation_index, by_block >();
 
-  retVal.reserve(volatileIdx.size());
+  retVal.reserve(retVal.size() + volatileIdx.size());
 
   auto opIterator = volatileIdx.lower_bound(*blockRangeBegin);
   for(; opIterator != volatileIdx.end() && opIterator->block < *blockRangeEnd; ++opIterator)
   {
-    uint64_t opId = opIterator->op_in_trx;
-    opId |= static_cast<uint64_t>(opIterator->trx_in_block) << 32;
-
     rocksdb_operation_object persistentOp(*opIterator);
-    persistentOp.id = opId;
+    persistentOp.id = get_reversible_op_id(opIterator->trx_in_block, opIterator->op_in_trx);
     retVal.emplace_back(std::move(persistentOp));
   }
 
@@ -1203,25 +1532,103 @@ account_history_rocksdb_plugin::impl::collectReversibleOps(uint32_t* blockRangeB
   return retVal;
 }
 
-void account_history_rocksdb_plugin::impl::find_account_history_data(const account_name_type& name, uint64_t start,
-  uint32_t limit, bool include_reversible, std::function<bool(unsigned int, const rocksdb_operation_object&)> processor) const
+void account_history_rocksdb_plugin::impl::collectStagedOps(StorageSnapshot* snapshot,
+  std::function<void(const rocksdb_operation_object&, const std::vector<account_name_type>&)> collector) const
 {
-  if(limit == 0)
+  std::lock_guard<std::mutex> lk(_stagingMtx);
+
+  /// Writer removes blocks from staging area only after storing them, so snapshot taken under lock can't miss any.
+  snapshot->take(_storage.get());
+
+  if(_stagedBlocks.empty())
     return;
 
-  ReadOptions rOptions;
+  /// Blocks already written (together with their lib), but not removed from staging area yet, are visible in snapshot.
+  std::string data;
+  auto s = _storage->Get(snapshot->readOptions(), _columnHandles[CURRENT_LIB], LIB_ID, &data);
+  uint32_t storedLib = 0;
+  if(s.ok())
+    load(storedLib, data.data(), data.size());
+  else
+    FC_ASSERT(s.IsNotFound());
+
+  for(const auto& block : _stagedBlocks)
+  {
+    if(block.lib <= storedLib)
+      continue;
+
+    for(const auto& op : block.ops)
+      collector(op.first, op.second);
+  }
+}
+
+bool account_history_rocksdb_plugin::impl::loadAccountHistoryState(const account_name_type& name,
+  StorageSnapshot* snapshot, account_history_info* ahInfo, std::vector<rocksdb_operation_object>* stagedOps) const
+{
+  collectStagedOps(snapshot,
+    [&name, stagedOps](const rocksdb_operation_object& op, const std::vector<account_name_type>& impacted)
+    {
+      if(std::find(impacted.begin(), impacted.end(), name) != impacted.end())
+        stagedOps->push_back(op);
+    }
+  );
 
   ah_info_by_name_slice_t nameSlice(name.data);
   PinnableSlice buffer;
-  auto s = _storage->Get(rOptions, _columnHandles[AH_INFO_BY_NAME], nameSlice, &buffer);
+  auto s = _storage->Get(snapshot->readOptions(), _columnHandles[AH_INFO_BY_NAME], nameSlice, &buffer);
 
   if(s.IsNotFound())
-    return;
+    return false;
 
   checkStatus(s);
 
+  load(*ahInfo, buffer.data(), buffer.size());
+  return true;
+}
+
+bool account_history_rocksdb_plugin::impl::processStagedHistory(const std::vector<rocksdb_operation_object>& stagedOps,
+  uint32_t firstSequence, uint64_t start, uint32_t limit, const operation_type_filter* filter, unsigned int* count,
+  const std::function<bool(unsigned int, const rocksdb_operation_object&)>& processor) const
+{
+  for(size_t i = stagedOps.size(); i > 0; --i)
+  {
+    const auto& op = stagedOps[i - 1];
+    unsigned int sequence = firstSequence + i - 1;
+
+    if(sequence > start)
+      continue;
+
+    if(filter != nullptr && filter->accepts(get_operation_type(op.serialized_op)) == false)
+      continue;
+
+    if(processor(sequence, op) && ++(*count) >= limit)
+      return true;
+  }
+
+  return false;
+}
+
+void account_history_rocksdb_plugin::impl::find_account_history_data(const account_name_type& name, uint64_t start,
+  uint32_t limit, bool include_reversible, std::function<bool(unsigned int, const rocksdb_operation_object&)> processor) const
+{
+  if(limit == 0)
+    return;
+
+  StorageSnapshot snapshot;
   account_history_info ahInfo;
-  load(ahInfo, buffer.data(), buffer.size());
+  std::vector<rocksdb_operation_object> stagedOps;
+  bool hasStoredHistory = loadAccountHistoryState(name, &snapshot, &ahInfo, &stagedOps);
+
+  /// Staged operations are the newest ones, so they are processed first.
+  unsigned int count = 0;
+  if(processStagedHistory(stagedOps, hasStoredHistory ? ahInfo.newestEntryId + 1 : 0, start, limit, nullptr, &count,
+    processor))
+    return;
+
+  if(hasStoredHistory == false)
+    return;
+
+  ReadOptions rOptions = snapshot.readOptions();
 
   ah_op_by_id_slice_t lowerBoundSlice(std::make_pair(ahInfo.id, ahInfo.oldestEntryId));
   ah_op_by_id_slice_t upperBoundSlice(std::make_pair(ahInfo.id, ahInfo.newestEntryId+1));
@@ -1242,8 +1649,6 @@ void account_history_rocksdb_plugin::impl::find_account_history_data(const accou
   auto keySlice = it->key();
   auto keyValue = ah_op_by_id_slice_t::unpackSlice(keySlice);
 
-  unsigned int count = 0;
-
   for(; it->Valid(); it->Prev())
   {
     auto keySlice = it->key();
@@ -1253,9 +1658,9 @@ void account_history_rocksdb_plugin::impl::find_account_history_data(const accou
     keyValue = ah_op_by_id_slice_t::unpackSlice(keySlice);
 
     auto valueSlice = it->value();
-    const auto& opId = id_slice_t::unpackSlice(valueSlice);
+    auto opId = ah_op_value_slice_t::unpackOpId(valueSlice);
     rocksdb_operation_object oObj;
-    bool found = find_operation_object(opId, &oObj);
+    bool found = find_operation_object(opId, &oObj, snapshot.readOptions());
     FC_ASSERT(found, "Missing operation?");
 
     if(processor(keyValue.second, oObj))
@@ -1267,11 +1672,137 @@ void account_history_rocksdb_plugin::impl::find_account_history_data(const accou
   }
 }
 
-bool account_history_rocksdb_plugin::impl::find_operation_object(size_t opId, rocksdb_operation_object* op) const
+void account_history_rocksdb_plugin::impl::find_account_history_data(const account_name_type& name, uint64_t start,
+  uint32_t limit, bool include_reversible, const operation_type_filter& filter,
+  std::function<bool(unsigned int, const rocksdb_operation_object&)> processor) const
+{
+  if(limit == 0)
+    return;
+
+  StorageSnapshot snapshot;
+  account_history_info ahInfo;
+  std::vector<rocksdb_operation_object> stagedOps;
+  bool hasStoredHistory = loadAccountHistoryState(name, &snapshot, &ahInfo, &stagedOps);
+
+  /// Staged operations are the newest ones, so they are processed first.
+  unsigned int count = 0;
+  if(processStagedHistory(stagedOps, hasStoredHistory ? ahInfo.newestEntryId + 1 : 0, start, limit, &filter, &count,
+    processor))
+    return;
+
+  if(hasStoredHistory == false)
+    return;
+
+  ReadOptions rOptions = snapshot.readOptions();
+
+  ah_op_by_id_slice_t lowerBoundSlice(std::make_pair(ahInfo.id, ahInfo.oldestEntryId));
+  ah_op_by_id_slice_t upperBoundSlice(std::make_pair(ahInfo.id, ahInfo.newestEntryId+1));
+
+  rOptions.iterate_lower_bound = &lowerBoundSlice;
+  rOptions.iterate_upper_bound = &upperBoundSlice;
+
+  ah_op_by_id_slice_t key(std::make_pair(ahInfo.id, start));
+  id_slice_t ahIdSlice(ahInfo.id);
+
+  std::unique_ptr<::rocksdb::Iterator> it(_storage->NewIterator(rOptions, _columnHandles[AH_OPERATION_BY_ID]));
+
+  it->SeekForPrev(key);
+
+  unsigned int scanned = 0;
+
+  /// Sequence numbers and ids of accepted operations, waiting to be loaded together.
+  std::vector<unsigned int> batchSequences;
+  std::vector<int64_t> batchOpIds;
+
+  /// Returns true when limit has been reached.
+  auto processBatch = [&]() -> bool
+  {
+    if(batchOpIds.empty())
+      return false;
+
+    std::vector<Slice> keys;
+    keys.reserve(batchOpIds.size());
+    for(const auto& opId : batchOpIds)
+      keys.emplace_back(reinterpret_cast<const char*>(&opId), sizeof(opId));
+
+    std::vector<ColumnFamilyHandle*> columns(keys.size(), _columnHandles[OPERATION_BY_ID]);
+    std::vector<std::string> values;
+    auto statuses = _storage->MultiGet(snapshot.readOptions(), columns, keys, &values);
+
+    bool limitReached = false;
+    for(size_t i = 0; i < statuses.size() && limitReached == false; ++i)
+    {
+      FC_ASSERT(statuses[i].IsNotFound() == false, "Missing operation?");
+      checkStatus(statuses[i]);
+
+      rocksdb_operation_object oObj;
+      load(oObj, values[i].data(), values[i].size());
+
+      if(processor(batchSequences[i], oObj))
+        limitReached = ++count >= limit;
+    }
+
+    batchSequences.clear();
+    batchOpIds.clear();
+    return limitReached;
+  };
+
+  for(; it->Valid(); it->Prev())
+  {
+    auto keySlice = it->key();
+    if(keySlice.starts_with(ahIdSlice) == false)
+      break;
+
+    auto keyValue = ah_op_by_id_slice_t::unpackSlice(keySlice);
+
+    if(++scanned > _filterScanLimit)
+    {
+      if(processBatch())
+        return;
+      FC_ASSERT(false, "Could not find filtered operation in ${total_processed_items} operations, to continue searching, set start=${sequence}.",
+        ("total_processed_items", _filterScanLimit)("sequence", keyValue.second));
+    }
+
+    auto valueSlice = it->value();
+    auto opId = ah_op_value_slice_t::unpackOpId(valueSlice);
+    uint32_t opType = 0;
+
+    if(ah_op_value_slice_t::unpackOpType(valueSlice, &opType) == false)
+    {
+      /// Entry written by older version - operation must be loaded to check its type.
+      if(processBatch())
+        return;
+
+      rocksdb_operation_object oObj;
+      bool found = find_operation_object(opId, &oObj, snapshot.readOptions());
+      FC_ASSERT(found, "Missing operation?");
+
+      if(filter.accepts(get_operation_type(oObj.serialized_op)) && processor(keyValue.second, oObj) && ++count >= limit)
+        return;
+
+      continue;
+    }
+
+    if(filter.accepts(opType) == false)
+      continue;
+
+    batchSequences.push_back(keyValue.second);
+    batchOpIds.push_back(opId);
+
+    /// Don't load more operations than still needed (processor still can reject some of them).
+    if(count + batchOpIds.size() >= limit && processBatch())
+      return;
+  }
+
+  processBatch();
+}
+
+bool account_history_rocksdb_plugin::impl::find_operation_object(size_t opId, rocksdb_operation_object* op,
+  const ReadOptions& rOptions) const
 {
   std::string data;
   id_slice_t idSlice(opId);
-  ::rocksdb::Status s = _storage->Get(ReadOptions(), _columnHandles[OPERATION_BY_ID], idSlice, &data);
+  ::rocksdb::Status s = _storage->Get(rOptions, _columnHandles[OPERATION_BY_ID], idSlice, &data);
 
   if(s.ok())
   {
@@ -1321,7 +1852,7 @@ void account_history_rocksdb_plugin::impl::find_operations_by_block(size_t block
 
 std::pair< uint32_t, uint64_t > account_history_rocksdb_plugin::impl::enumVirtualOperationsFromBlockRange(
   uint32_t blockRangeBegin, uint32_t blockRangeEnd, bool include_reversible,
-  fc::optional<uint64_t> resumeFromOperation, fc::optional<uint32_t> limit, 
+  fc::optional<uint64_t> resumeFromOperation, fc::optional<uint32_t> limit, fc::optional<operation_type_filter> typeFilter,
   std::function<bool(const rocksdb_operation_object&, uint64_t, bool)> processor) const
 {
   FC_ASSERT(blockRangeEnd > blockRangeBegin, "Block range must be upward");
@@ -1393,35 +1924,32 @@ std::pair< uint32_t, uint64_t > account_history_rocksdb_plugin::impl::enumVirtua
   ReadOptions rOptions;
   rOptions.iterate_upper_bound = &upperBoundSlice;
 
-  std::unique_ptr<::rocksdb::Iterator> it(_storage->NewIterator(rOptions, _columnHandles[OPERATION_BY_BLOCK]));
+  /// Holds virtual operations only, keyed the same way as OPERATION_BY_BLOCK.
+  std::unique_ptr<::rocksdb::Iterator> it(_storage->NewIterator(rOptions, _columnHandles[VIRTUAL_OP_BY_BLOCK]));
 
   for(it->Seek(rangeBeginSlice); it->Valid(); it->Next())
   {
     auto keySlice = it->key();
     const auto& key = op_by_block_num_slice_t::unpackSlice(keySlice);
 
-    /// Accept only virtual operations
-    if(key.second & VIRTUAL_OP_FLAG)
-    {
-      auto valueSlice = it->value();
-      auto opId = id_slice_t::unpackSlice(valueSlice);
+    if(typeFilter.valid() && typeFilter->accepts(op_type_slice_t::unpackSlice(it->value())) == false)
+      continue;
 
-      rocksdb_operation_object op;
-      bool found = find_operation_object(opId, &op);
-      FC_ASSERT(found);
+    ///Number of retrieved operations can't be greater then limit
+    if(limit.valid() && (cntLimit >= *limit))
+    {
+      nextElementAfterLimit = key.second;
+      break;
+    }
 
-      ///Number of retrieved operations can't be greater then limit
-      if(limit.valid() && (cntLimit >= *limit))
-      {
-        nextElementAfterLimit = key.second;
-        break;
-      }
+    rocksdb_operation_object op;
+    bool found = find_operation_object(key.second & ~VIRTUAL_OP_FLAG, &op);
+    FC_ASSERT(found);
 
-      if(processor(op, key.second, true))
-        ++cntLimit;
+    if(processor(op, key.second, true))
+      ++cntLimit;
 
-      lastFoundBlock = key.first;
-    }
+    lastFoundBlock = key.first;
   }
 
   if( nextElementAfterLimit.valid() )
@@ -1465,16 +1993,14 @@ std::pair< uint32_t, uint64_t > account_history_rocksdb_plugin::impl::enumVirtua
     op_by_block_num_slice_t lowerBoundSlice(block_op_id_pair(lastFoundBlock, 0));
     rOptions = ReadOptions();
     rOptions.iterate_lower_bound = &lowerBoundSlice;
-    it.reset(_storage->NewIterator(rOptions, _columnHandles[OPERATION_BY_BLOCK]));
+    it.reset(_storage->NewIterator(rOptions, _columnHandles[VIRTUAL_OP_BY_BLOCK]));
 
     op_by_block_num_slice_t nextRangeBeginSlice(block_op_id_pair(lastFoundBlock, 0));
-    for(it->Seek(nextRangeBeginSlice); it->Valid(); it->Next())
+    it->Seek(nextRangeBeginSlice);
+    if(it->Valid())
     {
-      auto keySlice = it->key();
-      const auto& key = op_by_block_num_slice_t::unpackSlice(keySlice);
-
-      if(key.second & VIRTUAL_OP_FLAG)
-        return std::make_pair( key.first, 0 );
+      const auto& key = op_by_block_num_slice_t::unpackSlice(it->key());
+      return std::make_pair( key.first, 0 );
     }
   }
 
@@ -1484,7 +2010,25 @@ std::pair< uint32_t, uint64_t > account_history_rocksdb_plugin::impl::enumVirtua
 bool account_history_rocksdb_plugin::impl::find_transaction_info(const protocol::transaction_id_type& trxId,
   bool include_reversible, uint32_t* blockNo, uint32_t* txInBlock) const
   {
-  ReadOptions rOptions;
+  /// Transactions of irreversible blocks not written yet by background writer
+  StorageSnapshot snapshot;
+  bool staged = false;
+  collectStagedOps(&snapshot,
+    [&](const rocksdb_operation_object& op, const std::vector<account_name_type>&)
+    {
+      if(staged == false && op.trx_id == trxId)
+      {
+        *blockNo = op.block;
+        *txInBlock = op.trx_in_block;
+        staged = true;
+      }
+    }
+  );
+
+  if(staged)
+    return true;
+
+  ReadOptions rOptions = snapshot.readOptions();
   TransactionIdSlice idSlice(trxId);
   std::string dataBuffer;
   ::rocksdb::Status s = _storage->Get(rOptions, _columnHandles[BY_TRANSACTION_ID], idSlice, &dataBuffer);
@@ -1513,6 +2057,8 @@ void account_history_rocksdb_plugin::impl::supplement_snapshot(const hive::chain
 
   auto pathString = actual_path.to_native_ansi_path();
 
+  drainStagedBlocks();
+
   ::rocksdb::Env* backupEnv = ::rocksdb::Env::Default();
   ::rocksdb::BackupableDBOptions backupableDbOptions(pathString);
 
@@ -1607,10 +2153,69 @@ uint32_t account_history_rocksdb_plugin::impl::get_lib(const uint32_t* fallbackI
 void account_history_rocksdb_plugin::impl::update_lib( uint32_t lib )
 {
   _cached_irreversible_block.store(lib);
+  store_lib( lib );
+}
+
+void account_history_rocksdb_plugin::impl::store_lib( uint32_t lib )
+{
   auto s = _writeBuffer.Put( _columnHandles[ CURRENT_LIB ], LIB_ID, lib_slice_t( lib ) );
   checkStatus( s );
 }
 
+void account_history_rocksdb_plugin::impl::backfillVirtualOps()
+{
+  ilog("Filling virtual_op_by_block column basing on stored operations...");
+
+  /// Operations are scanned in storage order, what is much faster than random lookups done by OPERATION_BY_BLOCK walk.
+  std::unique_ptr<::rocksdb::Iterator> it(_storage->NewIterator(ReadOptions(), _columnHandles[OPERATION_BY_ID]));
+
+  WriteBatch batch;
+  uint64_t scanned = 0;
+  uint64_t written = 0;
+  ::rocksdb::WriteOptions wOptions;
+  /// Operation ids are assigned sequentially, so last one tells how many operations have to be scanned.
+  const uint64_t total = std::max<uint64_t>(_operationSeqId, 1);
+  const fc::time_point startTime = fc::time_point::now();
+
+  for(it->SeekToFirst(); it->Valid(); it->Next())
+  {
+    rocksdb_operation_object op;
+    load(op, it->value().data(), it->value().size());
+
+    if(++scanned % STORE_UPGRADE_BATCH_SIZE == 0)
+    {
+      const auto elapsed = (fc::time_point::now() - startTime).to_seconds();
+      ilog("Processed ${s} of ${t} operations (${p}%), ${w} virtual ones so far, elapsed time: ${e}s...",
+        ("s", scanned)("t", total)("p", std::min<uint64_t>(scanned * 100 / total, 100))("w", written)("e", elapsed));
+    }
+
+    if(op.virtual_op == 0)
+      continue;
+
+    op_by_block_num_slice_t blockLocSlice(block_op_id_pair(op.block, uint64_t(op.id) | VIRTUAL_OP_FLAG));
+    auto s = batch.Put(_columnHandles[VIRTUAL_OP_BY_BLOCK], blockLocSlice, op_type_slice_t(get_operation_type(op.serialized_op)));
+    checkStatus(s);
+
+    if(++written % STORE_UPGRADE_BATCH_SIZE == 0)
+    {
+      s = _storage->Write(wOptions, &batch);
+      checkStatus(s);
+      batch.Clear();
+    }
+  }
+
+  checkStatus(it->status());
+
+  auto s = _storage->Write(wOptions, &batch);
+  checkStatus(s);
+
+  s = _storage->Flush(::rocksdb::FlushOptions(), _columnHandles[VIRTUAL_OP_BY_BLOCK]);
+  checkStatus(s);
+
+  ilog("virtual_op_by_block column filled: ${w} virtual operations found in ${s} ones, elapsed time: ${e}s.",
+    ("s", scanned)("w", written)("e", (fc::time_point::now() - startTime).to_seconds()));
+}
+
 account_history_rocksdb_plugin::impl::ColumnDefinitions account_history_rocksdb_plugin::impl::prepareColumnDefinitions(bool addDefaultColumn)
 {
   ColumnDefinitions columnDefs;
@@ -1639,6 +2244,10 @@ account_history_rocksdb_plugin::impl::ColumnDefinitions account_history_rocksdb_
   auto& byTxIdColumn = columnDefs.back();
   byTxIdColumn.options.comparator = by_txId_Comparator();
 
+  columnDefs.emplace_back("virtual_op_by_block", ColumnFamilyOptions());
+  auto& virtualOpByBlockColumn = columnDefs.back();
+  virtualOpByBlockColumn.options.comparator = op_by_block_num_Comparator();
+
   return columnDefs;
 }
 
@@ -1662,6 +2271,14 @@ bool account_history_rocksdb_plugin::impl::createDbSchema(const bfs::path& path)
     return false; /// DB does not need data import.
   }
 
+  std::vector<std::string> existingColumns;
+  s = DB::ListColumnFamilies(options, strPath, &existingColumns);
+  if(s.ok() && existingColumns.size() < columnDefs.size())
+  {
+    ilog("RocksDB storage at location: `${p}' misses some columns, it will be upgraded.", ("p", strPath));
+    return false; /// Store of older version - missing columns will be created and filled while opening.
+  }
+
   options.create_if_missing = true;
 
   s = DB::Open(options, strPath, &db);
@@ -1696,7 +2313,8 @@ bool account_history_rocksdb_plugin::impl::createDbSchema(const bfs::path& path)
   }
 }
 
-void account_history_rocksdb_plugin::impl::buildAccountHistoryRecord( const account_name_type& name, const rocksdb_operation_object& obj )
+void account_history_rocksdb_plugin::impl::buildAccountHistoryRecord( const account_name_type& name, const rocksdb_operation_object& obj,
+  uint32_t opType )
 {
   std::string strName = name;
 
@@ -1722,7 +2340,7 @@ void account_history_rocksdb_plugin::impl::buildAccountHistoryRecord( const acco
       _writeBuffer.putAHInfo(name, ahInfo);
 
     ah_op_by_id_slice_t ahInfoOpSlice(std::make_pair(ahInfo.id, nextEntryId));
-    id_slice_t valueSlice(obj.id);
+    ah_op_value_slice_t valueSlice(obj.id, opType);
     auto s = _writeBuffer.Put(_columnHandles[AH_OPERATION_BY_ID], ahInfoOpSlice, valueSlice);
     checkStatus(s);
   }
@@ -1736,7 +2354,7 @@ void account_history_rocksdb_plugin::impl::buildAccountHistoryRecord( const acco
     _writeBuffer.putAHInfo(name, ahInfo);
 
     ah_op_by_id_slice_t ahInfoOpSlice(std::make_pair(ahInfo.id, 0));
-    id_slice_t valueSlice(obj.id);
+    ah_op_value_slice_t valueSlice(obj.id, opType);
     auto s = _writeBuffer.Put(_columnHandles[AH_OPERATION_BY_ID], ahInfoOpSlice, valueSlice);
     checkStatus(s);
   }
@@ -1797,7 +2415,7 @@ void account_history_rocksdb_plugin::impl::prunePotentiallyTooOldItems(account_h
 
     auto value = dataItr->value();
 
-    auto pointedOpId = id_slice_t::unpackSlice(value);
+    auto pointedOpId = ah_op_value_slice_t::unpackOpId(value);
     rocksdb_operation_object op;
     find_operation_object(pointedOpId, &op);
 
@@ -2050,6 +2668,7 @@ void account_history_rocksdb_plugin::impl::on_irreversible_block( uint32_t block
     // it is unlikely we get here but flush storage in this case
     if(itr != volatile_idx.end() && itr->block < block_num)
     {
+      drainStagedBlocks();
       flushStorage();
 
       while(itr != volatile_idx.end() && itr->block < block_num)
@@ -2086,20 +2705,197 @@ void account_history_rocksdb_plugin::impl::on_irreversible_block( uint32_t block
     FC_ASSERT(moveRangeBeginI == volatile_idx.begin() || moveRangeBeginI == volatile_idx.end(), "All volatile ops processed by previous irreversible blocks should be already flushed");
 
     auto moveRangeEndI = volatile_idx.upper_bound(block_num);
-    volatileOpsGenericIndex.move_to_external_storage<by_block>(moveRangeBeginI, moveRangeEndI, [this](const volatile_operation_object& operation) -> void
-      {
-        rocksdb_operation_object obj(operation);
-        importOperation(obj, operation.impacted);
-      }
-    );
 
-    update_lib(block_num);
+    if(_writer.joinable())
+    {
+      staged_block block;
+      block.lib = block_num;
+      volatileOpsGenericIndex.move_to_external_storage<by_block>(moveRangeBeginI, moveRangeEndI, [&block](const volatile_operation_object& operation) -> void
+        {
+          rocksdb_operation_object obj(operation);
+          obj.id = get_reversible_op_id(operation.trx_in_block, operation.op_in_trx);
+          block.ops.emplace_back(std::move(obj), std::vector<account_name_type>(operation.impacted.begin(), operation.impacted.end()));
+        }
+      );
+
+      stageBlock(std::move(block));
+    }
+    else
+    {
+      volatileOpsGenericIndex.move_to_external_storage<by_block>(moveRangeBeginI, moveRangeEndI, [this](const volatile_operation_object& operation) -> void
+        {
+          rocksdb_operation_object obj(operation);
+          importOperation(obj, operation.impacted);
+        }
+      );
+
+      update_lib(block_num);
+    }
   }
 
   _currently_persisted_irreversible_block.store(0);
   _currently_persisted_irreversible_cv.notify_all();
 }
 
+void account_history_rocksdb_plugin::impl::stageBlock(staged_block&& block)
+{
+  std::unique_lock<std::mutex> lk(_stagingMtx);
+
+  if(_writerError)
+    std::rethrow_exception(_writerError);
+
+  if(_stagedBlocks.size() >= MAX_STAGED_BLOCKS)
+  {
+    wlog("Account history writer is ${n} irreversible blocks behind, waiting for it...", ("n", _stagedBlocks.size()));
+    _stagingCv.wait(lk, [this]() { return _stagedBlocks.size() < MAX_STAGED_BLOCKS || _writerError; });
+
+    if(_writerError)
+      std::rethrow_exception(_writerError);
+  }
+
+  _stagedBlocks.emplace_back(std::move(block));
+  lk.unlock();
+
+  _stagingCv.notify_all();
+}
+
+void account_history_rocksdb_plugin::impl::writerLoop()
+{
+  for(;;)
+  {
+    std::vector<const staged_block*> blocks;
+
+    {
+      std::unique_lock<std::mutex> lk(_stagingMtx);
+      _stagingCv.wait(lk, [this]() { return _stopWriter || (_writerPaused == false && _stagedBlocks.empty() == false); });
+
+      if(_stagedBlocks.empty())
+        return; /// Stop requested and everything written.
+
+      /// When RocksDB slows down writes, more blocks get collected meantime and are written in single batch.
+      for(const auto& block : _stagedBlocks)
+        blocks.push_back(&block);
+    }
+
+    fc::time_point writeStart = fc::time_point::now();
+    size_t stagedBlocks = 0;
+
+    try
+    {
+      uint32_t lib = 0;
+      for(const auto* block : blocks)
+      {
+        for(const auto& op : block->ops)
+        {
+          rocksdb_operation_object obj(op.first);
+          importOperation(obj, op.second);
+        }
+        lib = block->lib;
+      }
+
+      store_lib(lib);
+      flushWriteBuffer();
+
+      std::lock_guard<std::mutex> lk(_stagingMtx);
+      /// Written operations are now visible in storage, so they must stop being reported as reversible ones at once.
+      _cached_irreversible_block.store(lib);
+      _stagedBlocks.erase(_stagedBlocks.begin(), _stagedBlocks.begin() + blocks.size());
+      stagedBlocks = _stagedBlocks.size();
+    }
+    catch(const fc::exception& e)
+    {
+      elog("Account history background writer failed: ${e}", ("e", e.to_detail_string()));
+      std::lock_guard<std::mutex> lk(_stagingMtx);
+      _writerError = std::current_exception();
+    }
+    catch(const std::exception& e)
+    {
+      elog("Account history background writer failed: ${e}", ("e", e.what()));
+      std::lock_guard<std::mutex> lk(_stagingMtx);
+      _writerError = std::current_exception();
+    }
+
+    _stagingCv.notify_all();
+
+    if(_writerError)
+      return;
+
+    fc::microseconds writeTime = fc::time_point::now() - writeStart;
+    _writeTimeMetric.observe(writeTime);
+    reportWriterStats(blocks.size(), stagedBlocks, writeTime);
+  }
+}
+
+void account_history_rocksdb_plugin::impl::collectMetrics(hive::utilities::metrics::text_writer& writer) const
+{
+  std::lock_guard<std::mutex> lk(_metricsMtx);
+  if(!_storage)
+    return;
+
+  writer.gauge("hived_account_history_irreversible_block", "Last irreversible block written to account history storage",
+    _cached_irreversible_block.load());
+  {
+    std::lock_guard<std::mutex> stagingLock(_stagingMtx);
+    writer.gauge("hived_account_history_staged_blocks", "Irreversible blocks waiting for background writer", _stagedBlocks.size());
+  }
+
+  uint64_t value = 0;
+  if(_storage->GetIntProperty(DB::Properties::kIsWriteStopped, &value))
+    writer.gauge("hived_account_history_rocksdb_write_stopped", "1 when RocksDB stopped writes", value);
+  if(_storage->GetIntProperty(DB::Properties::kActualDelayedWriteRate, &value))
+    writer.gauge("hived_account_history_rocksdb_delayed_write_rate", "Write rate RocksDB slowed writes to, 0 when not delayed", value);
+  if(_storage->GetIntProperty(DB::Properties::kNumRunningCompactions, &value))
+    writer.gauge("hived_account_history_rocksdb_running_compactions", "Currently running RocksDB compactions", value);
+  if(_storage->GetIntProperty(DB::Properties::kNumRunningFlushes, &value))
+    writer.gauge("hived_account_history_rocksdb_running_flushes", "Currently running RocksDB flushes", value);
+  if(_storage->GetAggregatedIntProperty(DB::Properties::kEstimatePendingCompactionBytes, &value))
+    writer.gauge("hived_account_history_rocksdb_pending_compaction_bytes", "Estimated bytes RocksDB compaction needs to rewrite", value);
+
+  for(const auto* handle : _columnHandles)
+  {
+    const hive::utilities::metrics::labels_t labels = { { "column", handle->GetName() } };
+    if(_storage->GetIntProperty(const_cast<ColumnFamilyHandle*>(handle), DB::Properties::kEstimateNumKeys, &value))
+      writer.gauge("hived_account_history_rocksdb_estimated_keys", "Estimated number of keys in column", value, labels);
+  }
+  for(const auto* handle : _columnHandles)
+  {
+    const hive::utilities::metrics::labels_t labels = { { "column", handle->GetName() } };
+    if(_storage->GetIntProperty(const_cast<ColumnFamilyHandle*>(handle), DB::Properties::kTotalSstFilesSize, &value))
+      writer.gauge("hived_account_history_rocksdb_sst_bytes", "Size of SST files of column", value, labels);
+  }
+  for(const auto* handle : _columnHandles)
+  {
+    const hive::utilities::metrics::labels_t labels = { { "column", handle->GetName() } };
+    if(_storage->GetIntProperty(const_cast<ColumnFamilyHandle*>(handle), DB::Properties::kCurSizeAllMemTables, &value))
+      writer.gauge("hived_account_history_rocksdb_memtables_bytes", "Size of memtables of column", value, labels);
+  }
+}
+
+void account_history_rocksdb_plugin::impl::reportWriterStats(size_t writtenBlocks, size_t stagedBlocks,
+  const fc::microseconds& writeTime) const
+{
+  if(hive::plugins::statsd::util::statsd_enabled() == false)
+    return;
+
+  STATSD_TIMER("account_history_rocksdb", "writer", "write_time", writeTime, 1.0f);
+  STATSD_GAUGE("account_history_rocksdb", "writer", "written_blocks", writtenBlocks, 1.0f);
+  STATSD_GAUGE("account_history_rocksdb", "writer", "staged_blocks", stagedBlocks, 1.0f);
+
+  uint64_t value = 0;
+  if(_storage->GetIntProperty(DB::Properties::kIsWriteStopped, &value))
+    STATSD_GAUGE("account_history_rocksdb", "rocksdb", "write_stopped", value, 1.0f);
+  if(_storage->GetIntProperty(DB::Properties::kActualDelayedWriteRate, &value))
+    STATSD_GAUGE("account_history_rocksdb", "rocksdb", "delayed_write_rate", value, 1.0f);
+  if(_storage->GetIntProperty(DB::Properties::kNumRunningCompactions, &value))
+    STATSD_GAUGE("account_history_rocksdb", "rocksdb", "running_compactions", value, 1.0f);
+  if(_storage->GetIntProperty(DB::Properties::kNumRunningFlushes, &value))
+    STATSD_GAUGE("account_history_rocksdb", "rocksdb", "running_flushes", value, 1.0f);
+  if(_storage->GetAggregatedIntProperty(DB::Properties::kEstimatePendingCompactionBytes, &value))
+    STATSD_GAUGE("account_history_rocksdb", "rocksdb", "pending_compaction_bytes", value, 1.0f);
+  if(_storage->GetAggregatedIntProperty(DB::Properties::kCurSizeAllMemTables, &value))
+    STATSD_GAUGE("account_history_rocksdb", "rocksdb", "memtables_bytes", value, 1.0f);
+}
+
 void account_history_rocksdb_plugin::impl::on_pre_apply_block(const block_notification& bn)
 {
   if(_reindexing) return;
@@ -2249,6 +3045,8 @@ void account_history_rocksdb_plugin::set_program_options(
     ("account-history-rocksdb-track-account-range", boost::program_options::value< std::vector<std::string> >()->composing()->multitoken(), "Defines a range of accounts to track as a json pair [\"from\",\"to\"] [from,to] Can be specified multiple times.")
     ("account-history-rocksdb-whitelist-ops", boost::program_options::value< std::vector<std::string> >()->composing(), "Defines a list of operations which will be explicitly logged.")
     ("account-history-rocksdb-blacklist-ops", boost::program_options::value< std::vector<std::string> >()->composing(), "Defines a list of operations which will be explicitly ignored.")
+    ("account-history-rocksdb-background-write", bpo::value<bool>()->default_value(true),
+      "Write operations of irreversible blocks from separate thread, so block processing does not wait for RocksDB (i.e. stalled by compaction).")
 
   ;
   command_line_options.add_options()
@@ -2290,6 +3088,8 @@ void account_history_rocksdb_plugin::plugin_startup()
 
   if(_doImmediateImport)
     _my->importData(_blockLimit);
+
+  _my->startBackgroundWriter();
 }
 
 void account_history_rocksdb_plugin::plugin_shutdown()
@@ -2304,6 +3104,13 @@ void account_history_rocksdb_plugin::find_account_history_data(const account_nam
   _my->find_account_history_data(name, start, limit, include_reversible, processor);
 }
 
+void account_history_rocksdb_plugin::find_account_history_data(const account_name_type& name, uint64_t start, uint32_t limit,
+  bool include_reversible, const operation_type_filter& filter,
+  std::function<bool(unsigned int, const rocksdb_operation_object&)> processor) const
+{
+  _my->find_account_history_data(name, start, limit, include_reversible, filter, processor);
+}
+
 bool account_history_rocksdb_plugin::find_operation_object(size_t opId, rocksdb_operation_object* op) const
 {
   return _my->find_operation_object(opId, op);
@@ -2317,9 +3124,10 @@ void account_history_rocksdb_plugin::find_operations_by_block(size_t blockNum, b
 
 std::pair< uint32_t, uint64_t > account_history_rocksdb_plugin::enum_operations_from_block_range(uint32_t blockRangeBegin, uint32_t blockRangeEnd,
   bool include_reversible, fc::optional<uint64_t> operationBegin, fc::optional<uint32_t> limit,
-  std::function<bool(const rocksdb_operation_object&, uint64_t, bool)> processor) const
+  fc::optional<operation_type_filter> typeFilter, std::function<bool(const rocksdb_operation_object&, uint64_t, bool)> processor) const
 {
-  return _my->enumVirtualOperationsFromBlockRange(blockRangeBegin, blockRangeEnd, include_reversible, operationBegin, limit, processor);
+  return _my->enumVirtualOperationsFromBlockRange(blockRangeBegin, blockRangeEnd, include_reversible, operationBegin, limit,
+    typeFilter, processor);
 }
 
 bool account_history_rocksdb_plugin::find_transaction_info(const protocol::transaction_id_type& trxId, bool include_reversible, uint32_t* blockNo,
@@ -2328,6 +3136,35 @@ bool account_history_rocksdb_plugin::find_transaction_info(const protocol::trans
   return _my->find_transaction_info(trxId, include_reversible, blockNo, txInBlock);
   }
 
+#ifdef IS_TEST_NET
+
+void account_history_rocksdb_plugin::pause_background_writer(bool pause)
+{
+  _my->pauseBackgroundWriter(pause);
+}
+
+void account_history_rocksdb_plugin::wait_for_background_writer()
+{
+  _my->drainStagedBlocks();
+}
+
+size_t account_history_rocksdb_plugin::get_staged_block_count() const
+{
+  return _my->getStagedBlockCount();
+}
+
+void account_history_rocksdb_plugin::set_filter_scan_limit(uint32_t limit)
+{
+  _my->setFilterScanLimit(limit);
+}
+
+void account_history_rocksdb_plugin::rewrite_store_as_version(uint32_t minorVersion)
+{
+  _my->rewriteStoreAsVersion(minorVersion);
+}
+
+#endif
+
 } } }
 
 FC_REFLECT( hive::plugins::account_history_rocksdb::account_history_info,
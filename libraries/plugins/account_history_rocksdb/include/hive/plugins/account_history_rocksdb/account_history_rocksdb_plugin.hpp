@@ -15,7 +15,20 @@ namespace plugins { namespace account_history_rocksdb {
 
 namespace bfs = boost::filesystem;
 
-
+/** Bitwise operation type filter, where bit N is set when operation having `which() == N` shall be accepted
+  *  (pretending it is a 128-bit mask composed of {high, low}).
+  */
+struct operation_type_filter
+{
+  uint64_t low = 0;
+  uint64_t high = 0;
+
+  bool accepts(uint32_t opType) const
+  {
+    return opType < 64 ? (low & (UINT64_C(1) << opType)) != 0
+                       : opType < 128 && (high & (UINT64_C(1) << (opType - 64))) != 0;
+  }
+};
 
 class account_history_rocksdb_plugin final : public appbase::plugin< account_history_rocksdb_plugin >
 {
@@ -38,15 +51,30 @@ public:
 
   void find_account_history_data(const protocol::account_name_type& name, uint64_t start, uint32_t limit, bool include_reversible,
     std::function<bool(unsigned int, const rocksdb_operation_object&)> processor) const;
+  /// Like above, but only operations accepted by `filter` are loaded and passed to the processor.
+  void find_account_history_data(const protocol::account_name_type& name, uint64_t start, uint32_t limit, bool include_reversible,
+    const operation_type_filter& filter, std::function<bool(unsigned int, const rocksdb_operation_object&)> processor) const;
   bool find_operation_object(size_t opId, rocksdb_operation_object* data) const;
   void find_operations_by_block(size_t blockNum, bool include_reversible,
     std::function<void(const rocksdb_operation_object&)> processor) const;
   std::pair< uint32_t/*nr last block*/, uint64_t/*operation-id to resume from*/ > enum_operations_from_block_range(
     uint32_t blockRangeBegin, uint32_t blockRangeEnd, bool include_reversible,
-    fc::optional<uint64_t> operationBegin, fc::optional<uint32_t> limit,
+    fc::optional<uint64_t> operationBegin, fc::optional<uint32_t> limit, fc::optional<operation_type_filter> typeFilter,
     std::function<bool(const rocksdb_operation_object&, uint64_t, bool)> processor) const;
   bool find_transaction_info(const protocol::transaction_id_type& trxId, bool include_reversible, uint32_t* blockNo, uint32_t* txInBlock) const;
 
+#ifdef IS_TEST_NET
+  /// Holds (or resumes) background writer, so operations of irreversible blocks stay in staging area.
+  void pause_background_writer(bool pause);
+  /// Waits until background writer stores all staged blocks.
+  void wait_for_background_writer();
+  size_t get_staged_block_count() const;
+  /// Overrides number of AH entries checked against operation type filter before call gives up.
+  void set_filter_scan_limit(uint32_t limit);
+  /// Converts storage to format of given older minor version and reopens it, so it is upgraded again.
+  void rewrite_store_as_version(uint32_t minorVersion);
+#endif
+
 private:
   class impl;
 
@@ -165,38 +165,20 @@ DEFINE_API_IMPL( account_history_api_rocksdb_impl, get_account_history )
 
   bool include_reversible = args.include_reversible.valid() ? *args.include_reversible : false;
   
-  unsigned int total_processed_items = 0;
-
   if(args.operation_filter_low || args.operation_filter_high)
   {
-    uint64_t filter_low = args.operation_filter_low ? *args.operation_filter_low : 0;
-    uint64_t filter_high = args.operation_filter_high ? *args.operation_filter_high : 0;
+    account_history_rocksdb::operation_type_filter filter;
+    filter.low = args.operation_filter_low ? *args.operation_filter_low : 0;
+    filter.high = args.operation_filter_high ? *args.operation_filter_high : 0;
 
     try
     {
-
-    _dataSource.find_account_history_data(args.account, args.start, args.limit, include_reversible,
-      [&result, filter_low, filter_high, &total_processed_items](unsigned int sequence, const account_history_rocksdb::rocksdb_operation_object& op) -> bool
+    /// Operations are filtered inside by type stored in AH index, so only accepted ones get here.
+    _dataSource.find_account_history_data(args.account, args.start, args.limit, include_reversible, filter,
+      [&result](unsigned int sequence, const account_history_rocksdb::rocksdb_operation_object& op) -> bool
       {
-        FC_ASSERT(total_processed_items < 2000, "Could not find filtered operation in ${total_processed_items} operations, to continue searching, set start=${sequence}.",("total_processed_items",total_processed_items)("sequence",sequence));
-
-        // we want to accept any operations where the corresponding bit is set in {filter_high, filter_low}
-        api_operation_object api_op(op);
-        unsigned bit_number = api_op.op.which();
-        bool accepted = bit_number < 64 ? filter_low & (UINT64_C(1) << bit_number)
-                                        : filter_high & (UINT64_C(1) << (bit_number - 64));
-
-        ++total_processed_items;
-
-        if(accepted)
-        {
-          result.history.emplace(sequence, std::move(api_op));
-          return true;
-        }
-        else
-        {
-          return false;
-        }
+        result.history.emplace(sequence, api_operation_object(op));
+        return true;
       });
     }
     catch(const fc::exception& e)
@@ -293,6 +275,27 @@ private:
   bool     _accepted = false;
 };
 
+account_history_rocksdb::operation_type_filter build_operation_type_filter(uint64_t filter)
+{
+  account_history_rocksdb::operation_type_filter typeFilter;
+  filtering_visitor accepting_visitor;
+  hive::protocol::operation op;
+
+  for(int64_t opType = 0; opType < hive::protocol::operation::count(); ++opType)
+  {
+    op.set_which(opType);
+    if(accepting_visitor.check(filter, op))
+    {
+      if(opType < 64)
+        typeFilter.low |= UINT64_C(1) << opType;
+      else
+        typeFilter.high |= UINT64_C(1) << (opType - 64);
+    }
+  }
+
+  return typeFilter;
+}
+
 DEFINE_API_IMPL( account_history_api_rocksdb_impl, enum_virtual_ops)
 {
   enum_virtual_ops_return result;
@@ -301,8 +304,13 @@ DEFINE_API_IMPL( account_history_api_rocksdb_impl, enum_virtual_ops)
 
   bool include_reversible = args.include_reversible.valid() ? *args.include_reversible : false;
 
+  /// Lets the plugin skip stored operations of rejected types without loading them.
+  fc::optional< account_history_rocksdb::operation_type_filter > typeFilter;
+  if( args.filter.valid() )
+    typeFilter = build_operation_type_filter( *args.filter );
+
   std::pair< uint32_t, uint64_t > next_values = _dataSource.enum_operations_from_block_range(args.block_range_begin,
-    args.block_range_end, include_reversible, args.operation_begin, args.limit,
+    args.block_range_end, include_reversible, args.operation_begin, args.limit, typeFilter,
     [groupOps, &result, &args ](const account_history_rocksdb::rocksdb_operation_object& op, uint64_t operation_id, bool irreversible)
     {
 
@@ -397,6 +405,7 @@ account_history_api::account_history_api()
   }
 
   JSON_RPC_REGISTER_API( HIVE_ACCOUNT_HISTORY_API_PLUGIN_NAME );
+  JSON_RPC_REGISTER_BINARY_API( HIVE_ACCOUNT_HISTORY_API_PLUGIN_NAME );
 }
 
 account_history_api::~account_history_api() {}
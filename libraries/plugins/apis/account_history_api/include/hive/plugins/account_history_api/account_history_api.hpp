@@ -9,10 +9,19 @@
 #include <fc/variant.hpp>
 #include <fc/vector.hpp>
 
-namespace hive { namespace plugins { namespace account_history {
+namespace hive { namespace plugins {
 
+namespace account_history_rocksdb { struct operation_type_filter; }
 
-namespace detail { class abstract_account_history_api_impl; }
+namespace account_history {
+
+
+namespace detail {
+class abstract_account_history_api_impl;
+
+/// Translates enum_vops_filter into the set of accepted operation types (positions in `hive::protocol::operation`).
+account_history_rocksdb::operation_type_filter build_operation_type_filter( uint64_t filter );
+}
 
 struct api_operation_object
 {
@@ -152,7 +161,7 @@ struct enum_virtual_ops_args
 
 struct ops_array_wrapper
 {
-  ops_array_wrapper(uint32_t _block) : block(_block) {}
+  ops_array_wrapper(uint32_t _block = 0) : block(_block) {}
 
   uint32_t                          block = 0;
   bool                              irreversible = false;
@@ -6,12 +6,15 @@
 
 #include <hive/protocol/get_config.hpp>
 
+#include <atomic>
+#include <future>
+
 namespace hive { namespace plugins { namespace block_api {
 
 class block_api_impl
 {
   public:
-    block_api_impl();
+    block_api_impl( uint32_t max_streams );
     ~block_api_impl();
 
     DECLARE_API_IMPL(
@@ -20,7 +23,13 @@ class block_api_impl
       (get_block_range)
     )
 
+    void stream_block_range( const stream_block_range_args& args, const json_rpc::binary_stream_sink& push );
+
     chain::database& _db;
+
+  private:
+    const uint32_t          _max_streams;
+    std::atomic< uint32_t > _active_streams;
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -29,16 +38,25 @@ class block_api_impl
 //                                                                  //
 //////////////////////////////////////////////////////////////////////
 
-block_api::block_api()
-  : my( new block_api_impl() )
+block_api::block_api( uint32_t max_streams )
+  : my( new block_api_impl( max_streams ) )
 {
   JSON_RPC_REGISTER_API( HIVE_BLOCK_API_PLUGIN_NAME );
+  JSON_RPC_REGISTER_BINARY_API( HIVE_BLOCK_API_PLUGIN_NAME );
+
+  appbase::app().get_plugin< json_rpc::json_rpc_plugin >().add_binary_stream_method( HIVE_BLOCK_API_PLUGIN_NAME, "stream_block_range",
+    [this]( const std::vector< char >& args, const json_rpc::binary_stream_sink& push )
+    {
+      my->stream_block_range( fc::raw::unpack_from_vector< stream_block_range_args >( args ), push );
+    } );
 }
 
 block_api::~block_api() {}
 
-block_api_impl::block_api_impl()
-  : _db( appbase::app().get_plugin< hive::plugins::chain::chain_plugin >().db() ) {}
+block_api_impl::block_api_impl( uint32_t max_streams )
+  : _db( appbase::app().get_plugin< hive::plugins::chain::chain_plugin >().db() ),
+    _max_streams( max_streams ),
+    _active_streams( 0 ) {}
 
 block_api_impl::~block_api_impl() {}
 
@@ -79,6 +97,53 @@ DEFINE_API_IMPL( block_api_impl, get_block_range )
   return result;
 }
 
+/**
+  * Sends irreversible blocks straight from block_log, without locking the state.  Next chunk of blocks is read
+  * while current one is being sent, sending waits when client does not keep up.  Client that was disconnected
+  * can resume the stream from block number following the last one it received.
+  * Stream holds a webserver thread until it ends, so only limited number of streams can run at once.
+  */
+void block_api_impl::stream_block_range( const stream_block_range_args& args, const json_rpc::binary_stream_sink& push )
+{
+  struct stream_slot
+  {
+    explicit stream_slot( std::atomic< uint32_t >& active_streams ) : active_streams( active_streams ) { ++active_streams; }
+    ~stream_slot() { --active_streams; }
+
+    std::atomic< uint32_t >& active_streams;
+  } slot( _active_streams );
+  FC_ASSERT( _max_streams == 0 || _active_streams <= _max_streams,
+    "Too many concurrent block streams (limit ${l}), try again later", ("l", _max_streams) );
+
+  const chain::block_log& log = _db.get_block_log();
+  const uint64_t end_block_num = args.count ? uint64_t( std::max( args.starting_block_num, 1u ) ) + args.count : std::numeric_limits< uint64_t >::max();
+
+  auto read_chunk = [&log, end_block_num]( uint32_t first_block_num ) -> vector< signed_block >
+  {
+    auto head = log.head();
+    if( !head || first_block_num > head->block_num() || first_block_num >= end_block_num )
+      return vector< signed_block >();
+    uint64_t last_block_num = std::min< uint64_t >( { uint64_t( first_block_num ) + BLOCK_API_STREAM_READ_AHEAD - 1,
+      head->block_num(), end_block_num - 1 } );
+    return log.read_block_range_by_num( first_block_num, last_block_num - first_block_num + 1 );
+  };
+
+  std::future< vector< signed_block > > read_ahead = std::async( std::launch::async, read_chunk, std::max( args.starting_block_num, 1u ) );
+  for( ;; )
+  {
+    vector< signed_block > blocks = read_ahead.get();
+    if( blocks.empty() )
+      return;
+
+    read_ahead = std::async( std::launch::async, read_chunk, blocks.back().block_num() + 1 );
+    for( const signed_block& block : blocks )
+    {
+      if( !push( fc::raw::pack_to_vector( block ) ) )
+        return;
+    }
+  }
+}
+
 DEFINE_LOCKLESS_APIS( block_api,
   (get_block_header)
   (get_block)
@@ -8,11 +8,17 @@ block_api_plugin::~block_api_plugin() {}
 
 void block_api_plugin::set_program_options(
   options_description& cli,
-  options_description& cfg ) {}
+  options_description& cfg )
+{
+  cfg.add_options()
+    ("block-api-max-streams", bpo::value< uint32_t >()->default_value( BLOCK_API_DEFAULT_MAX_STREAMS ),
+      "Maximum number of concurrent block_api.stream_block_range calls, each holds a webserver thread until it ends (0 - unlimited).")
+    ;
+}
 
 void block_api_plugin::plugin_initialize( const variables_map& options )
 {
-  api = std::make_shared< block_api >();
+  api = std::make_shared< block_api >( options.at( "block-api-max-streams" ).as< uint32_t >() );
 }
 
 void block_api_plugin::plugin_startup() {}
@@ -5,6 +5,8 @@
 #include <hive/plugins/block_api/block_api_args.hpp>
 
 #define BLOCK_API_SINGLE_QUERY_LIMIT 1000
+#define BLOCK_API_STREAM_READ_AHEAD 1000
+#define BLOCK_API_DEFAULT_MAX_STREAMS 4
 
 namespace hive { namespace plugins { namespace block_api {
 
@@ -13,7 +15,8 @@ class block_api_impl;
 class block_api
 {
   public:
-    block_api();
+    /// @param max_streams limit of concurrent stream_block_range calls (each holds a webserver thread), 0 - unlimited
+    explicit block_api( uint32_t max_streams = BLOCK_API_DEFAULT_MAX_STREAMS );
     ~block_api();
 
     DECLARE_API(
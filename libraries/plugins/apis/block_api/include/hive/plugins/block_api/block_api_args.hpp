@@ -44,6 +44,13 @@ struct get_block_range_return
   vector<api_signed_block_object> blocks;
 };
 
+/* stream_block_range, binary websocket stream of packed signed_block items */
+struct stream_block_range_args
+{
+  uint32_t starting_block_num = 1;
+  uint32_t count = 0; /// 0 streams all irreversible blocks
+};
+
 } } } // hive::block_api
 
 FC_REFLECT( hive::plugins::block_api::get_block_header_args,
@@ -65,3 +72,7 @@ FC_REFLECT( hive::plugins::block_api::get_block_range_args,
 FC_REFLECT( hive::plugins::block_api::get_block_range_return,
   (blocks) )
 
+FC_REFLECT( hive::plugins::block_api::stream_block_range_args,
+  (starting_block_num)
+  (count) )
+
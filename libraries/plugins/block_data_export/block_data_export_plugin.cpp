@@ -1,11 +1,6 @@
 
-#define BOOST_THREAD_PROVIDES_EXECUTORS
-#define BOOST_THREAD_PROVIDES_FUTURE
-#define BOOST_THREAD_PROVIDES_FUTURE_CONTINUATION
-#define BOOST_THREAD_USES_MOVE
-
-
 #include <hive/plugins/block_data_export/block_data_export_plugin.hpp>
+#include <hive/plugins/block_data_export/columnar_export.hpp>
 #include <hive/plugins/block_data_export/exportable_block_data.hpp>
 
 #include <hive/chain/account_object.hpp>
@@ -13,11 +8,18 @@
 #include <hive/chain/global_property_object.hpp>
 #include <hive/chain/index.hpp>
 
-#include <boost/thread/future.hpp>
+#include <fc/io/raw.hpp>
+
 #include <boost/thread/sync_bounded_queue.hpp>
+#include <boost/thread/thread.hpp>
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <queue>
 #include <sstream>
 
@@ -25,6 +27,7 @@ namespace hive { namespace plugins { namespace block_data_export {
 
 using hive::chain::block_notification;
 using hive::chain::database;
+using hive::chain::operation_notification;
 
 using hive::protocol::block_id_type;
 
@@ -45,17 +48,34 @@ struct api_export_data_object
   }
 };
 
+/** Record of binary output: uint32 length followed by fc::raw packed binary_export_record is written per block,
+  *  offset of every record is appended to `<output>.index` file as uint64.
+  */
+struct binary_export_record
+{
+  block_id_type                               block_id;
+  block_id_type                               previous;
+  flat_map< string, std::vector< char > >     export_data;
+};
+
 } } } }
 
 FC_REFLECT( hive::plugins::block_data_export::detail::api_export_data_object, (block_id)(previous)(export_data) )
+FC_REFLECT( hive::plugins::block_data_export::detail::binary_export_record, (block_id)(previous)(export_data) )
 
 namespace hive { namespace plugins { namespace block_data_export { namespace detail {
 
 struct work_item
 {
-  std::shared_ptr< api_export_data_object >          edo;
-  boost::promise< std::shared_ptr< std::string > >   edo_json_promise;
-  boost::future< std::shared_ptr< std::string > >    edo_json_future = edo_json_promise.get_future();
+  uint64_t                                    sequence = 0;
+  std::shared_ptr< api_export_data_object >   edo;
+};
+
+/// Block encoded for output thread, or exception thrown by its encoding
+struct encoded_item
+{
+  std::vector< char >                         data;
+  std::exception_ptr                          error;
 };
 
 class block_data_export_plugin_impl
@@ -64,11 +84,12 @@ class block_data_export_plugin_impl
     block_data_export_plugin_impl( block_data_export_plugin& _plugin ) :
       _db( appbase::app().get_plugin< hive::plugins::chain::chain_plugin >().db() ),
       _self( _plugin ),
-      _data_queue( _max_queue_size ),
-      _output_queue( _max_queue_size ) {}
+      _columnar_queue( _max_columnar_queue_size ) {}
 
     void on_pre_apply_block( const block_notification& note );
     void on_post_apply_block( const block_notification& note );
+    void on_post_apply_operation( const operation_notification& note );
+    void on_irreversible_block( uint32_t block_num );
 
     void register_export_data_factory( const std::string& name, std::function< std::shared_ptr< exportable_block_data >() >& factory );
     void create_export_data( const block_id_type& previous, const block_id_type& block_id );
@@ -77,8 +98,10 @@ class block_data_export_plugin_impl
 
     void start_threads();
     void stop_threads();
-    void convert_to_json_thread_main();
+    void encoding_thread_main();
+    std::vector< char > encode( const api_export_data_object& edo )const;
     void output_thread_main();
+    void columnar_thread_main();
 
     database&                     _db;
     block_data_export_plugin&     _self;
@@ -92,15 +115,44 @@ class block_data_export_plugin_impl
       > >                        _factory_list;
     std::string                   _output_name;
     bool                          _enabled = false;
-
-    size_t                        _max_queue_size = 100;
-    boost::concurrent::sync_bounded_queue< std::shared_ptr< work_item > >    _data_queue;
-    boost::concurrent::sync_bounded_queue< std::shared_ptr< work_item > >    _output_queue;
+    bool                          _binary_format = false;
+
+    std::string                   _columnar_dir;
+    bool                          _columnar_enabled = false;
+    uint32_t                      _columnar_rows_per_group = 65536;
+    boost::signals2::connection   _post_apply_operation_conn;
+    boost::signals2::connection   _irreversible_block_conn;
+    /// Operations of block being applied
+    std::shared_ptr< columnar_block >                 _columnar_block;
+    /// Applied blocks which can still be replaced by other fork - only irreversible ones are written
+    std::deque< std::shared_ptr< columnar_block > >   _pending_columnar_blocks;
+
+    size_t                        _max_queue_size = 1000;
+    std::unique_ptr< boost::concurrent::sync_bounded_queue< std::shared_ptr< work_item > > >    _data_queue;
+    /// Sequence number given to next block sent to encoding threads
+    uint64_t                      _next_sequence = 0;
+
+    /// Encoded blocks waiting for output thread, indexed by sequence (encoding threads can finish them out of order)
+    std::map< uint64_t, encoded_item >   _encoded;
+    std::mutex                    _encoded_mutex;
+    std::condition_variable       _encoded_cv;
+    bool                          _encoding_finished = false;
+    /// Sequence number of next block to be written - encoding threads don't run further ahead than _max_queue_size
+    uint64_t                      _output_sequence = 0;
+    /// First failure of encoding or writing, nothing is exported after it
+    std::exception_ptr            _output_error;
 
     size_t                        _thread_stack_size = 4096*1024;
     std::shared_ptr< boost::thread >                      _output_thread;
 
-    std::vector< boost::thread >  _json_conversion_threads;
+    std::vector< boost::thread >  _encoding_threads;
+
+    size_t                        _max_columnar_queue_size = 100;
+    boost::concurrent::sync_bounded_queue< std::shared_ptr< columnar_block > >    _columnar_queue;
+    std::shared_ptr< boost::thread >                      _columnar_thread;
+    /// Failure of columnar writer, nothing is exported after it
+    std::exception_ptr            _columnar_error;
+    std::mutex                    _columnar_error_mutex;
 };
 
 void block_data_export_plugin_impl::start_threads()
@@ -108,10 +160,18 @@ void block_data_export_plugin_impl::start_threads()
   boost::thread::attributes attrs;
   attrs.set_stack_size( _thread_stack_size );
 
+  if( _columnar_enabled )
+    _columnar_thread = std::make_shared< boost::thread >( attrs, [this]() { columnar_thread_main(); } );
+
+  if( !_enabled )
+    return;
+
+  _data_queue = std::make_unique< boost::concurrent::sync_bounded_queue< std::shared_ptr< work_item > > >( _max_queue_size );
+
   size_t num_threads = boost::thread::hardware_concurrency()+1;
   for( size_t i=0; i<num_threads; i++ )
   {
-    _json_conversion_threads.emplace_back( attrs, [this]() { convert_to_json_thread_main(); } );
+    _encoding_threads.emplace_back( attrs, [this]() { encoding_thread_main(); } );
   }
 
   _output_thread = std::make_shared< boost::thread >( attrs, [this]() { output_thread_main(); } );
@@ -119,64 +179,250 @@ void block_data_export_plugin_impl::start_threads()
 
 void block_data_export_plugin_impl::stop_threads()
 {
-  //
-  // We must close the output queue first:  The output queue may be waiting on a future.
-  // If the conversion threads are still alive, the future will complete,
-  // the output thread will then wait on _output_queue and see close() has been called.
-  //
-  // (If we closed the conversion threads first, the future would never complete,
-  // and the output thread would wait forever.)
-  //
-  _output_queue.close();
-  _output_thread->join();
-  _output_thread.reset();
+  if( _columnar_thread )
+  {
+    // Blocks still reversible at shutdown most likely stay in the chain, so they are written too
+    // (otherwise they would be missing after restart, since they won't be applied again).
+    try
+    {
+      for( const auto& block : _pending_columnar_blocks )
+        _columnar_queue.push_back( block );
+    }
+    catch( const boost::concurrent::sync_queue_is_closed& e )
+    {
+      // columnar thread already stopped on error
+    }
+    _pending_columnar_blocks.clear();
 
-  _data_queue.close();
-  for( boost::thread& t : _json_conversion_threads )
+    _columnar_queue.close();
+    _columnar_thread->join();
+    _columnar_thread.reset();
+  }
+
+  if( !_output_thread )
+    return;
+
+  // Encoding threads finish all queued blocks first, then output thread writes them and quits.
+  _data_queue->close();
+  for( boost::thread& t : _encoding_threads )
     t.join();
-  _json_conversion_threads.clear();
+  _encoding_threads.clear();
+
+  {
+    std::lock_guard< std::mutex > lock( _encoded_mutex );
+    _encoding_finished = true;
+  }
+  _encoded_cv.notify_all();
+
+  _output_thread->join();
+  _output_thread.reset();
 }
 
-void block_data_export_plugin_impl::convert_to_json_thread_main()
+void block_data_export_plugin_impl::encoding_thread_main()
 {
   while( true )
   {
     std::shared_ptr< work_item > work;
     try
     {
-      _data_queue.pull_front( work );
+      _data_queue->pull_front( work );
     }
     catch( const boost::concurrent::sync_queue_is_closed& e )
     {
       break;
     }
 
-    // TODO exception handling
-    std::shared_ptr< std::string > edo_json = std::make_shared< std::string >( fc::json::to_string( work->edo ) );
-    work->edo_json_promise.set_value( edo_json );
+    {
+      // Memory held by encoded blocks is limited even when output is slow, since block waits here
+      // until output thread is close enough (the one it waits for is never held back, so it can't deadlock)
+      std::unique_lock< std::mutex > lock( _encoded_mutex );
+      _encoded_cv.wait( lock, [&]() { return work->sequence < _output_sequence + _max_queue_size || _output_error; } );
+      // Queue is still drained after failure, so block processing is not stuck on it
+      if( _output_error )
+        continue;
+    }
+
+    encoded_item encoded;
+    try
+    {
+      encoded.data = encode( *work->edo );
+    }
+    catch( const fc::exception& e )
+    {
+      elog( "Cannot encode export data of block ${b}: ${e}", ("b", work->edo->block_id)("e", e.to_detail_string()) );
+      encoded.error = std::current_exception();
+    }
+    catch( const std::exception& e )
+    {
+      elog( "Cannot encode export data of block ${b}: ${e}", ("b", work->edo->block_id)("e", e.what()) );
+      encoded.error = std::current_exception();
+    }
+    catch( ... )
+    {
+      elog( "Cannot encode export data of block ${b}: unknown exception", ("b", work->edo->block_id) );
+      encoded.error = std::current_exception();
+    }
+
+    {
+      std::lock_guard< std::mutex > lock( _encoded_mutex );
+      if( !_output_error )
+        _encoded.emplace( work->sequence, std::move( encoded ) );
+    }
+    _encoded_cv.notify_all();
+  }
+}
+
+std::vector< char > block_data_export_plugin_impl::encode( const api_export_data_object& edo )const
+{
+  std::vector< char > result;
+
+  if( !_binary_format )
+  {
+    std::string edo_json = fc::json::to_string( edo );
+    result.reserve( edo_json.length() + 1 );
+    result.assign( edo_json.begin(), edo_json.end() );
+    result.push_back( '\n' );
+    return result;
+  }
+
+  binary_export_record record;
+  record.block_id = edo.block_id;
+  record.previous = edo.previous;
+  for( const auto& data : edo.export_data )
+  {
+    if( data.second )
+      data.second->to_binary( record.export_data[ data.first ] );
   }
+
+  uint32_t size = fc::raw::pack_size( record );
+  result.resize( sizeof( size ) + size );
+  fc::datastream< char* > ds( result.data(), result.size() );
+  fc::raw::pack( ds, size );
+  fc::raw::pack( ds, record );
+  return result;
 }
 
 void block_data_export_plugin_impl::output_thread_main()
 {
   std::ofstream output_file( _output_name, std::ios::binary );
+  std::ofstream index_file;
+  if( _binary_format )
+    index_file.open( _output_name + ".index", std::ios::binary );
+
+  uint64_t next_sequence = 0;
+  uint64_t offset = 0;
+  std::vector< char > batch;
+  std::vector< uint64_t > offsets;
+
   while( true )
   {
-    std::shared_ptr< work_item > work;
+    batch.clear();
+    offsets.clear();
+    std::exception_ptr error;
+
+    {
+      std::unique_lock< std::mutex > lock( _encoded_mutex );
+      _encoded_cv.wait( lock, [&]() { return _encoding_finished || ( !_encoded.empty() && _encoded.begin()->first == next_sequence ); } );
+
+      // Takes all consecutive blocks encoded so far, to write them at once; block that failed to encode
+      // ends export, so there is no gap in output
+      for( auto it = _encoded.begin(); it != _encoded.end() && it->first == next_sequence; it = _encoded.erase( it ) )
+      {
+        if( it->second.error )
+        {
+          error = it->second.error;
+          break;
+        }
+        offsets.push_back( offset + batch.size() );
+        batch.insert( batch.end(), it->second.data.begin(), it->second.data.end() );
+        ++next_sequence;
+      }
+      _output_sequence = next_sequence;
+
+      if( batch.empty() && !error && _encoding_finished )
+        break;
+    }
+    _encoded_cv.notify_all();
+
     try
     {
-      _output_queue.pull_front( work );
+      output_file.write( batch.data(), batch.size() );
+      output_file.flush();
+      FC_ASSERT( output_file.good(), "Cannot write block data export file ${f}", ("f", _output_name) );
+      offset += batch.size();
+
+      if( _binary_format )
+      {
+        index_file.write( reinterpret_cast< const char* >( offsets.data() ), offsets.size() * sizeof( uint64_t ) );
+        index_file.flush();
+        FC_ASSERT( index_file.good(), "Cannot write block data export index file ${f}.index", ("f", _output_name) );
+      }
     }
-    catch( const boost::concurrent::sync_queue_is_closed& e )
+    catch( const fc::exception& e )
+    {
+      elog( "${e}", ("e", e.to_detail_string()) );
+      error = std::current_exception();
+    }
+
+    if( error )
     {
+      elog( "Block data export stopped after ${n} blocks", ("n", next_sequence) );
+      {
+        std::lock_guard< std::mutex > lock( _encoded_mutex );
+        _output_error = error;
+        _encoded.clear();
+      }
+      _encoded_cv.notify_all();
       break;
     }
+  }
+}
 
-    std::shared_ptr< std::string > edo_json = work->edo_json_future.get();
+void block_data_export_plugin_impl::columnar_thread_main()
+{
+  std::unique_ptr< columnar_writer > writer;
+  std::exception_ptr error;
+  try
+  {
+    writer = std::make_unique< columnar_writer >( _columnar_dir, _columnar_rows_per_group );
+    while( true )
+    {
+      std::shared_ptr< columnar_block > block;
+      try
+      {
+        _columnar_queue.pull_front( block );
+      }
+      catch( const boost::concurrent::sync_queue_is_closed& e )
+      {
+        break;
+      }
+
+      writer->write_block( *block );
+    }
+    writer->flush();
+    ilog( "Columnar block data export finished, blocks up to ${b} are written", ("b", writer->get_last_flushed_block()) );
+  }
+  catch( const fc::exception& e )
+  {
+    elog( "${e}", ("e", e.to_detail_string()) );
+    error = std::current_exception();
+  }
+  catch( const std::exception& e )
+  {
+    elog( "Columnar block data export failed: ${e}", ("e", e.what()) );
+    error = std::current_exception();
+  }
 
-    output_file.write( edo_json->c_str(), edo_json->length() );
-    output_file.put( '\n' );
-    output_file.flush();
+  if( error )
+  {
+    if( writer )
+      elog( "Columnar block data export stopped, blocks up to ${b} are fully written", ("b", writer->get_last_flushed_block()) );
+    {
+      std::lock_guard< std::mutex > lock( _columnar_error_mutex );
+      _columnar_error = error;
+    }
+    // chain thread would block forever on full queue that is no longer read
+    _columnar_queue.close();
   }
 }
 
@@ -191,6 +437,15 @@ void block_data_export_plugin_impl::register_export_data_factory(
 void block_data_export_plugin_impl::create_export_data( const block_id_type& previous, const block_id_type& block_id )
 {
   _edo.reset();
+  _columnar_block.reset();
+  if( _columnar_enabled )
+  {
+    _columnar_block = std::make_shared< columnar_block >();
+    _columnar_block->block_id = block_id;
+    _columnar_block->previous = previous;
+    _columnar_block->block_num = hive::protocol::block_header::num_from_id( block_id );
+  }
+
   if( !_enabled )
     return;
   _edo = std::make_shared< api_export_data_object >();
@@ -205,14 +460,34 @@ void block_data_export_plugin_impl::create_export_data( const block_id_type& pre
 
 void block_data_export_plugin_impl::send_export_data()
 {
+  if( _columnar_block )
+  {
+    // Blocks of abandoned fork get replaced by the ones with the same numbers
+    while( !_pending_columnar_blocks.empty() && _pending_columnar_blocks.back()->block_num >= _columnar_block->block_num )
+      _pending_columnar_blocks.pop_back();
+    _pending_columnar_blocks.emplace_back( std::move( _columnar_block ) );
+  }
+
+  if( !_edo )
+    return;
+
+  {
+    std::lock_guard< std::mutex > lock( _encoded_mutex );
+    if( _output_error )
+    {
+      _edo.reset();
+      std::rethrow_exception( _output_error );
+    }
+  }
+
   std::shared_ptr< work_item > work = std::make_shared< work_item >();
+  work->sequence = _next_sequence++;
   work->edo = _edo;
   _edo.reset();
 
   try
   {
-    _data_queue.push_back( work );
-    _output_queue.push_back( work );
+    _data_queue->push_back( work );
   }
   catch( const boost::concurrent::sync_queue_is_closed& e )
   {
@@ -237,6 +512,8 @@ std::shared_ptr< exportable_block_data > block_data_export_plugin_impl::find_abs
 void block_data_export_plugin_impl::on_pre_apply_block( const block_notification& note )
 {
   create_export_data( note.block.previous, note.block_id );
+  if( _columnar_block )
+    _columnar_block->timestamp = note.block.timestamp;
 }
 
 void block_data_export_plugin_impl::on_post_apply_block( const block_notification& note )
@@ -244,6 +521,49 @@ void block_data_export_plugin_impl::on_post_apply_block( const block_notificatio
   send_export_data();
 }
 
+void block_data_export_plugin_impl::on_post_apply_operation( const operation_notification& note )
+{
+  // operations of pending transactions are not exported
+  if( !_columnar_block )
+    return;
+
+  _columnar_block->operations.emplace_back();
+  columnar_operation& op = _columnar_block->operations.back();
+  op.trx_in_block = note.trx_in_block;
+  op.op_in_trx = note.op_in_trx;
+  op.virtual_op = note.virtual_op;
+  op.op = note.op;
+}
+
+void block_data_export_plugin_impl::on_irreversible_block( uint32_t block_num )
+{
+  if( !_columnar_enabled )
+    return;
+
+  try
+  {
+    while( !_pending_columnar_blocks.empty() && _pending_columnar_blocks.front()->block_num <= block_num )
+    {
+      _columnar_queue.push_back( _pending_columnar_blocks.front() );
+      _pending_columnar_blocks.pop_front();
+    }
+  }
+  catch( const boost::concurrent::sync_queue_is_closed& e )
+  {
+    std::lock_guard< std::mutex > lock( _columnar_error_mutex );
+    if( !_columnar_error )
+    {
+      elog( "Caught unexpected sync_queue_is_closed in block_data_export_plugin_impl::on_irreversible_block()" );
+      return;
+    }
+    // columnar thread stopped on error, so export stops here (there can't be gap in written blocks)
+    _columnar_enabled = false;
+    _columnar_block.reset();
+    _pending_columnar_blocks.clear();
+    std::rethrow_exception( _columnar_error );
+  }
+}
+
 } // detail
 
 block_data_export_plugin::block_data_export_plugin() {}
@@ -266,6 +586,14 @@ void block_data_export_plugin::set_program_options( options_description& cli, op
 {
   cfg.add_options()
       ("block-data-export-file", boost::program_options::value< string >()->default_value("NONE"), "Where to export data (NONE to discard)")
+      ("block-data-export-format", boost::program_options::value< string >()->default_value("json"),
+        "Format of exported data: json (line per block) or binary (length prefixed fc::raw records, with offset index in <file>.index)")
+      ("block-data-export-queue-size", boost::program_options::value< uint32_t >()->default_value(1000),
+        "Max number of blocks waiting for encoding or output, before block processing has to wait for export")
+      ("block-data-export-columnar-dir", boost::program_options::value< string >()->default_value("NONE"),
+        "Directory to write operations of irreversible blocks to, in column oriented files - one per operation type (NONE to disable)")
+      ("block-data-export-columnar-rows-per-group", boost::program_options::value< uint32_t >()->default_value(65536),
+        "Number of rows collected before they are appended to columnar export file")
       ;
 }
 
@@ -278,7 +606,16 @@ void block_data_export_plugin::plugin_initialize( const boost::program_options::
 
     my->_output_name = options.at( "block-data-export-file" ).as< string >();
     my->_enabled = (my->_output_name != "NONE");
-    if( !my->_enabled )
+    const std::string& format = options.at( "block-data-export-format" ).as< string >();
+    FC_ASSERT( format == "json" || format == "binary", "Unknown block-data-export-format: ${f}", ("f", format) );
+    my->_binary_format = (format == "binary");
+    my->_max_queue_size = options.at( "block-data-export-queue-size" ).as< uint32_t >();
+    FC_ASSERT( my->_max_queue_size > 0, "block-data-export-queue-size must be positive" );
+    my->_columnar_dir = options.at( "block-data-export-columnar-dir" ).as< string >();
+    my->_columnar_enabled = (my->_columnar_dir != "NONE");
+    my->_columnar_rows_per_group = options.at( "block-data-export-columnar-rows-per-group" ).as< uint32_t >();
+    FC_ASSERT( my->_columnar_rows_per_group > 0, "block-data-export-columnar-rows-per-group must be positive" );
+    if( !my->_enabled && !my->_columnar_enabled )
       return;
 
     my->_pre_apply_block_conn = my->_db.add_pre_apply_block_handler(
@@ -286,6 +623,14 @@ void block_data_export_plugin::plugin_initialize( const boost::program_options::
     my->_post_apply_block_conn = my->_db.add_post_apply_block_handler(
       [&]( const block_notification& note ){ my->on_post_apply_block( note ); }, *this, 9300 );
 
+    if( my->_columnar_enabled )
+    {
+      my->_post_apply_operation_conn = my->_db.add_post_apply_operation_handler(
+        [&]( const operation_notification& note ){ my->on_post_apply_operation( note ); }, *this, 9300 );
+      my->_irreversible_block_conn = my->_db.add_irreversible_block_handler(
+        [&]( uint32_t block_num ){ my->on_irreversible_block( block_num ); }, *this, 9300 );
+    }
+
     my->start_threads();
   }
   FC_CAPTURE_AND_RETHROW()
@@ -295,11 +640,13 @@ void block_data_export_plugin::plugin_startup() {}
 
 void block_data_export_plugin::plugin_shutdown()
 {
-  if( !my->_enabled )
+  if( !my->_enabled && !my->_columnar_enabled )
     return;
 
   chain::util::disconnect_signal( my->_pre_apply_block_conn );
   chain::util::disconnect_signal( my->_post_apply_block_conn );
+  chain::util::disconnect_signal( my->_post_apply_operation_conn );
+  chain::util::disconnect_signal( my->_irreversible_block_conn );
 
   my->stop_threads();
 }
@@ -307,4 +654,11 @@ void block_data_export_plugin::plugin_shutdown()
 exportable_block_data::exportable_block_data() {}
 exportable_block_data::~exportable_block_data() {}
 
+void exportable_block_data::to_binary( std::vector< char >& data )const
+{
+  fc::variant v;
+  to_variant( v );
+  data = fc::raw::pack_to_vector( v );
+}
+
 } } } // hive::plugins::block_data_export
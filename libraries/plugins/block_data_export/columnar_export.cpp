@@ -0,0 +1,316 @@
+#include <hive/plugins/block_data_export/columnar_export.hpp>
+
+#include <fc/io/raw.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <type_traits>
+
+namespace hive { namespace plugins { namespace block_data_export {
+
+namespace detail {
+
+template< typename T, typename Enable = void >
+struct column_type
+{
+  static constexpr column_encoding encoding = packed_encoding;
+};
+
+template< typename T >
+struct column_type< T, typename std::enable_if< std::is_integral< T >::value && sizeof( T ) <= 4 >::type >
+{
+  static constexpr column_encoding encoding = std::is_signed< T >::value ? int32_le_encoding : uint32_le_encoding;
+};
+
+template< typename T >
+struct column_type< T, typename std::enable_if< std::is_integral< T >::value && sizeof( T ) == 8 >::type >
+{
+  static constexpr column_encoding encoding = std::is_signed< T >::value ? int64_le_encoding : uint64_le_encoding;
+};
+
+template<>
+struct column_type< hive::protocol::account_name_type >
+{
+  static constexpr column_encoding encoding = account_id_encoding;
+};
+
+template< typename T >
+void append_fixed( std::vector< char >& data, T value )
+{
+  const char* bytes = reinterpret_cast< const char* >( &value );
+  data.insert( data.end(), bytes, bytes + sizeof( T ) );
+}
+
+template< typename T >
+void append_value( columnar_writer&, columnar_writer::column_builder& column, const T& value,
+  typename std::enable_if< column_type< T >::encoding == packed_encoding >::type* = nullptr )
+{
+  size_t offset = column.data.size();
+  size_t size = fc::raw::pack_size( value );
+  column.data.resize( offset + size );
+  fc::datastream< char* > ds( column.data.data() + offset, size );
+  fc::raw::pack( ds, value );
+  column.offsets.push_back( column.data.size() );
+}
+
+template< typename T >
+void append_value( columnar_writer&, columnar_writer::column_builder& column, const T& value,
+  typename std::enable_if< std::is_integral< T >::value >::type* = nullptr )
+{
+  switch( column_type< T >::encoding )
+  {
+    case int32_le_encoding:  append_fixed< int32_t >( column.data, value ); break;
+    case uint32_le_encoding: append_fixed< uint32_t >( column.data, value ); break;
+    case int64_le_encoding:  append_fixed< int64_t >( column.data, value ); break;
+    default:                 append_fixed< uint64_t >( column.data, value ); break;
+  }
+}
+
+inline void append_value( columnar_writer& writer, columnar_writer::column_builder& column, const hive::protocol::account_name_type& value )
+{
+  append_fixed< uint32_t >( column.data, writer.get_account_id( value ) );
+}
+
+/// Appends value of every operation member to its column, creating the columns for first row of the table.
+template< typename Op >
+struct member_column_visitor
+{
+  member_column_visitor( columnar_writer& writer, columnar_writer::table& table, const Op& op, size_t first_column )
+    : _writer( writer ), _table( table ), _op( op ), _next_column( first_column ) {}
+
+  template< typename Member, class Class, Member (Class::*member) >
+  void operator()( const char* name ) const
+  {
+    if( _table.columns.size() <= _next_column )
+      _table.columns.emplace_back( name, column_type< Member >::encoding );
+
+    append_value( _writer, _table.columns[ _next_column++ ], _op.*member );
+  }
+
+  columnar_writer&          _writer;
+  columnar_writer::table&   _table;
+  const Op&                 _op;
+  mutable size_t            _next_column;
+};
+
+struct operation_row_visitor
+{
+  typedef void result_type;
+
+  operation_row_visitor( columnar_writer& writer, uint32_t block_num, const columnar_operation& op )
+    : _writer( writer ), _block_num( block_num ), _op( op ) {}
+
+  template< typename Op >
+  void operator()( const Op& op ) const
+  {
+    std::string name = fc::get_typename< Op >::name();
+    auto pos = name.rfind( ':' );
+    if( pos != std::string::npos )
+      name.erase( 0, pos + 1 );
+
+    columnar_writer::table& table = _writer.get_table( name );
+    if( table.columns.empty() )
+    {
+      table.columns.emplace_back( "block_num", uint32_le_encoding );
+      table.columns.emplace_back( "trx_in_block", uint32_le_encoding );
+      table.columns.emplace_back( "op_in_trx", uint32_le_encoding );
+      table.columns.emplace_back( "virtual_op", uint32_le_encoding );
+    }
+
+    append_value( _writer, table.columns[0], _block_num );
+    append_value( _writer, table.columns[1], _op.trx_in_block );
+    append_value( _writer, table.columns[2], _op.op_in_trx );
+    append_value( _writer, table.columns[3], _op.virtual_op );
+
+    fc::reflector< Op >::visit( member_column_visitor< Op >( _writer, table, op, 4 ) );
+
+    _writer.finish_row( table );
+  }
+
+  columnar_writer&            _writer;
+  uint32_t                    _block_num;
+  const columnar_operation&   _op;
+};
+
+} // detail
+
+columnar_writer::columnar_writer( const fc::path& directory, uint32_t rows_per_group )
+  : _directory( directory ), _rows_per_group( rows_per_group )
+{
+  FC_ASSERT( _rows_per_group > 0, "Row group must hold at least one row" );
+  boost::filesystem::create_directories( _directory );
+  load_dictionary();
+}
+
+columnar_writer::~columnar_writer()
+{
+  if( _failed )
+    return;
+
+  try
+  {
+    flush();
+  }
+  FC_CAPTURE_AND_LOG( (_directory) )
+}
+
+void columnar_writer::write_block( const columnar_block& block )
+{
+  FC_ASSERT( !_failed, "Columnar export stopped after failed write" );
+  _block_num = block.block_num;
+
+  table& blocks = get_table( "blocks" );
+  if( blocks.columns.empty() )
+  {
+    blocks.columns.emplace_back( "block_num", uint32_le_encoding );
+    blocks.columns.emplace_back( "block_id", packed_encoding );
+    blocks.columns.emplace_back( "previous", packed_encoding );
+    blocks.columns.emplace_back( "timestamp", uint32_le_encoding );
+  }
+
+  detail::append_value( *this, blocks.columns[0], block.block_num );
+  detail::append_value( *this, blocks.columns[1], block.block_id );
+  detail::append_value( *this, blocks.columns[2], block.previous );
+  detail::append_value( *this, blocks.columns[3], block.timestamp.sec_since_epoch() );
+  finish_row( blocks );
+
+  for( const columnar_operation& op : block.operations )
+    op.op.visit( detail::operation_row_visitor( *this, block.block_num, op ) );
+}
+
+void columnar_writer::flush()
+{
+  FC_ASSERT( !_failed, "Columnar export stopped after failed write" );
+  for( auto& t : _tables )
+    flush_table( t.second );
+}
+
+uint32_t columnar_writer::get_last_flushed_block()const
+{
+  uint32_t last = _block_num;
+  for( const auto& t : _tables )
+  {
+    if( t.second.rows > 0 )
+      last = std::min( last, t.second.first_block_num - 1 );
+  }
+  return last;
+}
+
+uint32_t columnar_writer::get_account_id( const hive::protocol::account_name_type& name )
+{
+  std::string str_name = name;
+  auto it = _account_ids.find( str_name );
+  if( it != _account_ids.end() )
+    return it->second;
+
+  uint32_t id = _account_ids.size();
+  _account_ids.emplace( str_name, id );
+  _new_accounts.emplace_back( std::move( str_name ) );
+  return id;
+}
+
+columnar_writer::table& columnar_writer::get_table( const std::string& name )
+{
+  auto it = _tables.find( name );
+  if( it == _tables.end() )
+  {
+    it = _tables.emplace( name, table() ).first;
+    it->second.file_name = ( _directory / ( name + ".columns" ) ).string();
+  }
+  return it->second;
+}
+
+void columnar_writer::finish_row( table& t )
+{
+  if( t.rows == 0 )
+    t.first_block_num = _block_num;
+  if( ++t.rows >= _rows_per_group )
+    flush_table( t );
+}
+
+void columnar_writer::flush_table( table& t )
+{
+  if( t.rows == 0 )
+    return;
+
+  // until the row group is written, failure leaves files that must not be appended to
+  _failed = true;
+
+  // row group can't refer to names missing in the dictionary
+  write_new_accounts();
+
+  row_group group;
+  group.rows = t.rows;
+  group.columns.reserve( t.columns.size() );
+  for( column_builder& column : t.columns )
+  {
+    group.columns.emplace_back();
+    column_chunk& chunk = group.columns.back();
+    chunk.name = column.name;
+    chunk.encoding = column.encoding;
+
+    if( column.encoding == packed_encoding )
+    {
+      chunk.data.reserve( column.offsets.size() * sizeof( uint32_t ) + column.data.size() );
+      for( uint32_t offset : column.offsets )
+        detail::append_fixed( chunk.data, offset );
+      chunk.data.insert( chunk.data.end(), column.data.begin(), column.data.end() );
+    }
+    else
+    {
+      chunk.data.swap( column.data );
+    }
+
+    column.data.clear();
+    column.offsets.clear();
+  }
+
+  std::vector< char > packed = fc::raw::pack_to_vector( group );
+  std::ofstream file( t.file_name, std::ios::binary | std::ios::app );
+  file.write( packed.data(), packed.size() );
+  FC_ASSERT( file.good(), "Could not write to ${f}", ("f", t.file_name) );
+  t.rows = 0;
+  _failed = false;
+}
+
+void columnar_writer::load_dictionary()
+{
+  fc::path path = _directory / "accounts.dictionary";
+  if( !fc::exists( path ) )
+    return;
+
+  std::ifstream file( path.string(), std::ios::binary );
+  std::vector< char > content( ( std::istreambuf_iterator< char >( file ) ), std::istreambuf_iterator< char >() );
+
+  fc::datastream< const char* > ds( content.data(), content.size() );
+  while( ds.remaining() > 0 )
+  {
+    std::string name;
+    fc::raw::unpack( ds, name );
+    _account_ids.emplace( std::move( name ), _account_ids.size() );
+  }
+
+  ilog( "Loaded ${n} account names from columnar export dictionary", ("n", _account_ids.size()) );
+}
+
+void columnar_writer::write_new_accounts()
+{
+  if( _new_accounts.empty() )
+    return;
+
+  std::vector< char > packed;
+  for( const std::string& name : _new_accounts )
+  {
+    std::vector< char > packed_name = fc::raw::pack_to_vector( name );
+    packed.insert( packed.end(), packed_name.begin(), packed_name.end() );
+  }
+  _new_accounts.clear();
+
+  fc::path path = _directory / "accounts.dictionary";
+  std::ofstream file( path.string(), std::ios::binary | std::ios::app );
+  file.write( packed.data(), packed.size() );
+  FC_ASSERT( file.good(), "Could not write to ${f}", ("f", path) );
+}
+
+} } } // hive::plugins::block_data_export
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <hive/protocol/operations.hpp>
+#include <hive/protocol/types.hpp>
+
+#include <fc/filesystem.hpp>
+#include <fc/reflect/reflect.hpp>
+#include <fc/time.hpp>
+
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace hive { namespace plugins { namespace block_data_export {
+
+/// Operation captured during block application, to be written by columnar_writer.
+struct columnar_operation
+{
+  uint32_t                  trx_in_block = 0;
+  uint32_t                  op_in_trx = 0;
+  uint32_t                  virtual_op = 0;
+  hive::protocol::operation op;
+};
+
+struct columnar_block
+{
+  uint32_t                            block_num = 0;
+  hive::protocol::block_id_type       block_id;
+  hive::protocol::block_id_type       previous;
+  fc::time_point_sec                  timestamp;
+  std::vector< columnar_operation >   operations;
+};
+
+enum column_encoding : uint8_t
+{
+  uint32_le_encoding,   ///< 4 bytes per row
+  int32_le_encoding,    ///< 4 bytes per row
+  uint64_le_encoding,   ///< 8 bytes per row
+  int64_le_encoding,    ///< 8 bytes per row
+  account_id_encoding,  ///< 4 bytes per row, index of the name in accounts.dictionary
+  packed_encoding       ///< uint32 end offset of every row, then fc::raw packed values of all rows
+};
+
+struct column_chunk
+{
+  std::string           name;
+  uint8_t               encoding = packed_encoding;
+  std::vector< char >   data;
+};
+
+/** Unit appended to column files: values of `rows` consecutive rows for each of the columns.
+  *  Stored as fc::raw packed object, so every row group describes its own layout.
+  */
+struct row_group
+{
+  uint32_t                      rows = 0;
+  std::vector< column_chunk >   columns;
+};
+
+/** Writes operations of exported blocks in column oriented files placed in single directory:
+  *  - `<operation name>.columns` - one file per operation type, holding block_num, trx_in_block, op_in_trx,
+  *    virtual_op columns followed by one column per operation member,
+  *  - `blocks.columns` - block_num, block_id, previous, timestamp of every written block,
+  *  - `accounts.dictionary` - fc::raw packed account names, account_id column values index them.
+  *  Files are only appended to, so export can continue after node restart.
+  */
+class columnar_writer
+{
+  public:
+    columnar_writer( const fc::path& directory, uint32_t rows_per_group );
+    ~columnar_writer();
+
+    void write_block( const columnar_block& block );
+
+    /// Writes all collected rows, even when row groups are not full.
+    void flush();
+
+    /// @return number of the last block whose rows are all written to files (0 when there is none)
+    uint32_t get_last_flushed_block()const;
+
+    struct column_builder
+    {
+      column_builder( const std::string& n, column_encoding e ) : name( n ), encoding( e ) {}
+
+      std::string             name;
+      column_encoding         encoding;
+      std::vector< char >     data;
+      std::vector< uint32_t > offsets;  ///< only for packed_encoding
+    };
+
+    struct table
+    {
+      std::string                   file_name;
+      std::vector< column_builder > columns;
+      uint32_t                      rows = 0;
+      uint32_t                      first_block_num = 0; ///< block of the first row that is not written yet
+    };
+
+    uint32_t get_account_id( const hive::protocol::account_name_type& name );
+    table& get_table( const std::string& name );
+    /// Called when values of all columns have been appended for the row.
+    void finish_row( table& t );
+
+  private:
+    void flush_table( table& t );
+    void load_dictionary();
+    void write_new_accounts();
+
+    fc::path                                      _directory;
+    uint32_t                                      _rows_per_group = 0;
+    std::map< std::string, table >                _tables;
+    std::unordered_map< std::string, uint32_t >   _account_ids;
+    std::vector< std::string >                    _new_accounts;
+    uint32_t                                      _block_num = 0; ///< block being written (or last written one)
+    /// set when writing a row group failed, nothing is written after that, so there are no gaps in files
+    bool                                          _failed = false;
+};
+
+} } } // hive::plugins::block_data_export
+
+FC_REFLECT( hive::plugins::block_data_export::column_chunk, (name)(encoding)(data) )
+FC_REFLECT( hive::plugins::block_data_export::row_group, (rows)(columns) )
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 namespace fc {
 class variant;
@@ -15,6 +16,9 @@ class exportable_block_data
     virtual ~exportable_block_data();
 
     virtual void to_variant( fc::variant& v )const = 0;
+
+    /// Used by binary export format. By default packs result of to_variant(), override to pack data directly.
+    virtual void to_binary( std::vector< char >& data )const;
 };
 
 } } }
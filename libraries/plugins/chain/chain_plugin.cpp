@@ -7,6 +7,7 @@
 
 #include <hive/utilities/benchmark_dumper.hpp>
 #include <hive/utilities/database_configuration.hpp>
+#include <hive/utilities/metrics.hpp>
 
 #include <fc/string.hpp>
 #include <fc/io/json.hpp>
@@ -21,6 +22,7 @@
 
 #include <thread>
 #include <memory>
+#include <mutex>
 #include <iostream>
 
 namespace hive { namespace plugins { namespace chain {
@@ -38,6 +40,11 @@ using get_indexes_memory_details_type = std::function< void( index_memory_detail
 
 #define NUM_THREADS 1
 
+/// how often index statistics exposed in metrics are refreshed by write processing thread
+#define INDEX_METRICS_REFRESH_INTERVAL fc::seconds( 10 )
+
+namespace metrics = hive::utilities::metrics;
+
 struct generate_block_request
 {
   generate_block_request( const fc::time_point_sec w, const account_name_type& wo, const fc::ecc::private_key& priv_key, uint32_t s ) :
@@ -70,9 +77,21 @@ namespace detail {
 class chain_plugin_impl
 {
   public:
-    chain_plugin_impl() : write_queue( 64 ) {}
+    chain_plugin_impl() : write_queue( 64 ),
+      block_apply_time( metrics::registry::instance().get_histogram( "hived_block_apply_seconds", "Time of pushing block to the database" ) ),
+      write_lock_wait_time( metrics::registry::instance().get_histogram( "hived_write_lock_wait_seconds", "Time write processing waited for chainbase write lock" ) ),
+      write_lock_hold_time_metric( metrics::registry::instance().get_histogram( "hived_write_lock_hold_seconds", "Time write processing held chainbase write lock" ) )
+    {
+      write_queue_depth.store( 0 );
+      metrics_head_block_num.store( 0 );
+    }
     ~chain_plugin_impl() { stop_write_processing(); }
 
+    void push_write_request( write_context* cxt );
+    /// Copies index statistics for metrics, called with write lock held.
+    void refresh_index_metrics();
+    void collect_metrics( metrics::text_writer& writer );
+
     void register_snapshot_provider(state_snapshot_provider& provider)
       {
       snapshot_provider = &provider;
@@ -111,6 +130,11 @@ class chain_plugin_impl
     bool                             force_replay = false;
     uint32_t                         benchmark_interval = 0;
     uint32_t                         flush_interval = 0;
+    uint32_t                         trx_precheck_threads = 0;
+    uint32_t                         trx_admission_cache_size = 0;
+    uint32_t                         max_pending_transactions_per_account = 0;
+    uint64_t                         max_pending_transactions_size = 0;
+    bool                             comment_archive = false;
     bool                             replay_in_memory = false;
     std::vector< std::string >       replay_memory_indices{};
     flat_map<uint32_t,block_id_type> loaded_checkpoints;
@@ -137,6 +161,16 @@ class chain_plugin_impl
     state_snapshot_provider*            snapshot_provider = nullptr;
     bool                                is_p2p_enabled = true;
     std::atomic<uint32_t>               peer_count;
+
+    metrics::histogram&                 block_apply_time;
+    metrics::histogram&                 write_lock_wait_time;
+    metrics::histogram&                 write_lock_hold_time_metric;
+    /// number of requests pushed to write_queue and not yet taken by write processing thread
+    std::atomic<uint32_t>               write_queue_depth;
+    std::atomic<uint32_t>               metrics_head_block_num;
+    fc::time_point                      index_metrics_refresh_time;
+    std::mutex                          index_metrics_mutex;
+    index_memory_details_cntr_t         index_metrics;
 };
 
 struct write_request_visitor
@@ -146,6 +180,7 @@ struct write_request_visitor
   database* db;
   uint32_t  skip = 0;
   fc::optional< fc::exception >* except;
+  metrics::histogram* block_apply_time = nullptr;
   std::shared_ptr< abstract_block_producer > block_generator;
 
   typedef bool result_type;
@@ -157,6 +192,7 @@ struct write_request_visitor
     try
     {
       STATSD_START_TIMER( "chain", "write_time", "push_block", 1.0f )
+      metrics::scoped_timer apply_timer( *block_apply_time );
       result = db->push_block( *block, skip );
       STATSD_STOP_TIMER( "chain", "write_time", "push_block" )
     }
@@ -247,6 +283,8 @@ struct request_promise_visitor
 
 void chain_plugin_impl::start_write_processing()
 {
+  metrics::registry::instance().add_collector( "chain", [this]( metrics::text_writer& writer ) { collect_metrics( writer ); } );
+
   write_processor_thread = std::make_shared< std::thread >( [&]()
   {
     ilog("Write processing thread started.");
@@ -257,6 +295,7 @@ void chain_plugin_impl::start_write_processing()
     write_request_visitor req_visitor;
     req_visitor.db = &db;
     req_visitor.block_generator = block_generator;
+    req_visitor.block_apply_time = &block_apply_time;
 
     request_promise_visitor prom_visitor;
 
@@ -286,6 +325,7 @@ void chain_plugin_impl::start_write_processing()
     {
       if( write_queue.pop( cxt ) )
       {
+        --write_queue_depth;
         last_popped_block_time = fc::time_point::now();
 
 	      fc::time_point write_lock_request_time = fc::time_point::now();
@@ -293,6 +333,7 @@ void chain_plugin_impl::start_write_processing()
         {
           fc::time_point write_lock_acquired_time = fc::time_point::now();
           fc::microseconds write_lock_acquisition_time = write_lock_acquired_time - write_lock_request_time;
+          write_lock_wait_time.observe( write_lock_acquisition_time );
           if( write_lock_acquisition_time > fc::milliseconds( 50 ) )
           {
             wlog("write_lock_acquisition_time = ${write_lock_aquisition_time}μs exceeds warning threshold of 50ms",
@@ -330,8 +371,14 @@ void chain_plugin_impl::start_write_processing()
               break;
             }
 
+            --write_queue_depth;
             last_popped_block_time = fc::time_point::now();
           }
+
+          metrics_head_block_num.store( db.head_block_num() );
+          if( fc::time_point::now() - index_metrics_refresh_time > INDEX_METRICS_REFRESH_INTERVAL )
+            refresh_index_metrics();
+          write_lock_hold_time_metric.observe( fc::time_point::now() - write_lock_acquired_time );
         });
       }
 
@@ -357,8 +404,45 @@ void chain_plugin_impl::start_write_processing()
   });
 }
 
+void chain_plugin_impl::push_write_request( write_context* cxt )
+{
+  ++write_queue_depth;
+  write_queue.push( cxt );
+}
+
+void chain_plugin_impl::refresh_index_metrics()
+{
+  index_memory_details_cntr_t details;
+  for( auto idx : db.get_abstract_index_cntr() )
+  {
+    auto info = idx->get_statistics( true );
+    details.emplace_back( std::move( info._value_type_name ), info._item_count,
+      info._item_sizeof, info._item_additional_allocation, info._additional_container_allocation );
+  }
+
+  std::lock_guard< std::mutex > guard( index_metrics_mutex );
+  index_metrics = std::move( details );
+  index_metrics_refresh_time = fc::time_point::now();
+}
+
+void chain_plugin_impl::collect_metrics( metrics::text_writer& writer )
+{
+  writer.gauge( "hived_write_queue_depth", "Blocks and transactions waiting for write processing", write_queue_depth.load() );
+  writer.gauge( "hived_head_block_number", "Head block number after last write processing batch", metrics_head_block_num.load() );
+
+  // copy taken by write processing thread, so reading it never waits for chainbase lock
+  std::lock_guard< std::mutex > guard( index_metrics_mutex );
+  for( const auto& info : index_metrics )
+    writer.gauge( "hived_index_objects", "Number of objects in chainbase index", info.index_size, { { "index", info.index_name } } );
+  for( const auto& info : index_metrics )
+    writer.gauge( "hived_index_memory_bytes", "Estimated memory used by chainbase index (without dynamic allocations of objects)",
+      info.total_index_mem_usage, { { "index", info.index_name } } );
+}
+
 void chain_plugin_impl::stop_write_processing()
 {
+  metrics::registry::instance().remove_collector( "chain" );
+
   running = false;
 
   if( write_processor_thread )
@@ -419,6 +503,9 @@ void chain_plugin_impl::initial_settings()
   }
 
   db.set_flush_interval( flush_interval );
+  db.set_trx_precheck_threads( trx_precheck_threads );
+  db.set_trx_admission_cache_size( trx_admission_cache_size );
+  db.set_pending_transaction_limits( max_pending_transactions_per_account, max_pending_transactions_size );
   db.add_checkpoints( loaded_checkpoints );
   db.set_require_locking( check_locks );
 
@@ -455,6 +542,7 @@ void chain_plugin_impl::initial_settings()
   db_open_args.benchmark_is_enabled = benchmark_is_enabled;
   db_open_args.database_cfg = database_config;
   db_open_args.replay_in_memory = replay_in_memory;
+  db_open_args.enable_comment_archive = comment_archive;
   db_open_args.replay_memory_indices = replay_memory_indices;
 
   auto benchmark_lambda = [ this ] ( uint32_t current_block_number,
@@ -624,6 +712,16 @@ void chain_plugin::set_program_options(options_description& cli, options_descrip
       ("checkpoint,c", bpo::value<vector<string>>()->composing(), "Pairs of [BLOCK_NUM,BLOCK_ID] that should be enforced as checkpoints.")
       ("flush-state-interval", bpo::value<uint32_t>(),
         "flush shared memory changes to disk every N blocks")
+      ("trx-precheck-threads", bpo::value<uint32_t>()->default_value(0),
+        "Experimental: number of helper threads that verify signatures and validate transactions of a block in parallel before they are applied in order. 0 disables it.")
+      ("trx-admission-cache-size", bpo::value<uint32_t>()->default_value(20000),
+        "Number of recently seen transactions for which results of validation and signature verification are remembered, so they are not repeated when the same transaction arrives again or is reapplied. 0 disables the cache.")
+      ("max-pending-transactions-per-account", bpo::value<uint32_t>()->default_value(0),
+        "Maximum number of pending (not yet included in block) transactions paid by single account, f.e. 1000. New transactions of account that reached it are rejected. 0 (default) means no limit.")
+      ("max-pending-transactions-size", bpo::value<uint64_t>()->default_value(0),
+        "Maximum total size of pending transactions in MB, f.e. 64. When reached, transactions with lowest priority (RC left to paying account, when RC plugin is enabled) are dropped in favor of more valuable ones and block producer picks the most valuable transactions first. 0 (default) means no limit.")
+      ("comment-archive", bpo::bool_switch()->default_value(false),
+        "Experimental: move paid out comments from shared memory to RocksDB archive once they become irreversible. API calls read archived comments from the archive, what is slower than reading them from state. State snapshots can't be created nor loaded while it is enabled. Once enabled, it cannot be disabled without replay.")
       ;
   cli.add_options()
       ("replay-blockchain", bpo::bool_switch()->default_value(false), "clear chain database and replay all blocks" )
@@ -679,6 +777,11 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
     my->flush_interval = options.at( "flush-state-interval" ).as<uint32_t>();
   else
     my->flush_interval = 10000;
+  my->trx_precheck_threads = options.at( "trx-precheck-threads" ).as< uint32_t >();
+  my->trx_admission_cache_size = options.at( "trx-admission-cache-size" ).as< uint32_t >();
+  my->max_pending_transactions_per_account = options.at( "max-pending-transactions-per-account" ).as< uint32_t >();
+  my->max_pending_transactions_size = options.at( "max-pending-transactions-size" ).as< uint64_t >() * 1024 * 1024;
+  my->comment_archive = options.at( "comment-archive" ).as< bool >();
 
   if(options.count("checkpoint"))
   {
@@ -803,7 +906,7 @@ bool chain_plugin::accept_block( const hive::chain::signed_block& block, bool cu
   cxt.skip = skip;
   cxt.prom_ptr = &prom;
 
-  my->write_queue.push( &cxt );
+  my->push_write_request( &cxt );
 
   prom.get_future().get();
 
@@ -819,7 +922,7 @@ void chain_plugin::accept_transaction( const hive::chain::signed_transaction& tr
   cxt.req_ptr = &trx;
   cxt.prom_ptr = &prom;
 
-  my->write_queue.push( &cxt );
+  my->push_write_request( &cxt );
 
   prom.get_future().get();
 
@@ -840,7 +943,7 @@ hive::chain::signed_block chain_plugin::generate_block(
   cxt.req_ptr = &req;
   cxt.prom_ptr = &prom;
 
-  my->write_queue.push( &cxt );
+  my->push_write_request( &cxt );
 
   prom.get_future().get();
 
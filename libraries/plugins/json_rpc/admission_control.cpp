@@ -0,0 +1,166 @@
+#include <hive/plugins/json_rpc/admission_control.hpp>
+
+#include <fc/exception/exception.hpp>
+
+#include <algorithm>
+
+namespace hive { namespace plugins { namespace json_rpc {
+
+bool admission_limiter::try_acquire( uint32_t cost )
+{
+  cost = effective_cost( cost );
+
+  uint32_t used = _used.load( std::memory_order_relaxed );
+  do
+  {
+    if( used + cost > _capacity )
+      return false;
+  }
+  while( !_used.compare_exchange_weak( used, used + cost, std::memory_order_acquire, std::memory_order_relaxed ) );
+  return true;
+}
+
+void admission_limiter::release( uint32_t cost )
+{
+  _used.fetch_sub( effective_cost( cost ), std::memory_order_release );
+}
+
+void admission_control::slot::release()
+{
+  for( auto itr = _taken.rbegin(); itr != _taken.rend(); ++itr )
+    itr->first->release( itr->second );
+  _taken.clear();
+}
+
+void admission_control::set_concurrency_limit( const std::string& name, uint32_t limit )
+{
+  FC_ASSERT( _methods.empty(), "Admission control is already finalized" );
+  _rules[ name ].concurrency = limit;
+}
+
+void admission_control::set_cost( const std::string& name, uint32_t cost )
+{
+  FC_ASSERT( _methods.empty(), "Admission control is already finalized" );
+  FC_ASSERT( cost > 0, "Cost of ${n} has to be positive", ("n", name) );
+  rule& r = _rules[ name ];
+  r.cost = cost;
+  r.has_cost = true;
+}
+
+void admission_control::set_priority( const std::string& name )
+{
+  FC_ASSERT( _methods.empty(), "Admission control is already finalized" );
+  _rules[ name ].priority = true;
+}
+
+void admission_control::finalize( const std::vector< std::string >& methods )
+{
+  if( _rules.empty() && _normal_lane_capacity == 0 )
+    return;
+
+  if( _normal_lane_capacity > 0 )
+  {
+    _limiters.emplace_back( new admission_limiter( _normal_lane_capacity ) );
+    _normal_lane = _limiters.back().get();
+  }
+
+  std::map< std::string, admission_limiter* > api_limiters;
+  for( const auto& r : _rules )
+  {
+    if( r.second.concurrency > 0 && r.first.find( '.' ) == std::string::npos )
+    {
+      _limiters.emplace_back( new admission_limiter( r.second.concurrency ) );
+      api_limiters[ r.first ] = _limiters.back().get();
+    }
+  }
+
+  for( const std::string& method_name : methods )
+  {
+    if( _methods.count( method_name ) )
+      continue;
+
+    std::unique_ptr< method_entry > entry( new method_entry() );
+    std::string api = method_name.substr( 0, method_name.find( '.' ) );
+
+    auto api_rule = _rules.find( api );
+    if( api_rule != _rules.end() )
+    {
+      entry->cost = api_rule->second.cost;
+      entry->priority = api_rule->second.priority;
+      auto limiter = api_limiters.find( api );
+      if( limiter != api_limiters.end() )
+        entry->api_limiter = limiter->second;
+    }
+
+    auto method_rule = _rules.find( method_name );
+    if( method_rule != _rules.end() )
+    {
+      if( method_rule->second.has_cost )
+        entry->cost = method_rule->second.cost;
+      entry->priority |= method_rule->second.priority;
+      if( method_rule->second.concurrency > 0 )
+      {
+        _limiters.emplace_back( new admission_limiter( method_rule->second.concurrency ) );
+        entry->method_limiter = _limiters.back().get();
+      }
+    }
+
+    _methods.emplace( method_name, std::move( entry ) );
+  }
+}
+
+bool admission_control::admit( const std::string& method_name, slot& s )
+{
+  auto itr = _methods.find( method_name );
+  if( itr == _methods.end() )
+    return true;
+
+  method_entry& entry = *itr->second;
+
+  // most specific limiter first, so call rejected by its own limit does not even briefly take capacity shared with other methods
+  admission_limiter* limiters[] = { entry.method_limiter, entry.api_limiter, entry.priority ? nullptr : _normal_lane };
+  uint32_t costs[] = { 1, 1, entry.cost };
+  for( size_t i = 0; i < 3; ++i )
+  {
+    if( limiters[i] == nullptr )
+      continue;
+    if( !limiters[i]->try_acquire( costs[i] ) )
+    {
+      s.release();
+      entry.rejected.fetch_add( 1, std::memory_order_relaxed );
+      return false;
+    }
+    s._taken.emplace_back( limiters[i], costs[i] );
+  }
+  return true;
+}
+
+std::vector< admission_control::method_stats > admission_control::get_method_stats()const
+{
+  std::vector< method_stats > result;
+  for( const auto& m : _methods )
+  {
+    uint64_t rejected = m.second->rejected.load( std::memory_order_relaxed );
+    if( rejected == 0 )
+      continue;
+    result.emplace_back();
+    result.back().name = m.first;
+    result.back().rejected = rejected;
+  }
+  std::sort( result.begin(), result.end(), []( const method_stats& a, const method_stats& b ) { return a.name < b.name; } );
+  return result;
+}
+
+std::vector< admission_control::lane_stats > admission_control::get_lane_stats()const
+{
+  std::vector< lane_stats > result;
+  if( _normal_lane != nullptr )
+  {
+    result.emplace_back();
+    result.back().name = "normal";
+    result.back().executing = _normal_lane->used();
+  }
+  return result;
+}
+
+} } } // hive::plugins::json_rpc
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace hive { namespace plugins { namespace json_rpc {
+
+/**
+  * Weighted semaphore that never waits: call either gets its cost units at once or is rejected, so calls
+  * over the limit don't sleep on (and take) webserver threads.  Lock free, usable from any thread.
+  */
+class admission_limiter
+{
+  public:
+    explicit admission_limiter( uint32_t capacity ) : _capacity( capacity ), _used( 0 ) {}
+
+    /// Takes cost units (capped at capacity) when they are free; returns false otherwise.
+    bool try_acquire( uint32_t cost );
+    void release( uint32_t cost );
+
+    uint32_t capacity()const { return _capacity; }
+    uint32_t used()const { return _used.load( std::memory_order_relaxed ); }
+
+  private:
+    uint32_t effective_cost( uint32_t cost )const { return cost < _capacity ? cost : _capacity; }
+
+    const uint32_t            _capacity;
+    std::atomic< uint32_t >   _used;
+};
+
+/**
+  * Limits concurrent execution of API methods, so burst of expensive calls can't take all webserver threads
+  * (and read lock) from cheap ones.  Rules are given for whole API ("api") or single method ("api.method"),
+  * method rule overriding API one:
+  *  - concurrency limit: number of calls of the method (or all methods of the API) executing at once,
+  *  - cost: capacity units taken from normal lane by each call,
+  *  - priority: calls go to priority lane, which is not limited by normal lane capacity.
+  * Call that can't get all its slots at once is rejected (server busy), client is expected to retry later.
+  */
+class admission_control
+{
+  public:
+    /// Slots taken by admitted call, released on destruction.
+    class slot
+    {
+      public:
+        slot() = default;
+        slot( const slot& ) = delete;
+        slot& operator=( const slot& ) = delete;
+        ~slot() { release(); }
+
+        void release();
+
+      private:
+        friend class admission_control;
+
+        std::vector< std::pair< admission_limiter*, uint32_t > > _taken;
+    };
+
+    void set_concurrency_limit( const std::string& name, uint32_t limit );
+    void set_cost( const std::string& name, uint32_t cost );
+    void set_priority( const std::string& name );
+    /// Total cost of calls executing concurrently in normal lane, 0 means unlimited.
+    void set_normal_lane_capacity( uint32_t capacity ) { _normal_lane_capacity = capacity; }
+
+    /// Builds limiters for given "api.method" names; has to be called before admit, configuration can't change later.
+    void finalize( const std::vector< std::string >& methods );
+
+    bool enabled()const { return !_methods.empty(); }
+
+    /// Fills slot for the call and returns true when it can execute, false when it has to be rejected.
+    bool admit( const std::string& method_name, slot& s );
+
+    struct method_stats
+    {
+      std::string name;
+      uint64_t    rejected = 0;
+    };
+
+    struct lane_stats
+    {
+      std::string name;
+      uint32_t    executing = 0; ///< capacity units taken
+    };
+
+    std::vector< method_stats > get_method_stats()const;
+    /// Normal lane only, priority lane is not limited as a whole.
+    std::vector< lane_stats > get_lane_stats()const;
+
+  private:
+    struct rule
+    {
+      uint32_t concurrency = 0;
+      uint32_t cost = 1;
+      bool     priority = false;
+      bool     has_cost = false;
+    };
+
+    struct method_entry
+    {
+      admission_limiter*      method_limiter = nullptr;
+      admission_limiter*      api_limiter = nullptr;
+      uint32_t                cost = 1;
+      bool                    priority = false;
+      std::atomic< uint64_t > rejected;
+
+      method_entry() { rejected.store( 0 ); }
+    };
+
+    std::map< std::string, rule >                                     _rules;
+    uint32_t                                                          _normal_lane_capacity = 0;
+
+    std::vector< std::unique_ptr< admission_limiter > >               _limiters;
+    admission_limiter*                                                _normal_lane = nullptr;
+    std::unordered_map< std::string, std::unique_ptr< method_entry > > _methods;
+};
+
+} } } // hive::plugins::json_rpc
@@ -4,6 +4,7 @@
 
 #include <fc/variant.hpp>
 #include <fc/io/json.hpp>
+#include <fc/io/raw.hpp>
 #include <fc/reflect/variant.hpp>
 #include <fc/exception/exception.hpp>
 
@@ -33,6 +34,17 @@
   *
   * For methods that do not require arguments, use api_void_args
   * as the argument type.
+  *
+  * APIs whose args and return structs are all fc::raw serializable can
+  * additionally be exposed through binary RPC with JSON_RPC_REGISTER_BINARY_API.
+  * Binary requests come as websocket binary frames or http bodies with
+  * Content-Type application/octet-stream, each holding one fc::raw packed
+  * binary_rpc_request and answered with fc::raw packed binary_rpc_response.
+  *
+  * Binary stream methods (see add_binary_stream_method) can only be called
+  * through websocket.  Each item they produce is sent as separate
+  * binary_rpc_response frame, the stream ends with response that has
+  * empty result (or error code).
   */
 
 #define HIVE_JSON_RPC_PLUGIN_NAME "json_rpc"
@@ -43,6 +55,12 @@
   for_each_api( vtor );                                                                        \
 }
 
+#define JSON_RPC_REGISTER_BINARY_API( API_NAME )                                                \
+{                                                                                               \
+  hive::plugins::json_rpc::detail::register_binary_api_method_visitor vtor( API_NAME );       \
+  for_each_api( vtor );                                                                        \
+}
+
 #define JSON_RPC_PARSE_ERROR        (-32700)
 #define JSON_RPC_INVALID_REQUEST    (-32600)
 #define JSON_RPC_METHOD_NOT_FOUND   (-32601)
@@ -52,6 +70,7 @@
 #define JSON_RPC_NO_PARAMS          (-32001)
 #define JSON_RPC_PARSE_PARAMS_ERROR (-32002)
 #define JSON_RPC_ERROR_DURING_CALL  (-32003)
+#define JSON_RPC_SERVER_BUSY        (-32004) /// call rejected by admission control, can be retried later
 
 namespace hive { namespace plugins { namespace json_rpc {
 
@@ -74,6 +93,43 @@ typedef std::function< fc::variant(const fc::variant&) > api_method;
   */
 typedef std::map< string, api_method > api_description;
 
+/**
+  * @brief Binary counterpart of api_method
+  *
+  * Arguments: fc::raw packed args struct, returns fc::raw packed return struct
+  */
+typedef std::function< std::vector< char >(const std::vector< char >&) > binary_api_method;
+
+/**
+  * Receives fc::raw packed items of binary stream, blocks while receiver is
+  * not keeping up and returns false when receiver is gone.
+  */
+typedef std::function< bool(const std::vector< char >&) > binary_stream_sink;
+
+/**
+  * @brief Binary method producing its result as a sequence of items
+  *
+  * Arguments: fc::raw packed args struct and sink for packed items,
+  * returns when the stream ends or sink returns false
+  */
+typedef std::function< void(const std::vector< char >&, const binary_stream_sink&) > binary_stream_method;
+
+struct binary_rpc_request
+{
+  uint64_t             id = 0;  /// copied to response, so client can match them
+  string               api;
+  string               method;
+  std::vector< char >  args;    /// fc::raw packed <method>_args
+};
+
+struct binary_rpc_response
+{
+  uint64_t             id = 0;
+  int32_t              code = 0; /// 0 on success, one of JSON_RPC_* error codes otherwise
+  string               message;  /// error description when code is not 0
+  std::vector< char >  result;   /// fc::raw packed <method>_return
+};
+
 struct api_method_signature
 {
   fc::variant args;
@@ -105,6 +161,14 @@ class json_rpc_plugin : public appbase::plugin< json_rpc_plugin >
     void add_api_method( const string& api_name, const string& method_name, const api_method& api, const api_method_signature& sig );
     string call( const string& body );
 
+    void add_binary_api_method( const string& api_name, const string& method_name, const binary_api_method& api );
+    void add_binary_stream_method( const string& api_name, const string& method_name, const binary_stream_method& api );
+    /**
+      * processes fc::raw packed binary_rpc_request, returns packed binary_rpc_response
+      * stream methods need stream_sink, which gets packed binary_rpc_response for each item
+      */
+    std::vector< char > call_binary( const std::vector< char >& body, const binary_stream_sink& stream_sink = binary_stream_sink() );
+
   private:
     std::unique_ptr< detail::json_rpc_plugin_impl > my;
 };
@@ -140,8 +204,38 @@ namespace detail {
       hive::plugins::json_rpc::json_rpc_plugin& _json_rpc_plugin;
   };
 
+  class register_binary_api_method_visitor
+  {
+    public:
+      register_binary_api_method_visitor( const std::string& api_name )
+        : _api_name( api_name ),
+          _json_rpc_plugin( appbase::app().get_plugin< hive::plugins::json_rpc::json_rpc_plugin >() )
+      {}
+
+      template< typename Plugin, typename Method, typename Args, typename Ret >
+      void operator()(
+        Plugin& plugin,
+        const std::string& method_name,
+        Method method,
+        Args* args,
+        Ret* ret )
+      {
+        _json_rpc_plugin.add_binary_api_method( _api_name, method_name,
+          [&plugin,method]( const std::vector< char >& args ) -> std::vector< char >
+          {
+            return fc::raw::pack_to_vector( (plugin.*method)( fc::raw::unpack_from_vector< Args >( args ), /* lock= */ true ) );
+          } );
+      }
+
+    private:
+      std::string _api_name;
+      hive::plugins::json_rpc::json_rpc_plugin& _json_rpc_plugin;
+  };
+
 }
 
 } } } // hive::plugins::json_rpc
 
 FC_REFLECT( hive::plugins::json_rpc::api_method_signature, (args)(ret) )
+FC_REFLECT( hive::plugins::json_rpc::binary_rpc_request, (id)(api)(method)(args) )
+FC_REFLECT( hive::plugins::json_rpc::binary_rpc_response, (id)(code)(message)(result) )
@@ -1,9 +1,13 @@
 #include <hive/plugins/json_rpc/json_rpc_plugin.hpp>
 #include <hive/plugins/json_rpc/utility.hpp>
+#include <hive/plugins/json_rpc/admission_control.hpp>
 
 #include <hive/plugins/statsd/utility.hpp>
 
+#include <hive/utilities/metrics.hpp>
+
 #include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include <fc/log/logger_config.hpp>
 #include <fc/exception/exception.hpp>
@@ -144,6 +148,8 @@ namespace detail
       map< string, api_description >                     _registered_apis;
       vector< string >                                   _methods;
       map< string, map< string, api_method_signature > > _method_sigs;
+      map< string, map< string, binary_api_method > >    _registered_binary_apis;
+      map< string, map< string, binary_stream_method > > _registered_binary_streams;
     } data, proxy_data;
 
     public:
@@ -151,6 +157,8 @@ namespace detail
       ~json_rpc_plugin_impl();
 
       void add_api_method( const string& api_name, const string& method_name, const api_method& api, const api_method_signature& sig );
+      void add_binary_api_method( const string& api_name, const string& method_name, const binary_api_method& api );
+      void add_binary_stream_method( const string& api_name, const string& method_name, const binary_stream_method& api );
       void plugin_finalize_startup();
       void plugin_pre_shutdown();
 
@@ -159,6 +167,7 @@ namespace detail
       void rpc_id( const fc::variant_object& request, json_rpc_response& response );
       void rpc_jsonrpc( const fc::variant_object& request, json_rpc_response& response );
       json_rpc_response rpc( const fc::variant& message );
+      binary_rpc_response rpc_binary( const binary_rpc_request& request, const binary_stream_sink& stream_sink );
 
       void initialize();
 
@@ -173,6 +182,28 @@ namespace detail
         (get_signature) )
 
       std::unique_ptr< json_rpc_logger >                 _logger;
+
+      /// Call time histograms keyed by "api.method", only read after plugin_finalize_startup
+      std::unordered_map< string, hive::utilities::metrics::histogram* > _call_time_metrics;
+
+      admission_control                                  _admission;
+
+    private:
+      hive::utilities::metrics::histogram* find_call_time_metric( const string& method_name )const
+      {
+        auto itr = _call_time_metrics.find( method_name );
+        return itr == _call_time_metrics.end() ? nullptr : itr->second;
+      }
+
+      bool admit( const string& method_name, admission_control::slot& slot )
+      {
+        if( _admission.admit( method_name, slot ) )
+          return true;
+        STATSD_INCREMENT( "jsonrpc", "rejected", method_name, 1.0f );
+        return false;
+      }
+
+      void collect_metrics( hive::utilities::metrics::text_writer& writer )const;
   };
 
   json_rpc_plugin_impl::json_rpc_plugin_impl() {}
@@ -188,6 +219,16 @@ namespace detail
     proxy_data._methods.push_back( canonical_name.str() );
   }
 
+  void json_rpc_plugin_impl::add_binary_api_method( const string& api_name, const string& method_name, const binary_api_method& api )
+  {
+    proxy_data._registered_binary_apis[ api_name ][ method_name ] = api;
+  }
+
+  void json_rpc_plugin_impl::add_binary_stream_method( const string& api_name, const string& method_name, const binary_stream_method& api )
+  {
+    proxy_data._registered_binary_streams[ api_name ][ method_name ] = api;
+  }
+
   void json_rpc_plugin_impl::plugin_finalize_startup()
   {
     std::sort( proxy_data._methods.begin(), proxy_data._methods.end() );
@@ -195,13 +236,57 @@ namespace detail
     data._registered_apis = std::move( proxy_data._registered_apis );
     data._methods         = std::move( proxy_data._methods );
     data._method_sigs     = std::move( proxy_data._method_sigs );
+    data._registered_binary_apis = std::move( proxy_data._registered_binary_apis );
+    data._registered_binary_streams = std::move( proxy_data._registered_binary_streams );
+
+    auto& metrics = hive::utilities::metrics::registry::instance();
+    auto add_call_time_metric = [&]( const string& method_name )
+    {
+      _call_time_metrics[ method_name ] = &metrics.get_histogram( "hived_rpc_call_seconds",
+        "Time of API method execution", { { "method", method_name } } );
+    };
+    for( const auto& method_name : data._methods )
+      add_call_time_metric( method_name );
+    for( const auto& api : data._registered_binary_apis )
+      for( const auto& method : api.second )
+        add_call_time_metric( api.first + "." + method.first );
+    for( const auto& api : data._registered_binary_streams )
+      for( const auto& method : api.second )
+        add_call_time_metric( api.first + "." + method.first );
+
+    std::vector< string > all_methods;
+    all_methods.reserve( _call_time_metrics.size() );
+    for( const auto& m : _call_time_metrics )
+      all_methods.push_back( m.first );
+    _admission.finalize( all_methods );
+    if( _admission.enabled() )
+    {
+      metrics.add_collector( "json_rpc", [this]( hive::utilities::metrics::text_writer& writer ) { collect_metrics( writer ); } );
+    }
+  }
+
+  void json_rpc_plugin_impl::collect_metrics( hive::utilities::metrics::text_writer& writer )const
+  {
+    for( const auto& lane : _admission.get_lane_stats() )
+    {
+      writer.gauge( "hived_rpc_lane_executing", "Capacity units taken by executing calls",
+        lane.executing, { { "lane", lane.name } } );
+    }
+    for( const auto& method : _admission.get_method_stats() )
+    {
+      writer.counter( "hived_rpc_rejected_calls_total", "Calls rejected by admission control",
+        double( method.rejected ), { { "method", method.name } } );
+    }
   }
 
   void json_rpc_plugin_impl::plugin_pre_shutdown()
   {
+    hive::utilities::metrics::registry::instance().remove_collector( "json_rpc" );
     data._registered_apis.clear();
     data._methods.clear();
     data._method_sigs.clear();
+    data._registered_binary_apis.clear();
+    data._registered_binary_streams.clear();
   }
 
   void json_rpc_plugin_impl::initialize()
@@ -335,9 +420,15 @@ namespace detail
 
             try
             {
-              if( call )
+              admission_control::slot slot;
+              if( call && !admit( method_name, slot ) )
+              {
+                response.error = json_rpc_error( JSON_RPC_SERVER_BUSY, "Too many concurrent calls of " + method_name + ", try again later" );
+              }
+              else if( call )
               {
                 STATSD_START_TIMER( "jsonrpc", "api", method_name, 1.0f );
+                hive::utilities::metrics::scoped_timer call_timer( find_call_time_metric( method_name ) );
                 response.result = (*call)( func_args );
               }
             }
@@ -429,6 +520,92 @@ namespace detail
 
     return response;
   }
+
+  template< typename Method >
+  static const Method* find_binary_method( const map< string, map< string, Method > >& apis, const binary_rpc_request& request )
+  {
+    auto api_itr = apis.find( request.api );
+    if( api_itr == apis.end() )
+      return nullptr;
+    auto method_itr = api_itr->second.find( request.method );
+    if( method_itr == api_itr->second.end() )
+      return nullptr;
+    return &( method_itr->second );
+  }
+
+  binary_rpc_response json_rpc_plugin_impl::rpc_binary( const binary_rpc_request& request, const binary_stream_sink& stream_sink )
+  {
+    binary_rpc_response response;
+    response.id = request.id;
+
+    const binary_api_method* call = find_binary_method( data._registered_binary_apis, request );
+    const binary_stream_method* stream = call ? nullptr : find_binary_method( data._registered_binary_streams, request );
+
+    if( call == nullptr && stream == nullptr )
+    {
+      response.code = JSON_RPC_METHOD_NOT_FOUND;
+      response.message = "Could not find binary method " + request.api + "." + request.method;
+      return response;
+    }
+
+    if( stream != nullptr && !stream_sink )
+    {
+      response.code = JSON_RPC_INVALID_REQUEST;
+      response.message = "Binary stream method " + request.api + "." + request.method + " can only be called through websocket";
+      return response;
+    }
+
+    const string method_name = request.api + "." + request.method;
+    admission_control::slot slot;
+    if( !admit( method_name, slot ) )
+    {
+      response.code = JSON_RPC_SERVER_BUSY;
+      response.message = "Too many concurrent calls of " + method_name + ", try again later";
+      return response;
+    }
+
+    try
+    {
+      STATSD_START_TIMER( "jsonrpc", "api", method_name, 1.0f );
+      hive::utilities::metrics::scoped_timer call_timer( find_call_time_metric( method_name ) );
+      if( call != nullptr )
+      {
+        response.result = (*call)( request.args );
+      }
+      else
+      {
+        binary_rpc_response item;
+        item.id = request.id;
+        (*stream)( request.args, [&]( const std::vector< char >& packed_item ) -> bool
+        {
+          item.result = packed_item;
+          return stream_sink( fc::raw::pack_to_vector( item ) );
+        } );
+      }
+    }
+    catch( chainbase::lock_exception& e )
+    {
+      response.code = JSON_RPC_ERROR_DURING_CALL;
+      response.message = e.what();
+    }
+    catch( fc::assert_exception& e )
+    {
+      response.code = JSON_RPC_ERROR_DURING_CALL;
+      response.message = e.to_string();
+    }
+    catch( fc::exception& e )
+    {
+      response.code = JSON_RPC_SERVER_ERROR;
+      response.message = e.to_string();
+    }
+    catch( std::exception& e )
+    {
+      response.code = JSON_RPC_SERVER_ERROR;
+      response.message = e.what();
+    }
+
+    return response;
+  }
 }
 
 using detail::json_rpc_error;
@@ -442,6 +619,14 @@ void json_rpc_plugin::set_program_options( options_description& , options_descri
 {
   cfg.add_options()
     ("log-json-rpc", bpo::value< string >(), "json-rpc log directory name.")
+    ("rpc-concurrency-limit", bpo::value< vector< string > >()->composing()->multitoken(),
+      "Maximum number of concurrently executing calls of API or method, as api=N or api.method=N. Can be specified multiple times.")
+    ("rpc-call-cost", bpo::value< vector< string > >()->composing()->multitoken(),
+      "Capacity of normal lane taken by each call of API or method, as api=N or api.method=N (default 1). Can be specified multiple times.")
+    ("rpc-priority-method", bpo::value< vector< string > >()->composing()->multitoken(),
+      "API (api) or method (api.method) executed in priority lane, not limited by rpc-normal-lane-capacity. Can be specified multiple times.")
+    ("rpc-normal-lane-capacity", bpo::value< uint32_t >()->default_value( 0 ),
+      "Total cost of concurrently executing calls outside of priority lane (0 - unlimited). Calls over any limit are rejected at once with server busy error.")
     ;
 }
 
@@ -460,6 +645,49 @@ void json_rpc_plugin::plugin_initialize( const variables_map& options )
     fc::create_directories(p);
     my->_logger.reset(new json_rpc_logger(dir_name));
   }
+
+  auto parse_limit = []( const string& rule, const char* option ) -> std::pair< string, uint32_t >
+  {
+    auto pos = rule.find( '=' );
+    FC_ASSERT( pos != string::npos && pos > 0, "Invalid ${o} entry '${r}', expected api=N or api.method=N", ("o", option)("r", rule) );
+    string name = boost::trim_copy( rule.substr( 0, pos ) );
+    uint32_t value = 0;
+    try
+    {
+      value = boost::lexical_cast< uint32_t >( boost::trim_copy( rule.substr( pos + 1 ) ) );
+    }
+    catch( const boost::bad_lexical_cast& )
+    {
+      FC_THROW_EXCEPTION( fc::parse_error_exception, "Invalid ${o} entry '${r}', expected api=N or api.method=N", ("o", option)("r", rule) );
+    }
+    return std::make_pair( name, value );
+  };
+
+  if( options.count( "rpc-concurrency-limit" ) )
+  {
+    for( const string& rule : options.at( "rpc-concurrency-limit" ).as< vector< string > >() )
+    {
+      auto limit = parse_limit( rule, "rpc-concurrency-limit" );
+      my->_admission.set_concurrency_limit( limit.first, limit.second );
+    }
+  }
+
+  if( options.count( "rpc-call-cost" ) )
+  {
+    for( const string& rule : options.at( "rpc-call-cost" ).as< vector< string > >() )
+    {
+      auto cost = parse_limit( rule, "rpc-call-cost" );
+      my->_admission.set_cost( cost.first, cost.second );
+    }
+  }
+
+  if( options.count( "rpc-priority-method" ) )
+  {
+    for( const string& name : options.at( "rpc-priority-method" ).as< vector< string > >() )
+      my->_admission.set_priority( boost::trim_copy( name ) );
+  }
+
+  my->_admission.set_normal_lane_capacity( options.at( "rpc-normal-lane-capacity" ).as< uint32_t >() );
 }
 
 void json_rpc_plugin::plugin_startup() {}
@@ -481,6 +709,35 @@ void json_rpc_plugin::add_api_method( const string& api_name, const string& meth
   my->add_api_method( api_name, method_name, api, sig );
 }
 
+void json_rpc_plugin::add_binary_api_method( const string& api_name, const string& method_name, const binary_api_method& api )
+{
+  my->add_binary_api_method( api_name, method_name, api );
+}
+
+void json_rpc_plugin::add_binary_stream_method( const string& api_name, const string& method_name, const binary_stream_method& api )
+{
+  my->add_binary_stream_method( api_name, method_name, api );
+}
+
+std::vector< char > json_rpc_plugin::call_binary( const std::vector< char >& body, const binary_stream_sink& stream_sink )
+{
+  STATSD_START_TIMER( "jsonrpc", "overhead", "call_binary", 1.0f );
+  binary_rpc_request request;
+  try
+  {
+    fc::raw::unpack_from_vector( body, request );
+  }
+  catch( fc::exception& e )
+  {
+    binary_rpc_response response;
+    response.code = JSON_RPC_PARSE_ERROR;
+    response.message = e.to_string();
+    return fc::raw::pack_to_vector( response );
+  }
+
+  return fc::raw::pack_to_vector( my->rpc_binary( request, stream_sink ) );
+}
+
 string json_rpc_plugin::call( const string& message )
 {
   STATSD_START_TIMER( "jsonrpc", "overhead", "call", 1.0f );
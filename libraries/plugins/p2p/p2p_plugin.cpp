@@ -7,6 +7,8 @@
 
 #include <hive/chain/database_exceptions.hpp>
 
+#include <hive/utilities/metrics.hpp>
+
 #include <appbase/shutdown_mgr.hpp>
 
 #include <fc/network/ip.hpp>
@@ -20,6 +22,7 @@
 
 #include <boost/any.hpp>
 
+#include <atomic>
 #include <chrono>
 
 using std::string;
@@ -81,8 +84,15 @@ class p2p_plugin_impl : public graphene::net::node_delegate
 public:
 
   p2p_plugin_impl( plugins::chain::chain_plugin& c )
-    : shutdown_helper( "P2P plugin", HIVE_P2P_NUMBER_THREAD_SENSITIVE_ACTIONS ), chain( c )
+    : shutdown_helper( "P2P plugin", HIVE_P2P_NUMBER_THREAD_SENSITIVE_ACTIONS ), chain( c ),
+      block_arrival_offset( hive::utilities::metrics::registry::instance().get_histogram(
+        "hived_p2p_block_arrival_offset_seconds", "Delay between block timestamp and its arrival from p2p network (live blocks only)" ) )
   {
+    peer_count.store( 0 );
+    sync_items_remaining.store( 0 );
+    sync_blocks_received.store( 0 );
+    live_blocks_received.store( 0 );
+    transactions_received.store( 0 );
   }
   virtual ~p2p_plugin_impl()
   {
@@ -112,6 +122,8 @@ public:
   virtual uint32_t estimate_last_known_fork_from_git_revision_timestamp( uint32_t ) const override;
   virtual void error_encountered( const std::string& message, const fc::oexception& error ) override;
 
+  void collect_metrics( hive::utilities::metrics::text_writer& writer ) const;
+
   fc::optional<fc::ip::endpoint> endpoint;
   vector<fc::ip::endpoint> seeds;
   string user_agent;
@@ -127,11 +139,31 @@ public:
   plugins::chain::chain_plugin& chain;
 
   fc::thread p2p_thread;
+
+  // statistics exposed in metrics, updated by node delegate calls so reading them needs no p2p thread
+  hive::utilities::metrics::histogram& block_arrival_offset;
+  std::atomic< uint32_t > peer_count;
+  std::atomic< uint32_t > sync_items_remaining;
+  std::atomic< uint64_t > sync_blocks_received;
+  std::atomic< uint64_t > live_blocks_received;
+  std::atomic< uint64_t > transactions_received;
 };
 
 ////////////////////////////// Begin node_delegate Implementation //////////////////////////////
 bool p2p_plugin_impl::has_item( const graphene::net::item_id& id )
 {
+  // applied blocks are looked up in fork database and block log, which don't need the lock
+  if( id.item_type == graphene::net::block_message_type )
+  {
+    try
+    {
+      if( chain.db().is_known_block_unlocked(id.item_hash) )
+        return true;
+    }
+    FC_CAPTURE_LOG_AND_RETHROW( (id) )
+  }
+
+  // block might be just being applied (or it is on a fork we didn't switch to), wait for the outcome
   return chain.db().with_read_lock( [&]()
   {
     try
@@ -175,10 +207,12 @@ bool p2p_plugin_impl::handle_block( const graphene::net::block_message& blk_msg,
       // when the net code sees that, it will stop trying to push blocks from that chain, but
       // leave that peer connected so that they can get sync blocks from us
       bool result = chain.accept_block( blk_msg.block, sync_mode, ( block_producer | force_validate ) ? chain::database::skip_nothing : chain::database::skip_transaction_signatures );
+      ++( sync_mode ? sync_blocks_received : live_blocks_received );
 
       if( !sync_mode )
       {
         fc::microseconds offset = fc::time_point::now() - blk_msg.block.timestamp;
+        block_arrival_offset.observe( offset );
         STATSD_TIMER( "p2p", "offset", "block_arrival", offset, 1.0f )
         ilog( "Got ${t} transactions on block ${b} by ${w} -- Block Time Offset: ${l} ms",
           ("t", blk_msg.block.transactions.size())
@@ -227,6 +261,7 @@ void p2p_plugin_impl::handle_transaction( const graphene::net::trx_message& trx_
       action_catcher ac( shutdown_helper.get_running(), shutdown_helper.get_state( HIVE_P2P_TRANSACTION_HANDLER ) );
 
       chain.accept_transaction( trx_msg.trx );
+      ++transactions_received;
 
     } FC_CAPTURE_AND_RETHROW( (trx_msg) )
   }
@@ -245,72 +280,81 @@ void p2p_plugin_impl::handle_message( const graphene::net::message& message_to_p
 
 std::vector< graphene::net::item_hash_t > p2p_plugin_impl::get_block_ids( const std::vector< graphene::net::item_hash_t >& blockchain_synopsis, uint32_t& remaining_item_count, uint32_t limit )
 { try {
-  return chain.db().with_read_lock( [&]()
-  {
-    vector<block_id_type> result;
-    remaining_item_count = 0;
-    if( chain.db().head_block_num() == 0 )
-      return result;
+  // answered from fork database and block log only, no need to wait for block application
+  vector<block_id_type> result;
+  remaining_item_count = 0;
+  const uint32_t head_block_num = chain.db().head_block_num_unlocked();
+  if( head_block_num == 0 )
+    return result;
 
-    result.reserve( limit );
-    block_id_type last_known_block_id;
+  result.reserve( limit );
+  block_id_type last_known_block_id;
 
-    if( blockchain_synopsis.empty()
-        || ( blockchain_synopsis.size() == 1 && blockchain_synopsis[0] == block_id_type() ) )
-    {
-      // peer has sent us an empty synopsis meaning they have no blocks.
-      // A bug in old versions would cause them to send a synopsis containing block 000000000
-      // when they had an empty blockchain, so pretend they sent the right thing here.
-      // do nothing, leave last_known_block_id set to zero
-    }
-    else
-    {
-      bool found_a_block_in_synopsis = false;
+  if( blockchain_synopsis.empty()
+      || ( blockchain_synopsis.size() == 1 && blockchain_synopsis[0] == block_id_type() ) )
+  {
+    // peer has sent us an empty synopsis meaning they have no blocks.
+    // A bug in old versions would cause them to send a synopsis containing block 000000000
+    // when they had an empty blockchain, so pretend they sent the right thing here.
+    // do nothing, leave last_known_block_id set to zero
+  }
+  else
+  {
+    bool found_a_block_in_synopsis = false;
 
-      for( const item_hash_t& block_id_in_synopsis : boost::adaptors::reverse(blockchain_synopsis) )
+    for( const item_hash_t& block_id_in_synopsis : boost::adaptors::reverse(blockchain_synopsis) )
+    {
+      if (block_id_in_synopsis == block_id_type() ||
+        (chain.db().is_known_block_unlocked(block_id_in_synopsis) && is_included_block(block_id_in_synopsis)))
       {
-        if (block_id_in_synopsis == block_id_type() ||
-          (chain.db().is_known_block(block_id_in_synopsis) && is_included_block(block_id_in_synopsis)))
-        {
-          last_known_block_id = block_id_in_synopsis;
-          found_a_block_in_synopsis = true;
-          break;
-        }
+        last_known_block_id = block_id_in_synopsis;
+        found_a_block_in_synopsis = true;
+        break;
       }
-
-      if (!found_a_block_in_synopsis)
-        FC_THROW_EXCEPTION(graphene::net::peer_is_on_an_unreachable_fork, "Unable to provide a list of blocks starting at any of the blocks in peer's synopsis");
     }
 
-    for( uint32_t num = block_header::num_from_id(last_known_block_id);
-        num <= chain.db().head_block_num() && result.size() < limit;
-        ++num )
+    if (!found_a_block_in_synopsis)
+      FC_THROW_EXCEPTION(graphene::net::peer_is_on_an_unreachable_fork, "Unable to provide a list of blocks starting at any of the blocks in peer's synopsis");
+  }
+
+  for( uint32_t num = block_header::num_from_id(last_known_block_id);
+      num <= head_block_num && result.size() < limit;
+      ++num )
+  {
+    if( num > 0 )
     {
-      if( num > 0 )
-        result.push_back(chain.db().get_block_id_for_num(num));
+      block_id_type id = chain.db().find_block_id_for_num_unlocked(num);
+      if( id == block_id_type() )
+        break; // block was just removed from fork database due to fork switch
+      result.push_back(id);
     }
+  }
 
-    if( !result.empty() && block_header::num_from_id(result.back()) < chain.db().head_block_num() )
-      remaining_item_count = chain.db().head_block_num() - block_header::num_from_id(result.back());
+  if( !result.empty() && block_header::num_from_id(result.back()) < head_block_num )
+    remaining_item_count = head_block_num - block_header::num_from_id(result.back());
 
-    return result;
-  });
+  return result;
 } FC_CAPTURE_AND_RETHROW( (blockchain_synopsis)(remaining_item_count)(limit) ) }
 
 graphene::net::message p2p_plugin_impl::get_item( const graphene::net::item_id& id )
 { try {
   if( id.item_type == graphene::net::block_message_type )
   {
-    return chain.db().with_read_lock( [&]()
+    auto opt_block = chain.db().fetch_block_by_id_unlocked(id.item_hash);
+    if( !opt_block )
     {
-      auto opt_block = chain.db().fetch_block_by_id(id.item_hash);
-      if( !opt_block )
-        elog("Couldn't find block ${id} -- corresponding ID in our chain is ${id2}",
-          ("id", id.item_hash)("id2", chain.db().get_block_id_for_num(block_header::num_from_id(id.item_hash))));
-      FC_ASSERT( opt_block.valid() );
-      // ilog("Serving up block #${num}", ("num", opt_block->block_num()));
-      return block_message(*opt_block);
-    });
+      // not applied yet or not on main branch, serve it only when it survives application
+      opt_block = chain.db().with_read_lock( [&]()
+      {
+        return chain.db().fetch_block_by_id(id.item_hash);
+      });
+    }
+    if( !opt_block )
+      elog("Couldn't find block ${id} -- corresponding ID in our chain is ${id2}",
+        ("id", id.item_hash)("id2", chain.db().find_block_id_for_num_unlocked(block_header::num_from_id(id.item_hash))));
+    FC_ASSERT( opt_block.valid() );
+    // ilog("Serving up block #${num}", ("num", opt_block->block_num()));
+    return block_message(*opt_block);
   }
   return chain.db().with_read_lock( [&]()
   {
@@ -336,13 +380,14 @@ hive::protocol::chain_id_type p2p_plugin_impl::get_chain_id() const
 std::vector< graphene::net::item_hash_t > p2p_plugin_impl::get_blockchain_synopsis( const graphene::net::item_hash_t& reference_point, uint32_t number_of_blocks_after_reference_point )
 {
   try {
+  // answered from fork database and block log only, no need to wait for block application
   std::vector<item_hash_t> synopsis;
-  chain.db().with_read_lock( [&]()
+  [&]()
   {
     synopsis.reserve(30);
     uint32_t high_block_num;
     uint32_t non_fork_high_block_num;
-    uint32_t low_block_num = chain.db().get_last_irreversible_block_num();
+    uint32_t low_block_num = chain.db().last_irreversible_block_num_unlocked();
     std::vector<block_id_type> fork_history;
 
     if (reference_point != item_hash_t())
@@ -378,7 +423,7 @@ std::vector< graphene::net::item_hash_t > p2p_plugin_impl::get_blockchain_synops
         // block is a block we know about, but it is on a fork
         try
         {
-          fork_history = chain.db().get_block_ids_on_fork(reference_point);
+          fork_history = chain.db().get_block_ids_on_fork_unlocked(reference_point);
           // returns a vector where the last element is the common ancestor with the preferred chain,
           // and the first element is the reference point you passed in
           assert(fork_history.size() >= 2);
@@ -420,7 +465,7 @@ std::vector< graphene::net::item_hash_t > p2p_plugin_impl::get_blockchain_synops
     else
     {
       // no reference point specified, summarize the whole block chain
-      high_block_num = chain.db().head_block_num();
+      high_block_num = chain.db().head_block_num_unlocked();
       non_fork_high_block_num = high_block_num;
       if (high_block_num == 0)
         return; // we have no blocks
@@ -443,7 +488,11 @@ std::vector< graphene::net::item_hash_t > p2p_plugin_impl::get_blockchain_synops
       // if it's <= non_fork_high_block_num, we grab it from the main blockchain;
       // if it's not, we pull it from the fork history
       if( low_block_num <= non_fork_high_block_num )
-        synopsis.push_back(chain.db().get_block_id_for_num(low_block_num));
+      {
+        block_id_type id = chain.db().find_block_id_for_num_unlocked(low_block_num);
+        FC_ASSERT( id != block_id_type(), "Block ${n} was just removed from fork database", ("n", low_block_num) );
+        synopsis.push_back(id);
+      }
       else
         synopsis.push_back(fork_history[low_block_num - non_fork_high_block_num - 1]);
       low_block_num += (true_high_block_num - low_block_num + 2) / 2;
@@ -452,7 +501,7 @@ std::vector< graphene::net::item_hash_t > p2p_plugin_impl::get_blockchain_synops
 
     //idump((synopsis));
     return;
-  });
+  }();
 
   return synopsis;
 } FC_LOG_AND_RETHROW() }
@@ -460,14 +509,25 @@ std::vector< graphene::net::item_hash_t > p2p_plugin_impl::get_blockchain_synops
 void p2p_plugin_impl::sync_status( uint32_t item_type, uint32_t item_count )
 {
   // any status reports to GUI go here
+  sync_items_remaining.store( item_count );
 }
 
 void p2p_plugin_impl::connection_count_changed( uint32_t peer_count )
 {
   // any status reports to GUI go here
+  this->peer_count.store( peer_count );
   chain.connection_count_changed(peer_count);
 }
 
+void p2p_plugin_impl::collect_metrics( hive::utilities::metrics::text_writer& writer ) const
+{
+  writer.gauge( "hived_p2p_peer_count", "Number of connected p2p peers", peer_count.load() );
+  writer.gauge( "hived_p2p_sync_items_remaining", "Items still to be fetched during sync, as last reported by p2p node", sync_items_remaining.load() );
+  writer.counter( "hived_p2p_blocks_received_total", "Blocks received from p2p network and accepted by chain", sync_blocks_received.load(), { { "mode", "sync" } } );
+  writer.counter( "hived_p2p_blocks_received_total", "Blocks received from p2p network and accepted by chain", live_blocks_received.load(), { { "mode", "live" } } );
+  writer.counter( "hived_p2p_transactions_received_total", "Transactions received from p2p network and accepted by chain", transactions_received.load() );
+}
+
 uint32_t p2p_plugin_impl::get_block_number( const graphene::net::item_hash_t& block_id )
 {
   try {
@@ -478,12 +538,9 @@ fc::time_point_sec p2p_plugin_impl::get_block_time( const graphene::net::item_ha
 {
   try
   {
-    return chain.db().with_read_lock( [&]()
-    {
-      auto opt_block = chain.db().fetch_block_by_id( block_id );
-      if( opt_block.valid() ) return opt_block->timestamp;
-      return fc::time_point_sec::min();
-    });
+    auto opt_block = chain.db().fetch_block_by_id_unlocked( block_id );
+    if( opt_block.valid() ) return opt_block->timestamp;
+    return fc::time_point_sec::min();
   } FC_CAPTURE_AND_RETHROW( (block_id) )
 }
 
@@ -512,12 +569,9 @@ fc::time_point_sec p2p_plugin_impl::get_blockchain_now()
 
 bool p2p_plugin_impl::is_included_block(const block_id_type& block_id)
 { try {
-  return chain.db().with_read_lock( [&]()
-  {
-    uint32_t block_num = block_header::num_from_id(block_id);
-    block_id_type block_id_in_preferred_chain = chain.db().get_block_id_for_num(block_num);
-    return block_id == block_id_in_preferred_chain;
-  });
+  uint32_t block_num = block_header::num_from_id(block_id);
+  block_id_type block_id_in_preferred_chain = chain.db().find_block_id_for_num_unlocked(block_num);
+  return block_id == block_id_in_preferred_chain;
 } FC_CAPTURE_AND_RETHROW() }
 
 ////////////////////////////// End node_delegate Implementation //////////////////////////////
@@ -671,6 +725,11 @@ void p2p_plugin::plugin_startup()
     my->node->sync_from(graphene::net::item_id(graphene::net::block_message_type, block_id), std::vector<uint32_t>());
     ilog("P2P node listening at ${ep}", ("ep", my->node->get_actual_listening_endpoint()));
   }).wait();
+
+  hive::utilities::metrics::registry::instance().add_collector( "p2p", [this]( hive::utilities::metrics::text_writer& writer )
+  {
+    my->collect_metrics( writer );
+  } );
   ilog( "P2P Plugin started" );
 }
 
@@ -681,6 +740,8 @@ void p2p_plugin::plugin_pre_shutdown() {
 
   ilog("Shutting down P2P Plugin");
 
+  hive::utilities::metrics::registry::instance().remove_collector( "p2p" );
+
   my->shutdown_helper.prepare_shutdown();
   my->shutdown_helper.wait();
 
@@ -15,6 +15,8 @@
 
 #include <hive/jsonball/jsonball.hpp>
 
+#include <fc/uint128.hpp>
+
 #include <boost/algorithm/string.hpp>
 
 #define HIVE_RC_REGEN_TIME   (60*60*24*5)
@@ -65,6 +67,8 @@ class rc_plugin_impl
     void on_first_block();
     void validate_database();
 
+    int64_t get_pending_transaction_priority( const signed_transaction& tx )const;
+
     bool before_first_block()
     {
       return (_db.count< rc_account_object >() == 0);
@@ -363,6 +367,27 @@ void rc_plugin_impl::on_post_apply_transaction( const transaction_notification&
     export_data->tx_info.push_back( tx_info );
 } FC_CAPTURE_AND_RETHROW( (note.transaction) ) }
 
+int64_t rc_plugin_impl::get_pending_transaction_priority( const signed_transaction& tx )const
+{
+  // Called after transaction was applied, so its cost is already charged. Transactions of accounts that keep more
+  // of their RC go first, while accounts draining their mana to the bottom (which is what spam looks like) are the
+  // first to be dropped when there is not enough room for all pending transactions.
+  account_name_type resource_user = get_resource_user( tx );
+  if( resource_user == account_name_type() )
+    return 0;
+
+  const rc_account_object* rc_account = _db.find< rc_account_object, by_name >( resource_user );
+  if( rc_account == nullptr )
+    return 0;
+
+  int64_t max_rc = get_maximum_rc( _db.get_account( resource_user ), *rc_account );
+  if( max_rc <= 0 )
+    return 0;
+
+  int64_t current_rc = std::min( std::max( rc_account->rc_manabar.current_mana, int64_t( 0 ) ), max_rc );
+  return ( fc::uint128_t( current_rc ) * HIVE_100_PERCENT / max_rc ).to_int64();
+}
+
 struct block_extensions_count_resources_visitor
 {
   typedef void result_type;
@@ -1202,6 +1227,9 @@ void rc_plugin::plugin_initialize( const boost::program_options::variables_map&
     my->_post_apply_optional_action_conn = db.add_post_apply_optional_action_handler( [&]( const optional_action_notification& note )
       { try { my->on_post_apply_optional_action( note ); } FC_LOG_AND_RETHROW() }, *this, 0 );
 
+    db.get_pending_transaction_pool().set_priority_evaluator( [&]( const signed_transaction& tx )
+      { return my->get_pending_transaction_priority( tx ); } );
+
     HIVE_ADD_PLUGIN_INDEX(db, rc_resource_param_index);
     HIVE_ADD_PLUGIN_INDEX(db, rc_pool_index);
     HIVE_ADD_PLUGIN_INDEX(db, rc_account_index);
@@ -1257,6 +1285,8 @@ void rc_plugin::plugin_shutdown()
   chain::util::disconnect_signal( my->_post_apply_operation_conn );
   chain::util::disconnect_signal( my->_pre_apply_optional_action_conn );
   chain::util::disconnect_signal( my->_post_apply_optional_action_conn );
+
+  appbase::app().get_plugin< hive::plugins::chain::chain_plugin >().db().get_pending_transaction_pool().set_priority_evaluator( nullptr );
 }
 
 void rc_plugin::set_rc_plugin_skip_flags( rc_plugin_skip_flags skip )
@@ -1282,6 +1312,11 @@ void exp_rc_data::to_variant( fc::variant& v )const
   fc::to_variant( *this, v );
 }
 
+void exp_rc_data::to_binary( std::vector< char >& data )const
+{
+  data = fc::raw::pack_to_vector( *this );
+}
+
 int64_t get_maximum_rc( const account_object& account, const rc_account_object& rc_account )
 {
   int64_t result = account.vesting_shares.amount.value;
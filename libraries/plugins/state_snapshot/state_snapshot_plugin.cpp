@@ -1236,6 +1236,9 @@ void state_snapshot_plugin::impl::prepare_snapshot(const std::string& snapshotNa
 
   ilog("Request to generate snapshot in the location: `${p}'", ("p", actualStoragePath.string()));
 
+  // archived comments live in separate RocksDB storage, snapshot of chainbase indices alone would miss them
+  FC_ASSERT(_mainDb.has_comment_archive() == false, "Creating snapshot rejected: state snapshots are not supported with comment-archive enabled.");
+
   if(bfs::exists(actualStoragePath) == false)
     bfs::create_directories(actualStoragePath);
   else
@@ -1319,6 +1322,12 @@ void state_snapshot_plugin::impl::load_snapshot(const std::string& snapshotName,
 
   ilog("Trying to access snapshot in the location: `${p}'", ("p", actualStoragePath.string()));
 
+  if(openArgs.enable_comment_archive)
+    {
+    elog("Loading snapshot rejected: state snapshots are not supported with comment-archive enabled.");
+    return;
+    }
+
   benchmark_dumper dumper;
   dumper.initialize([](benchmark_dumper::database_object_sizeof_cntr_t&) {}, "state_snapshot_load.json");
 
@@ -30,6 +30,7 @@ SOFTWARE.
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <atomic>
 #include <cmath>
 #include <cstring>
 #include <deque>
@@ -106,7 +107,7 @@ private:
   bool m_isInitialized{false};
 
   //! Shall we exit?
-  bool m_mustExit{false};
+  std::atomic<bool> m_mustExit{false};
 
   //! Disable udp?
   bool m_disable_udp{false};
@@ -196,6 +197,12 @@ UDPSender::~UDPSender() {
   if (m_batching) {
     m_mustExit = true;
     m_batchingThread.join();
+
+    // Send messages queued after the last batch, i.e. final flush of aggregated metrics
+    while (!m_batchingMessageQueue.empty()) {
+      sendToDaemon(m_batchingMessageQueue.front());
+      m_batchingMessageQueue.pop_front();
+    }
   }
 
   if (m_socket >= 0) {
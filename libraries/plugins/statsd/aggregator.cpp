@@ -0,0 +1,157 @@
+#include <hive/plugins/statsd/aggregator.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#define HISTOGRAM_LINEAR_BUCKETS 64
+#define HISTOGRAM_SUB_BUCKETS 32
+#define HISTOGRAM_BUCKET_COUNT ( HISTOGRAM_LINEAR_BUCKETS + ( 32 - 6 ) * HISTOGRAM_SUB_BUCKETS )
+
+namespace hive { namespace plugins { namespace statsd {
+
+uint32_t latency_histogram::bucket_index( uint32_t value )
+{
+  if( value < HISTOGRAM_LINEAR_BUCKETS )
+    return value;
+
+  uint32_t msb = 31 - __builtin_clz( value );
+  uint32_t shift = msb - 5;
+  return HISTOGRAM_LINEAR_BUCKETS + ( msb - 6 ) * HISTOGRAM_SUB_BUCKETS + ( ( value >> shift ) - HISTOGRAM_SUB_BUCKETS );
+}
+
+uint32_t latency_histogram::bucket_upper_bound( uint32_t index )
+{
+  if( index < HISTOGRAM_LINEAR_BUCKETS )
+    return index;
+
+  uint32_t msb = ( index - HISTOGRAM_LINEAR_BUCKETS ) / HISTOGRAM_SUB_BUCKETS + 6;
+  uint64_t sub_bucket = ( index - HISTOGRAM_LINEAR_BUCKETS ) % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+  uint32_t shift = msb - 5;
+  return static_cast< uint32_t >( ( ( sub_bucket + 1 ) << shift ) - 1 );
+}
+
+void latency_histogram::record( uint32_t value )
+{
+  if( _buckets.empty() )
+    _buckets.resize( HISTOGRAM_BUCKET_COUNT );
+
+  ++_buckets[ bucket_index( value ) ];
+  ++_count;
+  _sum += value;
+  _min = std::min( _min, value );
+  _max = std::max( _max, value );
+}
+
+void latency_histogram::merge( const latency_histogram& other )
+{
+  if( other._count == 0 )
+    return;
+  if( _buckets.empty() )
+    _buckets.resize( HISTOGRAM_BUCKET_COUNT );
+
+  for( size_t i = 0; i < HISTOGRAM_BUCKET_COUNT; ++i )
+    _buckets[i] += other._buckets[i];
+  _count += other._count;
+  _sum += other._sum;
+  _min = std::min( _min, other._min );
+  _max = std::max( _max, other._max );
+}
+
+uint32_t latency_histogram::percentile( double fraction )const
+{
+  if( _count == 0 )
+    return 0;
+
+  uint64_t rank = std::max< uint64_t >( 1, static_cast< uint64_t >( std::ceil( fraction * _count ) ) );
+  uint64_t seen = 0;
+  for( size_t i = 0; i < HISTOGRAM_BUCKET_COUNT; ++i )
+  {
+    seen += _buckets[i];
+    if( seen >= rank )
+      return std::min( bucket_upper_bound( i ), _max );
+  }
+  return _max;
+}
+
+metrics_aggregator::metrics_aggregator() : _id( []() { static std::atomic< uint64_t > id( 0 ); return ++id; }() )
+{
+  _gauge_sequence.store( 0 );
+}
+
+metrics_aggregator::shard& metrics_aggregator::get_thread_shard()
+{
+  static thread_local std::unordered_map< uint64_t, std::shared_ptr< shard > > thread_shards;
+  std::shared_ptr< shard >& s = thread_shards[ _id ];
+  if( !s )
+  {
+    s = std::make_shared< shard >();
+    std::lock_guard< std::mutex > guard( _shards_mutex );
+    _shards.push_back( s );
+  }
+  return *s;
+}
+
+void metrics_aggregator::count( const std::string& key, int64_t delta )
+{
+  shard& s = get_thread_shard();
+  std::lock_guard< std::mutex > guard( s.lock );
+  s.counters[ key ] += delta;
+}
+
+void metrics_aggregator::gauge( const std::string& key, uint64_t value )
+{
+  shard& s = get_thread_shard();
+  uint64_t sequence = ++_gauge_sequence;
+  std::lock_guard< std::mutex > guard( s.lock );
+  s.gauges[ key ] = std::make_pair( sequence, value );
+}
+
+void metrics_aggregator::timing( const std::string& key, uint32_t ms )
+{
+  shard& s = get_thread_shard();
+  std::lock_guard< std::mutex > guard( s.lock );
+  s.timers[ key ].record( ms );
+}
+
+metrics_aggregator::snapshot metrics_aggregator::collect()
+{
+  std::vector< std::shared_ptr< shard > > shards;
+  {
+    std::lock_guard< std::mutex > guard( _shards_mutex );
+    shards = _shards;
+  }
+
+  snapshot result;
+  std::map< std::string, uint64_t > gauge_sequences;
+  for( const std::shared_ptr< shard >& s : shards )
+  {
+    shard taken;
+    {
+      std::lock_guard< std::mutex > guard( s->lock );
+      taken.counters.swap( s->counters );
+      taken.gauges.swap( s->gauges );
+      taken.timers.swap( s->timers );
+    }
+
+    for( const auto& c : taken.counters )
+      result.counters[ c.first ] += c.second;
+
+    // gauge keeps value of the latest update, no matter which thread made it
+    for( const auto& g : taken.gauges )
+    {
+      uint64_t& sequence = gauge_sequences[ g.first ];
+      if( g.second.first > sequence )
+      {
+        sequence = g.second.first;
+        result.gauges[ g.first ] = g.second.second;
+      }
+    }
+
+    for( const auto& t : taken.timers )
+      result.timers[ t.first ].merge( t.second );
+  }
+
+  return result;
+}
+
+} } } // hive::plugins::statsd
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace hive { namespace plugins { namespace statsd {
+
+/** Histogram of millisecond timings in log-linear buckets (HDR style): values below 64 have their own
+  *  bucket, larger ones share bucket with values having the same 6 most significant bits, so reported
+  *  percentiles are within 1/32 of the recorded values.
+  */
+class latency_histogram
+{
+  public:
+    void record( uint32_t value );
+    void merge( const latency_histogram& other );
+
+    /// Smallest bucket bound not exceeded by given fraction (0-1) of recorded values.
+    uint32_t percentile( double fraction )const;
+
+    uint64_t count()const { return _count; }
+    uint64_t sum()const { return _sum; }
+    uint32_t min()const { return _min; }
+    uint32_t max()const { return _max; }
+
+    static uint32_t bucket_index( uint32_t value );
+    /// Largest value falling into bucket of given index.
+    static uint32_t bucket_upper_bound( uint32_t index );
+
+  private:
+    std::vector< uint64_t > _buckets;
+    uint64_t                _count = 0;
+    uint64_t                _sum = 0;
+    uint32_t                _min = UINT32_MAX;
+    uint32_t                _max = 0;
+};
+
+/** Collects statsd metrics in memory instead of sending each event.  Every thread records to its own
+  *  shard, whose lock is only taken by another thread when collect() takes the recorded values out.
+  */
+class metrics_aggregator
+{
+  public:
+    metrics_aggregator();
+
+    void count( const std::string& key, int64_t delta );
+    void gauge( const std::string& key, uint64_t value );
+    void timing( const std::string& key, uint32_t ms );
+
+    struct snapshot
+    {
+      std::map< std::string, int64_t >            counters;
+      std::map< std::string, uint64_t >           gauges;
+      std::map< std::string, latency_histogram >  timers;
+    };
+
+    /// Takes out values recorded since previous call, merged over all threads.
+    snapshot collect();
+
+  private:
+    struct shard
+    {
+      std::mutex                                                          lock;
+      std::unordered_map< std::string, int64_t >                          counters;
+      std::unordered_map< std::string, std::pair< uint64_t, uint64_t > >  gauges; ///< update sequence, value
+      std::unordered_map< std::string, latency_histogram >                timers;
+    };
+
+    shard& get_thread_shard();
+
+    /// distinguishes aggregators in per thread shard lookup
+    const uint64_t                        _id;
+    std::mutex                            _shards_mutex;
+    std::vector< std::shared_ptr< shard > > _shards;
+    std::atomic< uint64_t >               _gauge_sequence;
+};
+
+} } } // hive::plugins::statsd
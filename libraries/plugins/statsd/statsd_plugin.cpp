@@ -1,11 +1,14 @@
 #include <hive/plugins/statsd/statsd_plugin.hpp>
+#include <hive/plugins/statsd/aggregator.hpp>
 
 #include <fc/network/resolve.hpp>
 #include <fc/thread/thread.hpp>
 
 #include <boost/algorithm/string.hpp>
 
-#include <sstream>
+#include <condition_variable>
+#include <limits>
+#include <thread>
 
 #include "StatsdClient.hpp"
 
@@ -17,9 +20,10 @@ namespace detail
 {
   inline std::string compose_key( const std::string& ns, const std::string& stat, const std::string& key )
   {
-    std::stringstream ss;
-    ss << ns << '.' << stat << '.' << key;
-    return ss.str();
+    std::string result;
+    result.reserve( ns.size() + stat.size() + key.size() + 2 );
+    result.append( ns ).append( 1, '.' ).append( stat ).append( 1, '.' ).append( key );
+    return result;
   }
 
   class statsd_plugin_impl
@@ -35,6 +39,10 @@ namespace detail
       void start();
       void shutdown();
 
+      void flush_loop();
+      /// Sends metrics aggregated since previous flush.
+      void flush_aggregated();
+
       bool is_accessible() const;
       bool filter_by_namespace( const std::string& ns, const std::string& stat ) const;
 
@@ -57,8 +65,16 @@ namespace detail
 
       fc::optional< fc::ip::endpoint >                   _statsd_endpoint;
       uint32_t                                           _statsd_batchsize = 1;
+      /// when not zero, metrics are aggregated in process and sent every that many seconds
+      uint32_t                                           _aggregation_interval = 0;
 
       std::unique_ptr< StatsdClient >                    _statsd;
+      std::unique_ptr< metrics_aggregator >              _aggregator;
+
+      std::thread                                        _flush_thread;
+      std::mutex                                         _flush_mutex;
+      std::condition_variable                            _flush_cv;
+      bool                                               _stop_flushing = false;
   };
 
   void statsd_plugin_impl::start()
@@ -80,6 +96,13 @@ namespace detail
     }
 
     _statsd.reset( new StatsdClient( host, port, "hived.", _statsd_batchsize ) );
+
+    if( _aggregation_interval )
+    {
+      _aggregator.reset( new metrics_aggregator() );
+      _flush_thread = std::thread( [this]() { flush_loop(); } );
+    }
+
     _started = true;
   }
 
@@ -95,9 +118,65 @@ namespace detail
     while( cnt++ < cnt_max )
       fc::usleep( fc::milliseconds( 200 ) );
 
+    if( _flush_thread.joinable() )
+    {
+      {
+        std::lock_guard< std::mutex > guard( _flush_mutex );
+        _stop_flushing = true;
+      }
+      _flush_cv.notify_one();
+      _flush_thread.join();
+      flush_aggregated();
+    }
+
     _statsd.reset();
   }
 
+  void statsd_plugin_impl::flush_loop()
+  {
+    std::unique_lock< std::mutex > lock( _flush_mutex );
+    while( !_flush_cv.wait_for( lock, std::chrono::seconds( _aggregation_interval ), [this]() { return _stop_flushing; } ) )
+    {
+      lock.unlock();
+      flush_aggregated();
+      lock.lock();
+    }
+  }
+
+  void statsd_plugin_impl::flush_aggregated()
+  {
+    metrics_aggregator::snapshot metrics = _aggregator->collect();
+
+    for( const auto& c : metrics.counters )
+    {
+      int64_t delta = c.second;
+      // statsd client sends int values, split deltas that don't fit
+      while( delta > std::numeric_limits< int >::max() || delta < std::numeric_limits< int >::min() )
+      {
+        int part = delta > 0 ? std::numeric_limits< int >::max() : std::numeric_limits< int >::min();
+        _statsd->count( c.first, part );
+        delta -= part;
+      }
+      if( delta != 0 )
+        _statsd->count( c.first, static_cast< int >( delta ) );
+    }
+
+    for( const auto& g : metrics.gauges )
+      _statsd->gauge( g.first, static_cast< unsigned int >( std::min< uint64_t >( g.second, std::numeric_limits< int >::max() ) ) );
+
+    for( const auto& t : metrics.timers )
+    {
+      const latency_histogram& h = t.second;
+      _statsd->count( t.first + ".count", static_cast< int >( std::min< uint64_t >( h.count(), std::numeric_limits< int >::max() ) ) );
+      _statsd->gauge( t.first + ".mean", static_cast< unsigned int >( h.sum() / h.count() ) );
+      _statsd->gauge( t.first + ".min", h.min() );
+      _statsd->gauge( t.first + ".p50", h.percentile( 0.5 ) );
+      _statsd->gauge( t.first + ".p90", h.percentile( 0.9 ) );
+      _statsd->gauge( t.first + ".p99", h.percentile( 0.99 ) );
+      _statsd->gauge( t.first + ".max", h.max() );
+    }
+  }
+
   bool statsd_plugin_impl::is_accessible() const
   {
     return !_shutdown_in_progress.load();
@@ -142,27 +221,57 @@ namespace detail
 
   void statsd_plugin_impl::increment( const std::string& ns, const std::string& stat, const std::string& key, const float frequency ) const noexcept
   {
-    execute_operation( ns, stat, [ &, this ](){ _statsd->increment( compose_key( ns, stat, key ), frequency ); } );
+    execute_operation( ns, stat, [ &, this ]()
+    {
+      if( _aggregator )
+        _aggregator->count( compose_key( ns, stat, key ), 1 );
+      else
+        _statsd->increment( compose_key( ns, stat, key ), frequency );
+    } );
   }
 
   void statsd_plugin_impl::decrement( const std::string& ns, const std::string& stat, const std::string& key, const float frequency ) const noexcept
   {
-    execute_operation( ns, stat, [ &, this ](){ _statsd->decrement( compose_key( ns, stat, key ), frequency ); } );
+    execute_operation( ns, stat, [ &, this ]()
+    {
+      if( _aggregator )
+        _aggregator->count( compose_key( ns, stat, key ), -1 );
+      else
+        _statsd->decrement( compose_key( ns, stat, key ), frequency );
+    } );
   }
 
   void statsd_plugin_impl::count( const std::string& ns, const std::string& stat, const std::string& key, const int64_t delta, const float frequency ) const noexcept
   {
-    execute_operation( ns, stat, [ &, this ](){ _statsd->count( compose_key( ns, stat, key ), delta, frequency ); } );
+    execute_operation( ns, stat, [ &, this ]()
+    {
+      if( _aggregator )
+        _aggregator->count( compose_key( ns, stat, key ), delta );
+      else
+        _statsd->count( compose_key( ns, stat, key ), delta, frequency );
+    } );
   }
 
   void statsd_plugin_impl::gauge( const std::string& ns, const std::string& stat, const std::string& key, const uint64_t value, const float frequency ) const noexcept
   {
-    execute_operation( ns, stat, [ &, this ](){ _statsd->gauge( compose_key( ns, stat, key ), value, frequency ); } );
+    execute_operation( ns, stat, [ &, this ]()
+    {
+      if( _aggregator )
+        _aggregator->gauge( compose_key( ns, stat, key ), value );
+      else
+        _statsd->gauge( compose_key( ns, stat, key ), value, frequency );
+    } );
   }
 
   void statsd_plugin_impl::timing( const std::string& ns, const std::string& stat, const std::string& key, const uint32_t ms, const float frequency ) const noexcept
   {
-    execute_operation( ns, stat, [ &, this ](){ _statsd->timing( compose_key( ns, stat, key ), ms, frequency ); } );
+    execute_operation( ns, stat, [ &, this ]()
+    {
+      if( _aggregator )
+        _aggregator->timing( compose_key( ns, stat, key ), ms );
+      else
+        _statsd->timing( compose_key( ns, stat, key ), ms, frequency );
+    } );
   }
 }
 
@@ -177,6 +286,9 @@ void statsd_plugin::set_program_options( options_description& cli, options_descr
   cfg.add_options()
     ("statsd-endpoint", bpo::value< std::string >(), "Endpoint to send statsd messages to.")
     ("statsd-batchsize", bpo::value< uint32_t >()->default_value( 1 ), "Size to batch statsd messages." )
+    ("statsd-aggregation-interval", bpo::value< uint32_t >()->default_value( 0 ),
+      "When not 0, metrics are aggregated in process and sent every that many seconds: counters as summed deltas, "
+      "gauges as last value and timers as <key>.count/mean/min/p50/p90/p99/max. Sampling frequency is ignored then, every event is aggregated." )
     ("statsd-whitelist", bpo::value< vector< std::string > >()->composing(), "Whitelist of statistics to capture.")
     ("statsd-blacklist", bpo::value< vector< std::string > >()->composing(), "Blacklist of statistics to capture.");
 }
@@ -192,6 +304,9 @@ void statsd_plugin::plugin_initialize( const boost::program_options::variables_m
     ilog( "Configured statsd to send to ${ep}", ("ep", endpoints[0]) );
   }
 
+  my->_statsd_batchsize = options.at( "statsd-batchsize" ).as< uint32_t >();
+  my->_aggregation_interval = options.at( "statsd-aggregation-interval" ).as< uint32_t >();
+
   if( options.count( "statsd-whitelist" ) )
   {
     my->_filter_stats = true;
@@ -19,7 +19,9 @@ using namespace appbase;
 /**
   * This plugin starts an HTTP/ws webserver and dispatches queries to
   * registered handles based on payload. The payload must be conform
-  * to the JSONRPC 2.0 spec.
+  * to the JSONRPC 2.0 spec, unless it is a websocket binary message or http
+  * request with Content-Type application/octet-stream, which are handled as
+  * binary RPC (see json_rpc_plugin::call_binary).
   *
   * The handler will be called from the appbase application io_service
   * thread.  The callback can be called from any thread and will
@@ -3,6 +3,8 @@
 
 #include <hive/plugins/chain/chain_plugin.hpp>
 
+#include <hive/utilities/metrics.hpp>
+
 #include <fc/network/ip.hpp>
 #include <fc/log/logger_config.hpp>
 #include <fc/io/json.hpp>
@@ -22,6 +24,9 @@
 #include <websocketpp/logger/stub.hpp>
 #include <websocketpp/logger/syslog.hpp>
 
+#include <atomic>
+#include <mutex>
+#include <set>
 #include <thread>
 #include <memory>
 #include <iostream>
@@ -133,9 +138,40 @@ namespace detail {
     typedef websocketpp::extensions::permessage_deflate::enabled<permessage_deflate_config> permessage_deflate_type;
   };
 
+/// http requests with this content type carry fc::raw packed binary_rpc_request
+const char* const binary_content_type = "application/octet-stream";
+
+inline bool is_binary_request( const std::string& content_type )
+{
+  return content_type.compare( 0, strlen( binary_content_type ), binary_content_type ) == 0;
+}
+
 using websocket_server_type = websocketpp::server< detail::asio_with_stub_log_and_permessage_deflate >;
+
+/// binary stream waits with sending next item while more than that is queued in the connection
+const size_t max_stream_buffered_bytes = 16 * 1024 * 1024;
+/// stream whose consumer does not take anything for that long is aborted and its connection closed
+const fc::microseconds max_stream_stall_time = fc::seconds( 30 );
+
 using websocket_local_server_type = websocketpp::server<detail::asio_local_with_stub_log_and_permessage_deflate>;
 
+/// http resource with metrics in Prometheus text format
+const char* const metrics_resource = "/metrics";
+
+/// answers GET /metrics, returns false when request is meant for API
+template< typename ConnectionPtr >
+bool handle_metrics_request( const ConnectionPtr& con )
+{
+  std::string resource = con->get_resource();
+  if( con->get_request().get_method() != "GET" || resource.compare( 0, resource.find( '?' ), metrics_resource ) != 0 )
+    return false;
+
+  con->set_body( hive::utilities::metrics::registry::instance().scrape() );
+  con->append_header( "Content-Type", "text/plain; version=0.0.4" );
+  con->set_status( websocketpp::http::status_code::ok );
+  return true;
+}
+
 class webserver_plugin_impl
 {
   public:
@@ -150,6 +186,10 @@ class webserver_plugin_impl
     void stop_webserver();
 
     void handle_ws_message( websocket_server_type*, connection_hdl, const detail::websocket_server_type::message_ptr& );
+    void handle_ws_open( connection_hdl );
+    void handle_ws_close( connection_hdl );
+    /// sends one item of binary stream, returns false when stream has to end
+    bool send_stream_frame( const websocket_server_type::connection_ptr& con, const std::vector< char >& frame );
     void handle_http_message( websocket_server_type*, connection_hdl );
     void handle_http_request( websocket_local_server_type*, connection_hdl );
 
@@ -174,7 +214,17 @@ class webserver_plugin_impl
     asio::io_service           thread_pool_ios;
     std::unique_ptr< asio::io_service::work > thread_pool_work;
 
+    /// open websocket connections, closed on shutdown so no thread waits for their consumers
+    std::mutex                                                   ws_connections_mutex;
+    std::set< connection_hdl, std::owner_less< connection_hdl > > ws_connections;
+
+    /// streams waiting for slow consumer hold pool threads, so only some of the threads can do that at once
+    uint32_t                   max_stalled_streams = 1;
+    std::atomic< uint32_t >    stalled_streams{ 0 };
+    std::atomic< bool >        stopping{ false };
+
     plugins::json_rpc::json_rpc_plugin* api = nullptr;
+    bool                                metrics_enabled = false;
     boost::signals2::connection         chain_sync_con;
 
     plugins::chain::chain_plugin& chain;
@@ -186,6 +236,8 @@ void webserver_plugin_impl::prepare_threads()
 
   for( uint32_t i = 0; i < thread_pool_size; ++i )
     thread_pool.create_thread( boost::bind( &asio::io_service::run, &thread_pool_ios ) );
+
+  max_stalled_streams = std::max< uint32_t >( 1, thread_pool_size / 4 );
 }
 
 void webserver_plugin_impl::start_webserver()
@@ -203,6 +255,9 @@ void webserver_plugin_impl::start_webserver()
         ws_server.set_reuse_addr( true );
 
         ws_server.set_message_handler( boost::bind( &webserver_plugin_impl::handle_ws_message, this, &ws_server, _1, _2 ) );
+        ws_server.set_open_handler( boost::bind( &webserver_plugin_impl::handle_ws_open, this, _1 ) );
+        ws_server.set_close_handler( boost::bind( &webserver_plugin_impl::handle_ws_close, this, _1 ) );
+        ws_server.set_fail_handler( boost::bind( &webserver_plugin_impl::handle_ws_close, this, _1 ) );
 
         if( http_endpoint && http_endpoint == ws_endpoint )
         {
@@ -291,6 +346,18 @@ void webserver_plugin_impl::stop_webserver()
   if( unix_server.is_listening() )
     unix_server.stop_listening();
 
+  // streams stop waiting for their consumers, then connections are closed so nothing new is sent
+  stopping.store( true );
+  {
+    std::lock_guard< std::mutex > guard( ws_connections_mutex );
+    for( const connection_hdl& hdl : ws_connections )
+    {
+      websocketpp::lib::error_code ec;
+      ws_server.close( hdl, websocketpp::close::status::going_away, "server shutdown", ec );
+    }
+    ws_connections.clear();
+  }
+
   thread_pool_ios.stop();
   thread_pool.join_all();
 
@@ -316,6 +383,49 @@ void webserver_plugin_impl::stop_webserver()
   }
 }
 
+void webserver_plugin_impl::handle_ws_open( connection_hdl hdl )
+{
+  std::lock_guard< std::mutex > guard( ws_connections_mutex );
+  if( !stopping.load() )
+    ws_connections.insert( std::move( hdl ) );
+}
+
+void webserver_plugin_impl::handle_ws_close( connection_hdl hdl )
+{
+  std::lock_guard< std::mutex > guard( ws_connections_mutex );
+  ws_connections.erase( hdl );
+}
+
+bool webserver_plugin_impl::send_stream_frame( const websocket_server_type::connection_ptr& con, const std::vector< char >& frame )
+{
+  if( con->get_buffered_amount() > max_stream_buffered_bytes )
+  {
+    bool too_slow = true;
+    if( stalled_streams.fetch_add( 1 ) < max_stalled_streams )
+    {
+      fc::time_point deadline = fc::time_point::now() + max_stream_stall_time;
+      while( !stopping.load() && con->get_state() == websocketpp::session::state::open &&
+        con->get_buffered_amount() > max_stream_buffered_bytes && fc::time_point::now() < deadline )
+        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+      too_slow = con->get_buffered_amount() > max_stream_buffered_bytes;
+    }
+    --stalled_streams;
+
+    if( too_slow && !stopping.load() && con->get_state() == websocketpp::session::state::open )
+    {
+      ulog( "Closing binary stream connection, consumer did not keep up" );
+      websocketpp::lib::error_code ec;
+      con->close( websocketpp::close::status::try_again_later, "stream consumer too slow", ec );
+    }
+    if( too_slow )
+      return false;
+  }
+
+  if( stopping.load() || con->get_state() != websocketpp::session::state::open )
+    return false;
+  return !con->send( frame.data(), frame.size(), websocketpp::frame::opcode::binary );
+}
+
 void webserver_plugin_impl::handle_ws_message( websocket_server_type* server, connection_hdl hdl, const detail::websocket_server_type::message_ptr& msg )
 {
   auto con = server->get_con_from_hdl( std::move( hdl ) );
@@ -337,8 +447,17 @@ void webserver_plugin_impl::handle_ws_message( websocket_server_type* server, co
 
         con->send( response );
       }
+      else if( msg->get_opcode() == websocketpp::frame::opcode::binary )
+      {
+        const auto& payload = msg->get_payload();
+        auto response = api->call_binary( std::vector< char >( payload.begin(), payload.end() ),
+          [con, this]( const std::vector< char >& frame ) { return send_stream_frame( con, frame ); } );
+        LOG_DELAY(arrival_time, fc::seconds(10), "Excessive delay to process ws binary API call");
+
+        con->send( response.data(), response.size(), websocketpp::frame::opcode::binary );
+      }
       else
-        con->send( "error: string payload expected" );
+        con->send( "error: string or binary payload expected" );
     }
     catch( fc::exception& e )
     {
@@ -382,8 +501,23 @@ void webserver_plugin_impl::handle_http_message( websocket_server_type* server,
 
     try
     {
-      con->set_body( api->call( body ) );
-      con->append_header( "Content-Type", "application/json" );
+      if( metrics_enabled && handle_metrics_request( con ) )
+      {
+        con->send_http_response();
+        return;
+      }
+
+      if( is_binary_request( con->get_request_header( "Content-Type" ) ) )
+      {
+        auto response = api->call_binary( std::vector< char >( body.begin(), body.end() ) );
+        con->set_body( std::string( response.begin(), response.end() ) );
+        con->append_header( "Content-Type", binary_content_type );
+      }
+      else
+      {
+        con->set_body( api->call( body ) );
+        con->append_header( "Content-Type", "application/json" );
+      }
       con->set_status( websocketpp::http::status_code::ok );
     }
     catch( fc::exception& e )
@@ -430,8 +564,23 @@ void webserver_plugin_impl::handle_http_request(websocket_local_server_type* ser
 
     try
     {
-      con->set_body( api->call( body ) );
-      con->append_header( "Content-Type", "application/json" );
+      if( metrics_enabled && handle_metrics_request( con ) )
+      {
+        con->send_http_response();
+        return;
+      }
+
+      if( is_binary_request( con->get_request_header( "Content-Type" ) ) )
+      {
+        auto response = api->call_binary( std::vector< char >( body.begin(), body.end() ) );
+        con->set_body( std::string( response.begin(), response.end() ) );
+        con->append_header( "Content-Type", binary_content_type );
+      }
+      else
+      {
+        con->set_body( api->call( body ) );
+        con->append_header( "Content-Type", "application/json" );
+      }
       con->set_status( websocketpp::http::status_code::ok );
     }
     catch( fc::exception& e )
@@ -481,6 +630,8 @@ void webserver_plugin::set_program_options( options_description&, options_descri
     ("rpc-endpoint", bpo::value< string >(), "Local http and websocket endpoint for webserver requests. Deprecated in favor of webserver-http-endpoint and webserver-ws-endpoint" )
     ("webserver-thread-pool-size", bpo::value<thread_pool_size_t>()->default_value(32),
       "Number of threads used to handle queries. Default: 32.")
+    ("webserver-enable-metrics", bpo::value< bool >()->default_value( false ),
+      "Serve metrics in Prometheus text format on GET /metrics of http endpoints.")
     ;
 }
 
@@ -490,6 +641,9 @@ void webserver_plugin::plugin_initialize( const variables_map& options )
   FC_ASSERT(thread_pool_size > 0, "webserver-thread-pool-size must be greater than 0");
   ilog("configured with ${tps} thread pool size", ("tps", thread_pool_size));
   my.reset( new detail::webserver_plugin_impl( thread_pool_size, appbase::app().get_plugin< plugins::chain::chain_plugin >() ) );
+  my->metrics_enabled = options.at( "webserver-enable-metrics" ).as< bool >();
+  if( my->metrics_enabled )
+    ilog( "serving metrics on ${r}", ("r", detail::metrics_resource) );
 
   if( options.count( "webserver-http-endpoint" ) )
   {
@@ -9,9 +9,15 @@
 #include <hive/chain/pending_required_action_object.hpp>
 #include <hive/chain/pending_optional_action_object.hpp>
 #include <hive/chain/witness_objects.hpp>
+#include <hive/chain/util/impacted.hpp>
 
 #include <fc/macros.hpp>
 
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <queue>
+
 namespace hive { namespace plugins { namespace witness {
 
 chain::signed_block block_producer::generate_block(fc::time_point_sec when, const chain::account_name_type& witness_owner, const fc::ecc::private_key& block_signing_private_key, uint32_t skip)
@@ -45,31 +51,53 @@ chain::signed_block block_producer::_generate_block(fc::time_point_sec when, con
     FC_ASSERT( witness_obj.signing_key == block_signing_private_key.get_public_key() );
 
   chain::signed_block pending_block;
+  bool selected_without_replay = false;
+
+  auto prepare_block = [&]( bool allow_selection_without_replay )
+  {
+    pending_block = chain::signed_block();
+    pending_block.previous = _db.head_block_id();
+    pending_block.timestamp = when;
+    pending_block.witness = witness_owner;
 
-  pending_block.previous = _db.head_block_id();
-  pending_block.timestamp = when;
-  pending_block.witness = witness_owner;
+    adjust_hardfork_version_vote( _db.get_witness( witness_owner ), pending_block );
 
-  adjust_hardfork_version_vote( _db.get_witness( witness_owner ), pending_block );
+    selected_without_replay = allow_selection_without_replay && select_applied_pending_transactions( when, pending_block );
+    if( !selected_without_replay )
+      apply_pending_transactions( witness_owner, when, pending_block );
 
-  apply_pending_transactions( witness_owner, when, pending_block );
+    // We have temporarily broken the invariant that
+    // _pending_tx_session is the result of applying _pending_tx, as
+    // _pending_tx now consists of the set of postponed transactions.
+    // However, the push_block() call below will re-create the
+    // _pending_tx_session.
 
-  // We have temporarily broken the invariant that
-  // _pending_tx_session is the result of applying _pending_tx, as
-  // _pending_tx now consists of the set of postponed transactions.
-  // However, the push_block() call below will re-create the
-  // _pending_tx_session.
+    if( !(skip & chain::database::skip_witness_signature) )
+      pending_block.sign( block_signing_private_key, _db.has_hardfork( HIVE_HARDFORK_0_20__1944 ) ? fc::ecc::bip_0062 : fc::ecc::fc_canonical );
 
-  if( !(skip & chain::database::skip_witness_signature) )
-    pending_block.sign( block_signing_private_key, _db.has_hardfork( HIVE_HARDFORK_0_20__1944 ) ? fc::ecc::bip_0062 : fc::ecc::fc_canonical );
+    // TODO:  Move this to _push_block() so session is restored.
+    if( !(skip & chain::database::skip_block_size_check) )
+    {
+      FC_ASSERT( fc::raw::pack_size(pending_block) <= HIVE_MAX_BLOCK_SIZE );
+    }
+  };
+
+  prepare_block( true );
 
-  // TODO:  Move this to _push_block() so session is restored.
-  if( !(skip & chain::database::skip_block_size_check) )
+  try
   {
-    FC_ASSERT( fc::raw::pack_size(pending_block) <= HIVE_MAX_BLOCK_SIZE );
+    _db.push_block( pending_block, skip );
+  }
+  catch( const fc::exception& e )
+  {
+    if( !selected_without_replay )
+      throw;
+    // selection relies on transactions not affecting each other through state other than their accounts;
+    // when that assumption fails the block is built again the slow way
+    wlog( "Block built from already applied pending transactions was rejected, rebuilding it: ${e}", ("e", e.to_detail_string()) );
+    prepare_block( false );
+    _db.push_block( pending_block, skip );
   }
-
-  _db.push_block( pending_block, skip );
 
   return pending_block;
 }
@@ -98,6 +126,118 @@ void block_producer::adjust_hardfork_version_vote(const chain::witness_object& w
   }
 }
 
+namespace {
+
+/// transactions which outcome depends on who produces the block or on being applied as part of the block
+bool depends_on_block_context( const chain::signed_transaction& tx )
+{
+  for( const auto& op : tx.operations )
+  {
+    if( op.which() == protocol::operation::tag< protocol::claim_account_operation >::value )
+    {
+      if( op.get< protocol::claim_account_operation >().fee.amount == 0 )
+        return true;
+    }
+    else if( op.which() == protocol::operation::tag< protocol::pow_operation >::value ||
+             op.which() == protocol::operation::tag< protocol::pow2_operation >::value
+#ifdef HIVE_ENABLE_SMT
+             || op.which() == protocol::operation::tag< protocol::smt_create_operation >::value
+#endif
+           )
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace
+
+bool block_producer::select_applied_pending_transactions(
+      fc::time_point_sec when,
+      chain::signed_block& pending_block)
+{
+  // pending state has to reflect all pending transactions applied in order on top of head block
+  if( !_db.are_pending_transactions_applied() )
+    return false;
+
+  // required and optional actions have to be applied on state containing exactly the selected transactions
+  const auto& pending_required_action_idx = _db.get_index< chain::pending_required_action_index, chain::by_execution >();
+  if( pending_required_action_idx.begin() != pending_required_action_idx.end() && pending_required_action_idx.begin()->execution_time <= when )
+    return false;
+  const auto& pending_optional_action_idx = _db.get_index< chain::pending_optional_action_index, chain::by_execution >();
+  if( pending_optional_action_idx.begin() != pending_optional_action_idx.end() && pending_optional_action_idx.begin()->execution_time <= when )
+    return false;
+
+  // The 4 is for the max size of the transaction vector length
+  size_t total_block_size = fc::raw::pack_size( pending_block ) + 4;
+  const auto& gpo = _db.get_dynamic_global_properties();
+  uint64_t maximum_block_size = gpo.maximum_block_size; //HIVE_MAX_BLOCK_SIZE;
+  uint64_t maximum_transaction_partition_size = maximum_block_size -  ( maximum_block_size * gpo.required_actions_partition_percent ) / HIVE_100_PERCENT;
+
+  // when not all pending transactions fit, the most valuable ones are picked, that is, not in order they were applied
+  if( total_block_size + _db.get_pending_transaction_pool().get_total_size() >= maximum_transaction_partition_size )
+    return false;
+
+  //
+  // Each pending transaction was already successfully applied in the state it would be applied in as part of
+  // the block - on top of the same head block and all preceding pending transactions. As long as all preceding
+  // transactions are included, nothing needs to be reapplied. When some transaction is left out (it expires
+  // before the block, or does not fit), transactions that touch any of its accounts could have relied on it,
+  // so they are left out as well (they stay pending for next block).
+  //
+  flat_set< protocol::account_name_type > skipped_accounts;
+  flat_set< protocol::account_name_type > tx_accounts;
+  uint64_t postponed_tx_count = 0;
+  for( const chain::signed_transaction& tx : _db._pending_tx )
+  {
+    if( postponed_tx_count > HIVE_BLOCK_GENERATION_POSTPONED_TX_LIMIT )
+      break;
+
+    if( depends_on_block_context( tx ) )
+      return false;
+
+    tx_accounts.clear();
+    hive::app::transaction_get_impacted_accounts( tx, tx_accounts );
+
+    bool include = tx.expiration >= when;
+    if( include )
+    {
+      for( const auto& account : tx_accounts )
+      {
+        if( skipped_accounts.count( account ) )
+        {
+          include = false;
+          break;
+        }
+      }
+    }
+
+    uint64_t new_total_size = total_block_size + fc::raw::pack_size( tx );
+    if( include && new_total_size >= maximum_transaction_partition_size )
+    {
+      postponed_tx_count++;
+      include = false;
+    }
+
+    if( !include )
+    {
+      skipped_accounts.insert( tx_accounts.begin(), tx_accounts.end() );
+      continue;
+    }
+
+    total_block_size = new_total_size;
+    pending_block.transactions.push_back( tx );
+  }
+  if( postponed_tx_count > 0 )
+  {
+    wlog( "Postponed ${n} transactions due to block size limit", ("n", _db._pending_tx.size() - pending_block.transactions.size()) );
+  }
+
+  pending_block.transaction_merkle_root = pending_block.calculate_merkle_root();
+  return true;
+}
+
 void block_producer::apply_pending_transactions(
       const chain::account_name_type& witness_owner,
       fc::time_point_sec when,
@@ -120,7 +260,7 @@ void block_producer::apply_pending_transactions(
   // the value of the "when" variable is known, which means we need to
   // re-apply pending transactions in this method.
   //
-  _db.pending_transaction_session().reset();
+  _db.undo_pending_transactions();
   _db.pending_transaction_session() = _db.start_undo_session();
 
   FC_TODO( "Safe to remove after HF20 occurs because no more pre HF20 blocks will be generated" );
@@ -135,18 +275,68 @@ void block_producer::apply_pending_transactions(
           });
   }
 
+  //
+  // When there is not enough room for all pending transactions, they are applied starting from the most valuable
+  // ones (see pending_transaction_pool), so the ones that don't fit are the least valuable. Transactions paid by the
+  // same account keep order in which they were received, since later ones usually rely on earlier ones. Transaction
+  // that fails because it relies on a less valuable one paid by different account (f.e. spends funds transferred
+  // to it) gets another chance after all others.
+  //
+  std::vector< const chain::signed_transaction* > ordered_pending_tx;
+  ordered_pending_tx.reserve( _db._pending_tx.size() );
+
+  const auto& pending_pool = _db.get_pending_transaction_pool();
+  const bool by_priority = total_block_size + pending_pool.get_total_size() >= maximum_transaction_partition_size;
+  if( by_priority )
+  {
+    typedef std::deque< size_t > account_queue; // positions in _pending_tx, in order of arrival
+    std::map< protocol::account_name_type, account_queue > account_queues;
+    std::vector< int64_t > priorities;
+    priorities.reserve( _db._pending_tx.size() );
+    for( size_t i = 0; i < _db._pending_tx.size(); ++i )
+    {
+      const chain::signed_transaction& tx = _db._pending_tx[i];
+      const auto* entry = pending_pool.find( tx.id() );
+      priorities.push_back( entry != nullptr ? entry->priority : 0 );
+      const auto& account = entry != nullptr ? entry->account : chain::pending_transaction_pool::make_entry( tx, tx.id() ).account;
+      account_queues[ account ].push_back( i );
+    }
+
+    // next transaction of account with the most valuable one first, among equally valuable the earliest one first
+    auto less_valuable = [&]( const account_queue* l, const account_queue* r )
+    {
+      size_t li = l->front();
+      size_t ri = r->front();
+      return priorities[li] != priorities[ri] ? priorities[li] < priorities[ri] : li > ri;
+    };
+    std::priority_queue< account_queue*, std::vector< account_queue* >, decltype( less_valuable ) > next_tx( less_valuable );
+    for( auto& queue : account_queues )
+      next_tx.push( &queue.second );
+    while( !next_tx.empty() )
+    {
+      account_queue* queue = next_tx.top();
+      next_tx.pop();
+      ordered_pending_tx.push_back( &_db._pending_tx[ queue->front() ] );
+      queue->pop_front();
+      if( !queue->empty() )
+        next_tx.push( queue );
+    }
+  }
+  else
+  {
+    for( const chain::signed_transaction& tx : _db._pending_tx )
+      ordered_pending_tx.push_back( &tx );
+  }
+
   uint64_t postponed_tx_count = 0;
-  // pop pending state (reset to head block state)
-  for( const chain::signed_transaction& tx : _db._pending_tx )
+  std::vector< const chain::signed_transaction* > failed_tx;
+  // @return false when transaction failed
+  auto apply_pending_transaction = [&]( const chain::signed_transaction& tx ) -> bool
   {
     // Only include transactions that have not expired yet for currently generating block,
     // this should clear problem transactions and allow block production to continue
-
-    if( postponed_tx_count > HIVE_BLOCK_GENERATION_POSTPONED_TX_LIMIT )
-      break;
-
     if( tx.expiration < when )
-      continue;
+      return true;
 
     uint64_t new_total_size = total_block_size + fc::raw::pack_size( tx );
 
@@ -154,7 +344,7 @@ void block_producer::apply_pending_transactions(
     if( new_total_size >= maximum_transaction_partition_size )
     {
       postponed_tx_count++;
-      continue;
+      return true;
     }
 
     try
@@ -171,7 +361,28 @@ void block_producer::apply_pending_transactions(
       // Do nothing, transaction will not be re-applied
       //wlog( "Transaction was not processed while generating block due to ${e}", ("e", e) );
       //wlog( "The transaction was ${t}", ("t", tx) );
+      return false;
     }
+    return true;
+  };
+
+  // pop pending state (reset to head block state)
+  for( const chain::signed_transaction* tx_ptr : ordered_pending_tx )
+  {
+    if( postponed_tx_count > HIVE_BLOCK_GENERATION_POSTPONED_TX_LIMIT )
+      break;
+
+    if( !apply_pending_transaction( *tx_ptr ) && by_priority )
+      failed_tx.push_back( tx_ptr );
+  }
+  // second chance in order of arrival (pointers to elements of _pending_tx)
+  std::sort( failed_tx.begin(), failed_tx.end() );
+  for( const chain::signed_transaction* tx_ptr : failed_tx )
+  {
+    if( postponed_tx_count > HIVE_BLOCK_GENERATION_POSTPONED_TX_LIMIT )
+      break;
+
+    apply_pending_transaction( *tx_ptr );
   }
   if( postponed_tx_count > 0 )
   {
@@ -246,6 +457,7 @@ FC_TODO( "Remove ifdef when optional actions are added" )
 #endif
 
   _db.pending_transaction_session().reset();
+  _db.set_pending_transactions_applied( _db._pending_tx.empty() );
 
   pending_block.transaction_merkle_root = pending_block.calculate_merkle_root();
 }
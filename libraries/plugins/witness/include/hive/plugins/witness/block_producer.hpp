@@ -34,6 +34,15 @@ private:
 
   void adjust_hardfork_version_vote( const chain::witness_object& witness, chain::signed_block& pending_block );
 
+  /**
+    * Fills block with pending transactions without applying them again, when they are already applied in
+    * pending state in the same order. Returns false when that is not possible and block has to be built
+    * with apply_pending_transactions().
+    */
+  bool select_applied_pending_transactions(
+    fc::time_point_sec when,
+    chain::signed_block& pending_block);
+
   void apply_pending_transactions(
     const chain::account_name_type& witness_owner,
     fc::time_point_sec when,
@@ -39,31 +39,80 @@ namespace hive { namespace protocol {
     return signee( canon_type ) == expected_signee;
   }
 
+  namespace {
+    /// packs given transactions (or their unsigned part) one after another into single buffer, for hashing with digest_type::hash_many
+    template< typename T >
+    void pack_for_hashing( const vector<signed_transaction>& transactions, vector<char>& buffer,
+      vector<const char*>& data, vector<uint32_t>& sizes )
+    {
+      data.resize( transactions.size() );
+      sizes.resize( transactions.size() );
+      size_t total_size = 0;
+      for( uint32_t i = 0; i < transactions.size(); ++i )
+      {
+        sizes[i] = fc::raw::pack_size( static_cast< const T& >( transactions[i] ) );
+        total_size += sizes[i];
+      }
+
+      // buffer is sized up front, so pointers to packed transactions stay valid
+      buffer.resize( total_size );
+      fc::datastream< char* > ds( buffer.data(), buffer.size() );
+      for( uint32_t i = 0; i < transactions.size(); ++i )
+      {
+        data[i] = ds.pos();
+        fc::raw::pack( ds, static_cast< const T& >( transactions[i] ) );
+      }
+    }
+  }
+
   checksum_type signed_block::calculate_merkle_root()const
   {
     if( transactions.size() == 0 )
       return checksum_type();
 
-    vector<digest_type> ids;
-    ids.resize( transactions.size() );
-    for( uint32_t i = 0; i < transactions.size(); ++i )
-      ids[i] = transactions[i].merkle_digest();
+    // leaves, as well as nodes of each level of the tree, are independent messages, so they are hashed in batches
+    vector<char> packed;
+    vector<const char*> data;
+    vector<uint32_t> sizes;
+    pack_for_hashing< signed_transaction >( transactions, packed, data, sizes );
 
-    vector<digest_type>::size_type current_number_of_hashes = ids.size();
-    while( current_number_of_hashes > 1 )
-    {
-      // hash ID's in pairs
-      uint32_t i_max = current_number_of_hashes - (current_number_of_hashes&1);
-      uint32_t k = 0;
+    vector<digest_type> ids( transactions.size() );
+    digest_type::hash_many( data.data(), sizes.data(), ids.data(), ids.size() );
 
-      for( uint32_t i = 0; i < i_max; i += 2 )
-        ids[k++] = digest_type::hash( std::make_pair( ids[i], ids[i+1] ) );
+    vector<digest_type> next_ids;
+    while( ids.size() > 1 )
+    {
+      // hash ID's in pairs - two adjacent digests are laid out exactly like packed std::pair of them
+      size_t pairs = ids.size() / 2;
+      data.resize( pairs );
+      sizes.assign( pairs, 2 * sizeof( digest_type ) );
+      for( size_t i = 0; i < pairs; ++i )
+        data[i] = ids[ 2 * i ].data();
 
-      if( current_number_of_hashes&1 )
-        ids[k++] = ids[i_max];
-      current_number_of_hashes = k;
+      next_ids.resize( pairs + ( ids.size() & 1 ) );
+      digest_type::hash_many( data.data(), sizes.data(), next_ids.data(), pairs );
+      if( ids.size() & 1 )
+        next_ids.back() = ids.back();
+      ids.swap( next_ids );
     }
     return checksum_type::hash( ids[0] );
   }
 
+  vector<transaction_id_type> signed_block::calculate_transaction_ids()const
+  {
+    vector<char> packed;
+    vector<const char*> data;
+    vector<uint32_t> sizes;
+    pack_for_hashing< transaction >( transactions, packed, data, sizes );
+
+    vector<digest_type> digests( transactions.size() );
+    digest_type::hash_many( data.data(), sizes.data(), digests.data(), digests.size() );
+
+    // same as transaction::id()
+    vector<transaction_id_type> result( transactions.size() );
+    for( size_t i = 0; i < digests.size(); ++i )
+      memcpy( result[i]._hash, digests[i]._hash, std::min( sizeof( result[i] ), sizeof( digests[i] ) ) );
+    return result;
+  }
+
 } } // hive::protocol
@@ -7,6 +7,8 @@ namespace hive { namespace protocol {
   struct signed_block : public signed_block_header
   {
     checksum_type calculate_merkle_root()const;
+    /// ids of all transactions (computed in batch, faster than calling id() on each)
+    vector<transaction_id_type> calculate_transaction_ids()const;
     vector<signed_transaction> transactions;
   };
 
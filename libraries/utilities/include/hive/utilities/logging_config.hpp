@@ -18,6 +18,10 @@ struct appender_args
   std::string file;
   std::string stream;
   std::string time_format;
+  /// file only: write messages from background thread
+  bool        async = false;
+  /// file + async only: "drop" or "block" when logging thread fills its queue
+  std::string overflow;
 
   void validate();
 };
@@ -37,5 +41,5 @@ fc::optional<fc::logging_config> load_logging_config( const boost::program_optio
 
 } } // hive::utilities
 
-FC_REFLECT( hive::utilities::appender_args, (appender)(file)(stream)(time_format) )
+FC_REFLECT( hive::utilities::appender_args, (appender)(file)(stream)(time_format)(async)(overflow) )
 FC_REFLECT( hive::utilities::logger_args, (name)(level)(appender) )
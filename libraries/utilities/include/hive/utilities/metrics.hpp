@@ -0,0 +1,118 @@
+#pragma once
+
+#include <fc/time.hpp>
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace hive { namespace utilities { namespace metrics {
+
+typedef std::vector< std::pair< std::string, std::string > > labels_t;
+
+/**
+  * Histogram of durations with fixed bucket bounds, as defined by Prometheus.  Recording is lock free,
+  * so it can be used from any thread, including ones holding chainbase lock.
+  */
+class histogram
+{
+  public:
+    /// bounds - upper bounds of buckets in seconds, ascending; values above the last one go to +Inf bucket
+    explicit histogram( std::vector< double > bounds = default_time_buckets() );
+
+    void observe( const fc::microseconds& duration );
+
+    /// from 0.5ms to 10s
+    static std::vector< double > default_time_buckets();
+
+    const std::vector< double >& bounds()const { return _bounds; }
+    /// number of observations not greater than bound with given index (cumulative), index bounds().size() is +Inf
+    uint64_t cumulative_count( size_t index )const;
+    uint64_t count()const { return _count.load( std::memory_order_relaxed ); }
+    double   sum()const { return double( _sum_us.load( std::memory_order_relaxed ) ) / 1000000.0; }
+
+  private:
+    std::vector< double >                         _bounds;
+    std::vector< int64_t >                        _bounds_us;
+    std::unique_ptr< std::atomic< uint64_t >[] >  _counts;
+    std::atomic< uint64_t >                       _count;
+    std::atomic< uint64_t >                       _sum_us;
+};
+
+/**
+  * Writes samples in Prometheus text exposition format.  All samples of one metric have to be written
+  * one after another; type and help line is written before the first of them.
+  */
+class text_writer
+{
+  public:
+    void gauge( const std::string& name, const std::string& help, double value, const labels_t& labels = labels_t() );
+    void counter( const std::string& name, const std::string& help, double value, const labels_t& labels = labels_t() );
+    void write_histogram( const std::string& name, const std::string& help, const histogram& h, const labels_t& labels = labels_t() );
+
+    std::string str()const { return _out.str(); }
+
+  private:
+    void header( const std::string& name, const std::string& help, const char* type );
+    void sample( const std::string& name, const labels_t& labels, double value, const std::string* le = nullptr );
+
+    std::ostringstream      _out;
+    std::set< std::string > _described;
+};
+
+/**
+  * Metrics shared by all plugins, exposed by webserver under /metrics.  Plugins either record to
+  * histograms obtained from the registry or add collectors that write current values during each scrape.
+  * Collectors run on webserver thread, so they must only read values that are safe to access without
+  * chainbase lock (atomics, cached copies, thread safe rocksdb properties).
+  */
+class registry
+{
+  public:
+    typedef std::function< void( text_writer& ) > collector;
+
+    static registry& instance();
+
+    /// Returns histogram with given name and labels, creating it on first call.  Reference stays valid until exit.
+    histogram& get_histogram( const std::string& name, const std::string& help, const labels_t& labels = labels_t() );
+
+    /// Replaces collector registered under the same name.
+    void add_collector( const std::string& name, collector c );
+    void remove_collector( const std::string& name );
+
+    /// Current values of all metrics in Prometheus text format.
+    std::string scrape();
+
+  private:
+    struct histogram_family
+    {
+      std::string                                       help;
+      std::map< labels_t, std::unique_ptr< histogram > > histograms;
+    };
+
+    std::mutex                                  _mutex;
+    std::map< std::string, histogram_family >   _histograms;
+    std::map< std::string, collector >          _collectors;
+};
+
+/// Records time elapsed since construction in given histogram when destroyed (nothing when histogram is null).
+class scoped_timer
+{
+  public:
+    explicit scoped_timer( histogram& h ) : scoped_timer( &h ) {}
+    explicit scoped_timer( histogram* h ) : _histogram( h ), _start( h != nullptr ? fc::time_point::now() : fc::time_point() ) {}
+    ~scoped_timer() { if( _histogram != nullptr ) _histogram->observe( fc::time_point::now() - _start ); }
+
+  private:
+    histogram*      _histogram;
+    fc::time_point  _start;
+};
+
+} } } // hive::utilities::metrics
@@ -17,6 +17,8 @@ void appender_args::validate()
 {
   FC_ASSERT( appender.length(), "Must specify an appender name" );
   FC_ASSERT( ( file.length() > 0 ) ^ ( stream.length() > 0 ), "Must specify either a file or a stream" );
+  FC_ASSERT( !async || file.length(), "Only file appender can be asynchronous" );
+  FC_ASSERT( overflow.empty() || async, "Overflow policy applies to asynchronous appender only" );
 }
 
 void logger_args::validate()
@@ -41,7 +43,9 @@ void set_logging_program_options( boost::program_options::options_description& o
 
   options.add_options()
     ("log-appender", boost::program_options::value< std::vector< std::string > >()->composing()->default_value( default_appender, str_default_appender ),
-      "Appender definition json: {\"appender\", \"stream\", \"file\"} Can only specify a file OR a stream" )
+      "Appender definition json: {\"appender\", \"stream\", \"file\"} Can only specify a file OR a stream. "
+      "File appender can also specify \"async\": true to write from background thread and \"overflow\": \"drop\" (default) or \"block\" "
+      "for messages logged when queue is full" )
     ("log-console-appender", boost::program_options::value< std::vector< std::string > >()->composing() )
     ("log-file-appender", boost::program_options::value< std::vector< std::string > >()->composing() )
     ("log-logger", boost::program_options::value< std::vector< std::string > >()->composing()->default_value( default_logger, str_default_logger ),
@@ -119,6 +123,9 @@ fc::optional<fc::logging_config> load_logging_config( const boost::program_optio
           file_appender_config.rotation_limit = fc::days(1);
           if (appender.time_format.length())
             file_appender_config.time_format = fc::variant( appender.time_format ).as<fc::appender::time_format>();
+          file_appender_config.async = appender.async;
+          if (appender.overflow.length())
+            file_appender_config.overflow = fc::variant( appender.overflow ).as<fc::file_appender::overflow_policy::type>();
           logging_config.appenders.push_back(
                                   fc::appender_config( appender.appender, "file", fc::variant( file_appender_config ) ) );
           found_logging_config = true;
@@ -0,0 +1,189 @@
+#include <hive/utilities/metrics.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+namespace hive { namespace utilities { namespace metrics {
+
+namespace {
+
+std::string escape_label_value( const std::string& value )
+{
+  std::string result;
+  result.reserve( value.size() );
+  for( char c : value )
+  {
+    switch( c )
+    {
+      case '\\': result += "\\\\"; break;
+      case '"':  result += "\\\""; break;
+      case '\n': result += "\\n"; break;
+      default:   result += c;
+    }
+  }
+  return result;
+}
+
+void write_value( std::ostream& out, double value )
+{
+  if( std::isinf( value ) )
+    out << ( value > 0 ? "+Inf" : "-Inf" );
+  else if( std::isnan( value ) )
+    out << "NaN";
+  else
+    out << std::setprecision( 15 ) << value;
+}
+
+} // anonymous
+
+histogram::histogram( std::vector< double > bounds ) : _bounds( std::move( bounds ) ),
+  _counts( new std::atomic< uint64_t >[ _bounds.size() + 1 ] )
+{
+  _bounds_us.reserve( _bounds.size() );
+  for( double bound : _bounds )
+    _bounds_us.push_back( static_cast< int64_t >( bound * 1000000.0 ) );
+  for( size_t i = 0; i <= _bounds.size(); ++i )
+    _counts[i].store( 0 );
+  _count.store( 0 );
+  _sum_us.store( 0 );
+}
+
+std::vector< double > histogram::default_time_buckets()
+{
+  return { 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10 };
+}
+
+void histogram::observe( const fc::microseconds& duration )
+{
+  int64_t us = std::max< int64_t >( 0, duration.count() );
+  size_t index = std::lower_bound( _bounds_us.begin(), _bounds_us.end(), us ) - _bounds_us.begin();
+  _counts[ index ].fetch_add( 1, std::memory_order_relaxed );
+  _sum_us.fetch_add( us, std::memory_order_relaxed );
+  _count.fetch_add( 1, std::memory_order_relaxed );
+}
+
+uint64_t histogram::cumulative_count( size_t index )const
+{
+  uint64_t result = 0;
+  for( size_t i = 0; i <= index && i <= _bounds.size(); ++i )
+    result += _counts[i].load( std::memory_order_relaxed );
+  return result;
+}
+
+void text_writer::header( const std::string& name, const std::string& help, const char* type )
+{
+  if( !_described.insert( name ).second )
+    return;
+  _out << "# HELP " << name << ' ' << help << '\n';
+  _out << "# TYPE " << name << ' ' << type << '\n';
+}
+
+void text_writer::sample( const std::string& name, const labels_t& labels, double value, const std::string* le )
+{
+  _out << name;
+  if( !labels.empty() || le != nullptr )
+  {
+    _out << '{';
+    bool first = true;
+    for( const auto& label : labels )
+    {
+      if( !first )
+        _out << ',';
+      first = false;
+      _out << label.first << "=\"" << escape_label_value( label.second ) << '"';
+    }
+    if( le != nullptr )
+      _out << ( first ? "" : "," ) << "le=\"" << *le << '"';
+    _out << '}';
+  }
+  _out << ' ';
+  write_value( _out, value );
+  _out << '\n';
+}
+
+void text_writer::gauge( const std::string& name, const std::string& help, double value, const labels_t& labels )
+{
+  header( name, help, "gauge" );
+  sample( name, labels, value );
+}
+
+void text_writer::counter( const std::string& name, const std::string& help, double value, const labels_t& labels )
+{
+  header( name, help, "counter" );
+  sample( name, labels, value );
+}
+
+void text_writer::write_histogram( const std::string& name, const std::string& help, const histogram& h, const labels_t& labels )
+{
+  header( name, help, "histogram" );
+
+  // read buckets first, so +Inf bucket is never below any of them even when observations come in meanwhile
+  std::vector< uint64_t > cumulative;
+  for( size_t i = 0; i <= h.bounds().size(); ++i )
+    cumulative.push_back( h.cumulative_count( i ) );
+  uint64_t count = std::max( h.count(), cumulative.back() );
+
+  for( size_t i = 0; i < h.bounds().size(); ++i )
+  {
+    std::ostringstream bound;
+    write_value( bound, h.bounds()[i] );
+    std::string le = bound.str();
+    sample( name + "_bucket", labels, double( cumulative[i] ), &le );
+  }
+  std::string inf = "+Inf";
+  sample( name + "_bucket", labels, double( count ), &inf );
+  sample( name + "_sum", labels, h.sum() );
+  sample( name + "_count", labels, double( count ) );
+}
+
+registry& registry::instance()
+{
+  static registry* instance = new registry(); // never destroyed, histograms can be recorded until exit
+  return *instance;
+}
+
+histogram& registry::get_histogram( const std::string& name, const std::string& help, const labels_t& labels )
+{
+  std::lock_guard< std::mutex > guard( _mutex );
+  histogram_family& family = _histograms[ name ];
+  if( family.help.empty() )
+    family.help = help;
+  std::unique_ptr< histogram >& h = family.histograms[ labels ];
+  if( !h )
+    h.reset( new histogram() );
+  return *h;
+}
+
+void registry::add_collector( const std::string& name, collector c )
+{
+  std::lock_guard< std::mutex > guard( _mutex );
+  _collectors[ name ] = std::move( c );
+}
+
+void registry::remove_collector( const std::string& name )
+{
+  std::lock_guard< std::mutex > guard( _mutex );
+  _collectors.erase( name );
+}
+
+std::string registry::scrape()
+{
+  text_writer writer;
+  std::vector< collector > collectors;
+  {
+    std::lock_guard< std::mutex > guard( _mutex );
+    for( const auto& family : _histograms )
+      for( const auto& h : family.second.histograms )
+        writer.write_histogram( family.first, family.second.help, *h.second, h.first );
+    for( const auto& c : _collectors )
+      collectors.push_back( c.second );
+  }
+
+  for( const collector& c : collectors )
+    c( writer );
+
+  return writer.str();
+}
+
+} } } // hive::utilities::metrics
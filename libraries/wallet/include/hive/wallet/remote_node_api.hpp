@@ -1,5 +1,9 @@
 #pragma once
 #include <hive/plugins/condenser_api/condenser_api.hpp>
+#include <hive/plugins/json_rpc/json_rpc_plugin.hpp>
+
+#include <fc/network/http/connection.hpp>
+#include <fc/network/ip.hpp>
 
 namespace hive { namespace wallet {
 
@@ -96,6 +100,34 @@ struct remote_node_api
   vector< database_api::api_recurrent_transfer_object > find_recurrent_transfers( const account_name_type& );
 };
 
+/**
+  * Client of binary RPC (see json_rpc_plugin::call_binary) for bulk readers of blocks and operations.
+  * Talks to webserver http endpoint, arguments and results are fc::raw packed instead of JSON.
+  * Only APIs registered with JSON_RPC_REGISTER_BINARY_API can be called.
+  */
+class binary_remote_node_api
+{
+  public:
+    binary_remote_node_api( const fc::ip::endpoint& server );
+
+    block_api::get_block_range_return get_block_range( const block_api::get_block_range_args& args );
+    account_history::enum_virtual_ops_return enum_virtual_ops( const account_history::enum_virtual_ops_args& args );
+
+    template< typename Return, typename Args >
+    Return call( const string& api, const string& method, const Args& args )
+    {
+      return fc::raw::unpack_from_vector< Return >( call_raw( api, method, fc::raw::pack_to_vector( args ) ) );
+    }
+
+    /// sends packed args, returns packed result or throws when server reported an error
+    std::vector< char > call_raw( const string& api, const string& method, const std::vector< char >& args );
+
+  private:
+    std::string                             _url;
+    std::unique_ptr< fc::http::connection > _connection;
+    uint64_t                                _next_id = 0;
+};
+
 } }
 
 FC_API( hive::wallet::remote_node_api,
@@ -437,4 +437,39 @@ vector< database_api::api_recurrent_transfer_object > remote_node_api::find_recu
   FC_ASSERT( false );
 }
 
+binary_remote_node_api::binary_remote_node_api( const fc::ip::endpoint& server )
+  : _url( "http://" + std::string( server ) + "/" ), _connection( new fc::http::connection() )
+{
+  _connection->connect_to( server );
+}
+
+block_api::get_block_range_return binary_remote_node_api::get_block_range( const block_api::get_block_range_args& args )
+{
+  return call< block_api::get_block_range_return >( "block_api", "get_block_range", args );
+}
+
+account_history::enum_virtual_ops_return binary_remote_node_api::enum_virtual_ops( const account_history::enum_virtual_ops_args& args )
+{
+  return call< account_history::enum_virtual_ops_return >( "account_history_api", "enum_virtual_ops", args );
+}
+
+std::vector< char > binary_remote_node_api::call_raw( const string& api, const string& method, const std::vector< char >& args )
+{
+  json_rpc::binary_rpc_request request;
+  request.id = _next_id++;
+  request.api = api;
+  request.method = method;
+  request.args = args;
+
+  std::vector< char > body = fc::raw::pack_to_vector( request );
+  fc::http::reply reply = _connection->request( "POST", _url, std::string( body.begin(), body.end() ),
+    { fc::http::header( "Content-Type", "application/octet-stream" ) } );
+  FC_ASSERT( reply.status == fc::http::reply::OK, "Binary API call failed with http status ${s}", ("s", reply.status) );
+
+  auto response = fc::raw::unpack_from_vector< json_rpc::binary_rpc_response >( reply.body );
+  FC_ASSERT( response.id == request.id, "Binary API response does not match request" );
+  FC_ASSERT( response.code == 0, "${api}.${method} failed: ${m}", (api)(method)("m", response.message) );
+  return std::move( response.result );
+}
+
 } }
@@ -0,0 +1,437 @@
+#if defined IS_TEST_NET
+#include <boost/test/unit_test.hpp>
+
+#include <hive/chain/account_object.hpp>
+#include <hive/protocol/hive_operations.hpp>
+
+#include <hive/plugins/account_history_api/account_history_api_plugin.hpp>
+#include <hive/plugins/account_history_api/account_history_api.hpp>
+#include <hive/plugins/account_history_rocksdb/account_history_rocksdb_plugin.hpp>
+#include <hive/plugins/debug_node/debug_node_plugin.hpp>
+
+#include <hive/utilities/tempdir.hpp>
+
+#include <fc/filesystem.hpp>
+#include <fc/io/raw.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <string>
+#include <tuple>
+
+#include "../db_fixture/database_fixture.hpp"
+
+using namespace hive::chain;
+using namespace hive::protocol;
+using hive::plugins::account_history_rocksdb::account_history_rocksdb_plugin;
+using hive::plugins::account_history_rocksdb::operation_type_filter;
+using hive::plugins::account_history_rocksdb::rocksdb_operation_object;
+using hive::plugins::account_history::enum_vops_filter;
+using hive::plugins::account_history::detail::build_operation_type_filter;
+
+namespace
+{
+
+/// Sequence number, block, trx_in_block, op_in_trx and body of AH entry - everything but operation id.
+typedef std::tuple< unsigned int, uint32_t, uint32_t, uint32_t, std::vector< char > > ah_entry;
+/// Block, operation id and body of virtual operation.
+typedef std::tuple< uint32_t, uint64_t, std::vector< char > > vop_entry;
+
+account_history_rocksdb_plugin& init_account_history( database_fixture& fixture, const fc::path& storage )
+{
+  appbase::app().register_plugin< account_history_rocksdb_plugin >();
+  fixture.db_plugin = &appbase::app().register_plugin< hive::plugins::debug_node::debug_node_plugin >();
+  fixture.init_account_pub_key = fixture.init_account_priv_key.get_public_key();
+
+  const std::string storage_name = storage.string();
+  int test_argc = 3;
+  const char* test_argv[] = { boost::unit_test::framework::master_test_suite().argv[0],
+                      "--account-history-rocksdb-path",
+                      storage_name.c_str() };
+
+  fixture.db_plugin->logging = false;
+  appbase::app().initialize<
+    account_history_rocksdb_plugin,
+    hive::plugins::debug_node::debug_node_plugin >( test_argc, (char**)test_argv );
+
+  fixture.db = &appbase::app().get_plugin< hive::plugins::chain::chain_plugin >().db();
+  BOOST_REQUIRE( fixture.db );
+  fixture.open_database();
+
+  return appbase::app().get_plugin< account_history_rocksdb_plugin >();
+}
+
+/// Newest entries first; `accept` allows to reject some entries, like API does for entries it can't return.
+std::vector< ah_entry > get_history( const account_history_rocksdb_plugin& ah, const account_name_type& name,
+  const operation_type_filter* filter = nullptr, uint64_t start = std::numeric_limits< uint32_t >::max(),
+  uint32_t limit = 1000, std::function< bool( unsigned int ) > accept = std::function< bool( unsigned int ) >() )
+{
+  std::vector< ah_entry > result;
+  auto processor = [&result, &accept]( unsigned int sequence, const rocksdb_operation_object& op ) -> bool
+  {
+    if( accept && accept( sequence ) == false )
+      return false;
+    result.emplace_back( sequence, op.block, op.trx_in_block, op.op_in_trx,
+      std::vector< char >( op.serialized_op.begin(), op.serialized_op.end() ) );
+    return true;
+  };
+
+  if( filter != nullptr )
+    ah.find_account_history_data( name, start, limit, true, *filter, processor );
+  else
+    ah.find_account_history_data( name, start, limit, true, processor );
+  return result;
+}
+
+/// Irreversible virtual operations of blocks in range [begin, end), in block order.
+std::vector< vop_entry > get_virtual_ops( const account_history_rocksdb_plugin& ah, uint32_t begin, uint32_t end,
+  fc::optional< operation_type_filter > filter = fc::optional< operation_type_filter >() )
+{
+  std::vector< vop_entry > result;
+  ah.enum_operations_from_block_range( begin, end, false, fc::optional< uint64_t >(), fc::optional< uint32_t >(), filter,
+    [&result]( const rocksdb_operation_object& op, uint64_t operation_id, bool irreversible ) -> bool
+    {
+      BOOST_REQUIRE( irreversible );
+      result.emplace_back( op.block, operation_id, std::vector< char >( op.serialized_op.begin(), op.serialized_op.end() ) );
+      return true;
+    } );
+  return result;
+}
+
+uint32_t get_op_type( const ah_entry& entry )
+{
+  return fc::raw::unpack_from_vector< operation >( std::get<4>( entry ), 0 ).which();
+}
+
+operation_type_filter make_filter( uint32_t op_type )
+{
+  operation_type_filter filter;
+  if( op_type < 64 )
+    filter.low = UINT64_C( 1 ) << op_type;
+  else
+    filter.high = UINT64_C( 1 ) << ( op_type - 64 );
+  return filter;
+}
+
+std::vector< ah_entry > filter_history( const std::vector< ah_entry >& history, uint32_t op_type )
+{
+  std::vector< ah_entry > result;
+  for( const auto& entry : history )
+  {
+    if( get_op_type( entry ) == op_type )
+      result.push_back( entry );
+  }
+  return result;
+}
+
+void make_irreversible( database_fixture& fixture, uint32_t block_num )
+{
+  for( uint32_t i = 0; i < 2 * HIVE_MAX_WITNESSES && fixture.db->get_last_irreversible_block_num() < block_num; ++i )
+    fixture.generate_block();
+  BOOST_REQUIRE( fixture.db->get_last_irreversible_block_num() >= block_num );
+}
+
+/// Pushes transfers (every third) and vesting operations of given account, each in its own transaction.
+void push_history_ops( database_fixture& fixture, const std::string& name, const fc::ecc::private_key& key,
+  uint32_t count )
+{
+  for( uint32_t i = 0; i < count; ++i )
+  {
+    signed_transaction tx;
+    if( i % 3 == 0 )
+    {
+      transfer_operation op;
+      op.from = name;
+      op.to = HIVE_INIT_MINER_NAME;
+      op.amount = asset( i + 1, HIVE_SYMBOL );
+      tx.operations.push_back( op );
+    }
+    else
+    {
+      transfer_to_vesting_operation op;
+      op.from = name;
+      op.amount = asset( i + 1, HIVE_SYMBOL );
+      tx.operations.push_back( op );
+    }
+    tx.set_expiration( fixture.db->head_block_time() + HIVE_MAX_TIME_UNTIL_EXPIRATION );
+    fixture.sign( tx, key );
+    fixture.db->push_transaction( tx, 0 );
+  }
+  fixture.generate_block();
+}
+
+/// Starts plugin and gives alice history of `op_count` operations (plus creation and funding), all written to storage.
+fc::ecc::private_key prepare_history( database_fixture& fixture, account_history_rocksdb_plugin& ah, uint32_t op_count )
+{
+  ah.plugin_startup();
+
+  fixture.generate_block();
+  fixture.db->set_hardfork( HIVE_NUM_HARDFORKS );
+  fixture.generate_block();
+
+  ACTORS_EXT( fixture, (alice) );
+  fixture.fund( "alice", ASSET( "100.000 TESTS" ) );
+  push_history_ops( fixture, "alice", alice_private_key, op_count );
+
+  make_irreversible( fixture, fixture.db->head_block_num() );
+  ah.wait_for_background_writer();
+  return alice_private_key;
+}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE( account_history_rocksdb, database_fixture );
+
+BOOST_AUTO_TEST_CASE( background_writer_test )
+{
+  try
+  {
+    fc::temp_directory storage_dir( hive::utilities::temp_directory_path() );
+    account_history_rocksdb_plugin& ah = init_account_history( *this, storage_dir.path() / "account-history" );
+    // starts background writer
+    ah.plugin_startup();
+
+    generate_block();
+    db->set_hardfork( HIVE_NUM_HARDFORKS );
+    generate_block();
+
+    ACTORS( (alice)(bob) );
+    fund( "alice", ASSET( "100.000 TESTS" ) );
+    generate_block();
+
+    make_irreversible( *this, db->head_block_num() );
+    ah.wait_for_background_writer();
+    BOOST_REQUIRE_EQUAL( ah.get_staged_block_count(), 0u );
+    const auto stored_history = get_history( ah, "alice" );
+    BOOST_REQUIRE( stored_history.empty() == false );
+
+    BOOST_TEST_MESSAGE( "--- Operations of irreversible blocks waiting for writer are visible" );
+    ah.pause_background_writer( true );
+
+    transfer_operation op;
+    op.from = "alice";
+    op.to = "bob";
+    op.amount = ASSET( "1.000 TESTS" );
+    signed_transaction tx;
+    tx.operations.push_back( op );
+    tx.set_expiration( db->head_block_time() + HIVE_MAX_TIME_UNTIL_EXPIRATION );
+    sign( tx, alice_private_key );
+    db->push_transaction( tx, 0 );
+    generate_block();
+    const uint32_t trx_block = db->head_block_num();
+
+    make_irreversible( *this, trx_block );
+    BOOST_REQUIRE( ah.get_staged_block_count() > 0 );
+
+    uint32_t block_num = 0;
+    uint32_t trx_in_block = 0;
+    BOOST_REQUIRE( ah.find_transaction_info( tx.id(), false, &block_num, &trx_in_block ) );
+    BOOST_REQUIRE_EQUAL( block_num, trx_block );
+    BOOST_REQUIRE_EQUAL( trx_in_block, 0u );
+
+    operation_type_filter transfers = make_filter( operation::tag< transfer_operation >::value );
+
+    const auto staged_history = get_history( ah, "alice" );
+    const auto staged_transfers = get_history( ah, "alice", &transfers );
+    BOOST_REQUIRE_EQUAL( staged_history.size(), stored_history.size() + 1 );
+    // newest first, numbered right after stored entries
+    BOOST_REQUIRE_EQUAL( std::get<0>( staged_history.front() ), std::get<0>( stored_history.front() ) + 1 );
+    BOOST_REQUIRE_EQUAL( std::get<1>( staged_history.front() ), trx_block );
+    BOOST_REQUIRE( std::equal( stored_history.begin(), stored_history.end(), staged_history.begin() + 1 ) );
+    BOOST_REQUIRE_EQUAL( staged_transfers.size(), 1u );
+    BOOST_REQUIRE( staged_transfers.front() == staged_history.front() );
+
+    BOOST_TEST_MESSAGE( "--- Written operations are reported the same way" );
+    ah.pause_background_writer( false );
+    ah.wait_for_background_writer();
+    BOOST_REQUIRE_EQUAL( ah.get_staged_block_count(), 0u );
+
+    BOOST_REQUIRE( get_history( ah, "alice" ) == staged_history );
+    BOOST_REQUIRE( get_history( ah, "alice", &transfers ) == staged_transfers );
+    block_num = trx_in_block = 0;
+    BOOST_REQUIRE( ah.find_transaction_info( tx.id(), false, &block_num, &trx_in_block ) );
+    BOOST_REQUIRE_EQUAL( block_num, trx_block );
+    BOOST_REQUIRE_EQUAL( trx_in_block, 0u );
+
+    ah.plugin_shutdown();
+  }
+  FC_LOG_AND_RETHROW()
+}
+
+BOOST_AUTO_TEST_CASE( filtered_history_test )
+{
+  try
+  {
+    fc::temp_directory storage_dir( hive::utilities::temp_directory_path() );
+    account_history_rocksdb_plugin& ah = init_account_history( *this, storage_dir.path() / "account-history" );
+    prepare_history( *this, ah, 30 );
+
+    const uint32_t transfer_type = operation::tag< transfer_operation >::value;
+    const operation_type_filter transfers = make_filter( transfer_type );
+    const auto history = get_history( ah, "alice" );
+    const auto expected = filter_history( history, transfer_type );
+    BOOST_REQUIRE_GE( expected.size(), 10u );
+    BOOST_REQUIRE_LT( expected.size(), history.size() );
+
+    BOOST_TEST_MESSAGE( "--- Filtered history holds the same entries as filtered full history" );
+    BOOST_REQUIRE( get_history( ah, "alice", &transfers ) == expected );
+
+    BOOST_TEST_MESSAGE( "--- Operations are loaded in batches not exceeding limit" );
+    for( uint32_t limit : { 1u, 3u, 7u } )
+    {
+      const auto limited = get_history( ah, "alice", &transfers, std::numeric_limits< uint32_t >::max(), limit );
+      BOOST_REQUIRE( limited == std::vector< ah_entry >( expected.begin(), expected.begin() + limit ) );
+    }
+
+    BOOST_TEST_MESSAGE( "--- Lookup starts at given sequence" );
+    const auto from_middle = get_history( ah, "alice", &transfers, std::get<0>( expected[4] ) );
+    BOOST_REQUIRE( from_middle == std::vector< ah_entry >( expected.begin() + 4, expected.end() ) );
+
+    BOOST_TEST_MESSAGE( "--- Entries rejected by processor don't count to limit" );
+    unsigned int newest = std::get<0>( expected[0] );
+    const auto accepted = get_history( ah, "alice", &transfers, std::numeric_limits< uint32_t >::max(), 3,
+      [&expected]( unsigned int sequence )
+      {
+        return sequence == std::get<0>( expected[0] ) || sequence == std::get<0>( expected[2] ) ||
+          sequence == std::get<0>( expected[4] );
+      } );
+    BOOST_REQUIRE_EQUAL( accepted.size(), 3u );
+    BOOST_REQUIRE_EQUAL( std::get<0>( accepted[0] ), newest );
+    BOOST_REQUIRE( accepted[1] == expected[2] );
+    BOOST_REQUIRE( accepted[2] == expected[4] );
+
+    ah.plugin_shutdown();
+  }
+  FC_LOG_AND_RETHROW()
+}
+
+BOOST_AUTO_TEST_CASE( filter_scan_limit_test )
+{
+  try
+  {
+    fc::temp_directory storage_dir( hive::utilities::temp_directory_path() );
+    account_history_rocksdb_plugin& ah = init_account_history( *this, storage_dir.path() / "account-history" );
+    prepare_history( *this, ah, 30 );
+    ah.set_filter_scan_limit( 10 );
+
+    const auto history = get_history( ah, "alice" );
+    BOOST_REQUIRE_GT( history.size(), 20u );
+    const operation_type_filter votes = make_filter( operation::tag< vote_operation >::value );
+    const operation_type_filter transfers = make_filter( operation::tag< transfer_operation >::value );
+
+    BOOST_TEST_MESSAGE( "--- Limit reached before scan limit" );
+    BOOST_REQUIRE_EQUAL( get_history( ah, "alice", &transfers, std::numeric_limits< uint32_t >::max(), 2 ).size(), 2u );
+
+    BOOST_TEST_MESSAGE( "--- Scan stops after scan limit, telling where to continue" );
+    auto require_scan_stop = [&]( uint64_t start, unsigned int next )
+    {
+      try
+      {
+        get_history( ah, "alice", &votes, start );
+        BOOST_FAIL( "Scan of account history should be stopped" );
+      }
+      catch( const fc::assert_exception& e )
+      {
+        BOOST_REQUIRE( e.to_detail_string().find( "start=" + std::to_string( next ) ) != std::string::npos );
+      }
+    };
+    require_scan_stop( std::numeric_limits< uint32_t >::max(), std::get<0>( history[10] ) );
+    require_scan_stop( std::get<0>( history[10] ), std::get<0>( history[20] ) );
+    HIVE_REQUIRE_THROW( get_history( ah, "alice", &transfers ), fc::assert_exception );
+
+    BOOST_TEST_MESSAGE( "--- Scan within limit ends normally" );
+    const unsigned int last_start = std::get<0>( history[ history.size() - 5 ] );
+    BOOST_REQUIRE( get_history( ah, "alice", &votes, last_start ).empty() );
+
+    ah.plugin_shutdown();
+  }
+  FC_LOG_AND_RETHROW()
+}
+
+BOOST_AUTO_TEST_CASE( v0_store_test )
+{
+  try
+  {
+    fc::temp_directory storage_dir( hive::utilities::temp_directory_path() );
+    account_history_rocksdb_plugin& ah = init_account_history( *this, storage_dir.path() / "account-history" );
+    fc::ecc::private_key alice_private_key = prepare_history( *this, ah, 30 );
+
+    const uint32_t transfer_type = operation::tag< transfer_operation >::value;
+    const operation_type_filter transfers = make_filter( transfer_type );
+    const auto history = get_history( ah, "alice" );
+    const auto filtered = get_history( ah, "alice", &transfers );
+    const auto limited = get_history( ah, "alice", &transfers, std::numeric_limits< uint32_t >::max(), 3 );
+
+    BOOST_TEST_MESSAGE( "--- Entries without operation type are read from store of version 0" );
+    ah.rewrite_store_as_version( 0 );
+    BOOST_REQUIRE( get_history( ah, "alice" ) == history );
+    BOOST_REQUIRE( get_history( ah, "alice", &transfers ) == filtered );
+    BOOST_REQUIRE( get_history( ah, "alice", &transfers, std::numeric_limits< uint32_t >::max(), 3 ) == limited );
+
+    BOOST_TEST_MESSAGE( "--- New entries are mixed with old ones" );
+    push_history_ops( *this, "alice", alice_private_key, 9 );
+    make_irreversible( *this, db->head_block_num() );
+    ah.wait_for_background_writer();
+
+    const auto new_history = get_history( ah, "alice" );
+    BOOST_REQUIRE_GT( new_history.size(), history.size() );
+    BOOST_REQUIRE( std::equal( history.begin(), history.end(), new_history.end() - history.size() ) );
+    BOOST_REQUIRE( get_history( ah, "alice", &transfers ) == filter_history( new_history, transfer_type ) );
+
+    ah.plugin_shutdown();
+  }
+  FC_LOG_AND_RETHROW()
+}
+
+BOOST_AUTO_TEST_CASE( virtual_ops_upgrade_test )
+{
+  try
+  {
+    fc::temp_directory storage_dir( hive::utilities::temp_directory_path() );
+    account_history_rocksdb_plugin& ah = init_account_history( *this, storage_dir.path() / "account-history" );
+    prepare_history( *this, ah, 30 );
+
+    const uint32_t end = db->get_last_irreversible_block_num() + 1;
+    const uint32_t completed_type = operation::tag< transfer_to_vesting_completed_operation >::value;
+    const uint32_t producer_type = operation::tag< producer_reward_operation >::value;
+
+    BOOST_TEST_MESSAGE( "--- Type filter built from API filter accepts only selected virtual operations" );
+    const operation_type_filter completed = build_operation_type_filter( enum_vops_filter::transfer_to_vesting_completed_operation );
+    BOOST_REQUIRE( completed.accepts( completed_type ) );
+    BOOST_REQUIRE( completed.accepts( producer_type ) == false );
+    BOOST_REQUIRE( completed.accepts( operation::tag< transfer_to_vesting_operation >::value ) == false );
+    const operation_type_filter rewards = build_operation_type_filter(
+      enum_vops_filter::transfer_to_vesting_completed_operation | enum_vops_filter::producer_reward_operation );
+    BOOST_REQUIRE( rewards.accepts( completed_type ) && rewards.accepts( producer_type ) );
+    BOOST_REQUIRE( rewards.accepts( operation::tag< fill_recurrent_transfer_operation >::value ) == false );
+    const operation_type_filter high = build_operation_type_filter( enum_vops_filter::failed_recurrent_transfer_operation );
+    BOOST_REQUIRE( high.accepts( operation::tag< failed_recurrent_transfer_operation >::value ) );
+    BOOST_REQUIRE_EQUAL( high.accepts( completed_type ), false );
+
+    const auto all_vops = get_virtual_ops( ah, 1, end );
+    const auto completed_vops = get_virtual_ops( ah, 1, end, completed );
+    BOOST_REQUIRE_GE( completed_vops.size(), 20u );
+    BOOST_REQUIRE_LT( completed_vops.size(), all_vops.size() );
+    for( const auto& entry : completed_vops )
+      BOOST_REQUIRE_EQUAL( fc::raw::unpack_from_vector< operation >( std::get<2>( entry ), 0 ).which(), completed_type );
+
+    const uint32_t ops_block = std::get<0>( completed_vops.front() );
+    const auto block_vops = get_virtual_ops( ah, ops_block, ops_block + 1 );
+
+    BOOST_TEST_MESSAGE( "--- Store of version 1 gets virtual operations index filled during upgrade" );
+    ah.rewrite_store_as_version( 1 );
+    BOOST_REQUIRE( get_virtual_ops( ah, 1, end ) == all_vops );
+    BOOST_REQUIRE( get_virtual_ops( ah, 1, end, completed ) == completed_vops );
+    BOOST_REQUIRE( get_virtual_ops( ah, ops_block, ops_block + 1 ) == block_vops );
+    BOOST_REQUIRE( get_virtual_ops( ah, 1, end, rewards ).size() >= completed_vops.size() );
+    for( const auto& entry : block_vops )
+      BOOST_REQUIRE_EQUAL( std::get<0>( entry ), ops_block );
+
+    ah.plugin_shutdown();
+  }
+  FC_LOG_AND_RETHROW()
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+#endif
@@ -0,0 +1,413 @@
+#if defined IS_TEST_NET
+#include <boost/test/unit_test.hpp>
+
+#include <hive/plugins/block_data_export/block_data_export_plugin.hpp>
+#include <hive/plugins/block_data_export/columnar_export.hpp>
+#include <hive/plugins/block_data_export/exportable_block_data.hpp>
+#include <hive/plugins/debug_node/debug_node_plugin.hpp>
+
+#include <hive/utilities/tempdir.hpp>
+
+#include <fc/container/flat.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/io/raw.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../db_fixture/database_fixture.hpp"
+
+using namespace hive::chain;
+using namespace hive::protocol;
+using hive::plugins::block_data_export::block_data_export_plugin;
+using hive::plugins::block_data_export::column_chunk;
+using hive::plugins::block_data_export::exportable_block_data;
+using hive::plugins::block_data_export::row_group;
+
+namespace
+{
+
+/// Export data that can't be encoded
+class failing_export_data : public exportable_block_data
+{
+  public:
+    virtual void to_variant( fc::variant& v )const override
+    {
+      FC_ASSERT( false, "failing_export_data can't be exported" );
+    }
+};
+
+struct exported_block
+{
+  block_id_type block_id;
+  block_id_type previous;
+};
+
+block_data_export_plugin& init_export( database_fixture& fixture, const std::vector< std::string >& options )
+{
+  appbase::app().register_plugin< block_data_export_plugin >();
+  fixture.db_plugin = &appbase::app().register_plugin< hive::plugins::debug_node::debug_node_plugin >();
+  fixture.init_account_pub_key = fixture.init_account_priv_key.get_public_key();
+
+  std::vector< const char* > test_argv = { boost::unit_test::framework::master_test_suite().argv[0] };
+  for( const std::string& option : options )
+    test_argv.push_back( option.c_str() );
+
+  fixture.db_plugin->logging = false;
+  appbase::app().initialize<
+    block_data_export_plugin,
+    hive::plugins::debug_node::debug_node_plugin >( test_argv.size(), (char**)test_argv.data() );
+
+  fixture.db = &appbase::app().get_plugin< hive::plugins::chain::chain_plugin >().db();
+  BOOST_REQUIRE( fixture.db );
+  fixture.open_database();
+
+  return appbase::app().get_plugin< block_data_export_plugin >();
+}
+
+block_data_export_plugin& init_binary_export( database_fixture& fixture, const fc::path& output )
+{
+  return init_export( fixture, { "--block-data-export-file", output.string(), "--block-data-export-format", "binary" } );
+}
+
+block_data_export_plugin& init_columnar_export( database_fixture& fixture, const fc::path& directory, uint32_t rows_per_group )
+{
+  return init_export( fixture, { "--block-data-export-columnar-dir", directory.string(),
+    "--block-data-export-columnar-rows-per-group", std::to_string( rows_per_group ) } );
+}
+
+std::vector< char > read_file( const fc::path& path )
+{
+  BOOST_REQUIRE( fc::exists( path ) );
+  std::ifstream file( path.string(), std::ios::binary );
+  return std::vector< char >( ( std::istreambuf_iterator< char >( file ) ), std::istreambuf_iterator< char >() );
+}
+
+/// Values of all rows of single column, each one as bytes it is encoded with.
+struct exported_column
+{
+  uint8_t                               encoding = 0;
+  std::vector< std::vector< char > >    rows;
+};
+
+struct exported_table
+{
+  std::vector< std::string >                  column_names;
+  std::map< std::string, exported_column >    columns;
+  uint32_t                                    rows = 0;
+  uint32_t                                    row_groups = 0;
+};
+
+/// Reads all row groups of columnar export file, checking every group has the same layout.
+exported_table read_columns( const fc::path& path )
+{
+  using namespace hive::plugins::block_data_export;
+
+  std::vector< char > data = read_file( path );
+  fc::datastream< const char* > ds( data.data(), data.size() );
+  exported_table result;
+  while( ds.remaining() > 0 )
+  {
+    row_group group;
+    fc::raw::unpack( ds, group );
+    BOOST_REQUIRE_GT( group.rows, 0u );
+
+    if( result.column_names.empty() )
+    {
+      for( const column_chunk& chunk : group.columns )
+        result.column_names.push_back( chunk.name );
+    }
+    BOOST_REQUIRE_EQUAL( group.columns.size(), result.column_names.size() );
+
+    for( size_t i = 0; i < group.columns.size(); ++i )
+    {
+      const column_chunk& chunk = group.columns[i];
+      BOOST_REQUIRE_EQUAL( chunk.name, result.column_names[i] );
+      exported_column& column = result.columns[ chunk.name ];
+      column.encoding = chunk.encoding;
+
+      if( chunk.encoding == packed_encoding )
+      {
+        const size_t offsets_size = group.rows * sizeof( uint32_t );
+        BOOST_REQUIRE_GE( chunk.data.size(), offsets_size );
+        const char* values = chunk.data.data() + offsets_size;
+        uint32_t begin = 0;
+        for( uint32_t row = 0; row < group.rows; ++row )
+        {
+          uint32_t end = 0;
+          std::memcpy( &end, chunk.data.data() + row * sizeof( uint32_t ), sizeof( end ) );
+          BOOST_REQUIRE( begin <= end && end <= chunk.data.size() - offsets_size );
+          column.rows.emplace_back( values + begin, values + end );
+          begin = end;
+        }
+        BOOST_REQUIRE_EQUAL( begin, chunk.data.size() - offsets_size );
+      }
+      else
+      {
+        const size_t width = ( chunk.encoding == uint64_le_encoding || chunk.encoding == int64_le_encoding ) ? 8 : 4;
+        BOOST_REQUIRE_EQUAL( chunk.data.size(), group.rows * width );
+        for( uint32_t row = 0; row < group.rows; ++row )
+          column.rows.emplace_back( chunk.data.begin() + row * width, chunk.data.begin() + ( row + 1 ) * width );
+      }
+    }
+
+    result.rows += group.rows;
+    ++result.row_groups;
+  }
+  return result;
+}
+
+uint32_t get_uint32( const exported_table& table, const std::string& column, uint32_t row )
+{
+  const std::vector< char >& value = table.columns.at( column ).rows.at( row );
+  BOOST_REQUIRE_EQUAL( value.size(), sizeof( uint32_t ) );
+  uint32_t result = 0;
+  std::memcpy( &result, value.data(), sizeof( result ) );
+  return result;
+}
+
+template< typename T >
+T get_packed( const exported_table& table, const std::string& column, uint32_t row )
+{
+  BOOST_REQUIRE_EQUAL( table.columns.at( column ).encoding, hive::plugins::block_data_export::packed_encoding );
+  return fc::raw::unpack_from_vector< T >( table.columns.at( column ).rows.at( row ), 0 );
+}
+
+std::vector< std::string > read_dictionary( const fc::path& path )
+{
+  std::vector< char > data = read_file( path );
+  fc::datastream< const char* > ds( data.data(), data.size() );
+  std::vector< std::string > result;
+  while( ds.remaining() > 0 )
+  {
+    std::string name;
+    fc::raw::unpack( ds, name );
+    result.push_back( name );
+  }
+  return result;
+}
+
+/// Reads records of binary export and checks they start at offsets from index file.
+std::vector< exported_block > read_binary_export( const fc::path& output )
+{
+  std::ifstream output_file( output.string(), std::ios::binary );
+  std::vector< char > data( ( std::istreambuf_iterator< char >( output_file ) ), std::istreambuf_iterator< char >() );
+  std::ifstream index_file( output.string() + ".index", std::ios::binary );
+  std::vector< char > index( ( std::istreambuf_iterator< char >( index_file ) ), std::istreambuf_iterator< char >() );
+  BOOST_REQUIRE_EQUAL( index.size() % sizeof( uint64_t ), 0u );
+
+  std::vector< exported_block > result;
+  fc::datastream< const char* > index_ds( index.data(), index.size() );
+  uint64_t position = 0;
+  while( position < data.size() )
+  {
+    uint64_t offset = 0;
+    BOOST_REQUIRE( index_ds.remaining() >= sizeof( offset ) );
+    fc::raw::unpack( index_ds, offset );
+    BOOST_REQUIRE_EQUAL( offset, position );
+
+    fc::datastream< const char* > ds( data.data() + position, data.size() - position );
+    uint32_t size = 0;
+    fc::raw::unpack( ds, size );
+    BOOST_REQUIRE( ds.remaining() >= size );
+
+    fc::datastream< const char* > record_ds( data.data() + position + sizeof( size ), size );
+    exported_block block;
+    boost::container::flat_map< std::string, std::vector< char > > export_data;
+    fc::raw::unpack( record_ds, block.block_id );
+    fc::raw::unpack( record_ds, block.previous );
+    fc::raw::unpack( record_ds, export_data );
+    BOOST_REQUIRE_EQUAL( record_ds.remaining(), 0u );
+    BOOST_REQUIRE( export_data.empty() );
+
+    result.push_back( block );
+    position += sizeof( size ) + size;
+  }
+  BOOST_REQUIRE_EQUAL( index_ds.remaining(), 0u );
+  return result;
+}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE( block_data_export, database_fixture );
+
+BOOST_AUTO_TEST_CASE( binary_format_test )
+{
+  try
+  {
+    fc::temp_directory output_dir( hive::utilities::temp_directory_path() );
+    fc::path output = output_dir.path() / "export.bin";
+    block_data_export_plugin& export_plugin = init_binary_export( *this, output );
+
+    generate_blocks( 10 );
+    // waits until all blocks are written
+    export_plugin.plugin_shutdown();
+
+    BOOST_TEST_MESSAGE( "--- Every applied block is exported in order, with its offset in index" );
+    std::vector< exported_block > blocks = read_binary_export( output );
+    BOOST_REQUIRE_EQUAL( blocks.size(), db->head_block_num() );
+    for( uint32_t i = 0; i < blocks.size(); ++i )
+    {
+      auto block = db->fetch_block_by_number( i + 1 );
+      BOOST_REQUIRE( block.valid() );
+      BOOST_REQUIRE( blocks[i].block_id == block->id() );
+      BOOST_REQUIRE( blocks[i].previous == block->previous );
+    }
+  }
+  FC_LOG_AND_RETHROW()
+}
+
+BOOST_AUTO_TEST_CASE( encoding_failure_test )
+{
+  try
+  {
+    fc::temp_directory output_dir( hive::utilities::temp_directory_path() );
+    fc::path output = output_dir.path() / "export.bin";
+    block_data_export_plugin& export_plugin = init_binary_export( *this, output );
+
+    generate_blocks( 3 );
+    export_plugin.register_export_data_type< failing_export_data >( "failing" );
+    // export fails, but block processing goes on
+    generate_blocks( 3 );
+    BOOST_REQUIRE_EQUAL( db->head_block_num(), 6u );
+    export_plugin.plugin_shutdown();
+
+    BOOST_TEST_MESSAGE( "--- Export stops before block that failed to encode" );
+    std::vector< exported_block > blocks = read_binary_export( output );
+    BOOST_REQUIRE_EQUAL( blocks.size(), 3u );
+    BOOST_REQUIRE( blocks.back().block_id == db->fetch_block_by_number( 3 )->id() );
+  }
+  FC_LOG_AND_RETHROW()
+}
+
+BOOST_AUTO_TEST_CASE( columnar_format_test )
+{
+  try
+  {
+    fc::temp_directory output_dir( hive::utilities::temp_directory_path() );
+    fc::path columns_dir = output_dir.path() / "columns";
+    block_data_export_plugin& export_plugin = init_columnar_export( *this, columns_dir, 4 );
+
+    generate_block();
+    db->set_hardfork( HIVE_NUM_HARDFORKS );
+    generate_block();
+
+    ACTORS( (alice)(bob)(carol) );
+    fund( "alice", ASSET( "10.000 TESTS" ) );
+    generate_block();
+
+    auto push_transfer = [&]( const std::string& to )
+    {
+      transfer_operation op;
+      op.from = "alice";
+      op.to = to;
+      op.amount = ASSET( "10.000 TESTS" );
+      signed_transaction tx;
+      tx.operations.push_back( op );
+      tx.set_expiration( db->head_block_time() + HIVE_MAX_TIME_UNTIL_EXPIRATION );
+      sign( tx, alice_private_key );
+      db->push_transaction( tx, 0 );
+    };
+
+    push_transfer( "bob" );
+    generate_block();
+    const uint32_t fork_block = db->head_block_num();
+    const block_id_type abandoned_id = db->head_block_id();
+    BOOST_REQUIRE_LT( db->get_last_irreversible_block_num(), fork_block );
+
+    // switch_forks() does the same: pops blocks of old fork and applies blocks of the new one.
+    // Transfer to bob can't be applied again, since alice has no funds left.
+    db->pop_block();
+    push_transfer( "carol" );
+    generate_block();
+    BOOST_REQUIRE_EQUAL( db->head_block_num(), fork_block );
+    BOOST_REQUIRE( db->head_block_id() != abandoned_id );
+
+    for( uint32_t i = 0; i < 2 * HIVE_MAX_WITNESSES && db->get_last_irreversible_block_num() < fork_block; ++i )
+      generate_block();
+    BOOST_REQUIRE_GE( db->get_last_irreversible_block_num(), fork_block );
+    // writes remaining rows, including ones of blocks still reversible
+    export_plugin.plugin_shutdown();
+
+    BOOST_TEST_MESSAGE( "--- Every block of current fork is written in order" );
+    exported_table blocks = read_columns( columns_dir / "blocks.columns" );
+    BOOST_REQUIRE( blocks.column_names == std::vector< std::string >( { "block_num", "block_id", "previous", "timestamp" } ) );
+    BOOST_REQUIRE_EQUAL( blocks.rows, db->head_block_num() );
+    BOOST_REQUIRE_GT( blocks.row_groups, 1u );
+    for( uint32_t i = 0; i < blocks.rows; ++i )
+    {
+      auto block = db->fetch_block_by_number( i + 1 );
+      BOOST_REQUIRE( block.valid() );
+      BOOST_REQUIRE_EQUAL( get_uint32( blocks, "block_num", i ), i + 1 );
+      BOOST_REQUIRE( get_packed< block_id_type >( blocks, "block_id", i ) == block->id() );
+      BOOST_REQUIRE( get_packed< block_id_type >( blocks, "previous", i ) == block->previous );
+      BOOST_REQUIRE_EQUAL( get_uint32( blocks, "timestamp", i ), block->timestamp.sec_since_epoch() );
+    }
+
+    BOOST_TEST_MESSAGE( "--- Operations of abandoned block are not written" );
+    const std::vector< std::string > accounts = read_dictionary( columns_dir / "accounts.dictionary" );
+    exported_table transfers = read_columns( columns_dir / "transfer_operation.columns" );
+    BOOST_REQUIRE( transfers.column_names == std::vector< std::string >(
+      { "block_num", "trx_in_block", "op_in_trx", "virtual_op", "from", "to", "amount", "memo" } ) );
+    BOOST_REQUIRE_EQUAL( transfers.columns.at( "to" ).encoding, hive::plugins::block_data_export::account_id_encoding );
+    uint32_t fork_transfers = 0;
+    for( uint32_t i = 0; i < transfers.rows; ++i )
+    {
+      const std::string& to = accounts.at( get_uint32( transfers, "to", i ) );
+      BOOST_REQUIRE_NE( to, "bob" );
+      if( get_uint32( transfers, "block_num", i ) != fork_block )
+        continue;
+
+      ++fork_transfers;
+      BOOST_REQUIRE_EQUAL( accounts.at( get_uint32( transfers, "from", i ) ), "alice" );
+      BOOST_REQUIRE_EQUAL( to, "carol" );
+      BOOST_REQUIRE( get_packed< asset >( transfers, "amount", i ) == ASSET( "10.000 TESTS" ) );
+      BOOST_REQUIRE( get_packed< std::string >( transfers, "memo", i ).empty() );
+      BOOST_REQUIRE_EQUAL( get_uint32( transfers, "trx_in_block", i ), 0u );
+      BOOST_REQUIRE_EQUAL( get_uint32( transfers, "virtual_op", i ), 0u );
+    }
+    BOOST_REQUIRE_EQUAL( fork_transfers, 1u );
+
+    BOOST_TEST_MESSAGE( "--- Virtual operations are written to their own files" );
+    exported_table rewards = read_columns( columns_dir / "producer_reward_operation.columns" );
+    BOOST_REQUIRE_GT( rewards.rows, 0u );
+    for( uint32_t i = 0; i < rewards.rows; ++i )
+    {
+      BOOST_REQUIRE_GT( get_uint32( rewards, "virtual_op", i ), 0u );
+      BOOST_REQUIRE_LE( get_uint32( rewards, "block_num", i ), db->head_block_num() );
+      if( i > 0 )
+        BOOST_REQUIRE_GE( get_uint32( rewards, "block_num", i ), get_uint32( rewards, "block_num", i - 1 ) );
+    }
+  }
+  FC_LOG_AND_RETHROW()
+}
+
+BOOST_AUTO_TEST_CASE( columnar_write_failure_test )
+{
+  try
+  {
+    fc::temp_directory output_dir( hive::utilities::temp_directory_path() );
+    fc::path columns_dir = output_dir.path() / "columns";
+    // blocks file can't be opened for writing
+    fc::create_directories( columns_dir / "blocks.columns" );
+    block_data_export_plugin& export_plugin = init_columnar_export( *this, columns_dir, 1 );
+
+    // export fails once first irreversible block is written, but block processing goes on
+    generate_blocks( 30 );
+    BOOST_REQUIRE_EQUAL( db->head_block_num(), 30u );
+    BOOST_REQUIRE_GT( db->get_last_irreversible_block_num(), 0u );
+    export_plugin.plugin_shutdown();
+
+    BOOST_TEST_MESSAGE( "--- Nothing is written after failed row group" );
+    BOOST_REQUIRE( fc::is_directory( columns_dir / "blocks.columns" ) );
+    BOOST_REQUIRE( !fc::exists( columns_dir / "producer_reward_operation.columns" ) );
+  }
+  FC_LOG_AND_RETHROW()
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+#endif
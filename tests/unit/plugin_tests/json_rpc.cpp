@@ -5,6 +5,8 @@
 #include <hive/chain/comment_object.hpp>
 #include <hive/protocol/hive_operations.hpp>
 #include <hive/plugins/json_rpc/json_rpc_plugin.hpp>
+#include <hive/plugins/json_rpc/admission_control.hpp>
+#include <hive/plugins/block_api/block_api.hpp>
 
 #include "../db_fixture/database_fixture.hpp"
 
@@ -312,5 +314,194 @@ BOOST_AUTO_TEST_CASE( semantics_validation )
   FC_LOG_AND_RETHROW()
 }
 
+BOOST_AUTO_TEST_CASE( binary_calls )
+{
+  try
+  {
+    using hive::plugins::json_rpc::binary_rpc_request;
+    using hive::plugins::json_rpc::binary_rpc_response;
+    namespace block_api = hive::plugins::block_api;
+
+    auto& rpc = appbase::app().get_plugin< hive::plugins::json_rpc::json_rpc_plugin >();
+
+    binary_rpc_request request;
+    request.id = 7;
+    request.api = "block_api";
+    request.method = "get_block_range";
+    request.args = fc::raw::pack_to_vector( block_api::get_block_range_args{ 1, 2 } );
+
+    auto response = fc::raw::unpack_from_vector< binary_rpc_response >( rpc.call_binary( fc::raw::pack_to_vector( request ) ) );
+    BOOST_REQUIRE_EQUAL( response.id, 7u );
+    BOOST_REQUIRE_EQUAL( response.code, 0 );
+    auto blocks = fc::raw::unpack_from_vector< block_api::get_block_range_return >( response.result );
+    BOOST_REQUIRE_EQUAL( blocks.blocks.size(), 2u );
+    BOOST_REQUIRE( blocks.blocks[0].block_id == db->fetch_block_by_number( 1 )->id() );
+
+    request.method = "get_block_ranges";
+    response = fc::raw::unpack_from_vector< binary_rpc_response >( rpc.call_binary( fc::raw::pack_to_vector( request ) ) );
+    BOOST_REQUIRE_EQUAL( response.code, JSON_RPC_METHOD_NOT_FOUND );
+
+    request.api = "database_api";
+    request.method = "get_dynamic_global_properties";
+    response = fc::raw::unpack_from_vector< binary_rpc_response >( rpc.call_binary( fc::raw::pack_to_vector( request ) ) );
+    BOOST_REQUIRE_EQUAL( response.code, JSON_RPC_METHOD_NOT_FOUND );
+
+    response = fc::raw::unpack_from_vector< binary_rpc_response >( rpc.call_binary( std::vector< char >{ 1, 2, 3 } ) );
+    BOOST_REQUIRE_EQUAL( response.code, JSON_RPC_PARSE_ERROR );
+  }
+  FC_LOG_AND_RETHROW()
+}
+
+BOOST_AUTO_TEST_CASE( binary_stream )
+{
+  try
+  {
+    using hive::plugins::json_rpc::binary_rpc_request;
+    using hive::plugins::json_rpc::binary_rpc_response;
+    namespace block_api = hive::plugins::block_api;
+
+    auto& rpc = appbase::app().get_plugin< hive::plugins::json_rpc::json_rpc_plugin >();
+    generate_blocks( 50 );
+    const uint32_t irreversible_block_num = db->get_block_log().head()->block_num();
+    BOOST_REQUIRE_GT( irreversible_block_num, 3u );
+
+    binary_rpc_request request;
+    request.id = 3;
+    request.api = "block_api";
+    request.method = "stream_block_range";
+    request.args = fc::raw::pack_to_vector( block_api::stream_block_range_args{ 2, 0 } );
+
+    // stream methods need websocket
+    auto response = fc::raw::unpack_from_vector< binary_rpc_response >( rpc.call_binary( fc::raw::pack_to_vector( request ) ) );
+    BOOST_REQUIRE_EQUAL( response.code, JSON_RPC_INVALID_REQUEST );
+
+    std::vector< binary_rpc_response > items;
+    auto sink = [&]( const std::vector< char >& frame )
+    {
+      items.push_back( fc::raw::unpack_from_vector< binary_rpc_response >( frame ) );
+      return true;
+    };
+    response = fc::raw::unpack_from_vector< binary_rpc_response >( rpc.call_binary( fc::raw::pack_to_vector( request ), sink ) );
+    BOOST_REQUIRE_EQUAL( response.code, 0 );
+    BOOST_REQUIRE( response.result.empty() );
+    BOOST_REQUIRE_EQUAL( items.size(), irreversible_block_num - 1 );
+    for( uint32_t i = 0; i < items.size(); ++i )
+    {
+      BOOST_REQUIRE_EQUAL( items[i].id, 3u );
+      auto block = fc::raw::unpack_from_vector< signed_block >( items[i].result );
+      BOOST_REQUIRE_EQUAL( block.block_num(), i + 2 );
+    }
+
+    // consumer that stops after two blocks
+    items.clear();
+    request.args = fc::raw::pack_to_vector( block_api::stream_block_range_args{ 1, 10 } );
+    rpc.call_binary( fc::raw::pack_to_vector( request ), [&]( const std::vector< char >& frame )
+    {
+      items.push_back( fc::raw::unpack_from_vector< binary_rpc_response >( frame ) );
+      return items.size() < 2;
+    } );
+    BOOST_REQUIRE_EQUAL( items.size(), 2u );
+
+    // streams hold webserver threads, so only limited number of them can run at once
+    std::function< void( uint32_t ) > open_nested_stream = [&]( uint32_t open_streams )
+    {
+      auto nested_response = fc::raw::unpack_from_vector< binary_rpc_response >( rpc.call_binary( fc::raw::pack_to_vector( request ),
+        [&]( const std::vector< char >& )
+        {
+          open_nested_stream( open_streams + 1 );
+          return false;
+        } ) );
+      if( open_streams < BLOCK_API_DEFAULT_MAX_STREAMS )
+      {
+        BOOST_REQUIRE_EQUAL( nested_response.code, 0 );
+      }
+      else
+      {
+        BOOST_REQUIRE_EQUAL( nested_response.code, JSON_RPC_ERROR_DURING_CALL );
+        BOOST_REQUIRE( nested_response.message.find( "Too many concurrent block streams" ) != std::string::npos );
+      }
+    };
+    open_nested_stream( 0 );
+    // all slots are free again
+    items.clear();
+    response = fc::raw::unpack_from_vector< binary_rpc_response >( rpc.call_binary( fc::raw::pack_to_vector( request ), sink ) );
+    BOOST_REQUIRE_EQUAL( response.code, 0 );
+    BOOST_REQUIRE_EQUAL( items.size(), 10u );
+  }
+  FC_LOG_AND_RETHROW()
+}
+
+BOOST_AUTO_TEST_CASE( admission_control )
+{
+  try
+  {
+    using hive::plugins::json_rpc::admission_control;
+    using hive::plugins::json_rpc::admission_limiter;
+
+    // limiter never waits, cost above capacity takes whole capacity
+    admission_limiter limiter( 3 );
+    BOOST_REQUIRE( limiter.try_acquire( 2 ) );
+    BOOST_REQUIRE( !limiter.try_acquire( 2 ) );
+    BOOST_REQUIRE( limiter.try_acquire( 1 ) );
+    BOOST_REQUIRE_EQUAL( limiter.used(), 3u );
+    limiter.release( 2 );
+    limiter.release( 1 );
+    BOOST_REQUIRE( limiter.try_acquire( 10 ) );
+    BOOST_REQUIRE_EQUAL( limiter.used(), 3u );
+    BOOST_REQUIRE( !limiter.try_acquire( 1 ) );
+    limiter.release( 10 );
+    BOOST_REQUIRE_EQUAL( limiter.used(), 0u );
+
+    admission_control admission;
+    admission.set_concurrency_limit( "condenser_api.get_account_history", 1 );
+    admission.set_concurrency_limit( "database_api", 2 );
+    admission.set_cost( "database_api.list_accounts", 3 );
+    admission.set_priority( "database_api.get_dynamic_global_properties" );
+    admission.set_normal_lane_capacity( 4 );
+    admission.finalize( { "condenser_api.get_account_history", "database_api.list_accounts",
+      "database_api.get_dynamic_global_properties", "block_api.get_block" } );
+    BOOST_REQUIRE( admission.enabled() );
+
+    // per method limit, slot is released with its destruction
+    {
+      admission_control::slot first, second;
+      BOOST_REQUIRE( admission.admit( "condenser_api.get_account_history", first ) );
+      // rejected at once, without waiting for the slot to be released
+      fc::time_point start = fc::time_point::now();
+      BOOST_REQUIRE( !admission.admit( "condenser_api.get_account_history", second ) );
+      BOOST_REQUIRE_LT( ( fc::time_point::now() - start ).count(), fc::milliseconds( 100 ).count() );
+    }
+    {
+      admission_control::slot again;
+      BOOST_REQUIRE( admission.admit( "condenser_api.get_account_history", again ) );
+    }
+
+    // normal lane capacity is shared by cost, priority lane and unknown methods bypass it
+    {
+      admission_control::slot list, block, block2, dgpo, dgpo2, unknown;
+      BOOST_REQUIRE( admission.admit( "database_api.list_accounts", list ) );
+      BOOST_REQUIRE( admission.admit( "block_api.get_block", block ) );
+      BOOST_REQUIRE( !admission.admit( "block_api.get_block", block2 ) );
+      BOOST_REQUIRE( admission.admit( "database_api.get_dynamic_global_properties", dgpo ) );
+      // API limit applies to priority methods too
+      BOOST_REQUIRE( !admission.admit( "database_api.get_dynamic_global_properties", dgpo2 ) );
+      BOOST_REQUIRE( admission.admit( "unknown_api.method", unknown ) );
+
+      auto lanes = admission.get_lane_stats();
+      BOOST_REQUIRE_EQUAL( lanes.size(), 1u );
+      BOOST_REQUIRE_EQUAL( lanes[0].executing, 4u );
+    }
+    BOOST_REQUIRE_EQUAL( admission.get_lane_stats()[0].executing, 0u );
+
+    auto rejected = admission.get_method_stats();
+    BOOST_REQUIRE_EQUAL( rejected.size(), 3u );
+    BOOST_REQUIRE_EQUAL( rejected[0].name, "block_api.get_block" );
+    BOOST_REQUIRE_EQUAL( rejected[1].name, "condenser_api.get_account_history" );
+    BOOST_REQUIRE_EQUAL( rejected[2].name, "database_api.get_dynamic_global_properties" );
+    BOOST_REQUIRE_EQUAL( rejected[0].rejected, 1u );
+  }
+  FC_LOG_AND_RETHROW()
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 #endif
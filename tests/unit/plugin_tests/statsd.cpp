@@ -0,0 +1,82 @@
+#if defined IS_TEST_NET
+#include <boost/test/unit_test.hpp>
+
+#include <hive/plugins/statsd/aggregator.hpp>
+
+#include <cstdint>
+
+using hive::plugins::statsd::latency_histogram;
+
+BOOST_AUTO_TEST_SUITE( statsd )
+
+BOOST_AUTO_TEST_CASE( bucket_index_test )
+{
+  BOOST_TEST_MESSAGE( "--- Small values have their own buckets" );
+  for( uint32_t value = 0; value < 64; ++value )
+  {
+    BOOST_REQUIRE_EQUAL( latency_histogram::bucket_index( value ), value );
+    BOOST_REQUIRE_EQUAL( latency_histogram::bucket_upper_bound( value ), value );
+  }
+
+  BOOST_TEST_MESSAGE( "--- Larger values fall into ordered buckets not wider than 1/32 of their values" );
+  auto check_value = []( uint32_t value )
+  {
+    uint32_t index = latency_histogram::bucket_index( value );
+    uint32_t upper_bound = latency_histogram::bucket_upper_bound( index );
+    BOOST_REQUIRE_GE( upper_bound, value );
+    BOOST_REQUIRE_LE( upper_bound - value, value / 32 );
+    BOOST_REQUIRE_LT( latency_histogram::bucket_upper_bound( index - 1 ), value );
+  };
+
+  uint32_t previous_index = latency_histogram::bucket_index( 63 );
+  for( uint32_t value = 64; value < ( 1 << 16 ); ++value )
+  {
+    check_value( value );
+    uint32_t index = latency_histogram::bucket_index( value );
+    BOOST_REQUIRE( index == previous_index || index == previous_index + 1 );
+    previous_index = index;
+  }
+  for( uint64_t value = 1 << 16; value <= UINT32_MAX; value = value * 3 / 2 + 1 )
+    check_value( static_cast< uint32_t >( value ) );
+  check_value( UINT32_MAX );
+  BOOST_REQUIRE_EQUAL( latency_histogram::bucket_upper_bound( latency_histogram::bucket_index( UINT32_MAX ) ), UINT32_MAX );
+}
+
+BOOST_AUTO_TEST_CASE( percentile_test )
+{
+  latency_histogram empty;
+  BOOST_REQUIRE_EQUAL( empty.percentile( 0.5 ), 0u );
+
+  BOOST_TEST_MESSAGE( "--- Percentiles of exactly represented values" );
+  latency_histogram lower;
+  latency_histogram upper;
+  for( uint32_t value = 1; value <= 50; ++value )
+    lower.record( value );
+  for( uint32_t value = 51; value <= 100; ++value )
+    upper.record( value );
+
+  latency_histogram merged;
+  merged.merge( lower );
+  merged.merge( upper );
+  merged.merge( empty );
+  BOOST_REQUIRE_EQUAL( merged.count(), 100u );
+  BOOST_REQUIRE_EQUAL( merged.sum(), 5050u );
+  BOOST_REQUIRE_EQUAL( merged.min(), 1u );
+  BOOST_REQUIRE_EQUAL( merged.max(), 100u );
+  BOOST_REQUIRE_EQUAL( merged.percentile( 0 ), 1u );
+  BOOST_REQUIRE_EQUAL( merged.percentile( 0.5 ), 50u );
+  BOOST_REQUIRE_EQUAL( merged.percentile( 0.99 ), 99u );
+  // bucket of 100 reaches above max
+  BOOST_REQUIRE_EQUAL( merged.percentile( 1 ), 100u );
+
+  BOOST_TEST_MESSAGE( "--- Percentiles of large values are within bucket precision" );
+  latency_histogram large;
+  large.record( 1000 );
+  large.record( 5000 );
+  BOOST_REQUIRE_GE( large.percentile( 0.5 ), 1000u );
+  BOOST_REQUIRE_LE( large.percentile( 0.5 ), 1000u + 1000u / 32 );
+  BOOST_REQUIRE_EQUAL( large.percentile( 0.9 ), 5000u );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+#endif
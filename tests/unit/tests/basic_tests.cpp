@@ -27,6 +27,7 @@
 #include <hive/chain/hive_fwd.hpp>
 
 #include <hive/chain/database.hpp>
+#include <hive/chain/database_exceptions.hpp>
 #include <hive/protocol/protocol.hpp>
 
 #include <hive/protocol/hive_operations.hpp>
@@ -35,9 +36,13 @@
 #include <hive/chain/hive_objects.hpp>
 #include <hive/chain/sps_objects.hpp>
 #include <hive/chain/transaction_object.hpp>
+#include <hive/chain/transaction_admission_cache.hpp>
+#include <hive/chain/pending_transaction_pool.hpp>
 
 #include <hive/chain/util/reward.hpp>
 
+#include <hive/utilities/metrics.hpp>
+
 #include <fc/crypto/digest.hpp>
 #include <fc/crypto/hex.hpp>
 #include "../db_fixture/database_fixture.hpp"
@@ -434,6 +439,129 @@ BOOST_AUTO_TEST_CASE( curation_weight_test )
 
 }
 
+BOOST_AUTO_TEST_CASE( transaction_admission_cache_test )
+{
+  transaction_admission_cache cache( 32 );
+
+  signed_transaction trx;
+  transfer_operation op;
+  op.from = "alice";
+  op.to = "bob";
+  op.amount = asset( 1, HIVE_SYMBOL );
+  trx.operations.push_back( op );
+  auto key = fc::ecc::private_key::regenerate( fc::sha256::hash( string( "alice" ) ) );
+  trx.sign( key, db->get_chain_id(), fc::ecc::fc_canonical );
+  const auto id = trx.id();
+  const auto keys = trx.get_signature_keys( db->get_chain_id(), fc::ecc::fc_canonical );
+
+  flat_set< public_key_type > found_keys;
+  BOOST_CHECK( !cache.find( id, trx, db->get_chain_id(), fc::ecc::fc_canonical, found_keys ) );
+  cache.store( id, trx, db->get_chain_id(), fc::ecc::fc_canonical, keys );
+  BOOST_REQUIRE( cache.find( id, trx, db->get_chain_id(), fc::ecc::fc_canonical, found_keys ) );
+  BOOST_CHECK( found_keys == keys );
+
+  // keys depend on signatures, chain id and canonical signature type
+  BOOST_CHECK( !cache.find( id, trx, chain_id_type( "abcd" ), fc::ecc::fc_canonical, found_keys ) );
+  BOOST_CHECK( !cache.find( id, trx, db->get_chain_id(), fc::ecc::bip_0062, found_keys ) );
+  signed_transaction resigned = trx;
+  resigned.signatures.clear();
+  resigned.sign( fc::ecc::private_key::regenerate( fc::sha256::hash( string( "bob" ) ) ), db->get_chain_id(), fc::ecc::fc_canonical );
+  BOOST_CHECK( resigned.id() == id );
+  BOOST_CHECK( !cache.find( id, resigned, db->get_chain_id(), fc::ecc::fc_canonical, found_keys ) );
+
+  // cache is bounded - with one entry per shard next entry in the same shard evicts previous one
+  cache.set_capacity( 16 );
+  signed_transaction empty;
+  vector< transaction_id_type > same_shard;
+  for( uint32_t i = 0; same_shard.size() < 2; ++i )
+  {
+    transaction_id_type next( fc::sha256::hash( i ).str().substr( 0, 40 ) );
+    if( next._hash[0] % 16 == id._hash[0] % 16 )
+      same_shard.push_back( next );
+  }
+  cache.store( same_shard[0], empty, db->get_chain_id(), fc::ecc::fc_canonical, keys );
+  BOOST_CHECK( !cache.find( id, trx, db->get_chain_id(), fc::ecc::fc_canonical, found_keys ) );
+  BOOST_CHECK( cache.find( same_shard[0], empty, db->get_chain_id(), fc::ecc::fc_canonical, found_keys ) );
+  cache.store( same_shard[1], empty, db->get_chain_id(), fc::ecc::fc_canonical, keys );
+  BOOST_CHECK( !cache.find( same_shard[0], empty, db->get_chain_id(), fc::ecc::fc_canonical, found_keys ) );
+  BOOST_CHECK( cache.find( same_shard[1], empty, db->get_chain_id(), fc::ecc::fc_canonical, found_keys ) );
+
+  cache.set_capacity( 0 );
+  BOOST_CHECK( !cache.find( same_shard[1], empty, db->get_chain_id(), fc::ecc::fc_canonical, found_keys ) );
+}
+
+BOOST_AUTO_TEST_CASE( pending_transaction_pool_test )
+{
+  pending_transaction_pool pool;
+  fc::time_point_sec now( 1000 );
+
+  auto make_entry = [&]( const string& from, uint32_t nonce, int64_t priority, fc::time_point_sec expiration )
+  {
+    signed_transaction trx;
+    transfer_operation op;
+    op.from = from;
+    op.to = "bob";
+    op.amount = asset( nonce, HIVE_SYMBOL );
+    trx.operations.push_back( op );
+    trx.set_expiration( expiration );
+    auto e = pending_transaction_pool::make_entry( trx, trx.id() );
+    e.priority = priority;
+    return e;
+  };
+
+  auto alice1 = make_entry( "alice", 1, 10, now + 60 );
+  BOOST_CHECK( alice1.account == account_name_type( "alice" ) );
+
+  // no limits by default
+  pool.add( alice1 );
+  BOOST_CHECK( pool.find_room( make_entry( "alice", 2, 0, now + 60 ), now ).empty() );
+
+  BOOST_TEST_MESSAGE( "--- Per account limit" );
+  pool.set_limits( 2, 0 );
+  auto alice2 = make_entry( "alice", 2, 5, now + 60 );
+  pool.check_account_limit( alice2 );
+  pool.add( alice2 );
+  BOOST_CHECK_EQUAL( pool.get_account_transaction_count( "alice" ), 2u );
+  HIVE_REQUIRE_THROW( pool.check_account_limit( make_entry( "alice", 3, 100, now + 60 ) ), transaction_pool_full_exception );
+  pool.check_account_limit( make_entry( "sam", 1, 0, now + 60 ) );
+  BOOST_CHECK( pool.remove( alice1.id ) );
+  BOOST_CHECK( !pool.remove( alice1.id ) );
+  pool.check_account_limit( make_entry( "alice", 3, 100, now + 60 ) );
+
+  BOOST_TEST_MESSAGE( "--- Size limit drops expired, then least valuable transactions" );
+  pool.add( alice1 );
+  const uint32_t entry_size = alice1.size;
+  BOOST_CHECK_EQUAL( pool.get_total_size(), 2u * entry_size );
+  pool.set_limits( 0, 3 * entry_size );
+  auto sam_expired = make_entry( "sam", 1, 50, now - 1 );
+  pool.add( sam_expired );
+  BOOST_CHECK_EQUAL( pool.get_transaction_count(), 3u );
+
+  auto dave = make_entry( "dave", 1, 1, now + 60 );
+  auto dropped = pool.find_room( dave, now );
+  BOOST_REQUIRE_EQUAL( dropped.size(), 1u );
+  BOOST_CHECK( dropped[0] == sam_expired.id );
+  pool.remove( sam_expired.id );
+  pool.add( dave );
+
+  // lower priority than anything already pending
+  HIVE_REQUIRE_THROW( pool.find_room( make_entry( "dave", 2, 0, now + 60 ), now ), transaction_pool_full_exception );
+  // equal priority is not enough either
+  HIVE_REQUIRE_THROW( pool.find_room( make_entry( "dave", 2, 1, now + 60 ), now ), transaction_pool_full_exception );
+  dropped = pool.find_room( make_entry( "dave", 2, 6, now + 60 ), now );
+  BOOST_REQUIRE_EQUAL( dropped.size(), 1u );
+  BOOST_CHECK( dropped[0] == dave.id );
+  // more valuable transactions stay, even when less valuable ones free part of needed room
+  auto big = make_entry( "sam", 2, 3, now + 60 );
+  big.size = 2 * entry_size;
+  HIVE_REQUIRE_THROW( pool.find_room( big, now ), transaction_pool_full_exception );
+
+  pool.clear();
+  BOOST_CHECK_EQUAL( pool.get_transaction_count(), 0u );
+  BOOST_CHECK_EQUAL( pool.get_total_size(), 0u );
+  BOOST_CHECK_EQUAL( pool.get_account_transaction_count( "alice" ), 0u );
+}
+
 #ifndef ENABLE_STD_ALLOCATOR
 BOOST_AUTO_TEST_CASE( chain_object_size )
 {
@@ -525,4 +653,92 @@ BOOST_AUTO_TEST_CASE( chain_object_size )
 }
 #endif
 
+BOOST_AUTO_TEST_CASE( metrics_text_format_test )
+{
+  try
+  {
+    namespace metrics = hive::utilities::metrics;
+    auto count_occurrences = []( const std::string& text, const std::string& pattern )
+    {
+      size_t count = 0;
+      for( size_t pos = text.find( pattern ); pos != std::string::npos; pos = text.find( pattern, pos + 1 ) )
+        ++count;
+      return count;
+    };
+
+    BOOST_TEST_MESSAGE( "--- Histogram buckets are cumulative, bound is inclusive" );
+    metrics::histogram h( { 0.001, 0.01 } );
+    h.observe( fc::microseconds( 500 ) );
+    h.observe( fc::milliseconds( 1 ) );
+    h.observe( fc::milliseconds( 5 ) );
+    h.observe( fc::seconds( 2 ) );
+    BOOST_REQUIRE_EQUAL( h.cumulative_count( 0 ), 2u );
+    BOOST_REQUIRE_EQUAL( h.cumulative_count( 1 ), 3u );
+    BOOST_REQUIRE_EQUAL( h.cumulative_count( 2 ), 4u );
+    BOOST_REQUIRE_EQUAL( h.count(), 4u );
+
+    BOOST_TEST_MESSAGE( "--- Text format has escaped labels and one HELP/TYPE per family" );
+    metrics::text_writer writer;
+    writer.write_histogram( "test_seconds", "Test histogram", h, { { "method", "a\"b\\c\nd" } } );
+    writer.write_histogram( "test_seconds", "Test histogram", metrics::histogram( { 0.001, 0.01 } ), { { "method", "plain" } } );
+    writer.gauge( "test_gauge", "Test gauge", 1.5 );
+    writer.counter( "test_total", "Test counter", 3, { { "lane", "normal" } } );
+    writer.counter( "test_total", "Test counter", 4, { { "lane", "priority" } } );
+    const std::string expected =
+      "# HELP test_seconds Test histogram\n"
+      "# TYPE test_seconds histogram\n"
+      "test_seconds_bucket{method=\"a\\\"b\\\\c\\nd\",le=\"0.001\"} 2\n"
+      "test_seconds_bucket{method=\"a\\\"b\\\\c\\nd\",le=\"0.01\"} 3\n"
+      "test_seconds_bucket{method=\"a\\\"b\\\\c\\nd\",le=\"+Inf\"} 4\n"
+      "test_seconds_sum{method=\"a\\\"b\\\\c\\nd\"} 2.0065\n"
+      "test_seconds_count{method=\"a\\\"b\\\\c\\nd\"} 4\n"
+      "test_seconds_bucket{method=\"plain\",le=\"0.001\"} 0\n"
+      "test_seconds_bucket{method=\"plain\",le=\"0.01\"} 0\n"
+      "test_seconds_bucket{method=\"plain\",le=\"+Inf\"} 0\n"
+      "test_seconds_sum{method=\"plain\"} 0\n"
+      "test_seconds_count{method=\"plain\"} 0\n"
+      "# HELP test_gauge Test gauge\n"
+      "# TYPE test_gauge gauge\n"
+      "test_gauge 1.5\n"
+      "# HELP test_total Test counter\n"
+      "# TYPE test_total counter\n"
+      "test_total{lane=\"normal\"} 3\n"
+      "test_total{lane=\"priority\"} 4\n";
+    BOOST_REQUIRE_EQUAL( writer.str(), expected );
+
+    BOOST_TEST_MESSAGE( "--- Histogram without labels has only le label" );
+    metrics::text_writer unlabeled_writer;
+    unlabeled_writer.write_histogram( "test_unlabeled_seconds", "Test histogram", metrics::histogram( { 0.5 } ) );
+    BOOST_REQUIRE_EQUAL( unlabeled_writer.str(),
+      "# HELP test_unlabeled_seconds Test histogram\n"
+      "# TYPE test_unlabeled_seconds histogram\n"
+      "test_unlabeled_seconds_bucket{le=\"0.5\"} 0\n"
+      "test_unlabeled_seconds_bucket{le=\"+Inf\"} 0\n"
+      "test_unlabeled_seconds_sum 0\n"
+      "test_unlabeled_seconds_count 0\n" );
+
+    BOOST_TEST_MESSAGE( "--- Registry scrape writes histograms and collectors" );
+    metrics::registry& registry = metrics::registry::instance();
+    metrics::histogram& first = registry.get_histogram( "test_registry_seconds", "Test registry histogram", { { "method", "first" } } );
+    metrics::histogram& second = registry.get_histogram( "test_registry_seconds", "Test registry histogram", { { "method", "second" } } );
+    BOOST_REQUIRE( &first != &second );
+    BOOST_REQUIRE( &first == &registry.get_histogram( "test_registry_seconds", "Test registry histogram", { { "method", "first" } } ) );
+    first.observe( fc::milliseconds( 3 ) );
+    registry.add_collector( "test_collector", []( metrics::text_writer& w ) { w.gauge( "test_registry_gauge", "Test registry gauge", 7 ); } );
+
+    std::string scraped = registry.scrape();
+    BOOST_REQUIRE_EQUAL( count_occurrences( scraped, "# HELP test_registry_seconds " ), 1u );
+    BOOST_REQUIRE_EQUAL( count_occurrences( scraped, "# TYPE test_registry_seconds histogram\n" ), 1u );
+    BOOST_REQUIRE_EQUAL( count_occurrences( scraped, "test_registry_seconds_bucket{method=\"first\",le=\"+Inf\"} 1\n" ), 1u );
+    BOOST_REQUIRE_EQUAL( count_occurrences( scraped, "test_registry_seconds_count{method=\"second\"} 0\n" ), 1u );
+    BOOST_REQUIRE_EQUAL( count_occurrences( scraped, "test_registry_gauge 7\n" ), 1u );
+
+    registry.remove_collector( "test_collector" );
+    scraped = registry.scrape();
+    BOOST_REQUIRE_EQUAL( count_occurrences( scraped, "test_registry_gauge" ), 0u );
+    BOOST_REQUIRE_EQUAL( count_occurrences( scraped, "test_registry_seconds_count{method=\"first\"} 1\n" ), 1u );
+  }
+  FC_LOG_AND_RETHROW()
+}
+
 BOOST_AUTO_TEST_SUITE_END()
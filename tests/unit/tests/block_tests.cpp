@@ -29,6 +29,7 @@
 #include <hive/protocol/exceptions.hpp>
 
 #include <hive/chain/database.hpp>
+#include <hive/chain/database_exceptions.hpp>
 #include <hive/chain/hive_objects.hpp>
 #include <hive/chain/history_object.hpp>
 
@@ -40,6 +41,9 @@
 
 #include <fc/crypto/digest.hpp>
 
+#include <atomic>
+#include <thread>
+
 #include "../db_fixture/database_fixture.hpp"
 
 using namespace hive;
@@ -51,7 +55,7 @@ using namespace hive::plugins;
 
 BOOST_AUTO_TEST_SUITE(block_tests)
 
-void open_test_database( database& db, const fc::path& dir )
+void open_test_database( database& db, const fc::path& dir, bool enable_comment_archive = false )
 {
   hive::chain::open_args args;
   args.data_dir = dir;
@@ -60,6 +64,7 @@ void open_test_database( database& db, const fc::path& dir )
   args.hbd_initial_supply = HBD_INITIAL_TEST_SUPPLY;
   args.shared_file_size = TEST_SHARED_MEM_SIZE;
   args.database_cfg = hive::utilities::default_database_configuration();
+  args.enable_comment_archive = enable_comment_archive;
   db.open( args );
 }
 
@@ -240,6 +245,190 @@ BOOST_AUTO_TEST_CASE( fork_blocks )
     BOOST_CHECK_EQUAL(db2.head_block_num(), 14u);
     PUSH_BLOCK( db1, good_block );
     BOOST_CHECK_EQUAL(db1.head_block_id().str(), db2.head_block_id().str());
+
+    // lock-free lookups see the same chain after fork switch
+    BOOST_CHECK_EQUAL(db1.head_block_num_unlocked(), db1.head_block_num());
+    BOOST_CHECK_EQUAL(db1.head_block_id_unlocked().str(), db1.head_block_id().str());
+    for( uint32_t num = 1; num <= db1.head_block_num(); ++num )
+      BOOST_CHECK_EQUAL(db1.find_block_id_for_num_unlocked(num).str(), db1.get_block_id_for_num(num).str());
+    auto fork_ids = db1.get_block_ids_on_fork_unlocked(block_id_type(db1_tip));
+    BOOST_REQUIRE_EQUAL(fork_ids.size(), 4u);
+    BOOST_CHECK_EQUAL(fork_ids.front().str(), db1_tip);
+    BOOST_CHECK_EQUAL(fork_ids.back().str(), db1.get_block_id_for_num(10).str());
+  } catch (fc::exception& e) {
+    edump((e.to_detail_string()));
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( fork_database_concurrent_reads )
+{
+  try {
+    fork_database fork_db;
+    signed_block genesis;
+    genesis.timestamp = fc::time_point_sec( HIVE_GENESIS_TIME );
+    fork_db.start_block( genesis );
+    fork_db.set_max_size( 50 );
+
+    const uint32_t block_count = 2000;
+    std::atomic<bool> done( false );
+    std::atomic<uint32_t> reads( 0 );
+    std::string reader_error;
+
+    // reader checks that every version it sees is consistent: head is linked with its ancestors
+    // and they are all findable, even though writer keeps pushing and pruning blocks
+    std::thread reader( [&]()
+    {
+      try
+      {
+        uint32_t last_head_num = 0;
+        while( !done.load() )
+        {
+          item_ptr head = fork_db.head();
+          FC_ASSERT( head && head->num >= last_head_num );
+          last_head_num = head->num;
+          FC_ASSERT( fork_db.is_known_block( head->id ) );
+          item_ptr prev = head->prev.lock();
+          if( prev )
+            FC_ASSERT( prev->num + 1 == head->num && prev->id == head->previous_id() );
+          auto branch = fork_db.fetch_branch_from( head->id, head->id );
+          FC_ASSERT( branch.first.size() == 1 && branch.first.front() == head );
+          ++reads;
+        }
+      }
+      catch( const fc::exception& e )
+      {
+        reader_error = e.to_detail_string();
+      }
+    } );
+
+    block_id_type previous = genesis.id();
+    for( uint32_t i = 1; i <= block_count; ++i )
+    {
+      signed_block b;
+      b.previous = previous;
+      b.timestamp = genesis.timestamp + i * HIVE_BLOCK_INTERVAL;
+      previous = fork_db.push_block( b )->id;
+      if( i % 10 == 0 )
+        fork_db.set_max_size( 50 );
+    }
+    done.store( true );
+    reader.join();
+
+    BOOST_CHECK_EQUAL( reader_error, "" );
+    BOOST_CHECK_EQUAL( fork_db.head()->num, block_count + genesis.block_num() );
+    BOOST_CHECK( fork_db.fetch_block_on_main_branch_by_number( block_count - 10 ) );
+    BOOST_CHECK( !fork_db.fetch_block_on_main_branch_by_number( 10 ) );
+    BOOST_TEST_MESSAGE( "Reader made " << reads.load() << " passes" );
+  } catch (fc::exception& e) {
+    edump((e.to_detail_string()));
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( fork_database_validated_reads )
+{
+  try {
+    fork_database fork_db;
+    signed_block genesis;
+    genesis.timestamp = fc::time_point_sec( HIVE_GENESIS_TIME );
+    fork_db.start_block( genesis );
+
+    auto make_block = [&]( const block_id_type& previous, uint32_t offset )
+    {
+      signed_block b;
+      b.previous = previous;
+      b.timestamp = genesis.timestamp + offset * HIVE_BLOCK_INTERVAL;
+      return b;
+    };
+
+    // pushed but not applied block is invisible to validated lookups
+    signed_block b1 = make_block( genesis.id(), 1 );
+    item_ptr item1 = fork_db.push_block( b1 );
+    BOOST_REQUIRE( fork_db.head() == item1 );
+    BOOST_REQUIRE( fork_db.validated_head()->id == genesis.id() );
+    BOOST_REQUIRE( !fork_db.fetch_validated_block( b1.id() ) );
+    BOOST_REQUIRE( !fork_db.fetch_validated_block_on_main_branch_by_number( b1.block_num() ) );
+    BOOST_REQUIRE( fork_db.fetch_validated_block_range_on_main_branch_by_number( genesis.block_num(), 10 ).size() == 1 );
+    item1->set_validated();
+    BOOST_REQUIRE( fork_db.validated_head() == item1 );
+    BOOST_REQUIRE( fork_db.fetch_validated_block( b1.id() ) == item1 );
+    BOOST_REQUIRE( fork_db.fetch_validated_block_on_main_branch_by_number( b1.block_num() ) == item1 );
+
+    // block that comes before its parent is published unlinked; linking must not modify published item
+    signed_block b2 = make_block( b1.id(), 2 );
+    signed_block b3 = make_block( b2.id(), 3 );
+    BOOST_REQUIRE_THROW( fork_db.push_block( b3 ), unlinkable_block_exception );
+    item_ptr unlinked3 = fork_db.fetch_block( b3.id() );
+    BOOST_REQUIRE( unlinked3 && !unlinked3->prev.lock() );
+    item_ptr head = fork_db.push_block( b2 );
+    BOOST_REQUIRE_EQUAL( head->id.str(), b3.id().str() );
+    BOOST_REQUIRE( head != unlinked3 );
+    BOOST_REQUIRE( !unlinked3->prev.lock() );
+    BOOST_REQUIRE_EQUAL( head->prev.lock()->id.str(), b2.id().str() );
+    BOOST_REQUIRE( fork_db.validated_head() == item1 );
+  } catch (fc::exception& e) {
+    edump((e.to_detail_string()));
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( fork_database_snapshot )
+{
+  try {
+    fork_database fork_db;
+    signed_block genesis;
+    genesis.timestamp = fc::time_point_sec( HIVE_GENESIS_TIME );
+    fork_db.start_block( genesis );
+
+    auto make_block = [&]( const block_id_type& previous, uint32_t offset )
+    {
+      signed_block b;
+      b.previous = previous;
+      b.timestamp = genesis.timestamp + offset * HIVE_BLOCK_INTERVAL;
+      return b;
+    };
+
+    // main branch long enough to need merging of layers, with fork block at every height
+    const uint32_t block_count = 3 * fork_database::MAX_LAYERS;
+    vector< item_ptr > main_branch, fork_branch;
+    block_id_type previous = genesis.id();
+    for( uint32_t i = 1; i <= block_count; ++i )
+    {
+      fork_branch.push_back( fork_db.push_block( make_block( previous, i + block_count ) ) );
+      main_branch.push_back( fork_db.push_block( make_block( previous, i ) ) );
+      previous = main_branch.back()->id;
+    }
+    BOOST_REQUIRE( fork_db.head() == fork_branch.back() ); // first pushed block wins at the same height
+    fork_db.set_head( main_branch.back() );
+    for( uint32_t i = 0; i < block_count; ++i )
+    {
+      auto blocks = fork_db.fetch_block_by_number( i + 2 );
+      BOOST_REQUIRE_EQUAL( blocks.size(), 2u );
+      BOOST_REQUIRE( blocks[0] == fork_branch[i] ); // insertion order is kept across layers
+      BOOST_REQUIRE( blocks[1] == main_branch[i] );
+      BOOST_REQUIRE( fork_db.fetch_block_on_main_branch_by_number( i + 2 ) == main_branch[i] );
+      BOOST_REQUIRE( fork_db.fetch_block( fork_branch[i]->id ) == fork_branch[i] );
+    }
+
+    // snapshot is not affected by later modifications
+    const fork_database::snapshot snap = fork_db.get_snapshot();
+    fork_db.pop_block();
+    fork_db.remove( main_branch.back()->id );
+    fork_db.push_block( make_block( main_branch[ block_count - 2 ]->id, 3 * block_count ) );
+    fork_db.set_max_size( 10 );
+    BOOST_REQUIRE( snap.head() == main_branch.back() );
+    BOOST_REQUIRE( snap.is_known_block( main_branch.back()->id ) );
+    BOOST_REQUIRE( snap.fetch_block_on_main_branch_by_number( 2 ) == main_branch.front() );
+    BOOST_REQUIRE_EQUAL( snap.fetch_block_range_on_main_branch_by_number( 1, block_count + 1 ).size(), block_count + 1 );
+
+    // current version has removed block and blocks out of reversible window hidden
+    BOOST_REQUIRE( !fork_db.is_known_block( main_branch.back()->id ) );
+    BOOST_REQUIRE_EQUAL( fork_db.head()->num, block_count + 1 );
+    BOOST_REQUIRE( !fork_db.is_known_block( main_branch.front()->id ) );
+    BOOST_REQUIRE( fork_db.fetch_block_by_number( 2 ).empty() );
+    BOOST_REQUIRE_EQUAL( fork_db.fetch_block_range_on_main_branch_by_number( 1, block_count + 2 ).size(), 11u );
+    BOOST_REQUIRE_THROW( fork_db.push_block( make_block( main_branch.front()->id, 4 * block_count ) ), fc::exception );
   } catch (fc::exception& e) {
     edump((e.to_detail_string()));
     throw;
@@ -362,6 +551,231 @@ BOOST_AUTO_TEST_CASE( duplicate_transactions )
   }
 }
 
+BOOST_AUTO_TEST_CASE( trx_precheck_replay )
+{
+  try {
+    fc::temp_directory dir1( hive::utilities::temp_directory_path() ),
+                  dir2( hive::utilities::temp_directory_path() ),
+                  dir3( hive::utilities::temp_directory_path() );
+    database db1,
+          db2,
+          db3;
+    witness::block_producer bp1( db1 );
+    db1._log_hardforks = false;
+    open_test_database( db1, dir1.path() );
+    db2._log_hardforks = false;
+    open_test_database( db2, dir2.path() );
+    db3._log_hardforks = false;
+    open_test_database( db3, dir3.path() );
+    db3.set_trx_precheck_threads( 3 );
+
+    auto state_digest = []( const database& db )
+    {
+      fc::sha256::encoder enc;
+      fc::raw::pack( enc, db.head_block_id() );
+      const auto& dgpo = db.get_dynamic_global_properties();
+      fc::raw::pack( enc, dgpo.get_current_supply() );
+      fc::raw::pack( enc, dgpo.get_current_hbd_supply() );
+      fc::raw::pack( enc, dgpo.total_vesting_shares );
+      for( const auto& account : db.get_index< account_index, by_id >() )
+      {
+        fc::raw::pack( enc, account.name );
+        fc::raw::pack( enc, account.get_balance() );
+        fc::raw::pack( enc, account.get_hbd_balance() );
+        fc::raw::pack( enc, account.get_vesting() );
+      }
+      return enc.result();
+    };
+
+    auto init_account_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("init_key")) );
+    public_key_type init_account_pub_key  = init_account_priv_key.get_public_key();
+    const std::vector< std::string > receivers = { "alice", "bob", "sam" };
+
+    auto produce_and_replay = [&]()
+    {
+      auto b = bp1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness( 1 ), init_account_priv_key, database::skip_nothing );
+      PUSH_BLOCK( db2, b );
+      PUSH_BLOCK( db3, b );
+      BOOST_REQUIRE_EQUAL( db2.head_block_id().str(), b.id().str() );
+      BOOST_REQUIRE_EQUAL( db3.head_block_id().str(), b.id().str() );
+      BOOST_REQUIRE( state_digest( db2 ) == state_digest( db3 ) );
+      return b;
+    };
+
+    produce_and_replay();
+
+    BOOST_TEST_MESSAGE( "Creating accounts" );
+    for( const auto& name : receivers )
+    {
+      signed_transaction trx;
+      account_create_operation cop;
+      cop.new_account_name = name;
+      cop.creator = HIVE_INIT_MINER_NAME;
+      cop.owner = authority(1, init_account_pub_key, 1);
+      cop.active = cop.owner;
+      trx.operations.push_back(cop);
+      trx.set_expiration( db1.head_block_time() + HIVE_MAX_TIME_UNTIL_EXPIRATION );
+      trx.sign( init_account_priv_key, db1.get_chain_id(), fc::ecc::fc_canonical );
+      db1.push_transaction( trx );
+    }
+    produce_and_replay();
+
+    BOOST_TEST_MESSAGE( "Applying blocks full of transfers with and without precheck threads" );
+    for( uint32_t b = 0; b < 3; ++b )
+    {
+      for( uint32_t i = 0; i < 30; ++i )
+      {
+        signed_transaction trx;
+        transfer_operation t;
+        t.from = HIVE_INIT_MINER_NAME;
+        t.to = receivers[ i % receivers.size() ];
+        t.amount = asset( 1 + i + 100 * b, HIVE_SYMBOL );
+        trx.operations.push_back(t);
+        trx.set_expiration( db1.head_block_time() + HIVE_MAX_TIME_UNTIL_EXPIRATION );
+        trx.sign( init_account_priv_key, db1.get_chain_id(), fc::ecc::fc_canonical );
+        db1.push_transaction( trx );
+      }
+      BOOST_REQUIRE_EQUAL( produce_and_replay().transactions.size(), 30u );
+    }
+
+    BOOST_TEST_MESSAGE( "Block with badly signed transaction has to be rejected in both modes" );
+    {
+      auto b = bp1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness( 1 ), init_account_priv_key, database::skip_nothing );
+      auto bad_key = fc::ecc::private_key::regenerate( fc::sha256::hash( string( "bad_key" ) ) );
+      for( uint32_t i = 0; i < 6; ++i )
+      {
+        signed_transaction trx;
+        transfer_operation t;
+        t.from = HIVE_INIT_MINER_NAME;
+        t.to = receivers[ i % receivers.size() ];
+        t.amount = asset( 1000 + i, HIVE_SYMBOL );
+        trx.operations.push_back(t);
+        trx.set_expiration( db2.head_block_time() + HIVE_MAX_TIME_UNTIL_EXPIRATION );
+        trx.sign( i == 4 ? bad_key : init_account_priv_key, db1.get_chain_id(), fc::ecc::fc_canonical );
+        b.transactions.push_back( trx );
+      }
+      b.transaction_merkle_root = b.calculate_merkle_root();
+      b.sign( init_account_priv_key );
+
+      const auto digest = state_digest( db2 );
+      HIVE_CHECK_THROW( PUSH_BLOCK( db2, b ), fc::exception );
+      HIVE_CHECK_THROW( PUSH_BLOCK( db3, b ), fc::exception );
+      BOOST_REQUIRE( state_digest( db2 ) == digest );
+      BOOST_REQUIRE( state_digest( db3 ) == digest );
+    }
+  } catch (fc::exception& e) {
+    edump((e.to_detail_string()));
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( comment_archive )
+{
+  try {
+    fc::temp_directory data_dir( hive::utilities::temp_directory_path() );
+    database db;
+    witness::block_producer bp( db );
+    db._log_hardforks = false;
+    open_test_database( db, data_dir.path(), true );
+
+    auto init_account_priv_key = fc::ecc::private_key::regenerate( fc::sha256::hash( string( "init_key" ) ) );
+    public_key_type init_account_pub_key = init_account_priv_key.get_public_key();
+
+    auto generate_block = [&]()
+    {
+      bp.generate_block( db.get_slot_time(1), db.get_scheduled_witness( 1 ), init_account_priv_key, database::skip_nothing );
+    };
+    auto push_operation = [&]( const operation& op )
+    {
+      signed_transaction trx;
+      trx.operations.push_back( op );
+      trx.set_expiration( db.head_block_time() + HIVE_MAX_TIME_UNTIL_EXPIRATION );
+      trx.sign( init_account_priv_key, db.get_chain_id(), fc::ecc::fc_canonical );
+      db.push_transaction( trx );
+      generate_block();
+    };
+    auto is_in_state = [&]( comment_id_type id )
+    {
+      const auto& idx = db.get_index< comment_index, by_id >();
+      return idx.find( id ) != idx.end();
+    };
+
+    generate_block();
+    db.set_hardfork( HIVE_BLOCKCHAIN_VERSION.minor_v() );
+    generate_block();
+
+    account_create_operation cop;
+    cop.new_account_name = "alice";
+    cop.creator = HIVE_INIT_MINER_NAME;
+    cop.fee = db.get_witness_schedule_object().median_props.account_creation_fee;
+    cop.owner = authority( 1, init_account_pub_key, 1 );
+    cop.active = cop.owner;
+    cop.posting = cop.owner;
+    push_operation( cop );
+
+    comment_operation post;
+    post.author = "alice";
+    post.permlink = "post";
+    post.parent_permlink = "test";
+    post.title = "foo";
+    post.body = "bar";
+    push_operation( post );
+
+    const comment_id_type post_id = db.get_comment( "alice", string( "post" ) ).get_id();
+
+    BOOST_TEST_MESSAGE( "Paid out comment is moved to archive once its payout becomes irreversible" );
+    for( uint32_t i = 0; i < HIVE_CASHOUT_WINDOW_SECONDS / HIVE_BLOCK_INTERVAL; ++i )
+      generate_block();
+    BOOST_REQUIRE( db.find_comment_cashout( post_id ) == nullptr );
+    for( uint32_t i = 0; i < 2 * HIVE_MAX_WITNESSES && is_in_state( post_id ); ++i )
+      generate_block();
+    BOOST_REQUIRE( !is_in_state( post_id ) );
+
+    BOOST_TEST_MESSAGE( "Outside of transaction evaluation archived comment is read without restoring it" );
+    const database& const_db = db;
+    const comment_object* archived = const_db.find_comment( "alice", string( "post" ) );
+    BOOST_REQUIRE( archived != nullptr );
+    BOOST_REQUIRE( archived->get_id() == post_id );
+    BOOST_REQUIRE( archived->is_root() );
+    BOOST_REQUIRE( archived->get_author_and_permlink_hash() ==
+      comment_object::compute_author_and_permlink_hash( db.get_account( "alice" ).get_id(), "post" ) );
+    BOOST_REQUIRE( &const_db.get_comment( post_id ) == archived );
+    BOOST_REQUIRE( db.find_comment( "alice", string( "post" ) ) == archived );
+    BOOST_REQUIRE( const_db.find_comment( "alice", string( "missing" ) ) == nullptr );
+    BOOST_REQUIRE( !is_in_state( post_id ) );
+
+    BOOST_TEST_MESSAGE( "Reply to archived comment brings it back to state" );
+    comment_operation reply;
+    reply.author = HIVE_INIT_MINER_NAME;
+    reply.permlink = "reply";
+    reply.parent_author = "alice";
+    reply.parent_permlink = "post";
+    reply.title = "foo";
+    reply.body = "bar";
+    push_operation( reply );
+
+    BOOST_REQUIRE( is_in_state( post_id ) );
+    const comment_object& reply_comment = db.get_comment( HIVE_INIT_MINER_NAME, string( "reply" ) );
+    BOOST_REQUIRE( reply_comment.get_parent_id() == post_id );
+    BOOST_REQUIRE( reply_comment.get_root_id() == post_id );
+    BOOST_REQUIRE_EQUAL( reply_comment.get_depth(), 1u );
+
+    BOOST_TEST_MESSAGE( "Restored comment is dropped again when no reversible block refers to it" );
+    for( uint32_t i = 0; i < 2 * HIVE_MAX_WITNESSES && is_in_state( post_id ); ++i )
+      generate_block();
+    BOOST_REQUIRE( !is_in_state( post_id ) );
+    BOOST_REQUIRE( is_in_state( reply_comment.get_id() ) );
+
+    BOOST_TEST_MESSAGE( "Edit of archived comment does not create new comment" );
+    post.body = "baz";
+    push_operation( post );
+    BOOST_REQUIRE( db.get_comment( "alice", string( "post" ) ).get_id() == post_id );
+  } catch (fc::exception& e) {
+    edump((e.to_detail_string()));
+    throw;
+  }
+}
+
 BOOST_AUTO_TEST_CASE( tapos )
 {
   try {
@@ -911,5 +1325,173 @@ BOOST_FIXTURE_TEST_CASE( generate_block_size, clean_database_fixture )
   FC_LOG_AND_RETHROW()
 }
 
+BOOST_FIXTURE_TEST_CASE( pending_transactions_selection, clean_database_fixture )
+{
+  try
+  {
+    ACTORS( (alice)(bob)(sam)(dave) );
+    fund( "alice", 10000 );
+    fund( "dave", 10000 );
+    generate_block();
+
+    auto make_transfer = [&]( const string& from, const string& to, const fc::ecc::private_key& key, fc::time_point_sec expiration )
+    {
+      signed_transaction tx;
+      transfer_operation op;
+      op.from = from;
+      op.to = to;
+      op.amount = asset( 1, HIVE_SYMBOL );
+      tx.operations.push_back( op );
+      tx.set_expiration( expiration );
+      sign( tx, key );
+      return tx;
+    };
+
+    BOOST_TEST_MESSAGE( "--- Transaction that expires before next block excludes later transactions of the same accounts" );
+    auto expiring = make_transfer( "alice", "bob", alice_private_key, db->head_block_time() + HIVE_BLOCK_INTERVAL );
+    auto dependent = make_transfer( "alice", "sam", alice_private_key, db->head_block_time() + HIVE_MAX_TIME_UNTIL_EXPIRATION );
+    auto independent = make_transfer( "dave", HIVE_INIT_MINER_NAME, dave_private_key, db->head_block_time() + HIVE_MAX_TIME_UNTIL_EXPIRATION );
+    PUSH_TX( *db, expiring );
+    PUSH_TX( *db, dependent );
+    PUSH_TX( *db, independent );
+    BOOST_REQUIRE_EQUAL( db->_pending_tx.size(), 3u );
+    BOOST_REQUIRE( db->are_pending_transactions_applied() );
+
+    // skip one slot, so the first transaction expires
+    generate_block( 0, init_account_priv_key, 1 );
+    auto head_block = db->fetch_block_by_number( db->head_block_num() );
+    BOOST_REQUIRE_EQUAL( head_block->transactions.size(), 1u );
+    BOOST_REQUIRE( head_block->transactions[0].id() == independent.id() );
+
+    BOOST_TEST_MESSAGE( "--- Left out transaction stays pending and goes to next block" );
+    BOOST_REQUIRE_EQUAL( db->_pending_tx.size(), 1u );
+    BOOST_REQUIRE( db->_pending_tx[0].id() == dependent.id() );
+    BOOST_REQUIRE( db->are_pending_transactions_applied() );
+    generate_block();
+    head_block = db->fetch_block_by_number( db->head_block_num() );
+    BOOST_REQUIRE_EQUAL( head_block->transactions.size(), 1u );
+    BOOST_REQUIRE( head_block->transactions[0].id() == dependent.id() );
+    BOOST_REQUIRE( db->_pending_tx.empty() );
+  }
+  FC_LOG_AND_RETHROW()
+}
+
+BOOST_FIXTURE_TEST_CASE( pending_transaction_limits, clean_database_fixture )
+{
+  try
+  {
+    ACTORS( (alice)(bob) );
+    fund( "alice", 10000 );
+    generate_block();
+
+    db->set_pending_transaction_limits( 2, 0 );
+
+    auto push_transfer = [&]( uint32_t amount )
+    {
+      signed_transaction tx;
+      transfer_operation op;
+      op.from = "alice";
+      op.to = "bob";
+      op.amount = asset( amount, HIVE_SYMBOL );
+      tx.operations.push_back( op );
+      tx.set_expiration( db->head_block_time() + HIVE_MAX_TIME_UNTIL_EXPIRATION );
+      sign( tx, alice_private_key );
+      db->push_transaction( tx, 0 );
+    };
+
+    BOOST_TEST_MESSAGE( "--- Account can't have more pending transactions than the limit" );
+    push_transfer( 1 );
+    push_transfer( 2 );
+    HIVE_REQUIRE_THROW( push_transfer( 3 ), transaction_pool_full_exception );
+    BOOST_REQUIRE_EQUAL( db->_pending_tx.size(), 2u );
+    BOOST_REQUIRE_EQUAL( db->get_pending_transaction_pool().get_account_transaction_count( "alice" ), 2u );
+
+    BOOST_TEST_MESSAGE( "--- Limit is freed once transactions are included in block" );
+    generate_block();
+    BOOST_REQUIRE_EQUAL( db->fetch_block_by_number( db->head_block_num() )->transactions.size(), 2u );
+    BOOST_REQUIRE_EQUAL( db->get_pending_transaction_pool().get_transaction_count(), 0u );
+    push_transfer( 3 );
+    BOOST_REQUIRE_EQUAL( db->_pending_tx.size(), 1u );
+  }
+  FC_LOG_AND_RETHROW()
+}
+
+BOOST_FIXTURE_TEST_CASE( pending_transaction_eviction, clean_database_fixture )
+{
+  try
+  {
+    ACTORS( (alice)(bob) );
+    fund( "alice", 10000 );
+    generate_block();
+
+    // transfers of bigger amounts are more valuable
+    db->get_pending_transaction_pool().set_priority_evaluator( []( const signed_transaction& tx )
+      { return tx.operations.front().get< transfer_operation >().amount.amount.value; } );
+
+    auto make_transfer = [&]( uint32_t amount )
+    {
+      signed_transaction tx;
+      transfer_operation op;
+      op.from = "alice";
+      op.to = "bob";
+      op.amount = asset( amount, HIVE_SYMBOL );
+      tx.operations.push_back( op );
+      tx.set_expiration( db->head_block_time() + HIVE_MAX_TIME_UNTIL_EXPIRATION );
+      sign( tx, alice_private_key );
+      return tx;
+    };
+
+    signed_transaction tx1 = make_transfer( 1 );
+    signed_transaction tx2 = make_transfer( 2 );
+    signed_transaction tx3 = make_transfer( 3 );
+    db->set_pending_transaction_limits( 0, fc::raw::pack_size( tx1 ) * 2 );
+    share_type alice_balance = db->get_account( "alice" ).balance.amount;
+
+    db->push_transaction( tx1, 0 );
+    db->push_transaction( tx2, 0 );
+
+    BOOST_TEST_MESSAGE( "--- Least valuable transaction is dropped together with its effects" );
+    db->push_transaction( tx3, 0 );
+    BOOST_REQUIRE_EQUAL( db->_pending_tx.size(), 2u );
+    BOOST_REQUIRE( db->_pending_tx[0].id() == tx2.id() );
+    BOOST_REQUIRE( db->_pending_tx[1].id() == tx3.id() );
+    BOOST_REQUIRE( !db->is_known_transaction( tx1.id() ) );
+    BOOST_REQUIRE( db->is_known_transaction( tx2.id() ) );
+    BOOST_REQUIRE( db->get_account( "alice" ).balance.amount == alice_balance - 5 );
+
+    BOOST_TEST_MESSAGE( "--- Dropped transaction is not a duplicate, it is rejected only because it is not valuable enough" );
+    HIVE_REQUIRE_THROW( db->push_transaction( tx1, 0 ), transaction_pool_full_exception );
+    BOOST_REQUIRE( db->get_account( "alice" ).balance.amount == alice_balance - 5 );
+
+    generate_block();
+    BOOST_REQUIRE_EQUAL( db->fetch_block_by_number( db->head_block_num() )->transactions.size(), 2u );
+    db->push_transaction( tx1, 0 );
+    BOOST_REQUIRE( db->get_account( "alice" ).balance.amount == alice_balance - 6 );
+
+    BOOST_TEST_MESSAGE( "--- Transactions preceding dropped one stay applied, the ones that follow it are applied again" );
+    generate_block();
+    signed_transaction tx5 = make_transfer( 5 );
+    signed_transaction tx1_again = make_transfer( 1 );
+    signed_transaction tx4 = make_transfer( 4 );
+    db->push_transaction( tx5, 0 );
+    db->push_transaction( tx1_again, 0 );
+    db->push_transaction( tx4, 0 );
+    BOOST_REQUIRE_EQUAL( db->_pending_tx.size(), 2u );
+    BOOST_REQUIRE( db->_pending_tx[0].id() == tx5.id() );
+    BOOST_REQUIRE( db->_pending_tx[1].id() == tx4.id() );
+    BOOST_REQUIRE( !db->is_known_transaction( tx1_again.id() ) );
+    BOOST_REQUIRE( db->is_known_transaction( tx5.id() ) );
+    BOOST_REQUIRE( db->get_account( "alice" ).balance.amount == alice_balance - 15 );
+
+    generate_block();
+    auto head_block = db->fetch_block_by_number( db->head_block_num() );
+    BOOST_REQUIRE_EQUAL( head_block->transactions.size(), 2u );
+    BOOST_REQUIRE( head_block->transactions[0].id() == tx5.id() );
+    BOOST_REQUIRE( head_block->transactions[1].id() == tx4.id() );
+    BOOST_REQUIRE( db->_pending_tx.empty() );
+  }
+  FC_LOG_AND_RETHROW()
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 #endif
@@ -32,6 +32,13 @@
 #include <hive/plugins/condenser_api/condenser_api_legacy_asset.hpp>
 #include <hive/plugins/condenser_api/condenser_api_legacy_objects.hpp>
 
+#include <graphene/net/compact_block.hpp>
+#include <graphene/net/core_messages.hpp>
+#include <graphene/net/message.hpp>
+#include <graphene/net/message_cache.hpp>
+#include <graphene/net/message_decoder.hpp>
+#include <graphene/net/rolling_bloom_filter.hpp>
+
 #include <fc/crypto/digest.hpp>
 #include <fc/crypto/elliptic.hpp>
 #include <fc/reflect/variant.hpp>
@@ -775,5 +782,345 @@ BOOST_AUTO_TEST_CASE( unpack_recursion_test )
   FC_LOG_AND_RETHROW();
 }
 
+BOOST_AUTO_TEST_CASE( p2p_message_trailing_data_test )
+{
+  try
+  {
+    signed_block block;
+    block.timestamp = fc::time_point_sec( 1514764800 );
+    block.witness = "initminer";
+    signed_transaction tx;
+    transfer_operation op;
+    op.from = "alice";
+    op.to = "bob";
+    op.amount = ASSET( "1.000 TESTS" );
+    tx.operations.push_back( op );
+    tx.set_expiration( block.timestamp + HIVE_MAX_TIME_UNTIL_EXPIRATION );
+    block.transactions.push_back( tx );
+
+    BOOST_TEST_MESSAGE( "--- Block id is at the end of packed block message" );
+    graphene::net::message block_msg = graphene::net::block_message( block );
+    graphene::net::block_message decoded = block_msg.as_exact< graphene::net::block_message >();
+    BOOST_REQUIRE( decoded.block_id == block.id() );
+    BOOST_REQUIRE( memcmp( block_msg.data.data() + block_msg.data.size() - sizeof( block_id_type ),
+      decoded.block_id.data(), sizeof( block_id_type ) ) == 0 );
+
+    BOOST_TEST_MESSAGE( "--- Block message with data appended is rejected, even though the block can be unpacked" );
+    graphene::net::message padded_block_msg( block_msg );
+    padded_block_msg.data.insert( padded_block_msg.data.end(), { 'j', 'u', 'n', 'k' } );
+    padded_block_msg.size = padded_block_msg.data.size();
+    BOOST_REQUIRE( padded_block_msg.as< graphene::net::block_message >().block_id == block.id() );
+    HIVE_REQUIRE_THROW( padded_block_msg.as_exact< graphene::net::block_message >(), fc::exception );
+
+    BOOST_TEST_MESSAGE( "--- Same for transaction message" );
+    graphene::net::message trx_msg = graphene::net::trx_message( tx );
+    BOOST_REQUIRE( trx_msg.as_exact< graphene::net::trx_message >().trx.id() == tx.id() );
+    trx_msg.data.push_back( 0 );
+    trx_msg.size = trx_msg.data.size();
+    HIVE_REQUIRE_THROW( trx_msg.as_exact< graphene::net::trx_message >(), fc::exception );
+
+    BOOST_TEST_MESSAGE( "--- Truncated message is rejected" );
+    graphene::net::message truncated_block_msg( block_msg );
+    truncated_block_msg.data.resize( truncated_block_msg.data.size() - 1 );
+    truncated_block_msg.size = truncated_block_msg.data.size();
+    HIVE_REQUIRE_THROW( truncated_block_msg.as_exact< graphene::net::block_message >(), fc::exception );
+  }
+  FC_LOG_AND_RETHROW();
+}
+
+namespace
+{
+
+struct compact_block_test_data
+{
+  compact_block_test_data()
+  {
+    block.timestamp = fc::time_point_sec( 1514764800 );
+    block.witness = "initminer";
+    for( const std::string& to : { "bob", "sam", "dave" } )
+    {
+      signed_transaction tx;
+      transfer_operation op;
+      op.from = "alice";
+      op.to = to;
+      op.amount = ASSET( "1.000 TESTS" );
+      tx.operations.push_back( op );
+      tx.set_expiration( block.timestamp + HIVE_MAX_TIME_UNTIL_EXPIRATION );
+      block.transactions.push_back( tx );
+    }
+    full_block = graphene::net::block_message( block );
+    block_message_hash = graphene::net::message( full_block ).id();
+    compact_block = graphene::net::compact_block_message( full_block, block_message_hash );
+  }
+
+  /// caches transaction as if it was relayed, contents hash is normally its id
+  void cache_transaction( const signed_transaction& tx, const fc::uint160_t& contents_hash )
+  {
+    auto msg = std::make_shared< const graphene::net::message >( graphene::net::trx_message( tx ) );
+    cache.cache_message( msg, msg->id(), graphene::net::message_propagation_data(), contents_hash );
+  }
+
+  graphene::net::partial_compact_block make_partial_block()
+  {
+    return graphene::net::partial_compact_block( compact_block, [this]( uint64_t short_transaction_id )
+      {
+        return cache.get_transaction_by_short_id( short_transaction_id );
+      } );
+  }
+
+  /// id sharing first 8 bytes (short id) with given one
+  static fc::uint160_t make_colliding_id( const transaction_id_type& id )
+  {
+    fc::uint160_t result = id;
+    result._hash[4] ^= 1;
+    return result;
+  }
+
+  signed_block                                          block;
+  graphene::net::block_message                          full_block;
+  graphene::net::message_hash_type                      block_message_hash;
+  graphene::net::compact_block_message                  compact_block;
+  graphene::net::detail::blockchain_tied_message_cache  cache;
+};
+
+}
+
+BOOST_AUTO_TEST_CASE( compact_block_reconstruction_test )
+{
+  try
+  {
+    compact_block_test_data data;
+    BOOST_REQUIRE_EQUAL( data.compact_block.short_transaction_ids.size(), 3u );
+    for( const signed_transaction& tx : data.block.transactions )
+      data.cache_transaction( tx, tx.id() );
+
+    BOOST_TEST_MESSAGE( "--- Short ids find transactions in message cache" );
+    for( size_t i = 0; i < data.block.transactions.size(); ++i )
+    {
+      auto msg = data.cache.get_transaction_by_short_id( data.compact_block.short_transaction_ids[i] );
+      BOOST_REQUIRE( msg );
+      BOOST_REQUIRE( msg->as< graphene::net::trx_message >().trx.id() == data.block.transactions[i].id() );
+    }
+    BOOST_REQUIRE( !data.cache.get_transaction_by_short_id( 0 ) );
+
+    BOOST_TEST_MESSAGE( "--- Block rebuilt from cached transactions is the block that was offered" );
+    graphene::net::message compact_msg( data.compact_block );
+    graphene::net::partial_compact_block partial_block( compact_msg.as< graphene::net::compact_block_message >(),
+      [&]( uint64_t short_transaction_id ) { return data.cache.get_transaction_by_short_id( short_transaction_id ); } );
+    BOOST_REQUIRE( partial_block.missing_transaction_indexes.empty() );
+    graphene::net::block_message reconstructed_block;
+    fc::optional< graphene::net::message > block_message_to_process;
+    BOOST_REQUIRE_EQUAL( partial_block.complete( reconstructed_block, block_message_to_process ), graphene::net::partial_compact_block::completed );
+    BOOST_REQUIRE( block_message_to_process.valid() );
+    BOOST_REQUIRE( block_message_to_process->id() == data.block_message_hash );
+    BOOST_REQUIRE( reconstructed_block.block_id == data.block.id() );
+    BOOST_REQUIRE( reconstructed_block.block.transaction_merkle_root == data.block.transaction_merkle_root );
+    BOOST_REQUIRE_EQUAL( reconstructed_block.block.transactions.size(), data.block.transactions.size() );
+    for( size_t i = 0; i < data.block.transactions.size(); ++i )
+      BOOST_REQUIRE( reconstructed_block.block.transactions[i].id() == data.block.transactions[i].id() );
+  }
+  FC_LOG_AND_RETHROW();
+}
+
+BOOST_AUTO_TEST_CASE( compact_block_missing_transactions_test )
+{
+  try
+  {
+    compact_block_test_data data;
+    data.cache_transaction( data.block.transactions[0], data.block.transactions[0].id() );
+    data.cache_transaction( data.block.transactions[2], data.block.transactions[2].id() );
+
+    BOOST_TEST_MESSAGE( "--- Transactions that are not cached are requested" );
+    graphene::net::partial_compact_block partial_block = data.make_partial_block();
+    BOOST_REQUIRE( partial_block.missing_transaction_indexes == std::vector< uint32_t >( { 1 } ) );
+    graphene::net::block_message reconstructed_block;
+    fc::optional< graphene::net::message > block_message_to_process;
+    BOOST_REQUIRE_EQUAL( partial_block.complete( reconstructed_block, block_message_to_process ), graphene::net::partial_compact_block::missing_transactions );
+    BOOST_REQUIRE( !block_message_to_process.valid() );
+
+    graphene::net::message fetch_msg( partial_block.get_fetch_message() );
+    auto fetch = fetch_msg.as< graphene::net::fetch_compact_block_transactions_message >();
+    BOOST_REQUIRE( fetch.block_message_hash == data.block_message_hash );
+    BOOST_REQUIRE( fetch.block_id == data.block.id() );
+    BOOST_REQUIRE( fetch.transaction_indexes == std::vector< uint32_t >( { 1 } ) );
+
+    BOOST_TEST_MESSAGE( "--- Peer replies with requested transactions of the full block" );
+    graphene::net::message reply_msg( graphene::net::get_compact_block_transactions( data.full_block, fetch.transaction_indexes ) );
+    auto reply = reply_msg.as< graphene::net::compact_block_transactions_message >();
+    BOOST_REQUIRE( reply.block_id == data.block.id() );
+    BOOST_REQUIRE_EQUAL( reply.transactions.size(), 1u );
+    BOOST_REQUIRE( reply.transactions[0].id() == data.block.transactions[1].id() );
+    HIVE_REQUIRE_THROW( graphene::net::get_compact_block_transactions( data.full_block, { 3 } ), fc::exception );
+
+    BOOST_TEST_MESSAGE( "--- Reply with wrong number of transactions is rejected" );
+    graphene::net::compact_block_transactions_message too_many( reply );
+    too_many.transactions.push_back( data.block.transactions[0] );
+    graphene::net::partial_compact_block copy_of_partial_block( partial_block );
+    HIVE_REQUIRE_THROW( copy_of_partial_block.add_missing_transactions( too_many ), fc::exception );
+
+    BOOST_TEST_MESSAGE( "--- Block is complete with transactions sent by the peer" );
+    partial_block.add_missing_transactions( reply );
+    BOOST_REQUIRE( partial_block.missing_transaction_indexes.empty() );
+    BOOST_REQUIRE_EQUAL( partial_block.complete( reconstructed_block, block_message_to_process ), graphene::net::partial_compact_block::completed );
+    BOOST_REQUIRE( block_message_to_process->id() == data.block_message_hash );
+    BOOST_REQUIRE( reconstructed_block.block_id == data.block.id() );
+  }
+  FC_LOG_AND_RETHROW();
+}
+
+BOOST_AUTO_TEST_CASE( compact_block_short_id_collision_test )
+{
+  try
+  {
+    compact_block_test_data data;
+    signed_transaction other_tx = data.block.transactions[0];
+    other_tx.operations[0].get< transfer_operation >().memo = "other";
+
+    BOOST_TEST_MESSAGE( "--- Short id matching more than one cached transaction finds nothing" );
+    data.cache_transaction( data.block.transactions[0], data.block.transactions[0].id() );
+    data.cache_transaction( other_tx, data.make_colliding_id( data.block.transactions[0].id() ) );
+    BOOST_REQUIRE( !data.cache.get_transaction_by_short_id( data.compact_block.short_transaction_ids[0] ) );
+    graphene::net::partial_compact_block ambiguous_block = data.make_partial_block();
+    BOOST_REQUIRE( ambiguous_block.missing_transaction_indexes == std::vector< uint32_t >( { 0, 1, 2 } ) );
+
+    BOOST_TEST_MESSAGE( "--- Short id matching different transaction makes node request all transactions" );
+    compact_block_test_data colliding_data;
+    colliding_data.cache_transaction( other_tx, colliding_data.make_colliding_id( colliding_data.block.transactions[0].id() ) );
+    for( size_t i = 1; i < colliding_data.block.transactions.size(); ++i )
+      colliding_data.cache_transaction( colliding_data.block.transactions[i], colliding_data.block.transactions[i].id() );
+    graphene::net::partial_compact_block partial_block = colliding_data.make_partial_block();
+    BOOST_REQUIRE( partial_block.missing_transaction_indexes.empty() );
+    BOOST_REQUIRE( partial_block.block.transactions[0].id() == other_tx.id() );
+
+    graphene::net::block_message reconstructed_block;
+    fc::optional< graphene::net::message > block_message_to_process;
+    BOOST_REQUIRE_EQUAL( partial_block.complete( reconstructed_block, block_message_to_process ), graphene::net::partial_compact_block::short_id_collision );
+    BOOST_REQUIRE( !block_message_to_process.valid() );
+    BOOST_REQUIRE( partial_block.all_transactions_requested );
+    BOOST_REQUIRE( partial_block.missing_transaction_indexes == std::vector< uint32_t >( { 0, 1, 2 } ) );
+
+    auto reply = graphene::net::get_compact_block_transactions( colliding_data.full_block, partial_block.get_fetch_message().transaction_indexes );
+    BOOST_TEST_MESSAGE( "--- Peer that sends transactions not forming the offered block is caught" );
+    graphene::net::partial_compact_block wrong_block( partial_block );
+    graphene::net::compact_block_transactions_message wrong_reply( reply );
+    std::swap( wrong_reply.transactions[1], wrong_reply.transactions[2] );
+    wrong_block.add_missing_transactions( wrong_reply );
+    BOOST_REQUIRE_EQUAL( wrong_block.complete( reconstructed_block, block_message_to_process ), graphene::net::partial_compact_block::mismatch );
+    BOOST_REQUIRE( !block_message_to_process.valid() );
+
+    BOOST_TEST_MESSAGE( "--- Block is complete with all transactions sent by the peer" );
+    partial_block.add_missing_transactions( reply );
+    BOOST_REQUIRE_EQUAL( partial_block.complete( reconstructed_block, block_message_to_process ), graphene::net::partial_compact_block::completed );
+    BOOST_REQUIRE( block_message_to_process->id() == colliding_data.block_message_hash );
+    BOOST_REQUIRE( reconstructed_block.block.transactions[0].id() == colliding_data.block.transactions[0].id() );
+  }
+  FC_LOG_AND_RETHROW();
+}
+
+BOOST_AUTO_TEST_CASE( message_decoding_threads_test )
+{
+  try
+  {
+    compact_block_test_data data;
+    for( signed_transaction& tx : data.block.transactions )
+      tx.operations[0].get< transfer_operation >().memo = std::string( 2000, 'x' );
+    data.block.transaction_merkle_root = data.block.calculate_merkle_root();
+    graphene::net::message block_msg( ( graphene::net::block_message( data.block ) ) );
+    BOOST_REQUIRE_GE( block_msg.size, GRAPHENE_NET_MIN_MESSAGE_SIZE_TO_DECODE_IN_THREAD );
+
+    graphene::net::detail::message_decoder decoder;
+    graphene::net::message_hash_type inline_hash;
+    fc::optional< graphene::net::block_message > inline_block;
+    decoder.decode( block_msg, inline_hash, inline_block );
+    BOOST_REQUIRE_EQUAL( decoder.get_messages_decoded_in_threads(), 0u );
+    BOOST_REQUIRE( inline_block.valid() );
+
+    BOOST_TEST_MESSAGE( "--- Block decoded on other thread is the same as decoded inline" );
+    decoder.set_thread_count( 2 );
+    for( uint32_t i = 0; i < 4; ++i )
+    {
+      graphene::net::message_hash_type hash;
+      fc::optional< graphene::net::block_message > decoded_block;
+      decoder.decode( block_msg, hash, decoded_block );
+      BOOST_REQUIRE( hash == inline_hash );
+      BOOST_REQUIRE( decoded_block.valid() );
+      BOOST_REQUIRE( decoded_block->block_id == inline_block->block_id );
+      BOOST_REQUIRE( decoded_block->block_id == data.block.id() );
+      BOOST_REQUIRE( fc::raw::pack_to_vector( decoded_block->block ) == fc::raw::pack_to_vector( inline_block->block ) );
+    }
+    BOOST_REQUIRE_EQUAL( decoder.get_messages_decoded_in_threads(), 4u );
+    BOOST_REQUIRE_EQUAL( decoder.get_messages_waiting(), 0u );
+
+    BOOST_TEST_MESSAGE( "--- Decoding continues after threads are replaced or removed" );
+    decoder.set_thread_count( 1 );
+    graphene::net::message_hash_type hash;
+    fc::optional< graphene::net::block_message > decoded_block;
+    decoder.decode( block_msg, hash, decoded_block );
+    BOOST_REQUIRE( hash == inline_hash );
+    BOOST_REQUIRE( decoded_block->block_id == inline_block->block_id );
+    BOOST_REQUIRE_EQUAL( decoder.get_messages_decoded_in_threads(), 5u );
+    decoder.set_thread_count( 0 );
+    decoded_block.reset();
+    decoder.decode( block_msg, hash, decoded_block );
+    BOOST_REQUIRE( hash == inline_hash );
+    BOOST_REQUIRE( decoded_block->block_id == inline_block->block_id );
+    BOOST_REQUIRE_EQUAL( decoder.get_messages_decoded_in_threads(), 5u );
+  }
+  FC_LOG_AND_RETHROW();
+}
+
+BOOST_AUTO_TEST_CASE( rolling_bloom_filter_test )
+{
+  try
+  {
+    auto make_item = []( uint32_t i )
+    {
+      return graphene::net::item_id( graphene::net::trx_message_type, fc::ripemd160::hash( std::to_string( i ) ) );
+    };
+    const fc::time_point start = fc::time_point::now();
+    const fc::microseconds bucket_duration = fc::seconds( 10 );
+    auto after_buckets = [&]( int64_t count ) { return start + fc::microseconds( bucket_duration.count() * count ); };
+
+    BOOST_TEST_MESSAGE( "--- Inserted items are found, others are not" );
+    graphene::net::rolling_bloom_filter filter( 100, 0.001, bucket_duration, 3 );
+    filter.insert( make_item( 1 ), start );
+    BOOST_REQUIRE( filter.contains( make_item( 1 ) ) );
+    BOOST_REQUIRE( !filter.contains( make_item( 2 ) ) );
+    BOOST_REQUIRE( !filter.contains( graphene::net::item_id( graphene::net::block_message_type, make_item( 1 ).item_hash ) ) );
+    BOOST_REQUIRE_GT( filter.size_in_bytes(), 0u );
+
+    BOOST_TEST_MESSAGE( "--- Items are remembered until their bucket is reused" );
+    filter.insert( make_item( 2 ), after_buckets( 1 ) );
+    filter.expire( after_buckets( 2 ) - fc::microseconds( 1 ) );
+    BOOST_REQUIRE( filter.contains( make_item( 1 ) ) );
+    filter.expire( after_buckets( 2 ) );
+    BOOST_REQUIRE( filter.contains( make_item( 1 ) ) );
+    BOOST_REQUIRE( filter.contains( make_item( 2 ) ) );
+    filter.expire( after_buckets( 3 ) );
+    BOOST_REQUIRE( !filter.contains( make_item( 1 ) ) );
+    BOOST_REQUIRE( filter.contains( make_item( 2 ) ) );
+    filter.insert( make_item( 3 ), after_buckets( 4 ) );
+    BOOST_REQUIRE( !filter.contains( make_item( 2 ) ) );
+    BOOST_REQUIRE( filter.contains( make_item( 3 ) ) );
+
+    BOOST_TEST_MESSAGE( "--- False positive rate stays near configured one for each of the full buckets" );
+    const uint32_t items_per_bucket = 1000;
+    const double false_positive_probability = 0.01;
+    graphene::net::rolling_bloom_filter full_filter( items_per_bucket, false_positive_probability, bucket_duration, 2 );
+    for( uint32_t i = 0; i < 2 * items_per_bucket; ++i )
+      full_filter.insert( make_item( i ), after_buckets( i / items_per_bucket ) );
+    for( uint32_t i = 0; i < 2 * items_per_bucket; ++i )
+      BOOST_REQUIRE( full_filter.contains( make_item( i ) ) );
+    const uint32_t probes = 10000;
+    uint32_t false_positives = 0;
+    for( uint32_t i = 0; i < probes; ++i )
+      if( full_filter.contains( make_item( 2 * items_per_bucket + i ) ) )
+        ++false_positives;
+    // two buckets give about twice the configured rate, the bound leaves room for random variation
+    BOOST_REQUIRE_LT( false_positives, uint32_t( 3 * false_positive_probability * probes ) );
+  }
+  FC_LOG_AND_RETHROW();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 #endif